@@ -13,6 +13,102 @@
 
 NS_ASSUME_NONNULL_BEGIN
 
+/// Returns the base64 encoded length (with padding) of data length.
+static inline size_t YYBase64EncodedLength(size_t length) {
+    return (length + 2) / 3 * 4;
+}
+
+/// Returns the max decoded data length of base64 string length.
+static inline size_t YYBase64DecodedMaxLength(size_t length) {
+    return (length + 3) / 4 * 3;
+}
+
+/**
+ Encodes data to base64 string (with padding) into a buffer.
+ 
+ @param bytes   The data.
+ @param length  The data length.
+ @param buffer  The output buffer, its size should be at least `YYBase64EncodedLength(length)`.
+ @return The written length.
+ */
+extern size_t YYBase64Encode(const void *bytes, size_t length, char *buffer);
+
+/**
+ Decodes base64 string into a buffer. The whitespace characters are skipped, and
+ the padding is optional.
+ 
+ @param string  The base64 string (ASCII).
+ @param length  The string length.
+ @param buffer  The output buffer, its size should be at least `YYBase64DecodedMaxLength(length)`.
+ @return The written length, or SIZE_MAX if the string is invalid.
+ */
+extern size_t YYBase64Decode(const char *string, size_t length, void *buffer);
+
+/// Streaming base64 encoder state, initialize it with zero: `YYBase64Encoder encoder = {0};`.
+typedef struct {
+    uint8_t tail[3];    ///< bytes not encoded yet
+    uint8_t tailLength; ///< count of bytes not encoded yet
+} YYBase64Encoder;
+
+/**
+ Encodes a piece of data, the last incomplete group (1 or 2 bytes) is kept in encoder.
+ The buffer size should be at least `YYBase64EncodedLength(length + 2)`.
+ Returns the written length.
+ */
+extern size_t YYBase64EncoderUpdate(YYBase64Encoder *encoder, const void *bytes, size_t length, char *buffer);
+
+/**
+ Encodes the bytes kept in encoder with padding and resets the encoder.
+ The buffer size should be at least 4. Returns the written length.
+ */
+extern size_t YYBase64EncoderFinish(YYBase64Encoder *encoder, char *buffer);
+
+/// Streaming base64 decoder state, initialize it with zero: `YYBase64Decoder decoder = {0};`.
+typedef struct {
+    uint32_t value;  ///< bits not decoded yet
+    uint8_t count;   ///< count of characters not decoded yet
+    uint8_t padding; ///< count of '=' received
+    BOOL failed;     ///< found invalid character
+} YYBase64Decoder;
+
+/**
+ Decodes a piece of base64 string, the last incomplete group is kept in decoder.
+ The buffer size should be at least `YYBase64DecodedMaxLength(length)`.
+ Returns the written length. Decoding stops at an invalid character and sets
+ `failed`, the bytes decoded before it in this call are still counted; once
+ `failed` is set, later calls write nothing and return 0.
+ */
+extern size_t YYBase64DecoderUpdate(YYBase64Decoder *decoder, const char *string, size_t length, void *buffer);
+
+/**
+ Decodes the characters kept in decoder and resets the decoder.
+ The buffer size should be at least 2, and `length` returns the written length.
+ Returns NO if the whole string is invalid.
+ */
+extern BOOL YYBase64DecoderFinish(YYBase64Decoder *decoder, void *buffer, size_t *length);
+
+/**
+ Encodes data to hex string into a buffer.
+ 
+ @param bytes      The data.
+ @param length     The data length.
+ @param buffer     The output buffer, its size should be at least `length * 2`.
+ @param uppercase  Whether use uppercase letters.
+ @return The written length.
+ */
+extern size_t YYHexEncode(const void *bytes, size_t length, char *buffer, BOOL uppercase);
+
+/**
+ Decodes hex string (case insensitive, spaces are skipped) into a buffer.
+ 
+ @param string  The hex string.
+ @param length  The string length.
+ @param buffer  The output buffer, its size should be at least `length / 2`.
+ @return The written length (the last odd digit is ignored), or SIZE_MAX if the
+ string contains invalid character.
+ */
+extern size_t YYHexDecode(const char *string, size_t length, void *buffer);
+
 /**
  Provide hash, encrypt, encode and some common method for `NSData`.
  */
@@ -183,9 +279,38 @@ NS_ASSUME_NONNULL_BEGIN
 
 /**
  Returns crc32 hash.
+ 
+ @discussion It uses the CPU's CRC32 instructions when available (ARMv8),
+ and the result is the same as zlib's crc32().
  */
 - (uint32_t)crc32;
 
+/**
+ Returns xxHash64 (XXH64, seed 0) hash.
+ 
+ @discussion It's a fast non-cryptographic hash, for cache key and hash table,
+ not for security.
+ */
+- (uint64_t)xxHash64;
+
+/**
+ Returns a lowercase NSString for xxHash64 (XXH64, seed 0) hash.
+ */
+- (NSString *)xxHash64String;
+
+/**
+ Returns a lowercase NSString for MurmurHash3 (x64 128-bit, seed 0) hash.
+ 
+ @discussion It's a fast non-cryptographic hash, for cache key and hash table,
+ not for security.
+ */
+- (NSString *)murmur3Hash128String;
+
+/**
+ Returns an NSData for MurmurHash3 (x64 128-bit, seed 0) hash.
+ */
+- (NSData *)murmur3Hash128Data;
+
 
 #pragma mark - Encrypt and Decrypt
 ///=============================================================================
@@ -238,6 +363,11 @@ NS_ASSUME_NONNULL_BEGIN
  
  @param hexString   The hex string which is case insensitive.
  
+ @discussion Spaces are skipped, and the last odd digit is ignored. Other characters
+ (including a "0x" prefix, or non-ASCII characters) are not accepted: this method
+ returns nil for them instead of converting them to meaningless bytes as the older
+ versions did.
+ 
  @return a new NSData, or nil if an error occurs.
  */
 #warning zll 16进制字符串转NSData
@@ -254,6 +384,8 @@ NS_ASSUME_NONNULL_BEGIN
  @warning This method has been implemented in iOS7.
  
  @param base64EncodedString  The encoded string.
+ 
+ @return a new NSData, or nil if the string is invalid.
  */
 #warning zll test
 + (nullable NSData *)dataWithBase64EncodedString:(NSString *)base64EncodedString;
@@ -273,6 +405,8 @@ NS_ASSUME_NONNULL_BEGIN
 #warning zll 压缩 & 解压缩  ???
 /**
  Decompress data from gzip data.
+ The output buffer is sized from the gzip trailer (ISIZE) when it's available (the
+ initial size is limited, as the trailer is not trusted), and grows as needed.
  @return Inflated data.
  */
 - (nullable NSData *)gzipInflate;
@@ -312,4 +446,143 @@ NS_ASSUME_NONNULL_BEGIN
 
 @end
 
+
+
+/// Compressed data format used by YYDataInflater and YYDataDeflater.
+typedef NS_ENUM(NSUInteger, YYDataCompressionFormat) {
+    YYDataCompressionFormatZlib = 0, ///< zlib format (RFC 1950)
+    YYDataCompressionFormatGzip,     ///< gzip format (RFC 1952), the inflater also accepts zlib format
+};
+
+/**
+ An incremental inflater, which decompresses the gzip or zlib data chunk by chunk
+ (for example, as the data arrives from network).
+ 
+ @discussion The whole compressed data is not required in memory. The output can be
+ written to a caller-supplied buffer, or returned as NSData with an internal buffer
+ which is reused between chunks. It's not thread-safe.
+ 
+ Sample Code:
+ 
+     YYDataInflater *inflater = [[YYDataInflater alloc] initWithFormat:YYDataCompressionFormatGzip];
+     // for each received chunk:
+     NSData *output = [inflater inflateData:chunk];
+     if (!output) { ... } // invalid data
+     if (inflater.finished) { ... }
+ */
+@interface YYDataInflater : NSObject
+- (instancetype)init UNAVAILABLE_ATTRIBUTE;
++ (instancetype)new UNAVAILABLE_ATTRIBUTE;
+
+/// Creates an inflater, returns nil if an error occurs.
+- (nullable instancetype)initWithFormat:(YYDataCompressionFormat)format;
+
+/// Whether the end of the compressed stream has been reached.
+@property (nonatomic, readonly, getter=isFinished) BOOL finished;
+
+/// Total consumed compressed bytes.
+@property (nonatomic, readonly) uint64_t totalIn;
+
+/// Total produced decompressed bytes.
+@property (nonatomic, readonly) uint64_t totalOut;
+
+/// This block will be invoked after each chunk is processed with `totalIn` and `totalOut`.
+@property (nullable, nonatomic, copy) void (^progress)(uint64_t totalIn, uint64_t totalOut);
+
+/**
+ Decompresses the bytes into a caller-supplied buffer.
+ 
+ @discussion Call it again with the remaining bytes if the buffer is full.
+ The bytes after the end of the stream are not consumed.
+ 
+ @param bytes     The compressed bytes.
+ @param length    The length of bytes.
+ @param buffer    The output buffer.
+ @param capacity  The capacity of the output buffer.
+ @param consumed  Returns the consumed length of bytes.
+ @return The written length, or -1 if the data is invalid.
+ */
+- (NSInteger)inflateBytes:(const void *)bytes
+                   length:(NSUInteger)length
+                   buffer:(void *)buffer
+                 capacity:(NSUInteger)capacity
+                 consumed:(NSUInteger *)consumed;
+
+/**
+ Decompresses a chunk of data.
+ 
+ @return The decompressed data of this chunk (may be empty), or nil if the data is invalid.
+ */
+- (nullable NSData *)inflateData:(NSData *)data;
+
+@end
+
+
+/**
+ An incremental deflater, which compresses the data to gzip or zlib format chunk by chunk.
+ 
+ @discussion The output can be written to a caller-supplied buffer, or returned as
+ NSData with an internal buffer which is reused between chunks. It's not thread-safe.
+ */
+@interface YYDataDeflater : NSObject
+- (instancetype)init UNAVAILABLE_ATTRIBUTE;
++ (instancetype)new UNAVAILABLE_ATTRIBUTE;
+
+/**
+ Creates a deflater, returns nil if an error occurs.
+ 
+ @param format  The output format.
+ @param level   Compression level from 0 to 9, or -1 (Z_DEFAULT_COMPRESSION) for default.
+ */
+- (nullable instancetype)initWithFormat:(YYDataCompressionFormat)format level:(int)level;
+
+/// Whether the stream has been finished (all output is produced).
+@property (nonatomic, readonly, getter=isFinished) BOOL finished;
+
+/// Total consumed uncompressed bytes.
+@property (nonatomic, readonly) uint64_t totalIn;
+
+/// Total produced compressed bytes.
+@property (nonatomic, readonly) uint64_t totalOut;
+
+/// This block will be invoked after each chunk is processed with `totalIn` and `totalOut`.
+@property (nullable, nonatomic, copy) void (^progress)(uint64_t totalIn, uint64_t totalOut);
+
+/**
+ Compresses the bytes into a caller-supplied buffer.
+ 
+ @discussion Call it again with the remaining bytes if the buffer is full. When
+ `finish` is YES, call it until `finished` becomes YES.
+ 
+ @param bytes     The uncompressed bytes.
+ @param length    The length of bytes.
+ @param buffer    The output buffer.
+ @param capacity  The capacity of the output buffer.
+ @param consumed  Returns the consumed length of bytes.
+ @param finish    Whether these are the last bytes of the stream.
+ @return The written length, or -1 if an error occurs.
+ */
+- (NSInteger)deflateBytes:(nullable const void *)bytes
+                   length:(NSUInteger)length
+                   buffer:(void *)buffer
+                 capacity:(NSUInteger)capacity
+                 consumed:(NSUInteger *)consumed
+                   finish:(BOOL)finish;
+
+/**
+ Compresses a chunk of data.
+ 
+ @return The compressed data produced for this chunk (may be empty), or nil if an error occurs.
+ */
+- (nullable NSData *)deflateData:(NSData *)data;
+
+/**
+ Finishes the stream.
+ 
+ @return The rest of the compressed data, or nil if an error occurs.
+ */
+- (nullable NSData *)finish;
+
+@end
+
 NS_ASSUME_NONNULL_END
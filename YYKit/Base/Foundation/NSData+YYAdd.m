@@ -14,21 +14,547 @@
 #include <CommonCrypto/CommonCrypto.h>
 #include <zlib.h>
 
+#if defined(__aarch64__)
+#include <sys/sysctl.h>
+#endif
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
 YYSYNTH_DUMMY_CLASS(NSData_YYAdd)
 
 
+/// Returns a lowercase hex string of the digest (at most 64 bytes).
+static NSString *YYDigestHexString(const unsigned char *digest, size_t length) {
+    static const char table[] = "0123456789abcdef";
+    char str[128];
+    length = MIN(length, sizeof(str) / 2);
+    for (size_t i = 0; i < length; i++) {
+        str[i * 2] = table[digest[i] >> 4];
+        str[i * 2 + 1] = table[digest[i] & 0x0F];
+    }
+    return [[NSString alloc] initWithBytes:str length:length * 2 encoding:NSASCIIStringEncoding];
+}
+
+#pragma mark - CRC32
+
+#if defined(__aarch64__)
+/// Whether the CPU supports ARMv8 CRC32 instructions.
+static BOOL YYCRC32HardwareAvailable(void) {
+#if defined(__ARM_FEATURE_CRC32)
+    return YES;
+#else
+    static BOOL available;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        int value = 0;
+        size_t size = sizeof(value);
+        if (sysctlbyname("hw.optional.armv8_crc32", &value, &size, NULL, 0) == 0) available = value != 0;
+    });
+    return available;
+#endif
+}
+
+/// CRC32 (same polynomial as zlib) with ARMv8 CRC32 instructions.
+__attribute__((target("crc")))
+static uint32_t YYCRC32Hardware(uint32_t crc, const unsigned char *bytes, size_t length) {
+    crc = ~crc;
+    while (length > 0 && ((uintptr_t)bytes & 7)) {
+        crc = __builtin_arm_crc32b(crc, *bytes++);
+        length--;
+    }
+    const uint64_t *words = (const uint64_t *)bytes;
+    while (length >= 32) {
+        crc = __builtin_arm_crc32d(crc, words[0]);
+        crc = __builtin_arm_crc32d(crc, words[1]);
+        crc = __builtin_arm_crc32d(crc, words[2]);
+        crc = __builtin_arm_crc32d(crc, words[3]);
+        words += 4;
+        length -= 32;
+    }
+    while (length >= 8) {
+        crc = __builtin_arm_crc32d(crc, *words++);
+        length -= 8;
+    }
+    bytes = (const unsigned char *)words;
+    while (length > 0) {
+        crc = __builtin_arm_crc32b(crc, *bytes++);
+        length--;
+    }
+    return ~crc;
+}
+#endif
+
+/// Updates a CRC32 checksum (compatible with zlib's crc32()), use CPU's CRC32 instructions if available.
+static uint32_t YYCRC32Update(uint32_t crc, const void *data, size_t length) {
+    if (!data || length == 0) return crc;
+#if defined(__aarch64__)
+    if (YYCRC32HardwareAvailable()) return YYCRC32Hardware(crc, data, length);
+#endif
+    const unsigned char *bytes = data;
+    while (length > 0) { // zlib takes 32-bit length
+        uInt size = (uInt)MIN(length, (size_t)1 << 30);
+        crc = (uint32_t)crc32(crc, bytes, size);
+        bytes += size;
+        length -= size;
+    }
+    return crc;
+}
+
+#pragma mark - xxHash64
+
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t YYHashRotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t YYHashRead64(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v; // little endian
+}
+
+static inline uint32_t YYHashRead32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline uint64_t YYXXH64Round(uint64_t acc, uint64_t input) {
+    acc += input * XXH_PRIME64_2;
+    acc = YYHashRotl64(acc, 31);
+    return acc * XXH_PRIME64_1;
+}
+
+static inline uint64_t YYXXH64MergeRound(uint64_t acc, uint64_t val) {
+    acc ^= YYXXH64Round(0, val);
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+/// xxHash64 (XXH64) of the data.
+static uint64_t YYXXH64(const void *data, size_t length, uint64_t seed) {
+    const unsigned char *p = data;
+    const unsigned char *end = p + length;
+    uint64_t h;
+    if (length >= 32) {
+        uint64_t v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+        uint64_t v2 = seed + XXH_PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - XXH_PRIME64_1;
+        const unsigned char *limit = end - 32;
+        do {
+            v1 = YYXXH64Round(v1, YYHashRead64(p));
+            v2 = YYXXH64Round(v2, YYHashRead64(p + 8));
+            v3 = YYXXH64Round(v3, YYHashRead64(p + 16));
+            v4 = YYXXH64Round(v4, YYHashRead64(p + 24));
+            p += 32;
+        } while (p <= limit);
+        h = YYHashRotl64(v1, 1) + YYHashRotl64(v2, 7) + YYHashRotl64(v3, 12) + YYHashRotl64(v4, 18);
+        h = YYXXH64MergeRound(h, v1);
+        h = YYXXH64MergeRound(h, v2);
+        h = YYXXH64MergeRound(h, v3);
+        h = YYXXH64MergeRound(h, v4);
+    } else {
+        h = seed + XXH_PRIME64_5;
+    }
+    h += (uint64_t)length;
+    
+    while (p + 8 <= end) {
+        h ^= YYXXH64Round(0, YYHashRead64(p));
+        h = YYHashRotl64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+        p += 8;
+    }
+    if (p + 4 <= end) {
+        h ^= (uint64_t)YYHashRead32(p) * XXH_PRIME64_1;
+        h = YYHashRotl64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= (*p) * XXH_PRIME64_5;
+        h = YYHashRotl64(h, 11) * XXH_PRIME64_1;
+        p++;
+    }
+    
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+#pragma mark - MurmurHash3 128
+
+#if defined(__has_attribute)
+#if __has_attribute(fallthrough)
+#define YY_FALLTHROUGH __attribute__((fallthrough))
+#endif
+#endif
+#ifndef YY_FALLTHROUGH
+#define YY_FALLTHROUGH
+#endif
+
+static inline uint64_t YYMurmur3FMix64(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xFF51AFD7ED558CCDULL;
+    k ^= k >> 33;
+    k *= 0xC4CEB9FE1A85EC53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+/// MurmurHash3_x64_128 of the data, the result is written to `out` (16 bytes, h1 and h2 in little endian).
+static void YYMurmur3Hash128(const void *data, size_t length, uint32_t seed, unsigned char out[16]) {
+    const unsigned char *p = data;
+    size_t blocks = length / 16;
+    uint64_t h1 = seed, h2 = seed;
+    const uint64_t c1 = 0x87C37B91114253D5ULL;
+    const uint64_t c2 = 0x4CF5AD432745937FULL;
+    
+    for (size_t i = 0; i < blocks; i++, p += 16) {
+        uint64_t k1 = YYHashRead64(p);
+        uint64_t k2 = YYHashRead64(p + 8);
+        k1 *= c1; k1 = YYHashRotl64(k1, 31); k1 *= c2; h1 ^= k1;
+        h1 = YYHashRotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52DCE729;
+        k2 *= c2; k2 = YYHashRotl64(k2, 33); k2 *= c1; h2 ^= k2;
+        h2 = YYHashRotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495AB5;
+    }
+    
+    uint64_t k1 = 0, k2 = 0;
+    switch (length & 15) {
+        case 15: k2 ^= ((uint64_t)p[14]) << 48; YY_FALLTHROUGH;
+        case 14: k2 ^= ((uint64_t)p[13]) << 40; YY_FALLTHROUGH;
+        case 13: k2 ^= ((uint64_t)p[12]) << 32; YY_FALLTHROUGH;
+        case 12: k2 ^= ((uint64_t)p[11]) << 24; YY_FALLTHROUGH;
+        case 11: k2 ^= ((uint64_t)p[10]) << 16; YY_FALLTHROUGH;
+        case 10: k2 ^= ((uint64_t)p[9]) << 8; YY_FALLTHROUGH;
+        case 9: k2 ^= ((uint64_t)p[8]);
+            k2 *= c2; k2 = YYHashRotl64(k2, 33); k2 *= c1; h2 ^= k2; YY_FALLTHROUGH;
+        case 8: k1 ^= ((uint64_t)p[7]) << 56; YY_FALLTHROUGH;
+        case 7: k1 ^= ((uint64_t)p[6]) << 48; YY_FALLTHROUGH;
+        case 6: k1 ^= ((uint64_t)p[5]) << 40; YY_FALLTHROUGH;
+        case 5: k1 ^= ((uint64_t)p[4]) << 32; YY_FALLTHROUGH;
+        case 4: k1 ^= ((uint64_t)p[3]) << 24; YY_FALLTHROUGH;
+        case 3: k1 ^= ((uint64_t)p[2]) << 16; YY_FALLTHROUGH;
+        case 2: k1 ^= ((uint64_t)p[1]) << 8; YY_FALLTHROUGH;
+        case 1: k1 ^= ((uint64_t)p[0]);
+            k1 *= c1; k1 = YYHashRotl64(k1, 31); k1 *= c2; h1 ^= k1;
+    }
+    
+    h1 ^= (uint64_t)length;
+    h2 ^= (uint64_t)length;
+    h1 += h2;
+    h2 += h1;
+    h1 = YYMurmur3FMix64(h1);
+    h2 = YYMurmur3FMix64(h2);
+    h1 += h2;
+    h2 += h1;
+    memcpy(out, &h1, 8);
+    memcpy(out + 8, &h2, 8);
+}
+
+
+
+#pragma mark - Base64 and Hex Codec
+
+static const char YYBase64EncodingTable[64] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/// Base64 value of a character: -1 for whitespace, -2 for invalid character.
+static const short YYBase64DecodingTable[256] = {
+    -2, -2, -2, -2, -2, -2, -2, -2, -2, -1, -1, -2,  -1,  -1, -2, -2,
+    -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2,  -2,  -2, -2, -2,
+    -1, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, 62,  -2,  -2, -2, 63,
+    52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -2, -2,  -2,  -2, -2, -2,
+    -2, 0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  10,  11,  12, 13, 14,
+    15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -2,  -2,  -2, -2, -2,
+    -2, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36,  37,  38, 39, 40,
+    41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -2,  -2,  -2, -2, -2,
+    -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2,  -2,  -2, -2, -2,
+    -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2,  -2,  -2, -2, -2,
+    -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2,  -2,  -2, -2, -2,
+    -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2,  -2,  -2, -2, -2,
+    -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2,  -2,  -2, -2, -2,
+    -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2,  -2,  -2, -2, -2,
+    -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2,  -2,  -2, -2, -2,
+    -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2,  -2,  -2, -2, -2
+};
+
+static inline void YYBase64EncodeTriple(const uint8_t *src, char *dst) {
+    uint32_t value = ((uint32_t)src[0] << 16) | ((uint32_t)src[1] << 8) | src[2];
+    dst[0] = YYBase64EncodingTable[value >> 18];
+    dst[1] = YYBase64EncodingTable[(value >> 12) & 0x3F];
+    dst[2] = YYBase64EncodingTable[(value >> 6) & 0x3F];
+    dst[3] = YYBase64EncodingTable[value & 0x3F];
+}
+
+size_t YYBase64EncoderUpdate(YYBase64Encoder *encoder, const void *bytes, size_t length, char *buffer) {
+    const uint8_t *src = bytes;
+    char *dst = buffer;
+    if (encoder->tailLength > 0) {
+        while (encoder->tailLength < 3 && length > 0) {
+            encoder->tail[encoder->tailLength++] = *src++;
+            length--;
+        }
+        if (encoder->tailLength < 3) return 0;
+        YYBase64EncodeTriple(encoder->tail, dst);
+        dst += 4;
+        encoder->tailLength = 0;
+    }
+    while (length >= 12) {
+        YYBase64EncodeTriple(src, dst);
+        YYBase64EncodeTriple(src + 3, dst + 4);
+        YYBase64EncodeTriple(src + 6, dst + 8);
+        YYBase64EncodeTriple(src + 9, dst + 12);
+        src += 12;
+        dst += 16;
+        length -= 12;
+    }
+    while (length >= 3) {
+        YYBase64EncodeTriple(src, dst);
+        src += 3;
+        dst += 4;
+        length -= 3;
+    }
+    while (length > 0) {
+        encoder->tail[encoder->tailLength++] = *src++;
+        length--;
+    }
+    return dst - buffer;
+}
+
+size_t YYBase64EncoderFinish(YYBase64Encoder *encoder, char *buffer) {
+    size_t tailLength = encoder->tailLength;
+    encoder->tailLength = 0;
+    if (tailLength == 0) return 0;
+    uint8_t tail[3] = {encoder->tail[0], tailLength > 1 ? encoder->tail[1] : 0, 0};
+    YYBase64EncodeTriple(tail, buffer);
+    buffer[3] = '=';
+    if (tailLength == 1) buffer[2] = '=';
+    return 4;
+}
+
+size_t YYBase64Encode(const void *bytes, size_t length, char *buffer) {
+    YYBase64Encoder encoder = {0};
+    size_t written = YYBase64EncoderUpdate(&encoder, bytes, length, buffer);
+    return written + YYBase64EncoderFinish(&encoder, buffer + written);
+}
+
+size_t YYBase64DecoderUpdate(YYBase64Decoder *decoder, const char *string, size_t length, void *buffer) {
+    const uint8_t *src = (const uint8_t *)string, *end = src + length;
+    uint8_t *dst = buffer;
+    if (decoder->failed) return 0;
+    while (src < end) {
+        if (decoder->count == 0 && decoder->padding == 0) { // fast path: 4 valid characters
+            while (end - src >= 4) {
+                short a = YYBase64DecodingTable[src[0]], b = YYBase64DecodingTable[src[1]];
+                short c = YYBase64DecodingTable[src[2]], d = YYBase64DecodingTable[src[3]];
+                if ((a | b | c | d) < 0) break;
+                uint32_t value = ((uint32_t)a << 18) | ((uint32_t)b << 12) | ((uint32_t)c << 6) | (uint32_t)d;
+                dst[0] = value >> 16;
+                dst[1] = value >> 8;
+                dst[2] = value;
+                src += 4;
+                dst += 3;
+            }
+            if (src == end) break;
+        }
+        uint8_t ch = *src++;
+        short value = YYBase64DecodingTable[ch];
+        if (value == -1) continue; // whitespace
+        if (ch == '=') {
+            decoder->padding++;
+            continue;
+        }
+        if (value < 0 || decoder->padding > 0) { // invalid character, or data after padding
+            decoder->failed = YES;
+            break;
+        }
+        decoder->value = (decoder->value << 6) | (uint32_t)value;
+        if (++decoder->count == 4) {
+            dst[0] = decoder->value >> 16;
+            dst[1] = decoder->value >> 8;
+            dst[2] = decoder->value;
+            dst += 3;
+            decoder->count = 0;
+            decoder->value = 0;
+        }
+    }
+    return dst - (uint8_t *)buffer;
+}
+
+BOOL YYBase64DecoderFinish(YYBase64Decoder *decoder, void *buffer, size_t *length) {
+    uint8_t *dst = buffer;
+    uint32_t count = decoder->count, padding = decoder->padding, value = decoder->value;
+    BOOL failed = decoder->failed;
+    memset(decoder, 0, sizeof(YYBase64Decoder));
+    *length = 0;
+    if (failed || count == 1) return NO;
+    if (padding > 0 && (count == 0 || count + padding > 4)) return NO;
+    if (count == 2) {
+        dst[0] = value >> 4;
+        *length = 1;
+    } else if (count == 3) {
+        dst[0] = value >> 10;
+        dst[1] = value >> 2;
+        *length = 2;
+    }
+    return YES;
+}
+
+size_t YYBase64Decode(const char *string, size_t length, void *buffer) {
+    YYBase64Decoder decoder = {0};
+    size_t written = YYBase64DecoderUpdate(&decoder, string, length, buffer);
+    size_t tail = 0;
+    if (!YYBase64DecoderFinish(&decoder, (uint8_t *)buffer + written, &tail)) return SIZE_MAX;
+    return written + tail;
+}
+
+size_t YYHexEncode(const void *bytes, size_t length, char *buffer, BOOL uppercase) {
+    const char *digits = uppercase ? "0123456789ABCDEF" : "0123456789abcdef";
+    const uint8_t *src = bytes;
+    char *dst = buffer;
+    size_t i = 0;
+#if defined(__ARM_NEON) && defined(__aarch64__)
+    uint8x16_t table = vld1q_u8((const uint8_t *)digits);
+    uint8x16_t mask = vdupq_n_u8(0x0F);
+    for (; i + 16 <= length; i += 16) {
+        uint8x16_t value = vld1q_u8(src + i);
+        uint8x16x2_t result;
+        result.val[0] = vqtbl1q_u8(table, vshrq_n_u8(value, 4));
+        result.val[1] = vqtbl1q_u8(table, vandq_u8(value, mask));
+        vst2q_u8((uint8_t *)dst + i * 2, result); // interleaved
+    }
+#elif defined(__SSSE3__)
+    __m128i table = _mm_loadu_si128((const __m128i *)digits);
+    __m128i mask = _mm_set1_epi8(0x0F);
+    for (; i + 16 <= length; i += 16) {
+        __m128i value = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i high = _mm_shuffle_epi8(table, _mm_and_si128(_mm_srli_epi16(value, 4), mask));
+        __m128i low = _mm_shuffle_epi8(table, _mm_and_si128(value, mask));
+        _mm_storeu_si128((__m128i *)(dst + i * 2), _mm_unpacklo_epi8(high, low));
+        _mm_storeu_si128((__m128i *)(dst + i * 2 + 16), _mm_unpackhi_epi8(high, low));
+    }
+#endif
+    for (; i < length; i++) {
+        dst[i * 2] = digits[src[i] >> 4];
+        dst[i * 2 + 1] = digits[src[i] & 0x0F];
+    }
+    return length * 2;
+}
+
+/// Hex value of a character, or -1 for invalid character.
+static inline int YYHexValue(uint8_t ch) {
+    if (ch >= '0' && ch <= '9') return ch - '0';
+    ch |= 0x20; // lowercase
+    if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+    return -1;
+}
+
+size_t YYHexDecode(const char *string, size_t length, void *buffer) {
+    const uint8_t *src = (const uint8_t *)string;
+    uint8_t *dst = buffer;
+    size_t written = 0;
+    int high = -1;
+    for (size_t i = 0; i < length; i++) {
+        if (src[i] == ' ') continue;
+        int value = YYHexValue(src[i]);
+        if (value < 0) return SIZE_MAX;
+        if (high < 0) {
+            high = value;
+        } else {
+            dst[written++] = (uint8_t)((high << 4) | value);
+            high = -1;
+        }
+    }
+    return written; // the last odd digit is ignored
+}
+
+
+#pragma mark - Inflate and Deflate
+
+#define ZLIB_CHUNK_SIZE (1024 * 64) ///< reused output buffer size of inflater and deflater
+#define ZLIB_MAX_RATIO 1032         ///< max compression ratio of deflate
+#define ZLIB_MAX_INITIAL_CAPACITY (1024 * 1024 * 8) ///< max initial output buffer size from the untrusted gzip trailer
+
+/// Returns the uncompressed length in gzip trailer (ISIZE, modulo 2^32), or 0 if not available.
+static NSUInteger YYGzipTrailerSize(NSData *data) {
+    NSUInteger length = data.length;
+    const uint8_t *bytes = data.bytes;
+    if (length < 18 || bytes[0] != 0x1F || bytes[1] != 0x8B) return 0;
+    const uint8_t *isize = bytes + length - 4;
+    NSUInteger size = (uint32_t)isize[0] | ((uint32_t)isize[1] << 8) | ((uint32_t)isize[2] << 16) | ((uint32_t)isize[3] << 24);
+    if (size / ZLIB_MAX_RATIO > length) return 0; // not a single member gzip
+    return size;
+}
+
+static NSData *YYDataInflate(NSData *data, YYDataCompressionFormat format) {
+    YYDataInflater *inflater = [[YYDataInflater alloc] initWithFormat:format];
+    if (!inflater) return nil;
+    
+    NSUInteger length = data.length, offset = 0, outLength = 0;
+    NSUInteger capacity = format == YYDataCompressionFormatGzip ? YYGzipTrailerSize(data) : 0;
+    capacity = capacity > 0 ? MIN(capacity + 1, (NSUInteger)ZLIB_MAX_INITIAL_CAPACITY) : length * 2;
+    if (capacity == 0) capacity = ZLIB_CHUNK_SIZE;
+    NSMutableData *output = [NSMutableData dataWithLength:capacity];
+    if (!output) return nil;
+    
+    while (!inflater.finished) {
+        if (outLength == output.length) [output setLength:output.length * 2];
+        NSUInteger consumed = 0;
+        NSInteger written = [inflater inflateBytes:(const uint8_t *)data.bytes + offset
+                                            length:length - offset
+                                            buffer:(uint8_t *)output.mutableBytes + outLength
+                                          capacity:output.length - outLength
+                                          consumed:&consumed];
+        if (written < 0) return nil;
+        offset += consumed;
+        outLength += written;
+        if (!inflater.finished && consumed == 0 && written == 0 && outLength < output.length) return nil; // truncated
+    }
+    [output setLength:outLength];
+    return output;
+}
+
+static NSData *YYDataDeflate(NSData *data, YYDataCompressionFormat format) {
+    YYDataDeflater *deflater = [[YYDataDeflater alloc] initWithFormat:format level:Z_DEFAULT_COMPRESSION];
+    if (!deflater) return nil;
+    
+    NSUInteger length = data.length, offset = 0, outLength = 0;
+    NSMutableData *output = [NSMutableData dataWithLength:compressBound((uLong)MIN(length, (NSUInteger)UINT32_MAX)) + 18]; // 18: gzip wrapper
+    if (!output) return nil;
+    
+    while (!deflater.finished) {
+        if (outLength == output.length) [output increaseLengthBy:MAX(output.length / 2, 16384)];
+        NSUInteger consumed = 0;
+        NSInteger written = [deflater deflateBytes:(const uint8_t *)data.bytes + offset
+                                            length:length - offset
+                                            buffer:(uint8_t *)output.mutableBytes + outLength
+                                          capacity:output.length - outLength
+                                          consumed:&consumed
+                                            finish:YES];
+        if (written < 0) return nil;
+        offset += consumed;
+        outLength += written;
+    }
+    [output setLength:outLength];
+    return output;
+}
+
+
 @implementation NSData (YYAdd)
 
 - (NSString *)md2String {
     unsigned char result[CC_MD2_DIGEST_LENGTH];
     CC_MD2(self.bytes, (CC_LONG)self.length, result);
-    return [NSString stringWithFormat:
-            @"%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x",
-            result[0], result[1], result[2], result[3],
-            result[4], result[5], result[6], result[7],
-            result[8], result[9], result[10], result[11],
-            result[12], result[13], result[14], result[15]
-            ];
+    return YYDigestHexString(result, sizeof(result));
 }
 
 - (NSData *)md2Data {
@@ -40,13 +566,7 @@ YYSYNTH_DUMMY_CLASS(NSData_YYAdd)
 - (NSString *)md4String {
     unsigned char result[CC_MD4_DIGEST_LENGTH];
     CC_MD4(self.bytes, (CC_LONG)self.length, result);
-    return [NSString stringWithFormat:
-            @"%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x",
-            result[0], result[1], result[2], result[3],
-            result[4], result[5], result[6], result[7],
-            result[8], result[9], result[10], result[11],
-            result[12], result[13], result[14], result[15]
-            ];
+    return YYDigestHexString(result, sizeof(result));
 }
 
 - (NSData *)md4Data {
@@ -58,13 +578,7 @@ YYSYNTH_DUMMY_CLASS(NSData_YYAdd)
 - (NSString *)md5String {
     unsigned char result[CC_MD5_DIGEST_LENGTH];
     CC_MD5(self.bytes, (CC_LONG)self.length, result);
-    return [NSString stringWithFormat:
-            @"%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x",
-            result[0], result[1], result[2], result[3],
-            result[4], result[5], result[6], result[7],
-            result[8], result[9], result[10], result[11],
-            result[12], result[13], result[14], result[15]
-            ];
+    return YYDigestHexString(result, sizeof(result));
 }
 
 - (NSData *)md5Data {
@@ -76,12 +590,7 @@ YYSYNTH_DUMMY_CLASS(NSData_YYAdd)
 - (NSString *)sha1String {
     unsigned char result[CC_SHA1_DIGEST_LENGTH];
     CC_SHA1(self.bytes, (CC_LONG)self.length, result);
-    NSMutableString *hash = [NSMutableString
-                             stringWithCapacity:CC_SHA1_DIGEST_LENGTH * 2];
-    for (int i = 0; i < CC_SHA1_DIGEST_LENGTH; i++) {
-        [hash appendFormat:@"%02x", result[i]];
-    }
-    return hash;
+    return YYDigestHexString(result, sizeof(result));
 }
 
 - (NSData *)sha1Data {
@@ -93,12 +602,7 @@ YYSYNTH_DUMMY_CLASS(NSData_YYAdd)
 - (NSString *)sha224String {
     unsigned char result[CC_SHA224_DIGEST_LENGTH];
     CC_SHA224(self.bytes, (CC_LONG)self.length, result);
-    NSMutableString *hash = [NSMutableString
-                             stringWithCapacity:CC_SHA224_DIGEST_LENGTH * 2];
-    for (int i = 0; i < CC_SHA224_DIGEST_LENGTH; i++) {
-        [hash appendFormat:@"%02x", result[i]];
-    }
-    return hash;
+    return YYDigestHexString(result, sizeof(result));
 }
 
 - (NSData *)sha224Data {
@@ -110,12 +614,7 @@ YYSYNTH_DUMMY_CLASS(NSData_YYAdd)
 - (NSString *)sha256String {
     unsigned char result[CC_SHA256_DIGEST_LENGTH];
     CC_SHA256(self.bytes, (CC_LONG)self.length, result);
-    NSMutableString *hash = [NSMutableString
-                             stringWithCapacity:CC_SHA256_DIGEST_LENGTH * 2];
-    for (int i = 0; i < CC_SHA256_DIGEST_LENGTH; i++) {
-        [hash appendFormat:@"%02x", result[i]];
-    }
-    return hash;
+    return YYDigestHexString(result, sizeof(result));
 }
 
 - (NSData *)sha256Data {
@@ -127,12 +626,7 @@ YYSYNTH_DUMMY_CLASS(NSData_YYAdd)
 - (NSString *)sha384String {
     unsigned char result[CC_SHA384_DIGEST_LENGTH];
     CC_SHA384(self.bytes, (CC_LONG)self.length, result);
-    NSMutableString *hash = [NSMutableString
-                             stringWithCapacity:CC_SHA384_DIGEST_LENGTH * 2];
-    for (int i = 0; i < CC_SHA384_DIGEST_LENGTH; i++) {
-        [hash appendFormat:@"%02x", result[i]];
-    }
-    return hash;
+    return YYDigestHexString(result, sizeof(result));
 }
 
 - (NSData *)sha384Data {
@@ -144,12 +638,7 @@ YYSYNTH_DUMMY_CLASS(NSData_YYAdd)
 - (NSString *)sha512String {
     unsigned char result[CC_SHA512_DIGEST_LENGTH];
     CC_SHA512(self.bytes, (CC_LONG)self.length, result);
-    NSMutableString *hash = [NSMutableString
-                             stringWithCapacity:CC_SHA512_DIGEST_LENGTH * 2];
-    for (int i = 0; i < CC_SHA512_DIGEST_LENGTH; i++) {
-        [hash appendFormat:@"%02x", result[i]];
-    }
-    return hash;
+    return YYDigestHexString(result, sizeof(result));
 }
 
 - (NSData *)sha512Data {
@@ -172,11 +661,7 @@ YYSYNTH_DUMMY_CLASS(NSData_YYAdd)
     unsigned char result[size];
     const char *cKey = [key cStringUsingEncoding:NSUTF8StringEncoding];
     CCHmac(alg, cKey, strlen(cKey), self.bytes, self.length, result);
-    NSMutableString *hash = [NSMutableString stringWithCapacity:size * 2];
-    for (int i = 0; i < size; i++) {
-        [hash appendFormat:@"%02x", result[i]];
-    }
-    return hash;
+    return YYDigestHexString(result, size);
 }
 
 - (NSData *)hmacDataUsingAlg:(CCHmacAlgorithm)alg withKey:(NSData *)key {
@@ -244,13 +729,31 @@ YYSYNTH_DUMMY_CLASS(NSData_YYAdd)
 }
 
 - (NSString *)crc32String {
-    uLong result = crc32(0, self.bytes, (uInt)self.length);
-    return [NSString stringWithFormat:@"%08x", (uint32_t)result];
+    return [NSString stringWithFormat:@"%08x", YYCRC32Update(0, self.bytes, self.length)];
 }
 
 - (uint32_t)crc32 {
-    uLong result = crc32(0, self.bytes, (uInt)self.length);
-    return (uint32_t)result;
+    return YYCRC32Update(0, self.bytes, self.length);
+}
+
+- (uint64_t)xxHash64 {
+    return YYXXH64(self.bytes, self.length, 0);
+}
+
+- (NSString *)xxHash64String {
+    return [NSString stringWithFormat:@"%016llx", (unsigned long long)YYXXH64(self.bytes, self.length, 0)];
+}
+
+- (NSString *)murmur3Hash128String {
+    unsigned char result[16];
+    YYMurmur3Hash128(self.bytes, self.length, 0, result);
+    return YYDigestHexString(result, sizeof(result));
+}
+
+- (NSData *)murmur3Hash128Data {
+    unsigned char result[16];
+    YYMurmur3Hash128(self.bytes, self.length, 0, result);
+    return [NSData dataWithBytes:result length:sizeof(result)];
 }
 
 - (NSData *)aes256EncryptWithKey:(NSData *)key iv:(NSData *)iv {
@@ -330,133 +833,56 @@ YYSYNTH_DUMMY_CLASS(NSData_YYAdd)
 
 - (NSString *)hexString {
     NSUInteger length = self.length;
-    NSMutableString *result = [NSMutableString stringWithCapacity:length * 2];
-    const unsigned char *byte = self.bytes;
-    for (int i = 0; i < length; i++, byte++) {
-        [result appendFormat:@"%02X", *byte];
-    }
-    return result;
+    if (length == 0) return @"";
+    char *buffer = malloc(length * 2);
+    if (!buffer) return nil;
+    size_t written = YYHexEncode(self.bytes, length, buffer, YES);
+    return [[NSString alloc] initWithBytesNoCopy:buffer length:written encoding:NSASCIIStringEncoding freeWhenDone:YES];
 }
 
 + (NSData *)dataWithHexString:(NSString *)hexStr {
-    hexStr = [hexStr stringByReplacingOccurrencesOfString:@" " withString:@""];
-    hexStr = [hexStr lowercaseString];
-    NSUInteger len = hexStr.length;
-    if (!len) return nil;
-    unichar *buf = malloc(sizeof(unichar) * len);
-    if (!buf) return nil;
-    [hexStr getCharacters:buf range:NSMakeRange(0, len)];
-    
-    NSMutableData *result = [NSMutableData data];
-    unsigned char bytes;
-    char str[3] = { '\0', '\0', '\0' };
-    int i;
-    for (i = 0; i < len / 2; i++) {
-        str[0] = buf[i * 2];
-        str[1] = buf[i * 2 + 1];
-        bytes = strtol(str, NULL, 16);
-        [result appendBytes:&bytes length:1];
-    }
-    free(buf);
+    if (hexStr.length == 0) return nil;
+    NSData *string = [hexStr dataUsingEncoding:NSASCIIStringEncoding];
+    if (!string) return nil;
+    NSMutableData *result = [NSMutableData dataWithLength:string.length / 2];
+    if (!result) return nil;
+    size_t length = YYHexDecode(string.bytes, string.length, result.mutableBytes);
+    if (length == SIZE_MAX) return nil;
+    result.length = length;
     return result;
 }
 
-static const char base64EncodingTable[64]
-= "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-static const short base64DecodingTable[256] = {
-    -2, -2, -2, -2, -2, -2, -2, -2, -2, -1, -1, -2,  -1,  -1, -2, -2,
-    -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2,  -2,  -2, -2, -2,
-    -1, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, 62,  -2,  -2, -2, 63,
-    52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -2, -2,  -2,  -2, -2, -2,
-    -2, 0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  10,  11,  12, 13, 14,
-    15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -2,  -2,  -2, -2, -2,
-    -2, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36,  37,  38, 39, 40,
-    41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -2,  -2,  -2, -2, -2,
-    -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2,  -2,  -2, -2, -2,
-    -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2,  -2,  -2, -2, -2,
-    -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2,  -2,  -2, -2, -2,
-    -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2,  -2,  -2, -2, -2,
-    -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2,  -2,  -2, -2, -2,
-    -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2,  -2,  -2, -2, -2,
-    -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2,  -2,  -2, -2, -2,
-    -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2,  -2,  -2, -2, -2
-};
-
 - (NSString *)base64EncodedString {
     NSUInteger length = self.length;
     if (length == 0)
         return @"";
     
-    NSUInteger out_length = ((length + 2) / 3) * 4;
-    uint8_t *output = malloc(((out_length + 2) / 3) * 4);
+    size_t outLength = YYBase64EncodedLength(length);
+    char *output = malloc(outLength);
     if (output == NULL)
         return nil;
     
-    const char *input = self.bytes;
-    NSInteger i, value;
-    for (i = 0; i < length; i += 3) {
-        value = 0;
-        for (NSInteger j = i; j < i + 3; j++) {
-            value <<= 8;
-            if (j < length) {
-                value |= (0xFF & input[j]);
-            }
-        }
-        NSInteger index = (i / 3) * 4;
-        output[index + 0] = base64EncodingTable[(value >> 18) & 0x3F];
-        output[index + 1] = base64EncodingTable[(value >> 12) & 0x3F];
-        output[index + 2] = ((i + 1) < length)
-        ? base64EncodingTable[(value >> 6) & 0x3F]
-        : '=';
-        output[index + 3] = ((i + 2) < length)
-        ? base64EncodingTable[(value >> 0) & 0x3F]
-        : '=';
-    }
-    
-    NSString *base64 = [[NSString alloc] initWithBytes:output
-                                                length:out_length
-                                              encoding:NSASCIIStringEncoding];
-    free(output);
-    return base64;
+    YYBase64Encode(self.bytes, length, output);
+    return [[NSString alloc] initWithBytesNoCopy:output
+                                          length:outLength
+                                        encoding:NSASCIIStringEncoding
+                                    freeWhenDone:YES];
 }
 
 + (NSData *)dataWithBase64EncodedString:(NSString *)base64EncodedString {
-    NSInteger length = base64EncodedString.length;
     const char *string = [base64EncodedString cStringUsingEncoding:NSASCIIStringEncoding];
-    if (string  == NULL)
+    if (string == NULL)
         return nil;
     
-    while (length > 0 && string[length - 1] == '=')
-        length--;
-    
-    NSInteger outputLength = length * 3 / 4;
-    NSMutableData *data = [NSMutableData dataWithLength:outputLength];
+    size_t length = strlen(string);
+    NSMutableData *data = [NSMutableData dataWithLength:YYBase64DecodedMaxLength(length)];
     if (data == nil)
         return nil;
-    if (length == 0)
-        return data;
-    
-    uint8_t *output = data.mutableBytes;
-    NSInteger inputPoint = 0;
-    NSInteger outputPoint = 0;
-    while (inputPoint < length) {
-        char i0 = string[inputPoint++];
-        char i1 = string[inputPoint++];
-        char i2 = inputPoint < length ? string[inputPoint++] : 'A';
-        char i3 = inputPoint < length ? string[inputPoint++] : 'A';
-        
-        output[outputPoint++] = (base64DecodingTable[i0] << 2)
-        | (base64DecodingTable[i1] >> 4);
-        if (outputPoint < outputLength) {
-            output[outputPoint++] = ((base64DecodingTable[i1] & 0xf) << 4)
-            | (base64DecodingTable[i2] >> 2);
-        }
-        if (outputPoint < outputLength) {
-            output[outputPoint++] = ((base64DecodingTable[i2] & 0x3) << 6)
-            | base64DecodingTable[i3];
-        }
-    }
     
+    size_t outputLength = YYBase64Decode(string, length, data.mutableBytes);
+    if (outputLength == SIZE_MAX)
+        return nil;
+    data.length = outputLength;
     return data;
 }
 
@@ -471,165 +897,22 @@ static const short base64DecodingTable[256] = {
 
 - (NSData *)gzipInflate {
     if ([self length] == 0) return self;
-    
-    unsigned full_length = (unsigned)[self length];
-    unsigned half_length = (unsigned)[self length] / 2;
-    
-    NSMutableData *decompressed = [NSMutableData
-                                   dataWithLength:full_length + half_length];
-    BOOL done = NO;
-    int status;
-    
-    z_stream strm;
-    strm.next_in = (Bytef *)[self bytes];
-    strm.avail_in = (unsigned)[self length];
-    strm.total_out = 0;
-    strm.zalloc = Z_NULL;
-    strm.zfree = Z_NULL;
-    
-    if (inflateInit2(&strm, (15 + 32)) != Z_OK) return nil;
-    while (!done) {
-        // Make sure we have enough room and reset the lengths.
-        if (strm.total_out >= [decompressed length])
-            [decompressed increaseLengthBy:half_length];
-        strm.next_out = [decompressed mutableBytes] + strm.total_out;
-        strm.avail_out = (uInt)([decompressed length] - strm.total_out);
-        
-        // Inflate another chunk.
-        status = inflate(&strm, Z_SYNC_FLUSH);
-        if (status == Z_STREAM_END) done = YES;
-        else if (status != Z_OK) break;
-    }
-    if (inflateEnd(&strm) != Z_OK) return nil;
-    
-    // Set real length.
-    if (done) {
-        [decompressed setLength:strm.total_out];
-        return [NSData dataWithData:decompressed];
-    } else return nil;
+    return YYDataInflate(self, YYDataCompressionFormatGzip);
 }
 
 - (NSData *)gzipDeflate {
     if ([self length] == 0) return self;
-    
-    z_stream strm;
-    
-    strm.zalloc = Z_NULL;
-    strm.zfree = Z_NULL;
-    strm.opaque = Z_NULL;
-    strm.total_out = 0;
-    strm.next_in = (Bytef *)[self bytes];
-    strm.avail_in = (uInt)[self length];
-    
-    // Compresssion Levels:
-    //   Z_NO_COMPRESSION
-    //   Z_BEST_SPEED
-    //   Z_BEST_COMPRESSION
-    //   Z_DEFAULT_COMPRESSION
-    
-    if (deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, (15 + 16),
-                     8, Z_DEFAULT_STRATEGY) != Z_OK)
-        return nil;
-    
-    // 16K chunks for expansion
-    NSMutableData *compressed = [NSMutableData dataWithLength:16384];
-    
-    do {
-        if (strm.total_out >= [compressed length])
-            [compressed increaseLengthBy:16384];
-        
-        strm.next_out = [compressed mutableBytes] + strm.total_out;
-        strm.avail_out = (uInt)([compressed length] - strm.total_out);
-        
-        deflate(&strm, Z_FINISH);
-    }
-    while (strm.avail_out == 0);
-    
-    deflateEnd(&strm);
-    
-    [compressed setLength:strm.total_out];
-    return [NSData dataWithData:compressed];
+    return YYDataDeflate(self, YYDataCompressionFormatGzip);
 }
 
 - (NSData *)zlibInflate {
     if ([self length] == 0) return self;
-    
-    NSUInteger full_length = [self length];
-    NSUInteger half_length = [self length] / 2;
-    
-    NSMutableData *decompressed = [NSMutableData
-                                   dataWithLength:full_length + half_length];
-    BOOL done = NO;
-    int status;
-    
-    z_stream strm;
-    strm.next_in = (Bytef *)[self bytes];
-    strm.avail_in = (uInt)full_length;
-    strm.total_out = 0;
-    strm.zalloc = Z_NULL;
-    strm.zfree = Z_NULL;
-    
-    if (inflateInit(&strm) != Z_OK) return nil;
-    
-    while (!done) {
-        // Make sure we have enough room and reset the lengths.
-        if (strm.total_out >= [decompressed length])
-            [decompressed increaseLengthBy:half_length];
-        strm.next_out = [decompressed mutableBytes] + strm.total_out;
-        strm.avail_out = (uInt)([decompressed length] - strm.total_out);
-        
-        // Inflate another chunk.
-        status = inflate(&strm, Z_SYNC_FLUSH);
-        if (status == Z_STREAM_END) done = YES;
-        else if (status != Z_OK) break;
-    }
-    if (inflateEnd(&strm) != Z_OK) return nil;
-    
-    // Set real length.
-    if (done) {
-        [decompressed setLength:strm.total_out];
-        return [NSData dataWithData:decompressed];
-    } else return nil;
+    return YYDataInflate(self, YYDataCompressionFormatZlib);
 }
 
 - (NSData *)zlibDeflate {
     if ([self length] == 0) return self;
-    
-    z_stream strm;
-    
-    strm.zalloc = Z_NULL;
-    strm.zfree = Z_NULL;
-    strm.opaque = Z_NULL;
-    strm.total_out = 0;
-    strm.next_in = (Bytef *)[self bytes];
-    strm.avail_in = (uInt)[self length];
-    
-    // Compresssion Levels:
-    //   Z_NO_COMPRESSION
-    //   Z_BEST_SPEED
-    //   Z_BEST_COMPRESSION
-    //   Z_DEFAULT_COMPRESSION
-    
-    if (deflateInit(&strm, Z_DEFAULT_COMPRESSION) != Z_OK) return nil;
-    
-    // 16K chuncks for expansion
-    NSMutableData *compressed = [NSMutableData dataWithLength:16384];
-    
-    do {
-        if (strm.total_out >= [compressed length])
-            [compressed increaseLengthBy:16384];
-        
-        strm.next_out = [compressed mutableBytes] + strm.total_out;
-        strm.avail_out = (uInt)([compressed length] - strm.total_out);
-        
-        deflate(&strm, Z_FINISH);
-    }
-    while (strm.avail_out == 0);
-    
-    deflateEnd(&strm);
-    
-    [compressed setLength:strm.total_out];
-    return [NSData dataWithData:compressed];
+    return YYDataDeflate(self, YYDataCompressionFormatZlib);
 }
 
 + (NSData *)dataNamed:(NSString *)name {
@@ -640,3 +923,142 @@ static const short base64DecodingTable[256] = {
 }
 
 @end
+
+
+
+@implementation YYDataInflater {
+    z_stream _stream;
+    BOOL _failed;
+    void *_buffer; ///< reused output buffer of `inflateData:`
+}
+
+- (instancetype)initWithFormat:(YYDataCompressionFormat)format {
+    self = [super init];
+    memset(&_stream, 0, sizeof(z_stream));
+    int windowBits = format == YYDataCompressionFormatGzip ? (15 + 32) : 15; // 32: detect gzip or zlib header
+    if (inflateInit2(&_stream, windowBits) != Z_OK) return nil;
+    return self;
+}
+
+- (void)dealloc {
+    inflateEnd(&_stream);
+    if (_buffer) free(_buffer);
+}
+
+- (NSInteger)inflateBytes:(const void *)bytes length:(NSUInteger)length buffer:(void *)buffer capacity:(NSUInteger)capacity consumed:(NSUInteger *)consumed {
+    *consumed = 0;
+    if (_failed) return -1;
+    if (_finished) return 0;
+    
+    uInt availIn = (uInt)MIN(length, (NSUInteger)UINT_MAX);
+    uInt availOut = (uInt)MIN(capacity, (NSUInteger)UINT_MAX);
+    _stream.next_in = (Bytef *)bytes;
+    _stream.avail_in = availIn;
+    _stream.next_out = buffer;
+    _stream.avail_out = availOut;
+    int status = inflate(&_stream, Z_NO_FLUSH);
+    if (status == Z_STREAM_END) {
+        _finished = YES;
+    } else if (status != Z_OK && status != Z_BUF_ERROR) { // Z_BUF_ERROR: no progress possible
+        _failed = YES;
+        return -1;
+    }
+    *consumed = availIn - _stream.avail_in;
+    NSUInteger written = availOut - _stream.avail_out;
+    _totalIn += *consumed;
+    _totalOut += written;
+    return written;
+}
+
+- (NSData *)inflateData:(NSData *)data {
+    if (!_buffer) _buffer = malloc(ZLIB_CHUNK_SIZE);
+    if (!_buffer) return nil;
+    NSMutableData *output = [NSMutableData data];
+    NSUInteger length = data.length, offset = 0;
+    while (!_finished) {
+        NSUInteger consumed = 0;
+        NSInteger written = [self inflateBytes:(const uint8_t *)data.bytes + offset length:length - offset buffer:_buffer capacity:ZLIB_CHUNK_SIZE consumed:&consumed];
+        if (written < 0) return nil;
+        if (written > 0) [output appendBytes:_buffer length:written];
+        offset += consumed;
+        if (written < ZLIB_CHUNK_SIZE && offset == length) break; // all input consumed and output flushed
+        if (written == 0 && consumed == 0) break;
+    }
+    if (_progress) _progress(_totalIn, _totalOut);
+    return output;
+}
+
+@end
+
+
+@implementation YYDataDeflater {
+    z_stream _stream;
+    BOOL _failed;
+    void *_buffer; ///< reused output buffer of `deflateData:` and `finish`
+}
+
+- (instancetype)initWithFormat:(YYDataCompressionFormat)format level:(int)level {
+    self = [super init];
+    memset(&_stream, 0, sizeof(z_stream));
+    int windowBits = format == YYDataCompressionFormatGzip ? (15 + 16) : 15; // 16: write gzip header
+    if (deflateInit2(&_stream, level, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK) return nil;
+    return self;
+}
+
+- (void)dealloc {
+    deflateEnd(&_stream);
+    if (_buffer) free(_buffer);
+}
+
+- (NSInteger)deflateBytes:(const void *)bytes length:(NSUInteger)length buffer:(void *)buffer capacity:(NSUInteger)capacity consumed:(NSUInteger *)consumed finish:(BOOL)finish {
+    *consumed = 0;
+    if (_failed) return -1;
+    if (_finished) return 0;
+    
+    uInt availIn = (uInt)MIN(length, (NSUInteger)UINT_MAX);
+    uInt availOut = (uInt)MIN(capacity, (NSUInteger)UINT_MAX);
+    BOOL last = finish && availIn == length; // the input larger than 4GB is finished in next call
+    _stream.next_in = (Bytef *)bytes;
+    _stream.avail_in = availIn;
+    _stream.next_out = buffer;
+    _stream.avail_out = availOut;
+    int status = deflate(&_stream, last ? Z_FINISH : Z_NO_FLUSH);
+    if (status == Z_STREAM_END) {
+        _finished = YES;
+    } else if (status != Z_OK && status != Z_BUF_ERROR) {
+        _failed = YES;
+        return -1;
+    }
+    *consumed = availIn - _stream.avail_in;
+    NSUInteger written = availOut - _stream.avail_out;
+    _totalIn += *consumed;
+    _totalOut += written;
+    return written;
+}
+
+- (NSData *)_deflateData:(NSData *)data finish:(BOOL)finish {
+    if (!_buffer) _buffer = malloc(ZLIB_CHUNK_SIZE);
+    if (!_buffer) return nil;
+    NSMutableData *output = [NSMutableData data];
+    NSUInteger length = data.length, offset = 0;
+    while (!_finished) {
+        NSUInteger consumed = 0;
+        NSInteger written = [self deflateBytes:(const uint8_t *)data.bytes + offset length:length - offset buffer:_buffer capacity:ZLIB_CHUNK_SIZE consumed:&consumed finish:finish];
+        if (written < 0) return nil;
+        if (written > 0) [output appendBytes:_buffer length:written];
+        offset += consumed;
+        if (!finish && written < ZLIB_CHUNK_SIZE && offset == length) break; // all input consumed
+    }
+    if (_progress) _progress(_totalIn, _totalOut);
+    return output;
+}
+
+- (NSData *)deflateData:(NSData *)data {
+    return [self _deflateData:data finish:NO];
+}
+
+- (NSData *)finish {
+    return [self _deflateData:nil finish:YES];
+}
+
+@end
@@ -9,10 +9,33 @@
 //  LICENSE file in the root directory of this source tree.
 //
 
+#ifndef NSNumber_YYAdd_h
+#define NSNumber_YYAdd_h
+
 #import <Foundation/Foundation.h>
 
 NS_ASSUME_NONNULL_BEGIN
 
+/**
+ Parses a plain decimal number string without NSNumberFormatter or temporary objects.
+ 
+ @discussion Leading and trailing whitespace is ignored. Only a decimal integer
+ in the range of `long long` (@"12", @"-34") and a decimal float without exponent
+ (@"-12.345", @".5") are accepted. Words, hex, exponent and out of range integers
+ are not, so the caller can fall back to its own parsing for them.
+ 
+ Integers are returned as `long long`, floats as `double`. Small integers are
+ returned from a shared cache.
+ 
+ @param string  The string described a number.
+ 
+ @param valid   Output whether the string is in an accepted format. Pass NULL
+ if not needed.
+ 
+ @return The number, or nil for invalid strings.
+ */
+extern NSNumber * _Nullable YYNumberParseString(NSString * _Nullable string, BOOL * _Nullable valid);
+
 /**
  Provide a method to parse `NSString` for `NSNumber`.
  */
@@ -22,6 +45,10 @@ NS_ASSUME_NONNULL_BEGIN
  Creates and returns an NSNumber object from a string.
  Valid format: @"12", @"12.345", @" -0xFF", @" .23e99 "...
  
+ @discussion The string is parsed by `YYNumberParseString()` first; only a string
+ it does not accept (words, hex, exponent, or a localized @"1,234") falls back to
+ the original parsing with NSNumberFormatter.
+ 
  @param string  The string described an number.
  
  @return an NSNumber when parse succeed, or nil if an error occurs.
@@ -32,3 +59,5 @@ NS_ASSUME_NONNULL_BEGIN
 @end
 
 NS_ASSUME_NONNULL_END
+
+#endif
@@ -12,13 +12,155 @@
 #import "NSNumber+YYAdd.h"
 #import "NSString+YYAdd.h"
 #import "YYKitMacro.h"
+#import <math.h>
 
 YYSYNTH_DUMMY_CLASS(NSNumber_YYAdd)
 
+#define NUMBER_STACK_BUFFER_SIZE 64
+#define NUMBER_CACHE_MIN -128
+#define NUMBER_CACHE_MAX 1023
+
+/// Type of a parsed number string.
+typedef NS_ENUM(NSInteger, YYNumberParseType) {
+    YYNumberParseTypeInvalid = 0,
+    YYNumberParseTypeInteger,  ///< fits in long long
+    YYNumberParseTypeDouble,
+};
+
+/// Parsed number value.
+typedef union {
+    long long i;
+    double d;
+} YYNumberParseValue;
+
+static inline BOOL YYNumberIsSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+/**
+ Parses an ASCII string (trimmed by whitespace).
+ Accepts only a plain decimal integer in the range of `long long`, or a plain
+ decimal float "-12.345" without exponent. Hex, exponent, words and out of range
+ integers are rejected, so that the callers keep their own results for them.
+ The string should be writable and NUL terminated at `end` (used by strtod).
+ */
+static YYNumberParseType YYNumberParseCString(char *str, char *end, YYNumberParseValue *value) {
+    static const double pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    
+    while (str < end && YYNumberIsSpace(*str)) str++;
+    while (end > str && YYNumberIsSpace(end[-1])) end--;
+    if (end == str) return YYNumberParseTypeInvalid;
+    *end = '\0';
+    
+    const char *cur = str;
+    BOOL negative = NO;
+    if (*cur == '+' || *cur == '-') {
+        negative = *cur == '-';
+        cur++;
+    }
+    
+    // significant digits are kept in mantissa until it overflows
+    unsigned long long mantissa = 0;
+    int exponent = 0;
+    BOOL hasDigit = NO, hasDot = NO, truncated = NO;
+    for (; cur < end && *cur >= '0' && *cur <= '9'; cur++) {
+        hasDigit = YES;
+        int digit = *cur - '0';
+        if (mantissa <= (ULLONG_MAX - digit) / 10) {
+            mantissa = mantissa * 10 + digit;
+        } else {
+            exponent++;
+            truncated = YES;
+        }
+    }
+    if (cur < end && *cur == '.') {
+        hasDot = YES;
+        for (cur++; cur < end && *cur >= '0' && *cur <= '9'; cur++) {
+            hasDigit = YES;
+            int digit = *cur - '0';
+            if (!truncated && mantissa <= (ULLONG_MAX - digit) / 10) {
+                mantissa = mantissa * 10 + digit;
+                exponent--;
+            } else {
+                truncated = YES;
+            }
+        }
+    }
+    if (!hasDigit || cur != end) return YYNumberParseTypeInvalid;
+    
+    if (!hasDot) {
+        if (truncated) return YYNumberParseTypeInvalid;
+        if (mantissa > (unsigned long long)LLONG_MAX + (negative ? 1 : 0)) return YYNumberParseTypeInvalid;
+        value->i = negative ? (long long)(0 - mantissa) : (long long)mantissa;
+        return YYNumberParseTypeInteger;
+    }
+    
+    double d;
+    if (!truncated && mantissa <= (1ULL << 53) && exponent >= -22) {
+        // both mantissa and power of 10 are exact, so the result is correctly rounded
+        d = (double)mantissa / pow10[-exponent];
+        if (negative) d = -d;
+    } else {
+        d = strtod(str, NULL);
+    }
+    if (isnan(d) || isinf(d)) return YYNumberParseTypeInvalid;
+    value->d = d;
+    return YYNumberParseTypeDouble;
+}
+
+NSNumber *YYNumberParseString(NSString *string, BOOL *valid) {
+    static __unsafe_unretained NSNumber *cache[NUMBER_CACHE_MAX - NUMBER_CACHE_MIN + 1];
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        for (int i = NUMBER_CACHE_MIN; i <= NUMBER_CACHE_MAX; i++) {
+            cache[i - NUMBER_CACHE_MIN] = (__bridge NSNumber *)CFBridgingRetain(@((long long)i));
+        }
+    });
+    
+    if (valid) *valid = NO;
+    if (!string) return nil;
+    CFStringRef cfString = (__bridge CFStringRef)string;
+    CFIndex length = CFStringGetLength(cfString);
+    if (length == 0) return nil;
+    
+    // copy as ASCII; a non-ASCII string is never a number
+    char stackBuffer[NUMBER_STACK_BUFFER_SIZE];
+    char *buffer = length < NUMBER_STACK_BUFFER_SIZE ? stackBuffer : malloc(length + 1);
+    if (!buffer) return nil;
+    CFIndex used = 0;
+    CFIndex converted = CFStringGetBytes(cfString, CFRangeMake(0, length), kCFStringEncodingASCII, 0, false, (UInt8 *)buffer, length, &used);
+    YYNumberParseType type = YYNumberParseTypeInvalid;
+    YYNumberParseValue value;
+    if (converted == length) {
+        type = YYNumberParseCString(buffer, buffer + used, &value);
+    }
+    if (buffer != stackBuffer) free(buffer);
+    
+    NSNumber *num = nil;
+    switch (type) {
+        case YYNumberParseTypeInvalid: return nil;
+        case YYNumberParseTypeInteger: {
+            if (value.i >= NUMBER_CACHE_MIN && value.i <= NUMBER_CACHE_MAX) {
+                num = cache[value.i - NUMBER_CACHE_MIN];
+            } else {
+                num = [NSNumber numberWithLongLong:value.i];
+            }
+        } break;
+        case YYNumberParseTypeDouble: num = [NSNumber numberWithDouble:value.d]; break;
+    }
+    if (valid) *valid = YES;
+    return num;
+}
+
 
 @implementation NSNumber (YYAdd)
 
 + (NSNumber *)numberWithString:(NSString *)string {
+    BOOL valid = NO;
+    NSNumber *number = YYNumberParseString(string, &valid);
+    if (valid) return number;
+    
     NSString *str = [[string stringByTrim] lowercaseString];
     if (!str || !str.length) {
         return nil;
@@ -54,9 +196,13 @@ YYSYNTH_DUMMY_CLASS(NSNumber_YYAdd)
         else
             return nil;
     }
-    // normal number
-    NSNumberFormatter *formatter = [[NSNumberFormatter alloc] init];
-    [formatter setNumberStyle:NSNumberFormatterDecimalStyle];
+    // normal number (NSNumberFormatter is thread safe since iOS 7)
+    static NSNumberFormatter *formatter;
+    static dispatch_once_t formatterOnceToken;
+    dispatch_once(&formatterOnceToken, ^{
+        formatter = [[NSNumberFormatter alloc] init];
+        [formatter setNumberStyle:NSNumberFormatterDecimalStyle];
+    });
     return [formatter numberFromString:string];
 }
 
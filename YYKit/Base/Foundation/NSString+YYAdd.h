@@ -139,6 +139,17 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (NSString *)stringByEscapingHTML;
 
+/**
+ Unescape HTML Entity to characters.
+ Example: "a&gt;b&#39;" will be unescape to "a>b'".
+ 
+ @discussion Numeric entities and all the HTML 4 named entities (Latin-1 such as
+ "&nbsp;", "&eacute;", Greek letters such as "&alpha;", symbols and punctuation
+ such as "&hellip;") are supported, and "&apos;". An entity must end with ';',
+ an unknown or malformed entity is kept as is.
+ */
+- (NSString *)stringByUnescapingHTML;
+
 #pragma mark - Drawing
 ///=============================================================================
 /// @name Drawing
@@ -18,6 +18,218 @@
 YYSYNTH_DUMMY_CLASS(NSString_YYAdd)
 
 
+/**
+ Percent-encodes the string in UTF-8 with a lookup table, the same as the
+ `stringByAddingPercentEncodingWithAllowedCharacters:` path of `stringByURLEncode`:
+ only the unreserved characters (RFC 3986) and "/", "?" are not encoded.
+ Returns nil if the string cannot be converted to UTF-8.
+ */
+static NSString *YYURLEncodeString(NSString *string) {
+    static BOOL allowed[256];
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        const char *chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-._~/?";
+        for (const char *c = chars; *c; c++) allowed[(uint8_t)*c] = YES;
+    });
+    static const char digits[] = "0123456789ABCDEF";
+    
+    NSUInteger length = [string lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+    if (length == 0) return string.length ? nil : @"";
+    const uint8_t *src = (const uint8_t *)string.UTF8String;
+    if (!src) return nil;
+    
+    NSUInteger i = 0;
+    while (i < length && allowed[src[i]]) i++;
+    if (i == length) return string.copy; // nothing to encode
+    
+    char *buffer = malloc(length * 3);
+    if (!buffer) return nil;
+    memcpy(buffer, src, i);
+    char *dst = buffer + i;
+    for (; i < length; i++) {
+        uint8_t c = src[i];
+        if (allowed[c]) {
+            *dst++ = c;
+        } else {
+            dst[0] = '%';
+            dst[1] = digits[c >> 4];
+            dst[2] = digits[c & 0x0F];
+            dst += 3;
+        }
+    }
+    return [[NSString alloc] initWithBytesNoCopy:buffer length:dst - buffer encoding:NSASCIIStringEncoding freeWhenDone:YES];
+}
+
+/// Entities of the characters escaped by `stringByEscapingHTML`.
+static const char *const YYHTMLEscapeTable[128] = {
+    ['"'] = "&quot;", ['&'] = "&amp;", ['\''] = "&apos;", ['<'] = "&lt;", ['>'] = "&gt;",
+};
+
+/**
+ Escapes HTML in UTF-16 characters, untouched spans are copied in bulk.
+ Returns the escaped length. If `dst` is NULL, only the length is calculated.
+ */
+static NSUInteger YYHTMLEscapeCharacters(const unichar *src, NSUInteger length, unichar *dst) {
+    NSUInteger dstLength = 0, start = 0;
+    for (NSUInteger i = 0; i < length; i++) {
+        unichar c = src[i];
+        const char *entity = c < 128 ? YYHTMLEscapeTable[c] : NULL;
+        if (!entity) continue;
+        NSUInteger span = i - start;
+        if (dst) memcpy(dst + dstLength, src + start, span * sizeof(unichar));
+        dstLength += span;
+        for (; *entity; entity++, dstLength++) {
+            if (dst) dst[dstLength] = *entity;
+        }
+        start = i + 1;
+    }
+    NSUInteger span = length - start;
+    if (dst) memcpy(dst + dstLength, src + start, span * sizeof(unichar));
+    return dstLength + span;
+}
+
+#define HTML_ENTITY_NAME_MAX 8
+
+typedef struct {
+    const char *name;
+    unichar value;
+} YYHTMLEntity;
+
+static int YYHTMLEntityCompare(const void *key, const void *entity) {
+    return strcmp(key, ((const YYHTMLEntity *)entity)->name);
+}
+
+/// Returns the character of a named entity (without '&' and ';'), or 0 if not found.
+static unichar YYHTMLEntityLookup(const unichar *name, NSUInteger length) {
+    // all the HTML 4 entities and "apos", sorted by name in ASCII order for bsearch
+    static const YYHTMLEntity entities[] = {
+        {"AElig", 198}, {"Aacute", 193}, {"Acirc", 194}, {"Agrave", 192}, {"Alpha", 913},
+        {"Aring", 197}, {"Atilde", 195}, {"Auml", 196}, {"Beta", 914}, {"Ccedil", 199}, {"Chi", 935},
+        {"Dagger", 8225}, {"Delta", 916}, {"ETH", 208}, {"Eacute", 201}, {"Ecirc", 202},
+        {"Egrave", 200}, {"Epsilon", 917}, {"Eta", 919}, {"Euml", 203}, {"Gamma", 915}, {"Iacute", 205},
+        {"Icirc", 206}, {"Igrave", 204}, {"Iota", 921}, {"Iuml", 207}, {"Kappa", 922}, {"Lambda", 923},
+        {"Mu", 924}, {"Ntilde", 209}, {"Nu", 925}, {"OElig", 338}, {"Oacute", 211}, {"Ocirc", 212},
+        {"Ograve", 210}, {"Omega", 937}, {"Omicron", 927}, {"Oslash", 216}, {"Otilde", 213},
+        {"Ouml", 214}, {"Phi", 934}, {"Pi", 928}, {"Prime", 8243}, {"Psi", 936}, {"Rho", 929},
+        {"Scaron", 352}, {"Sigma", 931}, {"THORN", 222}, {"Tau", 932}, {"Theta", 920}, {"Uacute", 218},
+        {"Ucirc", 219}, {"Ugrave", 217}, {"Upsilon", 933}, {"Uuml", 220}, {"Xi", 926}, {"Yacute", 221},
+        {"Yuml", 376}, {"Zeta", 918}, {"aacute", 225}, {"acirc", 226}, {"acute", 180}, {"aelig", 230},
+        {"agrave", 224}, {"alefsym", 8501}, {"alpha", 945}, {"amp", 38}, {"and", 8743}, {"ang", 8736},
+        {"apos", 39}, {"aring", 229}, {"asymp", 8776}, {"atilde", 227}, {"auml", 228}, {"bdquo", 8222},
+        {"beta", 946}, {"brvbar", 166}, {"bull", 8226}, {"cap", 8745}, {"ccedil", 231}, {"cedil", 184},
+        {"cent", 162}, {"chi", 967}, {"circ", 710}, {"clubs", 9827}, {"cong", 8773}, {"copy", 169},
+        {"crarr", 8629}, {"cup", 8746}, {"curren", 164}, {"dArr", 8659}, {"dagger", 8224},
+        {"darr", 8595}, {"deg", 176}, {"delta", 948}, {"diams", 9830}, {"divide", 247}, {"eacute", 233},
+        {"ecirc", 234}, {"egrave", 232}, {"empty", 8709}, {"emsp", 8195}, {"ensp", 8194},
+        {"epsilon", 949}, {"equiv", 8801}, {"eta", 951}, {"eth", 240}, {"euml", 235}, {"euro", 8364},
+        {"exist", 8707}, {"fnof", 402}, {"forall", 8704}, {"frac12", 189}, {"frac14", 188},
+        {"frac34", 190}, {"frasl", 8260}, {"gamma", 947}, {"ge", 8805}, {"gt", 62}, {"hArr", 8660},
+        {"harr", 8596}, {"hearts", 9829}, {"hellip", 8230}, {"iacute", 237}, {"icirc", 238},
+        {"iexcl", 161}, {"igrave", 236}, {"image", 8465}, {"infin", 8734}, {"int", 8747}, {"iota", 953},
+        {"iquest", 191}, {"isin", 8712}, {"iuml", 239}, {"kappa", 954}, {"lArr", 8656}, {"lambda", 955},
+        {"lang", 9001}, {"laquo", 171}, {"larr", 8592}, {"lceil", 8968}, {"ldquo", 8220}, {"le", 8804},
+        {"lfloor", 8970}, {"lowast", 8727}, {"loz", 9674}, {"lrm", 8206}, {"lsaquo", 8249},
+        {"lsquo", 8216}, {"lt", 60}, {"macr", 175}, {"mdash", 8212}, {"micro", 181}, {"middot", 183},
+        {"minus", 8722}, {"mu", 956}, {"nabla", 8711}, {"nbsp", 160}, {"ndash", 8211}, {"ne", 8800},
+        {"ni", 8715}, {"not", 172}, {"notin", 8713}, {"nsub", 8836}, {"ntilde", 241}, {"nu", 957},
+        {"oacute", 243}, {"ocirc", 244}, {"oelig", 339}, {"ograve", 242}, {"oline", 8254},
+        {"omega", 969}, {"omicron", 959}, {"oplus", 8853}, {"or", 8744}, {"ordf", 170}, {"ordm", 186},
+        {"oslash", 248}, {"otilde", 245}, {"otimes", 8855}, {"ouml", 246}, {"para", 182},
+        {"part", 8706}, {"permil", 8240}, {"perp", 8869}, {"phi", 966}, {"pi", 960}, {"piv", 982},
+        {"plusmn", 177}, {"pound", 163}, {"prime", 8242}, {"prod", 8719}, {"prop", 8733}, {"psi", 968},
+        {"quot", 34}, {"rArr", 8658}, {"radic", 8730}, {"rang", 9002}, {"raquo", 187}, {"rarr", 8594},
+        {"rceil", 8969}, {"rdquo", 8221}, {"real", 8476}, {"reg", 174}, {"rfloor", 8971}, {"rho", 961},
+        {"rlm", 8207}, {"rsaquo", 8250}, {"rsquo", 8217}, {"sbquo", 8218}, {"scaron", 353},
+        {"sdot", 8901}, {"sect", 167}, {"shy", 173}, {"sigma", 963}, {"sigmaf", 962}, {"sim", 8764},
+        {"spades", 9824}, {"sub", 8834}, {"sube", 8838}, {"sum", 8721}, {"sup", 8835}, {"sup1", 185},
+        {"sup2", 178}, {"sup3", 179}, {"supe", 8839}, {"szlig", 223}, {"tau", 964}, {"there4", 8756},
+        {"theta", 952}, {"thetasym", 977}, {"thinsp", 8201}, {"thorn", 254}, {"tilde", 732},
+        {"times", 215}, {"trade", 8482}, {"uArr", 8657}, {"uacute", 250}, {"uarr", 8593},
+        {"ucirc", 251}, {"ugrave", 249}, {"uml", 168}, {"upsih", 978}, {"upsilon", 965}, {"uuml", 252},
+        {"weierp", 8472}, {"xi", 958}, {"yacute", 253}, {"yen", 165}, {"yuml", 255}, {"zeta", 950},
+        {"zwj", 8205}, {"zwnj", 8204}
+    };
+    if (length == 0 || length > HTML_ENTITY_NAME_MAX) return 0;
+    char key[HTML_ENTITY_NAME_MAX + 1];
+    for (NSUInteger i = 0; i < length; i++) {
+        if (name[i] >= 128) return 0;
+        key[i] = name[i];
+    }
+    key[length] = '\0';
+    const YYHTMLEntity *entity = bsearch(key, entities, sizeof(entities) / sizeof(entities[0]), sizeof(YYHTMLEntity), YYHTMLEntityCompare);
+    return entity ? entity->value : 0;
+}
+
+/**
+ Unescapes HTML entities in UTF-16 characters: the HTML 4 named entities (such as
+ "&amp;", "&eacute;", "&alpha;") and numeric entities ("&#39;", "&#x1F600;").
+ An entity must end with ';', an unknown or malformed one is kept as is.
+ Untouched spans are copied in bulk. `dst` should have room for `length`
+ characters (an entity is never shorter than its result).
+ Returns the unescaped length.
+ */
+static NSUInteger YYHTMLUnescapeCharacters(const unichar *src, NSUInteger length, unichar *dst) {
+    NSUInteger dstLength = 0, start = 0, i = 0;
+    while (i < length) {
+        if (src[i] != '&') {
+            i++;
+            continue;
+        }
+        uint32_t code = 0;
+        NSUInteger end = i + 1;
+        if (end < length && src[end] == '#') {
+            end++;
+            BOOL hex = end < length && (src[end] | 0x20) == 'x';
+            if (hex) end++;
+            NSUInteger digitStart = end;
+            for (; end < length; end++) {
+                unichar c = src[end];
+                uint32_t digit;
+                if (c >= '0' && c <= '9') digit = c - '0';
+                else if (hex && (c | 0x20) >= 'a' && (c | 0x20) <= 'f') digit = (c | 0x20) - 'a' + 10;
+                else break;
+                code = code * (hex ? 16 : 10) + digit;
+                if (code > 0x10FFFF) code = 0x110000; // clamp to invalid
+            }
+            if (end == digitStart || end == length || src[end] != ';') {
+                i++;
+                continue;
+            }
+            // invalid code points are replaced with U+FFFD, as a browser does
+            if (code == 0 || code > 0x10FFFF || (code >= 0xD800 && code <= 0xDFFF)) code = 0xFFFD;
+        } else {
+            NSUInteger nameStart = end;
+            while (end < length && end - nameStart <= HTML_ENTITY_NAME_MAX && src[end] != ';' && src[end] != '&') end++;
+            if (end == length || src[end] != ';') {
+                i++;
+                continue;
+            }
+            code = YYHTMLEntityLookup(src + nameStart, end - nameStart);
+            if (!code) {
+                i++;
+                continue;
+            }
+        }
+        
+        NSUInteger span = i - start;
+        memmove(dst + dstLength, src + start, span * sizeof(unichar));
+        dstLength += span;
+        if (code > 0xFFFF) {
+            code -= 0x10000;
+            dst[dstLength++] = 0xD800 + (code >> 10);
+            dst[dstLength++] = 0xDC00 + (code & 0x3FF);
+        } else {
+            dst[dstLength++] = code;
+        }
+        i = end + 1;
+        start = i;
+    }
+    NSUInteger span = length - start;
+    memmove(dst + dstLength, src + start, span * sizeof(unichar));
+    return dstLength + span;
+}
+
+
 @implementation NSString (YYAdd)
 
 - (NSString *)md2String {
@@ -96,6 +308,9 @@ YYSYNTH_DUMMY_CLASS(NSString_YYAdd)
 }
 
 - (NSString *)stringByURLEncode {
+    NSString *encoded = YYURLEncodeString(self);
+    if (encoded) return encoded;
+    
     if ([self respondsToSelector:@selector(stringByAddingPercentEncodingWithAllowedCharacters:)]) {
         /**
          AFNetworking/AFURLRequestSerialization.m
@@ -172,30 +387,40 @@ YYSYNTH_DUMMY_CLASS(NSString_YYAdd)
     NSUInteger len = self.length;
     if (!len) return self;
     
+    const unichar *src = CFStringGetCharactersPtr((CFStringRef)self);
+    unichar *buf = NULL;
+    if (!src) {
+        buf = malloc(sizeof(unichar) * len);
+        if (!buf) return self;
+        [self getCharacters:buf range:NSMakeRange(0, len)];
+        src = buf;
+    }
+    
+    NSUInteger resultLen = YYHTMLEscapeCharacters(src, len, NULL);
+    if (resultLen == len) { // nothing to escape
+        if (buf) free(buf);
+        return self.copy;
+    }
+    unichar *result = malloc(sizeof(unichar) * resultLen);
+    if (!result) {
+        if (buf) free(buf);
+        return self;
+    }
+    YYHTMLEscapeCharacters(src, len, result);
+    if (buf) free(buf);
+    return [[NSString alloc] initWithCharactersNoCopy:result length:resultLen freeWhenDone:YES];
+}
+
+- (NSString *)stringByUnescapingHTML {
+    NSUInteger len = self.length;
+    if (!len) return self;
+    if ([self rangeOfString:@"&" options:NSLiteralSearch].location == NSNotFound) return self.copy;
+    
     unichar *buf = malloc(sizeof(unichar) * len);
     if (!buf) return self;
     [self getCharacters:buf range:NSMakeRange(0, len)];
-    
-    NSMutableString *result = [NSMutableString string];
-    for (int i = 0; i < len; i++) {
-        unichar c = buf[i];
-        NSString *esc = nil;
-        switch (c) {
-            case 34: esc = @"&quot;"; break;
-            case 38: esc = @"&amp;"; break;
-            case 39: esc = @"&apos;"; break;
-            case 60: esc = @"&lt;"; break;
-            case 62: esc = @"&gt;"; break;
-            default: break;
-        }
-        if (esc) {
-            [result appendString:esc];
-        } else {
-            CFStringAppendCharacters((CFMutableStringRef)result, &c, 1);
-        }
-    }
-    free(buf);
-    return result;
+    NSUInteger resultLen = YYHTMLUnescapeCharacters(buf, len, buf); // in place
+    return [[NSString alloc] initWithCharactersNoCopy:buf length:resultLen freeWhenDone:YES];
 }
 
 - (CGSize)sizeForFont:(UIFont *)font size:(CGSize)size mode:(NSLineBreakMode)lineBreakMode {
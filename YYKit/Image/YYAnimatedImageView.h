@@ -59,6 +59,18 @@ NS_ASSUME_NONNULL_BEGIN
  */
 @property (nonatomic, readonly) BOOL currentIsPlayingAnimation;
 
+/**
+ The count of display frames dropped since the current image was set: it's increased
+ on every display tick (of the animation timer) on which the due image frame is not
+ decoded yet, so the animation is held on the current frame. A stall which lasts
+ 100ms on a 60Hz screen counts 6.
+ 
+ All animated image views share a global frame scheduler which decodes frames
+ with a time budget per display tick, and the views with nearest deadline are
+ served first. You can use this value to measure the playback smoothness.
+ */
+@property (nonatomic, readonly) NSUInteger droppedFrameCount;
+
 /**
  The animation timer's runloop mode, default is `NSRunLoopCommonModes`.
  
@@ -121,6 +133,12 @@ NS_ASSUME_NONNULL_BEGIN
 /// will be displayed. The rectangle should not outside the image's bounds.
 /// It may used to display sprite animation with a single image (sprite sheet).
 - (CGRect)animatedImageContentsRectAtIndex:(NSUInteger)index;
+
+/// Called by the image view with the max count of decoded frames it buffers for this
+/// image, or 0 when the buffer is cleared (memory warning, background). The image may
+/// use it to decide how many spare frame bitmaps should be kept for reuse.
+/// This method may be called on background thread.
+- (void)animatedImageSetMaxBufferCount:(NSUInteger)count;
 @end
 
 NS_ASSUME_NONNULL_END
@@ -14,8 +14,11 @@
 #import "UIDevice+YYAdd.h"
 #import "YYImageCoder.h"
 #import "YYKitMacro.h"
+#import <libkern/OSAtomic.h>
 
 #define BUFFER_SIZE (10 * 1024 * 1024) // 10MB (minimum memory buffer size)
+#define FETCH_BUDGET_RATIO 0.8 // decode time budget per display tick (ratio of tick duration)
+#define FETCH_QUEUE_MAX_COUNT 8 // max decoding queue count (one per active CPU)
 
 #define LOCK(...) dispatch_semaphore_wait(self->_lock, DISPATCH_TIME_FOREVER); \
 __VA_ARGS__; \
@@ -34,12 +37,15 @@ typedef NS_ENUM(NSUInteger, YYAnimatedImageType) {
     YYAnimatedImageTypeHighlightedImages,
 };
 
+@class _YYAnimatedImageViewFetchRequest;
+
 @interface YYAnimatedImageView() {
     @package
     UIImage <YYAnimatedImage> *_curAnimatedImage;
     
     dispatch_semaphore_t _lock; ///< lock for _buffer
-    NSOperationQueue *_requestQueue; ///< image request queue, serial
+    _YYAnimatedImageViewFetchRequest *_fetchRequest; ///< current frame fetch request
+    NSUInteger _fetchQueueIndex; ///< the scheduler's queue which decodes this view's frames
     
     CADisplayLink *_link; ///< ticker for change frame
     NSTimeInterval _time; ///< time after last frame
@@ -54,6 +60,7 @@ typedef NS_ENUM(NSUInteger, YYAnimatedImageType) {
     
     NSMutableDictionary *_buffer; ///< frame buffer
     BOOL _bufferMiss; ///< whether miss frame on last opportunity
+    NSUInteger _droppedFrameCount; ///< display ticks missed since the image was set
     NSUInteger _maxBufferCount; ///< maximum buffer count
     NSInteger _incrBufferCount; ///< current allowed buffer count (will increase by step)
     
@@ -64,34 +71,51 @@ typedef NS_ENUM(NSUInteger, YYAnimatedImageType) {
 - (void)calcMaxBufferCount;
 @end
 
-/// An operation for image fetch
-@interface _YYAnimatedImageViewFetchOperation : NSOperation
+/// A request to fetch (decode) the future frames for a view.
+@interface _YYAnimatedImageViewFetchRequest : NSObject
 @property (nonatomic, weak) YYAnimatedImageView *view;
 @property (nonatomic, assign) NSUInteger nextIndex;
 @property (nonatomic, strong) UIImage <YYAnimatedImage> *curImage;
+@property (nonatomic, assign) NSTimeInterval deadline; ///< media time when the view needs the next frame
+@property (nonatomic, assign) NSUInteger queueIndex; ///< the scheduler's queue to run this request
+@property (atomic, assign, getter=isCancelled) BOOL cancelled;
+@property (atomic, assign, getter=isFinished) BOOL finished;
+- (void)fetchNextFrame;
 @end
 
-@implementation _YYAnimatedImageViewFetchOperation
-- (void)main {
-    __strong YYAnimatedImageView *view = _view;
-    if (!view) return;
-    if ([self isCancelled]) return;
-    view->_incrBufferCount++;
-    if (view->_incrBufferCount == 0) [view calcMaxBufferCount];
-    if (view->_incrBufferCount > (NSInteger)view->_maxBufferCount) {
-        view->_incrBufferCount = view->_maxBufferCount;
+@implementation _YYAnimatedImageViewFetchRequest {
+    BOOL _started;
+    NSUInteger _remainCount; ///< frames remain to check
+    NSUInteger _totalCount;
+}
+
+/// Decode at most one missing frame, called on the view's queue of the scheduler.
+- (void)fetchNextFrame {
+    if (!_started) {
+        _started = YES;
+        __strong YYAnimatedImageView *view = _view;
+        if (!view || [self isCancelled]) {
+            self.finished = YES;
+            return;
+        }
+        view->_incrBufferCount++;
+        if (view->_incrBufferCount == 0) [view calcMaxBufferCount];
+        if (view->_incrBufferCount > (NSInteger)view->_maxBufferCount) {
+            view->_incrBufferCount = view->_maxBufferCount;
+        }
+        _remainCount = view->_incrBufferCount < 1 ? 1 : view->_incrBufferCount;
+        _totalCount = view->_totalFrameCount;
+        view = nil;
     }
-    NSUInteger idx = _nextIndex;
-    NSUInteger max = view->_incrBufferCount < 1 ? 1 : view->_incrBufferCount;
-    NSUInteger total = view->_totalFrameCount;
-    view = nil;
     
-    for (int i = 0; i < max; i++, idx++) {
+    while (_remainCount > 0) {
         @autoreleasepool {
-            if (idx >= total) idx = 0;
+            if (_nextIndex >= _totalCount) _nextIndex = 0;
             if ([self isCancelled]) break;
             __strong YYAnimatedImageView *view = _view;
             if (!view) break;
+            NSUInteger idx = _nextIndex++;
+            _remainCount--;
             LOCK_VIEW(BOOL miss = (view->_buffer[@(idx)] == nil));
             if (miss) {
                 UIImage *img = [_curImage animatedImageFrameAtIndex:idx];
@@ -99,9 +123,129 @@ typedef NS_ENUM(NSUInteger, YYAnimatedImageType) {
                 if ([self isCancelled]) break;
                 LOCK_VIEW(view->_buffer[@(idx)] = img ? img : [NSNull null]);
                 view = nil;
+                if (_remainCount > 0) return; // give other views a chance
             }
         }
     }
+    self.finished = YES;
+}
+@end
+
+
+/**
+ A global frame scheduler shared by all animated image views.
+ 
+ The frames are decoded on a small set of serial queues (one per active CPU), and
+ each view is assigned to one of them in round-robin, so a view's frames are still
+ decoded serially. On each display tick, every queue decodes frames for at most
+ FETCH_BUDGET_RATIO of the tick duration, one frame at a time, and always serves
+ its request with the nearest deadline first, so many animated views on screen
+ will not burst the decoding work.
+ */
+@interface _YYAnimatedImageFrameScheduler : NSObject
++ (instancetype)sharedScheduler;
+- (NSUInteger)assignQueueIndex; ///< returns a queue for a new view (round-robin)
+- (void)addRequest:(_YYAnimatedImageViewFetchRequest *)request; ///< main thread
+- (void)dispatchBlock:(void (^)(void))block queueIndex:(NSUInteger)index; ///< run block serially with the decoding on the queue
+@end
+
+@implementation _YYAnimatedImageFrameScheduler {
+    dispatch_semaphore_t _lock; ///< lock for _requests and _working
+    NSMutableArray *_requests;  ///< Array<_YYAnimatedImageViewFetchRequest>, pending requests
+    NSUInteger _queueCount;
+    dispatch_queue_t _queues[FETCH_QUEUE_MAX_COUNT];
+    BOOL _working[FETCH_QUEUE_MAX_COUNT]; ///< whether the queue is decoding
+    int32_t _counter;
+    CADisplayLink *_link;
+}
+
++ (instancetype)sharedScheduler {
+    static _YYAnimatedImageFrameScheduler *scheduler;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        scheduler = [self new];
+    });
+    return scheduler;
+}
+
+- (instancetype)init {
+    self = [super init];
+    _lock = dispatch_semaphore_create(1);
+    _requests = [NSMutableArray new];
+    _queueCount = [NSProcessInfo processInfo].activeProcessorCount;
+    _queueCount = YY_CLAMP(_queueCount, 1, FETCH_QUEUE_MAX_COUNT);
+    for (NSUInteger i = 0; i < _queueCount; i++) {
+        _queues[i] = dispatch_queue_create("com.ibireme.yykit.animatedimage.fetch", DISPATCH_QUEUE_SERIAL);
+    }
+    dispatch_sync_on_main_queue(^{
+        _link = [CADisplayLink displayLinkWithTarget:[YYWeakProxy proxyWithTarget:self] selector:@selector(tick:)];
+        [_link addToRunLoop:[NSRunLoop mainRunLoop] forMode:NSRunLoopCommonModes];
+        _link.paused = YES;
+    });
+    return self;
+}
+
+- (NSUInteger)assignQueueIndex {
+    int32_t cur = OSAtomicIncrement32(&_counter);
+    if (cur < 0) cur = -cur;
+    return (NSUInteger)cur % _queueCount;
+}
+
+- (void)addRequest:(_YYAnimatedImageViewFetchRequest *)request {
+    LOCK([_requests addObject:request]);
+    _link.paused = NO;
+}
+
+- (void)dispatchBlock:(void (^)(void))block queueIndex:(NSUInteger)index {
+    dispatch_async(_queues[index % _queueCount], block);
+}
+
+- (void)tick:(CADisplayLink *)link {
+    NSTimeInterval budget = link.duration * FETCH_BUDGET_RATIO;
+    BOOL start[FETCH_QUEUE_MAX_COUNT] = {0};
+    LOCK(
+         if (_requests.count == 0) {
+             _link.paused = YES;
+         } else {
+             for (_YYAnimatedImageViewFetchRequest *request in _requests) {
+                 NSUInteger index = request.queueIndex % _queueCount;
+                 if (!_working[index]) {
+                     _working[index] = YES;
+                     start[index] = YES;
+                 }
+             }
+         }
+    )//LOCK
+    for (NSUInteger i = 0; i < _queueCount; i++) {
+        if (!start[i]) continue;
+        dispatch_async(_queues[i], ^{
+            NSTimeInterval begin = CACurrentMediaTime();
+            do {
+                _YYAnimatedImageViewFetchRequest *request = [self nextRequestForQueueIndex:i];
+                if (!request) break;
+                [request fetchNextFrame];
+            } while (CACurrentMediaTime() - begin < budget);
+            LOCK(_working[i] = NO);
+        });
+    }
+}
+
+/// Remove the finished requests, and returns the queue's request with the nearest deadline.
+- (_YYAnimatedImageViewFetchRequest *)nextRequestForQueueIndex:(NSUInteger)index {
+    _YYAnimatedImageViewFetchRequest *next = nil;
+    LOCK(
+         for (NSInteger i = (NSInteger)_requests.count - 1; i >= 0; i--) {
+             _YYAnimatedImageViewFetchRequest *request = _requests[i];
+             if ([request isCancelled] || [request isFinished] || !request.view) {
+                 [_requests removeObjectAtIndex:i];
+             } else if (request.queueIndex % _queueCount != index) {
+                 continue;
+             } else if (!next || request.deadline <= next.deadline) {
+                 next = request;
+             }
+         }
+    )//LOCK
+    return next;
 }
 @end
 
@@ -146,19 +290,18 @@ typedef NS_ENUM(NSUInteger, YYAnimatedImageType) {
     if (!_link) {
         _lock = dispatch_semaphore_create(1);
         _buffer = [NSMutableDictionary new];
-        _requestQueue = [[NSOperationQueue alloc] init];
-        _requestQueue.maxConcurrentOperationCount = 1;
         _link = [CADisplayLink displayLinkWithTarget:[YYWeakProxy proxyWithTarget:self] selector:@selector(step:)];
         if (_runloopMode) {
             [_link addToRunLoop:[NSRunLoop mainRunLoop] forMode:_runloopMode];
         }
         _link.paused = YES;
+        _fetchQueueIndex = [[_YYAnimatedImageFrameScheduler sharedScheduler] assignQueueIndex];
         
         [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(didReceiveMemoryWarning:) name:UIApplicationDidReceiveMemoryWarningNotification object:nil];
         [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(didEnterBackground:) name:UIApplicationDidEnterBackgroundNotification object:nil];
     }
     
-    [_requestQueue cancelAllOperations];
+    [self cancelFetchRequest];
     LOCK(
          if (_buffer.count) {
              NSMutableDictionary *holder = _buffer;
@@ -184,9 +327,15 @@ typedef NS_ENUM(NSUInteger, YYAnimatedImageType) {
     _totalFrameCount = 1;
     _loopEnd = NO;
     _bufferMiss = NO;
+    _droppedFrameCount = 0;
     _incrBufferCount = 0;
 }
 
+- (void)cancelFetchRequest {
+    _fetchRequest.cancelled = YES;
+    _fetchRequest = nil;
+}
+
 - (void)setImage:(UIImage *)image {
     if (self.image == image) return;
     [self setImage:image withType:YYAnimatedImageTypeImage];
@@ -302,10 +451,19 @@ typedef NS_ENUM(NSUInteger, YYAnimatedImageType) {
     double maxBufferCount = (double)max / (double)bytes;
     maxBufferCount = YY_CLAMP(maxBufferCount, 1, 512);
     _maxBufferCount = maxBufferCount;
+    [self updateImageMaxBufferCount:_maxBufferCount];
+}
+
+// let the image size its frame bitmap pool with the buffer count.
+- (void)updateImageMaxBufferCount:(NSUInteger)count {
+    UIImage <YYAnimatedImage> *image = _curAnimatedImage;
+    if ([image respondsToSelector:@selector(animatedImageSetMaxBufferCount:)]) {
+        [image animatedImageSetMaxBufferCount:count];
+    }
 }
 
 - (void)dealloc {
-    [_requestQueue cancelAllOperations];
+    _fetchRequest.cancelled = YES;
     [[NSNotificationCenter defaultCenter] removeObserver:self name:UIApplicationDidReceiveMemoryWarningNotification object:nil];
     [[NSNotificationCenter defaultCenter] removeObserver:self name:UIApplicationDidEnterBackgroundNotification object:nil];
     [_link invalidate];
@@ -317,7 +475,7 @@ typedef NS_ENUM(NSUInteger, YYAnimatedImageType) {
 
 - (void)stopAnimating {
     [super stopAnimating];
-    [_requestQueue cancelAllOperations];
+    [self cancelFetchRequest];
     _link.paused = YES;
     self.currentIsPlayingAnimation = NO;
 }
@@ -341,8 +499,8 @@ typedef NS_ENUM(NSUInteger, YYAnimatedImageType) {
 }
 
 - (void)didReceiveMemoryWarning:(NSNotification *)notification {
-    [_requestQueue cancelAllOperations];
-    [_requestQueue addOperationWithBlock: ^{
+    [self cancelFetchRequest];
+    [[_YYAnimatedImageFrameScheduler sharedScheduler] dispatchBlock:^{
         _incrBufferCount = -60 - (int)(arc4random() % 120); // about 1~3 seconds to grow back..
         NSNumber *next = @((_curIndex + 1) % _totalFrameCount);
         LOCK(
@@ -353,11 +511,12 @@ typedef NS_ENUM(NSUInteger, YYAnimatedImageType) {
                  }
              }
         )//LOCK
-    }];
+        [self updateImageMaxBufferCount:0]; // free the spare bitmaps, grow back with the buffer
+    } queueIndex:_fetchQueueIndex];
 }
 
 - (void)didEnterBackground:(NSNotification *)notification {
-    [_requestQueue cancelAllOperations];
+    [self cancelFetchRequest];
     NSNumber *next = @((_curIndex + 1) % _totalFrameCount);
     LOCK(
          NSArray * keys = _buffer.allKeys;
@@ -367,6 +526,7 @@ typedef NS_ENUM(NSUInteger, YYAnimatedImageType) {
              }
          }
      )//LOCK
+    [self updateImageMaxBufferCount:0];
 }
 
 - (void)step:(CADisplayLink *)link {
@@ -420,6 +580,7 @@ typedef NS_ENUM(NSUInteger, YYAnimatedImageType) {
                  bufferIsFull = YES;
              }
          } else {
+             _droppedFrameCount++;
              _bufferMiss = YES;
          }
     )//LOCK
@@ -428,12 +589,16 @@ typedef NS_ENUM(NSUInteger, YYAnimatedImageType) {
         [self.layer setNeedsDisplay]; // let system call `displayLayer:` before runloop sleep
     }
     
-    if (!bufferIsFull && _requestQueue.operationCount == 0) { // if some work not finished, wait for next opportunity
-        _YYAnimatedImageViewFetchOperation *operation = [_YYAnimatedImageViewFetchOperation new];
-        operation.view = self;
-        operation.nextIndex = nextIndex;
-        operation.curImage = image;
-        [_requestQueue addOperation:operation];
+    if (!bufferIsFull && (!_fetchRequest || [_fetchRequest isFinished])) { // if some work not finished, wait for next opportunity
+        _YYAnimatedImageViewFetchRequest *request = [_YYAnimatedImageViewFetchRequest new];
+        request.view = self;
+        request.nextIndex = nextIndex;
+        request.curImage = image;
+        NSTimeInterval remain = _bufferMiss ? 0 : [image animatedImageDurationAtIndex:_curIndex] - _time;
+        request.deadline = CACurrentMediaTime() + MAX(remain, 0); // late views first
+        request.queueIndex = _fetchQueueIndex;
+        _fetchRequest = request;
+        [[_YYAnimatedImageFrameScheduler sharedScheduler] addRequest:request];
     }
 }
 
@@ -491,7 +656,7 @@ typedef NS_ENUM(NSUInteger, YYAnimatedImageType) {
     
     dispatch_async_on_main_queue(^{
         LOCK(
-             [_requestQueue cancelAllOperations];
+             [self cancelFetchRequest];
              [_buffer removeAllObjects];
              [self willChangeValueForKey:@"currentAnimatedImageIndex"];
              _curIndex = currentAnimatedImageIndex;
@@ -512,6 +677,10 @@ typedef NS_ENUM(NSUInteger, YYAnimatedImageType) {
     return _curIndex;
 }
 
+- (NSUInteger)droppedFrameCount {
+    return _droppedFrameCount;
+}
+
 - (void)setRunloopMode:(NSString *)runloopMode {
     if ([_runloopMode isEqual:runloopMode]) return;
     if (_link) {
@@ -46,6 +46,19 @@ NS_ASSUME_NONNULL_BEGIN
 + (nullable YYImage *)imageWithData:(NSData *)data;
 + (nullable YYImage *)imageWithData:(NSData *)data scale:(CGFloat)scale;
 
+/**
+ Creates an image with a finalized decoder, so the data which is already parsed
+ (for example, to check the frame count) is not parsed again.
+ 
+ @discussion If the image has multiple frames, the decoder is retained by the image
+ to decode the animation frames; you should not use it in other place after this call.
+ The image's scale is the decoder's scale.
+ 
+ @param decoder  A finalized decoder.
+ @return A new image, or nil if an error occurs.
+ */
+- (nullable instancetype)initWithDecoder:(YYImageDecoder *)decoder;
+
 /**
  If the image is created from data or file, then the value indicates the data type.
  */
@@ -13,6 +13,8 @@
 #import "NSString+YYAdd.h"
 #import "NSBundle+YYAdd.h"
 
+#define FRAME_BUFFER_POOL_MIN_CAPACITY 1 // spare frame bitmaps kept before a view sets its buffer count
+
 @implementation YYImage {
     YYImageDecoder *_decoder;
     NSArray *_preloadedFrames;
@@ -73,9 +75,16 @@
 - (instancetype)initWithData:(NSData *)data scale:(CGFloat)scale {
     if (data.length == 0) return nil;
     if (scale <= 0) scale = [UIScreen mainScreen].scale;
+    YYImageDecoder *decoder = [YYImageDecoder decoderWithData:data scale:scale];
+    if (!decoder) return nil;
+    return [self initWithDecoder:decoder];
+}
+
+- (instancetype)initWithDecoder:(YYImageDecoder *)decoder {
+    if (!decoder.isFinalized) return nil;
     _preloadedLock = dispatch_semaphore_create(1);
     @autoreleasepool {
-        YYImageDecoder *decoder = [YYImageDecoder decoderWithData:data scale:scale];
+        if (decoder.frameCount > 1) decoder.frameBufferPoolCapacity = FRAME_BUFFER_POOL_MIN_CAPACITY;
         YYImageFrame *frame = [decoder frameAtIndex:0 decodeForDisplay:YES];
         UIImage *image = frame.image;
         if (!image) return nil;
@@ -168,6 +177,17 @@
     return [_decoder frameAtIndex:index decodeForDisplay:YES].image;
 }
 
+- (void)animatedImageSetMaxBufferCount:(NSUInteger)count {
+    if (!_decoder) return;
+    /*
+     The view releases a buffered frame after it is displayed and decodes the next
+     one, so at most `count` bitmaps are released before they can be reused. If all
+     the frames are buffered, no frame is released and no spare bitmap is needed.
+     */
+    NSUInteger capacity = count < _decoder.frameCount ? count : 0;
+    _decoder.frameBufferPoolCapacity = MAX(capacity, FRAME_BUFFER_POOL_MIN_CAPACITY);
+}
+
 - (NSTimeInterval)animatedImageDurationAtIndex:(NSUInteger)index {
     NSTimeInterval duration = [_decoder frameDurationAtIndex:index];
     
@@ -79,6 +79,17 @@ typedef NS_OPTIONS(NSUInteger, YYImageCacheType) {
  */
 @property BOOL decodeForDisplay;
 
+/**
+ The target pixel size to decode the image. Default is CGSizeZero (full size).
+ 
+ @discussion If the value is not zero, the non-animated image larger than this size
+ will be decoded at a smaller size (see `-[YYImageDecoder frameAtIndex:targetPixelSize:decodeForDisplay:]`)
+ when fetch image from disk cache or web, and the memory cache cost is the smaller
+ bitmap's size. It's useful for a cache which is dedicated to thumbnails. The disk
+ cache still keeps the original image data.
+ */
+@property CGSize decodeTargetPixelSize;
+
 
 #pragma mark - Initializer
 ///=============================================================================
@@ -64,7 +64,16 @@ static inline dispatch_queue_t YYImageCacheDecodeQueue() {
     }
     if (scale <= 0) scale = [UIScreen mainScreen].scale;
     UIImage *image;
-    if (_allowAnimatedImage) {
+    CGSize targetPixelSize = self.decodeTargetPixelSize;
+    if (targetPixelSize.width > 0 && targetPixelSize.height > 0) {
+        YYImageDecoder *decoder = [YYImageDecoder decoderWithData:data scale:scale];
+        if (_allowAnimatedImage && decoder.frameCount > 1) {
+            image = [[YYImage alloc] initWithDecoder:decoder]; // don't parse the data again
+            if (_decodeForDisplay) image = [image imageByDecoded];
+        } else {
+            image = [decoder frameAtIndex:0 targetPixelSize:targetPixelSize decodeForDisplay:_decodeForDisplay].image;
+        }
+    } else if (_allowAnimatedImage) {
         image = [[YYImage alloc] initWithData:data scale:scale];
         if (_decodeForDisplay) image = [image imageByDecoded];
     } else {
@@ -28,6 +28,7 @@ typedef NS_ENUM(NSUInteger, YYImageType) {
     YYImageTypePNG,         ///< png
     YYImageTypeWebP,        ///< webp
     YYImageTypeOther,       ///< other image format
+    YYImageTypePreDecoded,  ///< YYImage's pre-decoded animation, see `-[YYImageDecoder preDecodedAnimationData]`
 };
 
 
@@ -139,6 +140,16 @@ typedef NS_ENUM(NSUInteger, YYImageBlendOperation) {
 @property (nonatomic, readonly) NSUInteger height;         ///< Image canvas height.
 @property (nonatomic, readonly, getter=isFinalized) BOOL finalized;
 
+/**
+ The max count of free frame bitmaps kept for reuse, default is 0 (no pool).
+ 
+ @discussion If the value is not zero, the frames decoded for display at canvas size
+ are rendered into identically sized bitmaps (bytesPerRow * height) from a pool, and
+ the bitmap is returned to the pool when the frame image is released. In this way, 
+ playing an animation does no bitmap allocation in steady state.
+ */
+@property (nonatomic) NSUInteger frameBufferPoolCapacity;
+
 /**
  Creates an image decoder.
  
@@ -166,6 +177,34 @@ typedef NS_ENUM(NSUInteger, YYImageBlendOperation) {
  */
 - (BOOL)updateData:(nullable NSData *)data final:(BOOL)final;
 
+/**
+ Appends the newly arrived data to the incremental image (streaming decode).
+ 
+ @discussion Unlike `updateData:final:`, you only need to pass the bytes which
+ arrived after the last call. The bytes are copied to an append-only buffer owned
+ by the decoder, so the caller does not need to keep the accumulated data: the
+ `data` property returns an immutable view of all the bytes appended so far
+ (without copying). The bytes in this view are never changed by later calls.
+ 
+ On each call, non-animated WebP only feeds the new bytes to libwebp's incremental
+ decoder, and the rows decoded so far can be displayed. Other formats pass the
+ accumulated bytes to ImageIO's incremental image source with
+ `CGImageSourceUpdateData()`, and ImageIO continues decoding from where it stopped.
+ The frame info (size, count) is refreshed on each call. Animated WebP and APNG
+ are parsed when the data is finalized.
+ 
+ You should not mix this method with `updateData:final:` on the same decoder.
+ 
+ @param data  The new data (not the accumulated data), the data is copied.
+ 
+ @param final  A value that specifies whether the data is the last piece.
+ Pass YES if it is, NO otherwise. When the data is already finalized, you can
+ not append the data anymore.
+ 
+ @return Whether succeed.
+ */
+- (BOOL)appendData:(nullable NSData *)data final:(BOOL)final;
+
 /**
  Convenience method to create a decoder with specified data.
  @param data  Image data.
@@ -185,6 +224,24 @@ typedef NS_ENUM(NSUInteger, YYImageBlendOperation) {
  */
 - (nullable YYImageFrame *)frameAtIndex:(NSUInteger)index decodeForDisplay:(BOOL)decodeForDisplay;
 
+/**
+ Decodes and returns a frame from a specified index at a smaller pixel size.
+ 
+ @discussion The image's pixel size is the smallest size (keeping the aspect ratio)
+ that fills the target size, so a thumbnail doesn't cost the full resolution bitmap
+ memory. The image is decoded with the codec's scaled decoding if possible (ImageIO's
+ thumbnail for JPEG/PNG..., libwebp's scaling for WebP), animated frames are composited
+ in full size and then scaled down (the result is always decoded in this case).
+ 
+ @param index  Frame image index (zero-based).
+ @param targetPixelSize  The target size in pixels (in display orientation). If the
+    image is not larger than this size, the frame is decoded in full size.
+ @param decodeForDisplay Whether decode the image to memory bitmap for display,
+    same as `frameAtIndex:decodeForDisplay:`.
+ @return A new frame with image, or nil if an error occurs.
+ */
+- (nullable YYImageFrame *)frameAtIndex:(NSUInteger)index targetPixelSize:(CGSize)targetPixelSize decodeForDisplay:(BOOL)decodeForDisplay;
+
 /**
  Returns the frame duration from a specified index.
  @param index  Frame image (zero-based).
@@ -208,6 +265,24 @@ typedef NS_ENUM(NSUInteger, YYImageBlendOperation) {
 #warning zll CGImageProperties
 - (nullable NSDictionary *)imageProperties;
 
+/**
+ Creates the pre-decoded animation data of the image.
+ 
+ @discussion The pre-decoded animation data stores each frame's changed region 
+ (compared with the previous frame) as premultiplied BGRA pixels compressed with
+ LZ4, and a full frame every 32 frames. Decoding a frame from this data is just
+ decompress and copy pixels, which costs much less CPU than decoding GIF/APNG/WebP.
+ The data is larger than the original data, you may store it on disk (for example
+ in YYImageCache's disk cache), and decode it later with memory-mapped data. 
+ YYImageDecoder (and YYImage) detects the data as `YYImageTypePreDecoded`.
+ 
+ This method decodes all frames, you should call it in background thread.
+ 
+ @return The pre-decoded animation data, or nil if an error occurs (or the data is
+ not finalized).
+ */
+- (nullable NSData *)preDecodedAnimationData;
+
 @end
 
 
@@ -246,6 +321,25 @@ typedef NS_ENUM(NSUInteger, YYImageBlendOperation) {
 @property (nonatomic) BOOL lossless;              ///< Lossless, only available for WebP.
 @property (nonatomic) CGFloat quality;            ///< Compress quality, 0.0~1.0, only available for JPG/JP2/WebP.
 
+/**
+ The max count of frames encoded concurrently, only available for APNG/WebP.
+ Default is the active processor count, 1 means the frames are encoded serially.
+ 
+ @discussion Frames are encoded on background threads, and then muxed in order.
+ Each frame being encoded holds its decoded bitmap, so you may use a smaller value
+ to reduce the peak memory when encoding large images.
+ */
+@property (nonatomic) NSUInteger maxConcurrentFrameCount;
+
+/**
+ Whether to use libwebp's multi-threaded encoding for each frame, only available
+ for WebP. Default is NO.
+ 
+ @discussion It is useful for single frame image or when `maxConcurrentFrameCount` is 1,
+ otherwise the frames are already encoded concurrently.
+ */
+@property (nonatomic) BOOL useThreads;
+
 - (instancetype)init UNAVAILABLE_ATTRIBUTE;
 + (instancetype)new UNAVAILABLE_ATTRIBUTE;
 
@@ -373,6 +467,43 @@ CG_EXTERN YYImageType YYImageTypeFromUTType(CFStringRef uti);
 /// Get image type's file extension (such as @"jpg").
 CG_EXTERN NSString *_Nullable YYImageTypeGetExtension(YYImageType type);
 
+/// Image header information, see `YYImageProbeData()` and `YYImageProbeFile()`.
+typedef struct {
+    YYImageType type;               ///< Image type.
+    NSUInteger width;               ///< Pixel width (before orientation applied).
+    NSUInteger height;              ///< Pixel height (before orientation applied).
+    NSUInteger frameCount;          ///< Frame count, 0 if unknown.
+    UIImageOrientation orientation; ///< EXIF orientation (JPEG only), default is Up.
+} YYImageProbeInfo;
+
+/**
+ Get image's size, frame count and orientation by parsing the data's header,
+ without creating a decoder or decoding pixels.
+ 
+ @discussion It supports JPEG (SOF and EXIF orientation), PNG/APNG (IHDR and acTL),
+ GIF (logical screen and image descriptors) and WebP (VP8, VP8L and VP8X).
+ For other image types, it only sets the info's type.
+ 
+ @param data  Image data.
+ @param info  The info to fill.
+ @return Whether the size was found.
+ */
+CG_EXTERN BOOL YYImageProbeData(CFDataRef data, YYImageProbeInfo *info);
+
+/**
+ Same as `YYImageProbeData()`, but reads the header from file.
+ 
+ @discussion It reads the file's first 4KB, and reads at most 4KB more with small
+ reads when needed (for example, a JPEG's SOF marker after a large EXIF segment,
+ or WebP's frame chunks). The GIF's frames are only counted in the first 4KB, 
+ so the frame count is 0 (unknown) for a larger animated GIF.
+ 
+ @param path  Image file path.
+ @param info  The info to fill.
+ @return Whether the size was found.
+ */
+CG_EXTERN BOOL YYImageProbeFile(NSString *path, YYImageProbeInfo *info);
+
 
 
 /// Returns the shared DeviceRGB color space.
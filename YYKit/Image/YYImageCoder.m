@@ -19,6 +19,9 @@
 #import <objc/runtime.h>
 #import <pthread.h>
 #import <zlib.h>
+#import <libkern/OSAtomic.h>
+#import <fcntl.h>
+#import <sys/stat.h>
 #import "YYImage.h"
 #import "YYKitMacro.h"
 
@@ -66,6 +69,109 @@ static inline uint32_t yy_swap_endian_uint32(uint32_t value) {
     (uint32_t)((value & 0xFF000000U) >> 24) ;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+#pragma mark - Blend (premultiplied BGRA8888)
+
+/*
+ Compositing kernels for the animated image canvas. All pixels are 32bit
+ premultiplied (kCGBitmapByteOrder32Host | kCGImageAlphaPremultipliedFirst),
+ so the channel order doesn't matter except the alpha in the highest byte.
+ 
+ OVER:  dst = src + dst * (255 - src.alpha) / 255
+ 
+ NEON (8 pixels) or SSE2 (4 pixels) is used when available, the tail pixels
+ are blended with scalar code, and the results are exactly the same.
+ */
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#import <arm_neon.h>
+#define YY_BLEND_NEON 1
+#elif defined(__SSE2__)
+#import <emmintrin.h>
+#define YY_BLEND_SSE2 1
+#endif
+
+/// (x / 255) with rounding, x should be in [0, 255 * 255]
+static inline uint32_t yy_blend_div255(uint32_t x) {
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+/// Blend a row of pixels over the destination row.
+static void yy_blend_over_row(const uint32_t *src, uint32_t *dst, uint32_t width) {
+    uint32_t x = 0;
+#if YY_BLEND_NEON
+    for (; x + 8 <= width; x += 8) {
+        uint8x8x4_t s = vld4_u8((const uint8_t *)(src + x));
+        uint8x8x4_t d = vld4_u8((const uint8_t *)(dst + x));
+        uint8x8_t ia = vmvn_u8(s.val[3]); // 255 - alpha
+        for (int c = 0; c < 4; c++) {
+            uint16x8_t t = vmull_u8(d.val[c], ia);
+            uint8x8_t v = vraddhn_u16(t, vrshrq_n_u16(t, 8)); // div255
+            d.val[c] = vqadd_u8(s.val[c], v);
+        }
+        vst4_u8((uint8_t *)(dst + x), d);
+    }
+#elif YY_BLEND_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i c255 = _mm_set1_epi16(255);
+    const __m128i c128 = _mm_set1_epi16(128);
+    for (; x + 4 <= width; x += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + x));
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + x));
+        __m128i s_lo = _mm_unpacklo_epi8(s, zero);
+        __m128i s_hi = _mm_unpackhi_epi8(s, zero);
+        __m128i ia_lo = _mm_sub_epi16(c255, _mm_shufflehi_epi16(_mm_shufflelo_epi16(s_lo, 0xFF), 0xFF));
+        __m128i ia_hi = _mm_sub_epi16(c255, _mm_shufflehi_epi16(_mm_shufflelo_epi16(s_hi, 0xFF), 0xFF));
+        __m128i t_lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), ia_lo), c128);
+        __m128i t_hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), ia_hi), c128);
+        t_lo = _mm_srli_epi16(_mm_add_epi16(t_lo, _mm_srli_epi16(t_lo, 8)), 8); // div255
+        t_hi = _mm_srli_epi16(_mm_add_epi16(t_hi, _mm_srli_epi16(t_hi, 8)), 8);
+        __m128i v = _mm_packus_epi16(t_lo, t_hi);
+        _mm_storeu_si128((__m128i *)(dst + x), _mm_adds_epu8(_mm_packus_epi16(s_lo, s_hi), v));
+    }
+#endif
+    for (; x < width; x++) {
+        uint32_t s = src[x];
+        uint32_t a = s >> 24;
+        if (a == 255) {
+            dst[x] = s;
+        } else if (a != 0) {
+            uint32_t d = dst[x], ia = 255 - a, result = 0;
+            for (int shift = 0; shift < 32; shift += 8) {
+                uint32_t c = ((s >> shift) & 0xFF) + yy_blend_div255(((d >> shift) & 0xFF) * ia);
+                result |= (c > 255 ? 255 : c) << shift;
+            }
+            dst[x] = result;
+        }
+    }
+}
+
+/// Blend the source region over the destination region.
+static void yy_blend_over(const uint8_t *src, size_t src_bytes_per_row,
+                          uint8_t *dst, size_t dst_bytes_per_row,
+                          uint32_t width, uint32_t height) {
+    for (uint32_t y = 0; y < height; y++) {
+        yy_blend_over_row((const uint32_t *)(src + y * src_bytes_per_row), (uint32_t *)(dst + y * dst_bytes_per_row), width);
+    }
+}
+
+/// Copy the source region to the destination region (blend op 'SOURCE').
+static void yy_blend_copy(const uint8_t *src, size_t src_bytes_per_row,
+                          uint8_t *dst, size_t dst_bytes_per_row,
+                          uint32_t width, uint32_t height) {
+    for (uint32_t y = 0; y < height; y++) {
+        memcpy(dst + y * dst_bytes_per_row, src + y * src_bytes_per_row, (size_t)width * 4);
+    }
+}
+
+/// Clear the destination region to transparent black (dispose op 'BACKGROUND').
+static void yy_blend_clear(uint8_t *dst, size_t dst_bytes_per_row, uint32_t width, uint32_t height) {
+    for (uint32_t y = 0; y < height; y++) {
+        memset(dst + y * dst_bytes_per_row, 0, (size_t)width * 4);
+    }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 #pragma mark - APNG
 
@@ -625,6 +731,578 @@ static uint8_t *yy_png_copy_frame_data_at_index(const uint8_t *data,
     return frame_data;
 }
 
+/*
+ Native APNG frame decoder.
+ 
+ The frame's `IDAT`/`fdAT` chunks are inflated one by one (without remux), then
+ the scanlines are unfiltered and converted to premultiplied BGRA8888 (same as
+ kCGBitmapByteOrder32Host | kCGImageAlphaPremultipliedFirst) and written to the
+ caller's buffer directly, so the frame can be rendered into the canvas in place.
+ 
+ Supported: bit depth 1/2/4/8/16, color type 0/2/3/4/6, no interlace.
+ Use yy_png_decoder_available() to check whether a png can be decoded.
+ */
+
+typedef struct {
+    z_stream stream;          ///< inflate stream, reused for each frame
+    bool stream_inited;       ///< whether the stream is inited
+    uint8_t *line_buf;        ///< two scanline buffers (previous, current)
+    size_t line_buf_size;     ///< line_buf's capacity in bytes
+    uint32_t *pixel_buf;      ///< converted scanline buffer for blend op 'OVER'
+    size_t pixel_buf_size;    ///< pixel_buf's capacity in bytes
+    uint32_t palette[256];    ///< premultiplied BGRA palette (with tRNS)
+    bool has_trns_key;        ///< whether gray/rgb image has a transparent key
+    uint16_t trns_key[3];     ///< transparent gray or rgb sample value
+} yy_png_decoder;
+
+static bool yy_png_decoder_available(const yy_png_info *info) {
+    const yy_png_chunk_IHDR *IHDR = &info->header;
+    if (IHDR->compression_method != 0 || IHDR->filter_method != 0) return false;
+    if (IHDR->interlace_method != 0) return false;
+    switch (IHDR->color_type) {
+        case 0: return IHDR->bit_depth == 1 || IHDR->bit_depth == 2 || IHDR->bit_depth == 4 || IHDR->bit_depth == 8 || IHDR->bit_depth == 16;
+        case 3: return IHDR->bit_depth == 1 || IHDR->bit_depth == 2 || IHDR->bit_depth == 4 || IHDR->bit_depth == 8;
+        case 2: case 4: case 6: return IHDR->bit_depth == 8 || IHDR->bit_depth == 16;
+        default: return false;
+    }
+}
+
+static inline uint32_t yy_png_premultiplied_bgra(uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+    if (a != 255) {
+        r = (r * a + 127) / 255;
+        g = (g * a + 127) / 255;
+        b = (b * a + 127) / 255;
+    }
+    return (uint32_t)b | ((uint32_t)g << 8) | ((uint32_t)r << 16) | ((uint32_t)a << 24);
+}
+
+static void yy_png_decoder_release(yy_png_decoder *decoder) {
+    if (!decoder) return;
+    if (decoder->stream_inited) inflateEnd(&decoder->stream);
+    if (decoder->line_buf) free(decoder->line_buf);
+    if (decoder->pixel_buf) free(decoder->pixel_buf);
+    free(decoder);
+}
+
+/**
+ Create a native decoder for apng frames.
+ 
+ @param data  apng file data
+ @param info  png info, yy_png_decoder_available() should returns true.
+ @return A decoder, you may call yy_png_decoder_release() to release it.
+ Returns NULL if an error occurs.
+ */
+static yy_png_decoder *yy_png_decoder_create(const uint8_t *data, const yy_png_info *info) {
+    if (!yy_png_decoder_available(info)) return NULL;
+    yy_png_decoder *decoder = calloc(1, sizeof(yy_png_decoder));
+    if (!decoder) return NULL;
+    if (inflateInit(&decoder->stream) != Z_OK) {
+        free(decoder);
+        return NULL;
+    }
+    decoder->stream_inited = true;
+    
+    const yy_png_chunk_info *PLTE = NULL, *tRNS = NULL;
+    for (uint32_t i = 0; i < info->chunk_num; i++) {
+        const yy_png_chunk_info *chunk = info->chunks + i;
+        if (chunk->fourcc == YY_FOUR_CC('P', 'L', 'T', 'E')) PLTE = chunk;
+        else if (chunk->fourcc == YY_FOUR_CC('t', 'R', 'N', 'S')) tRNS = chunk;
+    }
+    
+    uint8_t color_type = info->header.color_type;
+    if (color_type == 3) {
+        if (!PLTE || PLTE->length % 3 != 0 || PLTE->length > 768) {
+            yy_png_decoder_release(decoder);
+            return NULL;
+        }
+        const uint8_t *rgb = data + PLTE->offset + 8;
+        const uint8_t *alpha = tRNS ? data + tRNS->offset + 8 : NULL;
+        uint32_t alpha_num = tRNS ? tRNS->length : 0;
+        for (uint32_t i = 0, max = PLTE->length / 3; i < max; i++) {
+            uint8_t a = i < alpha_num ? alpha[i] : 255;
+            decoder->palette[i] = yy_png_premultiplied_bgra(rgb[i * 3], rgb[i * 3 + 1], rgb[i * 3 + 2], a);
+        }
+    } else if (tRNS) {
+        const uint8_t *key = data + tRNS->offset + 8;
+        if (color_type == 0 && tRNS->length >= 2) {
+            decoder->has_trns_key = true;
+            decoder->trns_key[0] = (key[0] << 8) | key[1];
+        } else if (color_type == 2 && tRNS->length >= 6) {
+            decoder->has_trns_key = true;
+            decoder->trns_key[0] = (key[0] << 8) | key[1];
+            decoder->trns_key[1] = (key[2] << 8) | key[3];
+            decoder->trns_key[2] = (key[4] << 8) | key[5];
+        }
+    }
+    return decoder;
+}
+
+/// Reverse the scanline filter, `prev` is zero for the first line.
+static bool yy_png_unfilter_line(uint8_t filter, uint8_t *cur, const uint8_t *prev, size_t row_bytes, size_t bpp) {
+    switch (filter) {
+        case 0: break;
+        case 1: { // sub
+            for (size_t i = bpp; i < row_bytes; i++) cur[i] += cur[i - bpp];
+        } break;
+        case 2: { // up
+            for (size_t i = 0; i < row_bytes; i++) cur[i] += prev[i];
+        } break;
+        case 3: { // average
+            for (size_t i = 0; i < bpp; i++) cur[i] += prev[i] >> 1;
+            for (size_t i = bpp; i < row_bytes; i++) cur[i] += (uint8_t)(((uint32_t)cur[i - bpp] + prev[i]) >> 1);
+        } break;
+        case 4: { // paeth
+            for (size_t i = 0; i < bpp; i++) cur[i] += prev[i];
+            for (size_t i = bpp; i < row_bytes; i++) {
+                int a = cur[i - bpp], b = prev[i], c = prev[i - bpp];
+                int p = a + b - c;
+                int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+                cur[i] += (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+            }
+        } break;
+        default: return false;
+    }
+    return true;
+}
+
+/// Convert an unfiltered scanline to premultiplied BGRA and write to dst.
+static void yy_png_decoder_write_line(const yy_png_decoder *decoder, const yy_png_chunk_IHDR *IHDR,
+                                      const uint8_t *line, uint32_t width, uint32_t *dst) {
+    uint8_t depth = IHDR->bit_depth;
+    for (uint32_t x = 0; x < width; x++) {
+        uint32_t pixel;
+        switch (IHDR->color_type) {
+            case 0: { // gray
+                uint16_t sample;
+                uint8_t gray;
+                if (depth == 16) {
+                    sample = (line[x * 2] << 8) | line[x * 2 + 1];
+                    gray = line[x * 2];
+                } else if (depth == 8) {
+                    sample = gray = line[x];
+                } else {
+                    uint32_t bit = x * depth;
+                    uint32_t mask = (1 << depth) - 1;
+                    sample = (line[bit >> 3] >> (8 - depth - (bit & 7))) & mask;
+                    gray = sample * 255 / mask;
+                }
+                uint8_t a = (decoder->has_trns_key && sample == decoder->trns_key[0]) ? 0 : 255;
+                pixel = yy_png_premultiplied_bgra(gray, gray, gray, a);
+            } break;
+            case 2: { // rgb
+                uint8_t r, g, b, a = 255;
+                if (depth == 16) {
+                    const uint8_t *p = line + x * 6;
+                    r = p[0]; g = p[2]; b = p[4];
+                    if (decoder->has_trns_key &&
+                        ((p[0] << 8) | p[1]) == decoder->trns_key[0] &&
+                        ((p[2] << 8) | p[3]) == decoder->trns_key[1] &&
+                        ((p[4] << 8) | p[5]) == decoder->trns_key[2]) a = 0;
+                } else {
+                    const uint8_t *p = line + x * 3;
+                    r = p[0]; g = p[1]; b = p[2];
+                    if (decoder->has_trns_key &&
+                        r == decoder->trns_key[0] && g == decoder->trns_key[1] && b == decoder->trns_key[2]) a = 0;
+                }
+                pixel = yy_png_premultiplied_bgra(r, g, b, a);
+            } break;
+            case 3: { // palette
+                uint8_t index;
+                if (depth == 8) {
+                    index = line[x];
+                } else {
+                    uint32_t bit = x * depth;
+                    index = (line[bit >> 3] >> (8 - depth - (bit & 7))) & ((1 << depth) - 1);
+                }
+                pixel = decoder->palette[index];
+            } break;
+            case 4: { // gray + alpha
+                const uint8_t *p = depth == 16 ? line + x * 4 : line + x * 2;
+                uint8_t gray = p[0], a = depth == 16 ? p[2] : p[1];
+                pixel = yy_png_premultiplied_bgra(gray, gray, gray, a);
+            } break;
+            default: { // rgba
+                const uint8_t *p = depth == 16 ? line + x * 8 : line + x * 4;
+                if (depth == 16) {
+                    pixel = yy_png_premultiplied_bgra(p[0], p[2], p[4], p[6]);
+                } else {
+                    pixel = yy_png_premultiplied_bgra(p[0], p[1], p[2], p[3]);
+                }
+            } break;
+        }
+        dst[x] = pixel;
+    }
+}
+
+/**
+ Decode an apng frame to a premultiplied BGRA8888 buffer.
+ 
+ @param decoder   native decoder
+ @param data      apng file data
+ @param info      png info
+ @param index     frame index (zero-based)
+ @param dst       the top-left pixel of the frame region in destination buffer
+ @param dst_bytes_per_row destination buffer's bytes per row
+ @param blend_over YES: blend the frame over the destination, NO: overwrite the destination
+ @return Whether succeed. The destination may be partially written if the frame data is broken.
+ */
+static bool yy_png_decoder_decode_frame(yy_png_decoder *decoder,
+                                        const uint8_t *data,
+                                        const yy_png_info *info,
+                                        const uint32_t index,
+                                        uint8_t *dst,
+                                        size_t dst_bytes_per_row,
+                                        bool blend_over) {
+    if (index >= info->apng_frame_num) return false;
+    const yy_png_frame_info *frame_info = info->apng_frames + index;
+    const yy_png_chunk_IHDR *IHDR = &info->header;
+    uint32_t width = frame_info->frame_control.width;
+    uint32_t height = frame_info->frame_control.height;
+    if (width == 0 || height == 0) return false;
+    
+    uint32_t channels = 1;
+    switch (IHDR->color_type) {
+        case 2: channels = 3; break;
+        case 4: channels = 2; break;
+        case 6: channels = 4; break;
+    }
+    size_t bits_per_pixel = channels * IHDR->bit_depth;
+    size_t row_bytes = ((size_t)width * bits_per_pixel + 7) / 8;
+    size_t bpp = bits_per_pixel >= 8 ? bits_per_pixel / 8 : 1;
+    size_t line_size = row_bytes + 1; // filter type + row
+    
+    if (decoder->line_buf_size < line_size * 2) {
+        uint8_t *buf = realloc(decoder->line_buf, line_size * 2);
+        if (!buf) return false;
+        decoder->line_buf = buf;
+        decoder->line_buf_size = line_size * 2;
+    }
+    if (blend_over && decoder->pixel_buf_size < (size_t)width * 4) {
+        uint32_t *buf = realloc(decoder->pixel_buf, (size_t)width * 4);
+        if (!buf) return false;
+        decoder->pixel_buf = buf;
+        decoder->pixel_buf_size = (size_t)width * 4;
+    }
+    uint8_t *prev = decoder->line_buf;
+    uint8_t *cur = decoder->line_buf + line_size;
+    memset(prev, 0, line_size);
+    
+    z_stream *stream = &decoder->stream;
+    if (inflateReset(stream) != Z_OK) return false;
+    
+    uint32_t y = 0;
+    size_t line_pos = 0;
+    bool stream_end = false;
+    for (uint32_t c = 0; c < frame_info->chunk_num && y < height && !stream_end; c++) {
+        const yy_png_chunk_info *chunk = info->chunks + frame_info->chunk_index + c;
+        const uint8_t *payload = data + chunk->offset + 8;
+        uint32_t payload_length = chunk->length;
+        if (chunk->fourcc == YY_FOUR_CC('f', 'd', 'A', 'T')) { // skip sequence number
+            payload += 4;
+            payload_length -= 4;
+        }
+        stream->next_in = (Bytef *)payload;
+        stream->avail_in = payload_length;
+        
+        while (y < height) {
+            stream->next_out = cur + line_pos;
+            stream->avail_out = (uInt)(line_size - line_pos);
+            int ret = inflate(stream, Z_NO_FLUSH);
+            if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) return false;
+            line_pos = line_size - stream->avail_out;
+            bool line_full = line_pos == line_size;
+            if (line_full) { // got a full scanline
+                if (!yy_png_unfilter_line(cur[0], cur + 1, prev + 1, row_bytes, bpp)) return false;
+                uint32_t *dst_line = (uint32_t *)(dst + dst_bytes_per_row * y);
+                if (blend_over) {
+                    yy_png_decoder_write_line(decoder, IHDR, cur + 1, width, decoder->pixel_buf);
+                    yy_blend_over_row(decoder->pixel_buf, dst_line, width);
+                } else {
+                    yy_png_decoder_write_line(decoder, IHDR, cur + 1, width, dst_line);
+                }
+                uint8_t *tmp = prev;
+                prev = cur;
+                cur = tmp;
+                line_pos = 0;
+                y++;
+            }
+            if (ret == Z_STREAM_END) {
+                stream_end = true;
+                break;
+            }
+            if (ret == Z_BUF_ERROR) break; // no progress, need more input
+            if (stream->avail_in == 0 && !line_full) break; // this chunk is consumed
+        }
+    }
+    return y == height;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+#pragma mark - Pre-decoded Animation
+
+/*
+ Pre-decoded animation format (all fields are little endian):
+ 
+ header (32 bytes):
+    magic         'YYAF'
+    version       uint32, 1
+    width         uint32, canvas width
+    height        uint32, canvas height
+    frame_count   uint32
+    loop_count    uint32, 0 means infinite
+    orientation   uint32, UIImageOrientation
+    reserved      uint32
+ 
+ frame table (32 bytes per frame):
+    duration      uint32, in microseconds
+    flags         uint32, YY_ANIM_FLAG_xxx
+    x, y          uint32, dirty rect origin (top-left based)
+    width, height uint32, dirty rect size (may be zero if the frame is same as previous)
+    offset        uint32, pixel data offset from the file start
+    length        uint32, pixel data length
+ 
+ pixel data:
+    The dirty rect's pixels (premultiplied BGRA8888, rows are tightly packed), 
+    compressed in LZ4 block format.
+ 
+ The frame is rendered by copying the dirty rect's pixels onto the previous frame's
+ canvas, a keyframe's dirty rect is the whole canvas. The data can be memory-mapped,
+ and the playback is just decompress and blit, without image codec.
+ */
+
+#define YY_ANIM_MAGIC YY_FOUR_CC('Y', 'Y', 'A', 'F')
+#define YY_ANIM_VERSION 1
+#define YY_ANIM_HEADER_SIZE 32
+#define YY_ANIM_FRAME_SIZE 32
+#define YY_ANIM_FLAG_KEYFRAME 1     ///< the frame doesn't depend on previous frame
+#define YY_ANIM_KEYFRAME_INTERVAL 32 ///< max frames between two keyframes (for seeking)
+
+typedef struct {
+    uint32_t duration;
+    uint32_t flags;
+    uint32_t x, y, width, height;
+    uint32_t offset;
+    uint32_t length;
+} yy_anim_frame;
+
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    uint32_t frame_count;
+    uint32_t loop_count;
+    uint32_t orientation;
+    const uint8_t *frames; ///< frame table
+} yy_anim_info;
+
+static inline uint32_t yy_anim_read_uint32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void yy_anim_write_uint32(uint8_t *p, uint32_t value) {
+    p[0] = value & 0xFF;
+    p[1] = (value >> 8) & 0xFF;
+    p[2] = (value >> 16) & 0xFF;
+    p[3] = (value >> 24) & 0xFF;
+}
+
+static void yy_anim_frame_read(const yy_anim_info *info, uint32_t index, yy_anim_frame *frame) {
+    const uint8_t *p = info->frames + index * YY_ANIM_FRAME_SIZE;
+    frame->duration = yy_anim_read_uint32(p);
+    frame->flags = yy_anim_read_uint32(p + 4);
+    frame->x = yy_anim_read_uint32(p + 8);
+    frame->y = yy_anim_read_uint32(p + 12);
+    frame->width = yy_anim_read_uint32(p + 16);
+    frame->height = yy_anim_read_uint32(p + 20);
+    frame->offset = yy_anim_read_uint32(p + 24);
+    frame->length = yy_anim_read_uint32(p + 28);
+}
+
+static void yy_anim_frame_write(uint8_t *p, const yy_anim_frame *frame) {
+    yy_anim_write_uint32(p, frame->duration);
+    yy_anim_write_uint32(p + 4, frame->flags);
+    yy_anim_write_uint32(p + 8, frame->x);
+    yy_anim_write_uint32(p + 12, frame->y);
+    yy_anim_write_uint32(p + 16, frame->width);
+    yy_anim_write_uint32(p + 20, frame->height);
+    yy_anim_write_uint32(p + 24, frame->offset);
+    yy_anim_write_uint32(p + 28, frame->length);
+}
+
+/// Parse and validate the header and frame table, returns false if the data is invalid.
+static bool yy_anim_info_read(const uint8_t *data, size_t length, yy_anim_info *info) {
+    if (length < YY_ANIM_HEADER_SIZE) return false;
+    if (yy_anim_read_uint32(data) != YY_ANIM_MAGIC) return false;
+    if (yy_anim_read_uint32(data + 4) != YY_ANIM_VERSION) return false;
+    info->width = yy_anim_read_uint32(data + 8);
+    info->height = yy_anim_read_uint32(data + 12);
+    info->frame_count = yy_anim_read_uint32(data + 16);
+    info->loop_count = yy_anim_read_uint32(data + 20);
+    info->orientation = yy_anim_read_uint32(data + 24);
+    info->frames = data + YY_ANIM_HEADER_SIZE;
+    if (info->width == 0 || info->height == 0 || info->frame_count == 0) return false;
+    if (info->width > 0x4000 || info->height > 0x4000) return false;
+    if (info->orientation > 7) return false;
+    if ((uint64_t)info->frame_count * YY_ANIM_FRAME_SIZE > length - YY_ANIM_HEADER_SIZE) return false;
+    
+    for (uint32_t i = 0; i < info->frame_count; i++) {
+        yy_anim_frame frame;
+        yy_anim_frame_read(info, i, &frame);
+        if ((uint64_t)frame.x + frame.width > info->width) return false;
+        if ((uint64_t)frame.y + frame.height > info->height) return false;
+        if ((uint64_t)frame.offset + frame.length > length) return false;
+        if (frame.flags & YY_ANIM_FLAG_KEYFRAME) {
+            if (frame.x != 0 || frame.y != 0 || frame.width != info->width || frame.height != info->height) return false;
+        } else if (i == 0) {
+            return false; // first frame should be a keyframe
+        }
+    }
+    return true;
+}
+
+/*
+ LZ4 block format (https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md),
+ a greedy compressor and a safe decompressor.
+ */
+
+#define YY_LZ4_HASH_LOG 12
+#define YY_LZ4_MIN_MATCH 4
+#define YY_LZ4_LAST_LITERALS 5  ///< the last 5 bytes are always literals
+#define YY_LZ4_MF_LIMIT 12      ///< the last match must start at least 12 bytes before the end
+#define YY_LZ4_MAX_OFFSET 65535
+
+static inline size_t yy_lz4_compress_bound(size_t length) {
+    return length + length / 255 + 16;
+}
+
+static inline uint32_t yy_lz4_read32(const uint8_t *p) {
+    uint32_t value;
+    memcpy(&value, p, 4);
+    return value;
+}
+
+static inline uint32_t yy_lz4_hash(uint32_t sequence) {
+    return (sequence * 2654435761U) >> (32 - YY_LZ4_HASH_LOG);
+}
+
+/// Write a length (literals or match) which exceeds the token's 4 bits.
+static inline uint8_t *yy_lz4_write_length(uint8_t *op, size_t length) {
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (uint8_t)length;
+    return op;
+}
+
+/// Compress to dst, returns the compressed length, or 0 if dst is not enough.
+static size_t yy_lz4_compress(const uint8_t *src, size_t src_length, uint8_t *dst, size_t dst_capacity) {
+    const uint8_t *ip = src, *anchor = src, *iend = src + src_length;
+    uint8_t *op = dst, *oend = dst + dst_capacity;
+    
+    if (src_length > YY_LZ4_MF_LIMIT) {
+        uint32_t table[1 << YY_LZ4_HASH_LOG] = {0}; // position of a sequence's last occurrence
+        const uint8_t *mflimit = iend - YY_LZ4_MF_LIMIT;
+        const uint8_t *matchlimit = iend - YY_LZ4_LAST_LITERALS;
+        ip++;
+        while (ip < mflimit) {
+            uint32_t sequence = yy_lz4_read32(ip);
+            uint32_t h = yy_lz4_hash(sequence);
+            const uint8_t *ref = src + table[h];
+            table[h] = (uint32_t)(ip - src);
+            if (ip - ref > YY_LZ4_MAX_OFFSET || yy_lz4_read32(ref) != sequence) {
+                ip++;
+                continue;
+            }
+            
+            while (ip > anchor && ref > src && ip[-1] == ref[-1]) { // extend backward
+                ip--;
+                ref--;
+            }
+            const uint8_t *mip = ip + YY_LZ4_MIN_MATCH, *mref = ref + YY_LZ4_MIN_MATCH;
+            while (mip < matchlimit && *mip == *mref) { // extend forward
+                mip++;
+                mref++;
+            }
+            
+            size_t literal_length = ip - anchor;
+            size_t match_length = mip - ip - YY_LZ4_MIN_MATCH;
+            if ((size_t)(oend - op) < 1 + literal_length + literal_length / 255 + 1 + 2 + match_length / 255 + 1) return 0;
+            uint8_t *token = op++;
+            *token = (uint8_t)((literal_length < 15 ? literal_length : 15) << 4);
+            if (literal_length >= 15) op = yy_lz4_write_length(op, literal_length - 15);
+            memcpy(op, anchor, literal_length);
+            op += literal_length;
+            size_t offset = ip - ref;
+            *op++ = offset & 0xFF;
+            *op++ = (offset >> 8) & 0xFF;
+            *token |= (uint8_t)(match_length < 15 ? match_length : 15);
+            if (match_length >= 15) op = yy_lz4_write_length(op, match_length - 15);
+            
+            ip = anchor = mip;
+            if (ip - 2 > src) table[yy_lz4_hash(yy_lz4_read32(ip - 2))] = (uint32_t)(ip - 2 - src);
+        }
+    }
+    
+    size_t literal_length = iend - anchor; // last literals
+    if ((size_t)(oend - op) < 1 + literal_length + literal_length / 255 + 1) return 0;
+    *op++ = (uint8_t)((literal_length < 15 ? literal_length : 15) << 4);
+    if (literal_length >= 15) op = yy_lz4_write_length(op, literal_length - 15);
+    memcpy(op, anchor, literal_length);
+    op += literal_length;
+    return op - dst;
+}
+
+/// Decompress to dst, returns false if the data is invalid or the output length is not dst_length.
+static bool yy_lz4_decompress(const uint8_t *src, size_t src_length, uint8_t *dst, size_t dst_length) {
+    const uint8_t *ip = src, *iend = src + src_length;
+    uint8_t *op = dst, *oend = dst + dst_length;
+    
+    while (ip < iend) {
+        uint8_t token = *ip++;
+        size_t literal_length = token >> 4;
+        if (literal_length == 15) {
+            uint8_t b;
+            do {
+                if (ip >= iend) return false;
+                b = *ip++;
+                literal_length += b;
+            } while (b == 255);
+        }
+        if (literal_length > (size_t)(iend - ip) || literal_length > (size_t)(oend - op)) return false;
+        memcpy(op, ip, literal_length);
+        op += literal_length;
+        ip += literal_length;
+        if (ip == iend) break; // the last sequence has only literals
+        
+        if (iend - ip < 2) return false;
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - dst)) return false;
+        size_t match_length = token & 15;
+        if (match_length == 15) {
+            uint8_t b;
+            do {
+                if (ip >= iend) return false;
+                b = *ip++;
+                match_length += b;
+            } while (b == 255);
+        }
+        match_length += YY_LZ4_MIN_MATCH;
+        if (match_length > (size_t)(oend - op)) return false;
+        
+        const uint8_t *ref = op - offset;
+        if (offset >= match_length) {
+            memcpy(op, ref, match_length);
+            op += match_length;
+        } else { // overlapped (repeated pattern)
+            for (size_t i = 0; i < match_length; i++) *op++ = *ref++;
+        }
+    }
+    return op == oend;
+}
+
 
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -635,6 +1313,16 @@ static inline size_t YYImageByteAlign(size_t size, size_t alignment) {
     return ((size + (alignment - 1)) / alignment) * alignment;
 }
 
+/// Grow the buffer to at least `length` bytes, returns NO if memory is not enough.
+static inline BOOL YYImageBufferReserve(uint8_t **buffer, size_t *capacity, size_t length) {
+    if (*capacity >= length) return YES;
+    uint8_t *buf = realloc(*buffer, length);
+    if (!buf) return NO;
+    *buffer = buf;
+    *capacity = length;
+    return YES;
+}
+
 /// Convert degree to radians
 static inline CGFloat YYImageDegreesToRadians(CGFloat degrees) {
     return degrees * M_PI / 180;
@@ -678,6 +1366,137 @@ static void YYCGDataProviderReleaseDataCallback(void *info, const void *data, si
     if (info) free(info);
 }
 
+/*
+ A pool of identically sized bitmap buffers for the decoded frames of an animation.
+ 
+ The image created with yy_frame_pool_create_image() holds the buffer, and the buffer
+ is returned to the pool when the image (data provider) is released, so the frames
+ can reuse the bitmap memory without allocation. At most `capacity` free buffers are
+ kept in the pool, the others are freed when returned.
+ 
+ The pool is reference counted (owner + buffers in use), so it's safe to release the
+ pool before the images.
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    size_t buffer_size;     ///< bytes per buffer
+    uint32_t capacity;      ///< max free buffers kept in pool
+    uint32_t free_count;    ///< free buffers count
+    uint32_t slot_count;    ///< free buffers stack size (>= capacity)
+    void **free_buffers;    ///< free buffers stack
+    uint32_t ref_count;     ///< owner + buffers in use
+} yy_frame_pool;
+
+static yy_frame_pool *yy_frame_pool_create(size_t buffer_size, uint32_t capacity) {
+    if (buffer_size == 0) return NULL;
+    yy_frame_pool *pool = calloc(1, sizeof(yy_frame_pool));
+    if (!pool) return NULL;
+    pool->slot_count = capacity ? capacity : 1;
+    pool->free_buffers = calloc(pool->slot_count, sizeof(void *));
+    if (!pool->free_buffers) {
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pool->buffer_size = buffer_size;
+    pool->capacity = capacity;
+    pool->ref_count = 1;
+    return pool;
+}
+
+/**
+ Change the max free buffers kept in pool. The free buffers are kept when growing,
+ only the excess ones are freed when shrinking. Returns false if memory is not enough
+ (the pool is not changed).
+ */
+static bool yy_frame_pool_set_capacity(yy_frame_pool *pool, uint32_t capacity) {
+    void **slots = NULL;
+    void **excess = NULL;
+    uint32_t excess_count = 0;
+    pthread_mutex_lock(&pool->lock);
+    if (capacity > pool->slot_count) {
+        slots = realloc(pool->free_buffers, capacity * sizeof(void *));
+        if (!slots) {
+            pthread_mutex_unlock(&pool->lock);
+            return false;
+        }
+        pool->free_buffers = slots;
+        pool->slot_count = capacity;
+    }
+    if (pool->free_count > capacity) { // freed outside the lock
+        excess_count = pool->free_count - capacity;
+        excess = malloc(excess_count * sizeof(void *));
+        if (excess) {
+            memcpy(excess, pool->free_buffers + capacity, excess_count * sizeof(void *));
+            pool->free_count = capacity;
+        }
+    }
+    pool->capacity = capacity;
+    pthread_mutex_unlock(&pool->lock);
+    if (excess) {
+        for (uint32_t i = 0; i < excess_count; i++) free(excess[i]);
+        free(excess);
+    }
+    return true;
+}
+
+static void yy_frame_pool_unref(yy_frame_pool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    bool dead = --pool->ref_count == 0;
+    pthread_mutex_unlock(&pool->lock);
+    if (!dead) return;
+    for (uint32_t i = 0; i < pool->free_count; i++) free(pool->free_buffers[i]);
+    free(pool->free_buffers);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+/// Release the pool by owner, the buffers in use are still valid.
+static void yy_frame_pool_release(yy_frame_pool *pool) {
+    if (pool) yy_frame_pool_unref(pool);
+}
+
+/// Get a buffer (not cleared) from the pool, returns NULL if memory is not enough.
+static void *yy_frame_pool_acquire(yy_frame_pool *pool) {
+    void *buffer = NULL;
+    pthread_mutex_lock(&pool->lock);
+    if (pool->free_count > 0) buffer = pool->free_buffers[--pool->free_count];
+    pool->ref_count++;
+    pthread_mutex_unlock(&pool->lock);
+    if (!buffer) buffer = malloc(pool->buffer_size);
+    if (!buffer) yy_frame_pool_unref(pool);
+    return buffer;
+}
+
+/// Return a buffer to the pool.
+static void yy_frame_pool_recycle(yy_frame_pool *pool, void *buffer) {
+    pthread_mutex_lock(&pool->lock);
+    if (pool->free_count < pool->capacity) {
+        pool->free_buffers[pool->free_count++] = buffer;
+        buffer = NULL;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    if (buffer) free(buffer);
+    yy_frame_pool_unref(pool);
+}
+
+static void YYCGDataProviderRecycleFrameCallback(void *info, const void *data, size_t size) {
+    yy_frame_pool_recycle(info, (void *)data);
+}
+
+/// Create an image with the buffer from pool, the buffer is recycled when the image is released.
+static CGImageRef yy_frame_pool_create_image(yy_frame_pool *pool, void *buffer, size_t width, size_t height,
+                                             size_t bytes_per_row, CGBitmapInfo bitmap_info) CF_RETURNS_RETAINED {
+    CGDataProviderRef provider = CGDataProviderCreateWithData(pool, buffer, pool->buffer_size, YYCGDataProviderRecycleFrameCallback);
+    if (!provider) {
+        yy_frame_pool_recycle(pool, buffer);
+        return NULL;
+    }
+    CGImageRef image = CGImageCreate(width, height, 8, 32, bytes_per_row, YYCGColorSpaceGetDeviceRGB(), bitmap_info, provider, NULL, false, kCGRenderingIntentDefault);
+    CFRelease(provider); // recycle the buffer if image is NULL
+    return image;
+}
+
 /**
  Decode an image to bitmap buffer with the specified format.
  
@@ -913,6 +1732,22 @@ CGImageRef YYCGImageCreateDecodedCopy(CGImageRef imageRef, BOOL decodeForDisplay
     }
 }
 
+/// Create a smaller decoded copy (BGRA8888 premultiplied or BGRX8888) with the specified pixel size.
+static CGImageRef YYCGImageCreateDownsampledCopy(CGImageRef imageRef, size_t width, size_t height) CF_RETURNS_RETAINED {
+    if (!imageRef || width == 0 || height == 0) return NULL;
+    CGImageAlphaInfo alphaInfo = CGImageGetAlphaInfo(imageRef) & kCGBitmapAlphaInfoMask;
+    BOOL hasAlpha = !(alphaInfo == kCGImageAlphaNone || alphaInfo == kCGImageAlphaNoneSkipFirst || alphaInfo == kCGImageAlphaNoneSkipLast);
+    CGBitmapInfo bitmapInfo = kCGBitmapByteOrder32Host;
+    bitmapInfo |= hasAlpha ? kCGImageAlphaPremultipliedFirst : kCGImageAlphaNoneSkipFirst;
+    CGContextRef context = CGBitmapContextCreate(NULL, width, height, 8, 0, YYCGColorSpaceGetDeviceRGB(), bitmapInfo);
+    if (!context) return NULL;
+    CGContextSetInterpolationQuality(context, kCGInterpolationHigh);
+    CGContextDrawImage(context, CGRectMake(0, 0, width, height), imageRef); // decode and scale
+    CGImageRef newImage = CGBitmapContextCreateImage(context);
+    CFRelease(context);
+    return newImage;
+}
+
 CGImageRef YYCGImageCreateAffineTransformCopy(CGImageRef imageRef, CGAffineTransform transform, CGSize destSize, CGBitmapInfo destBitmapInfo) {
     if (!imageRef) return NULL;
     size_t srcWidth = CGImageGetWidth(imageRef);
@@ -1107,6 +1942,10 @@ YYImageType YYImageDetectType(CFDataRef data) {
                 return YYImageTypeWebP;
             }
         } break;
+            
+        case YY_ANIM_MAGIC: { // pre-decoded animation
+            return YYImageTypePreDecoded;
+        } break;
         /*
         case YY_FOUR_CC('B', 'P', 'G', 0xFB): { // BPG
             return YYImageTypeBPG;
@@ -1185,24 +2024,287 @@ NSString *YYImageTypeGetExtension(YYImageType type) {
     }
 }
 
-CFDataRef YYCGImageCreateEncodedData(CGImageRef imageRef, YYImageType type, CGFloat quality) {
-    if (!imageRef) return nil;
-    quality = quality < 0 ? 0 : quality > 1 ? 1 : quality;
+/*
+ Image header probe: reads the image's header to get size, frame count and 
+ orientation without decoding pixels. The bytes beyond the header are read from
+ file with small reads only when needed (for example, JPEG's SOF after a large
+ EXIF segment), and the total read length is limited.
+ */
+
+#define YY_PROBE_HEADER_LENGTH 4096    ///< file header length read at first
+#define YY_PROBE_MAX_EXTRA_LENGTH 4096 ///< max length read from file beyond the header
+#define YY_PROBE_MAX_SEGMENT_COUNT 256 ///< max JPEG segments or PNG/WebP chunks to walk
+
+typedef struct {
+    const uint8_t *bytes;  ///< the whole data, or the file's header
+    size_t length;         ///< length of bytes
+    uint64_t total_length; ///< data or file length
+    int fd;                ///< file to read the bytes beyond `bytes`, or -1
+    size_t read_budget;    ///< remaining length allowed to read from file
+} yy_probe_source;
+
+static bool yy_probe_read(yy_probe_source *src, uint64_t offset, uint8_t *dst, size_t length) {
+    if (offset > src->total_length || length > src->total_length - offset) return false;
+    if (offset + length <= src->length) {
+        memcpy(dst, src->bytes + offset, length);
+        return true;
+    }
+    if (src->fd < 0 || length > src->read_budget) return false;
+    src->read_budget -= length;
+    return pread(src->fd, dst, length, (off_t)offset) == (ssize_t)length;
+}
+
+static inline uint32_t yy_probe_uint16(const uint8_t *p, bool little_endian) {
+    return little_endian ? (p[0] | (p[1] << 8)) : ((p[0] << 8) | p[1]);
+}
+
+static inline uint32_t yy_probe_uint32(const uint8_t *p, bool little_endian) {
+    return little_endian ? ((uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24))
+                         : (((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3]);
+}
+
+/**
+ Find the orientation tag in JPEG's APP1 segment payload.
+ APP1 is also used by other metadata (such as XMP), only the one starts with
+ "Exif\0\0" is EXIF. Returns whether the segment is EXIF.
+ */
+static bool yy_probe_jpeg_exif(yy_probe_source *src, uint64_t start, uint32_t length, YYImageProbeInfo *info) {
+    uint8_t header[14];
+    if (length < 14 || !yy_probe_read(src, start, header, 14)) return false;
+    if (memcmp(header, "Exif\0\0", 6) != 0) return false;
+    bool little_endian;
+    if (header[6] == 'I' && header[7] == 'I') little_endian = true;
+    else if (header[6] == 'M' && header[7] == 'M') little_endian = false;
+    else return true;
     
-    if (type == YYImageTypeWebP) {
-#if YYIMAGE_WEBP_ENABLED
-        if (quality == 1) {
-            return YYCGImageCreateEncodedWebPData(imageRef, YES, quality, 4, YYImagePresetDefault);
-        } else {
-            return YYCGImageCreateEncodedWebPData(imageRef, NO, quality, 4, YYImagePresetDefault);
+    uint64_t tiff = start + 6; // offsets in EXIF are from the TIFF header
+    uint32_t tiff_length = length - 6;
+    uint32_t ifd = yy_probe_uint32(header + 10, little_endian);
+    if (ifd > tiff_length - 2) return true;
+    uint8_t count_bytes[2];
+    if (!yy_probe_read(src, tiff + ifd, count_bytes, 2)) return true;
+    uint32_t count = yy_probe_uint16(count_bytes, little_endian);
+    for (uint32_t i = 0; i < count && i < 64; i++) {
+        uint32_t entry_offset = ifd + 2 + i * 12;
+        if (entry_offset > tiff_length - 12) return true;
+        uint8_t entry[12];
+        if (!yy_probe_read(src, tiff + entry_offset, entry, 12)) return true;
+        if (yy_probe_uint16(entry, little_endian) == 0x0112) { // orientation, SHORT
+            info->orientation = YYUIImageOrientationFromEXIFValue(yy_probe_uint16(entry + 8, little_endian));
+            return true;
         }
-#else
-        return NULL;
-#endif
     }
+    return true;
+}
+
+static bool yy_probe_jpeg(yy_probe_source *src, YYImageProbeInfo *info) {
+    uint64_t offset = 2; // SOI
+    bool exif_found = false;
+    for (int i = 0; i < YY_PROBE_MAX_SEGMENT_COUNT; i++) {
+        uint8_t marker[4];
+        if (!yy_probe_read(src, offset, marker, 2)) return false;
+        if (marker[0] != 0xFF) return false;
+        if (marker[1] == 0xFF) { // fill byte
+            offset++;
+            continue;
+        }
+        if (marker[1] == 0x01 || (marker[1] >= 0xD0 && marker[1] <= 0xD8)) { // standalone marker (TEM, RSTn, SOI)
+            offset += 2;
+            continue;
+        }
+        if (marker[1] == 0xD9 || marker[1] == 0xDA) return false; // EOI or SOS before SOF
+        if (!yy_probe_read(src, offset + 2, marker + 2, 2)) return false;
+        uint32_t length = yy_probe_uint16(marker + 2, false); // including the length field
+        if (length < 2) return false;
+        
+        uint8_t type = marker[1];
+        if (type >= 0xC0 && type <= 0xCF && type != 0xC4 && type != 0xC8 && type != 0xCC) { // SOFn
+            uint8_t sof[5]; // precision, height, width
+            if (length < 7 || !yy_probe_read(src, offset + 4, sof, 5)) return false;
+            info->height = yy_probe_uint16(sof + 1, false);
+            info->width = yy_probe_uint16(sof + 3, false);
+            info->frameCount = 1;
+            return info->width > 0 && info->height > 0;
+        }
+        if (type == 0xE1 && !exif_found) { // APP1, keep scanning if it's not EXIF (XMP...)
+            exif_found = yy_probe_jpeg_exif(src, offset + 4, length - 2, info);
+        }
+        offset += 2 + length;
+    }
+    return false;
+}
+
+static bool yy_probe_png(yy_probe_source *src, YYImageProbeInfo *info) {
+    uint8_t header[24]; // signature, IHDR length, fourcc, width, height
+    if (!yy_probe_read(src, 0, header, 24)) return false;
+    if (yy_probe_uint32(header + 12, false) != yy_probe_uint32((const uint8_t *)"IHDR", false)) return false;
+    info->width = yy_probe_uint32(header + 16, false);
+    info->height = yy_probe_uint32(header + 20, false);
+    info->frameCount = 1;
     
-    CFStringRef uti = YYImageTypeToUTType(type);
-    if (!uti) return nil;
+    // acTL should be placed before IDAT
+    uint64_t offset = 8;
+    for (int i = 0; i < YY_PROBE_MAX_SEGMENT_COUNT; i++) {
+        uint8_t chunk[12]; // length, fourcc, (num_frames)
+        if (!yy_probe_read(src, offset, chunk, 8)) break;
+        if (memcmp(chunk + 4, "IDAT", 4) == 0 || memcmp(chunk + 4, "IEND", 4) == 0) break;
+        uint32_t length = yy_probe_uint32(chunk, false);
+        if (memcmp(chunk + 4, "acTL", 4) == 0) {
+            if (length >= 8 && yy_probe_read(src, offset + 8, chunk + 8, 4)) {
+                uint32_t num_frames = yy_probe_uint32(chunk + 8, false);
+                if (num_frames > 0) info->frameCount = num_frames;
+            }
+            break;
+        }
+        offset += 12 + (uint64_t)length;
+    }
+    return info->width > 0 && info->height > 0;
+}
+
+static bool yy_probe_gif(yy_probe_source *src, YYImageProbeInfo *info) {
+    const uint8_t *bytes = src->bytes;
+    size_t length = src->length;
+    if (length < 13) return false;
+    info->width = yy_probe_uint16(bytes + 6, true);
+    info->height = yy_probe_uint16(bytes + 8, true);
+    
+    // count image descriptors, only in the probed bytes (walking the sub-blocks
+    // in file needs too many reads)
+    size_t offset = 13;
+    if (bytes[10] & 0x80) offset += 3 * (1 << ((bytes[10] & 0x07) + 1)); // global color table
+    NSUInteger count = 0;
+    bool complete = false;
+    while (offset < length) {
+        uint8_t block = bytes[offset];
+        if (block == 0x3B) { // trailer
+            complete = true;
+            break;
+        } else if (block == 0x21) { // extension
+            offset += 2;
+        } else if (block == 0x2C) { // image descriptor
+            if (offset + 10 > length) break;
+            uint8_t flags = bytes[offset + 9];
+            offset += 10;
+            if (flags & 0x80) offset += 3 * (1 << ((flags & 0x07) + 1)); // local color table
+            offset += 1; // LZW minimum code size
+            count++;
+        } else {
+            complete = true; // invalid block, ImageIO also stops here
+            break;
+        }
+        while (offset < length && bytes[offset] != 0) offset += 1 + bytes[offset]; // sub-blocks
+        offset++; // block terminator
+    }
+    if (!complete && src->length == src->total_length) complete = true; // truncated data
+    info->frameCount = complete ? count : 0;
+    return info->width > 0 && info->height > 0;
+}
+
+static bool yy_probe_webp(yy_probe_source *src, YYImageProbeInfo *info) {
+    uint8_t header[30]; // RIFF header, first chunk header, first chunk's 10 bytes
+    if (!yy_probe_read(src, 0, header, 30)) return false;
+    const uint8_t *chunk = header + 12;
+    const uint8_t *payload = header + 20;
+    if (memcmp(chunk, "VP8 ", 4) == 0) { // lossy
+        if (payload[3] != 0x9D || payload[4] != 0x01 || payload[5] != 0x2A) return false;
+        info->width = yy_probe_uint16(payload + 6, true) & 0x3FFF;
+        info->height = yy_probe_uint16(payload + 8, true) & 0x3FFF;
+        info->frameCount = 1;
+    } else if (memcmp(chunk, "VP8L", 4) == 0) { // lossless
+        if (payload[0] != 0x2F) return false;
+        uint32_t bits = yy_probe_uint32(payload + 1, true);
+        info->width = (bits & 0x3FFF) + 1;
+        info->height = ((bits >> 14) & 0x3FFF) + 1;
+        info->frameCount = 1;
+    } else if (memcmp(chunk, "VP8X", 4) == 0) { // extended
+        info->width = (payload[4] | (payload[5] << 8) | (payload[6] << 16)) + 1;
+        info->height = (payload[7] | (payload[8] << 8) | (payload[9] << 16)) + 1;
+        info->frameCount = 1;
+        if (payload[0] & 0x02) { // animation, count ANMF chunks
+            NSUInteger count = 0;
+            uint64_t offset = 12 + 8 + yy_probe_uint32(chunk + 4, true);
+            info->frameCount = 0;
+            while (true) {
+                if (offset >= src->total_length) { // all chunks are walked
+                    info->frameCount = count;
+                    break;
+                }
+                uint8_t sub[8];
+                if (!yy_probe_read(src, offset, sub, 8)) break; // out of budget
+                if (memcmp(sub, "ANMF", 4) == 0) count++;
+                uint32_t size = yy_probe_uint32(sub + 4, true);
+                offset += 8 + (uint64_t)size + (size & 1); // chunks are padded to even size
+            }
+        }
+    } else {
+        return false;
+    }
+    return info->width > 0 && info->height > 0;
+}
+
+/// Probe the source, the info's type should be set.
+static bool yy_probe(yy_probe_source *src, YYImageProbeInfo *info) {
+    switch (info->type) {
+        case YYImageTypeJPEG: return yy_probe_jpeg(src, info);
+        case YYImageTypePNG: return yy_probe_png(src, info);
+        case YYImageTypeGIF: return yy_probe_gif(src, info);
+        case YYImageTypeWebP: return yy_probe_webp(src, info);
+        default: return false;
+    }
+}
+
+BOOL YYImageProbeData(CFDataRef data, YYImageProbeInfo *info) {
+    if (!info) return NO;
+    memset(info, 0, sizeof(YYImageProbeInfo));
+    info->type = YYImageDetectType(data);
+    if (info->type == YYImageTypeUnknown) return NO;
+    size_t length = CFDataGetLength(data);
+    yy_probe_source src = {CFDataGetBytePtr(data), length, length, -1, 0};
+    return yy_probe(&src, info);
+}
+
+BOOL YYImageProbeFile(NSString *path, YYImageProbeInfo *info) {
+    if (!info) return NO;
+    memset(info, 0, sizeof(YYImageProbeInfo));
+    if (path.length == 0) return NO;
+    int fd = open(path.fileSystemRepresentation, O_RDONLY);
+    if (fd < 0) return NO;
+    
+    BOOL suc = NO;
+    struct stat st;
+    uint8_t header[YY_PROBE_HEADER_LENGTH];
+    ssize_t length = fstat(fd, &st) == 0 ? pread(fd, header, sizeof(header), 0) : -1;
+    if (length > 0) {
+        CFDataRef data = CFDataCreateWithBytesNoCopy(kCFAllocatorDefault, header, length, kCFAllocatorNull);
+        if (data) {
+            info->type = YYImageDetectType(data);
+            CFRelease(data);
+        }
+        yy_probe_source src = {header, (size_t)length, (uint64_t)st.st_size, fd, YY_PROBE_MAX_EXTRA_LENGTH};
+        suc = yy_probe(&src, info);
+    }
+    close(fd);
+    return suc;
+}
+
+CFDataRef YYCGImageCreateEncodedData(CGImageRef imageRef, YYImageType type, CGFloat quality) {
+    if (!imageRef) return nil;
+    quality = quality < 0 ? 0 : quality > 1 ? 1 : quality;
+    
+    if (type == YYImageTypeWebP) {
+#if YYIMAGE_WEBP_ENABLED
+        if (quality == 1) {
+            return YYCGImageCreateEncodedWebPData(imageRef, YES, quality, 4, YYImagePresetDefault);
+        } else {
+            return YYCGImageCreateEncodedWebPData(imageRef, NO, quality, 4, YYImagePresetDefault);
+        }
+#else
+        return NULL;
+#endif
+    }
+    
+    CFStringRef uti = YYImageTypeToUTType(type);
+    if (!uti) return nil;
     
     CFMutableDataRef data = CFDataCreateMutable(CFAllocatorGetDefault(), 0);
     if (!data) return NULL;
@@ -1233,7 +2335,7 @@ BOOL YYImageWebPAvailable() {
     return YES;
 }
 
-CFDataRef YYCGImageCreateEncodedWebPData(CGImageRef imageRef, BOOL lossless, CGFloat quality, int compressLevel, YYImagePreset preset) {
+static CFDataRef YYCGImageCreateEncodedWebPDataWithThreads(CGImageRef imageRef, BOOL lossless, CGFloat quality, int compressLevel, YYImagePreset preset, BOOL useThreads) {
     if (!imageRef) return nil;
     size_t width = CGImageGetWidth(imageRef);
     size_t height = CGImageGetHeight(imageRef);
@@ -1257,6 +2359,7 @@ CFDataRef YYCGImageCreateEncodedWebPData(CGImageRef imageRef, BOOL lossless, CGF
     config.quality = round(quality * 100.0);
     config.lossless = lossless;
     config.method = compressLevel;
+    config.thread_level = useThreads ? 1 : 0;
     switch ((WebPPreset)preset) {
         case WEBP_PRESET_DEFAULT: {
             config.image_hint = WEBP_HINT_DEFAULT;
@@ -1299,6 +2402,10 @@ fail:
     return nil;
 }
 
+CFDataRef YYCGImageCreateEncodedWebPData(CGImageRef imageRef, BOOL lossless, CGFloat quality, int compressLevel, YYImagePreset preset) {
+    return YYCGImageCreateEncodedWebPDataWithThreads(imageRef, lossless, quality, compressLevel, preset, NO);
+}
+
 NSUInteger YYImageGetWebPFrameCount(CFDataRef webpData) {
     if (!webpData || CFDataGetLength(webpData) == 0) return 0;
     
@@ -1503,16 +2610,42 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
 }
 @end
 
+/*
+ Memory of the append-only buffer used by `appendData:final:`.
+ The bytes already written are never changed or moved: when the buffer is full,
+ the decoder moves to a larger one, and the old memory is freed when no data
+ object (the decoder's `data`, ImageIO's source) refers to it.
+ */
+@interface _YYImageDecoderBuffer : NSObject {
+@package
+    uint8_t *_bytes;
+    size_t _capacity;
+}
+@end
+
+@implementation _YYImageDecoderBuffer
+- (void)dealloc {
+    if (_bytes) free(_bytes);
+}
+@end
+
 
 @implementation YYImageDecoder {
     pthread_mutex_t _lock; // recursive lock
     
     BOOL _sourceTypeDetected;
+    _YYImageDecoderBuffer *_appendBuffer; ///< accumulated bytes for `appendData:final:`
+    size_t _appendLength;                 ///< bytes written to _appendBuffer
     CGImageSourceRef _source;
     yy_png_info *_apngSource;
+    yy_png_decoder *_apngDecoder; ///< native apng frame decoder, NULL if not available
 #if YYIMAGE_WEBP_ENABLED
     WebPDemuxer *_webpSource;
+    WebPIDecoder *_webpIDecoder;  ///< incremental decoder for partial (non-animated) webp
+    size_t _webpIDecodedLength;   ///< data length already appended to _webpIDecoder
 #endif
+    BOOL _preDecoded;             ///< the data is pre-decoded animation
+    yy_anim_info _preDecodedInfo; ///< pre-decoded animation's header, the frame table points to _data
     
     UIImageOrientation _orientation;
     dispatch_semaphore_t _framesLock;
@@ -1520,15 +2653,26 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
     BOOL _needBlend;
     NSUInteger _blendFrameIndex;
     CGContextRef _blendCanvas;
+    yy_frame_pool *_framePool;  ///< canvas sized bitmap pool for decoded frames, NULL if disabled
+    NSUInteger _frameBufferPoolCapacity;
+    uint8_t *_blendFrameBuffer;     ///< frame pixels to be blended over the canvas
+    size_t _blendFrameBufferSize;
+    uint8_t *_blendRestoreBuffer;   ///< canvas region pixels for dispose op 'PREVIOUS'
+    size_t _blendRestoreBufferSize;
 }
 
 - (void)dealloc {
     if (_source) CFRelease(_source);
     if (_apngSource) yy_png_info_release(_apngSource);
+    if (_apngDecoder) yy_png_decoder_release(_apngDecoder);
 #if YYIMAGE_WEBP_ENABLED
     if (_webpSource) WebPDemuxDelete(_webpSource);
+    if (_webpIDecoder) WebPIDelete(_webpIDecoder);
 #endif
     if (_blendCanvas) CFRelease(_blendCanvas);
+    yy_frame_pool_release(_framePool);
+    if (_blendFrameBuffer) free(_blendFrameBuffer);
+    if (_blendRestoreBuffer) free(_blendRestoreBuffer);
     pthread_mutex_destroy(&_lock);
 }
 
@@ -1561,6 +2705,14 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
     return result;
 }
 
+- (BOOL)appendData:(NSData *)data final:(BOOL)final {
+    BOOL result = NO;
+    pthread_mutex_lock(&_lock);
+    result = [self _appendData:data final:final];
+    pthread_mutex_unlock(&_lock);
+    return result;
+}
+
 - (YYImageFrame *)frameAtIndex:(NSUInteger)index decodeForDisplay:(BOOL)decodeForDisplay {
     YYImageFrame *result = nil;
     pthread_mutex_lock(&_lock);
@@ -1569,6 +2721,37 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
     return result;
 }
 
+- (void)setFrameBufferPoolCapacity:(NSUInteger)frameBufferPoolCapacity {
+    pthread_mutex_lock(&_lock);
+    if (_frameBufferPoolCapacity != frameBufferPoolCapacity) {
+        _frameBufferPoolCapacity = frameBufferPoolCapacity;
+        // keep the pooled buffers, or release the pool if disabled (buffers in use are still valid)
+        if (_framePool &&
+            (frameBufferPoolCapacity == 0 ||
+             !yy_frame_pool_set_capacity(_framePool, (uint32_t)MIN(frameBufferPoolCapacity, UINT32_MAX)))) {
+            yy_frame_pool_release(_framePool);
+            _framePool = NULL;
+        }
+    }
+    pthread_mutex_unlock(&_lock);
+}
+
+- (NSUInteger)frameBufferPoolCapacity {
+    NSUInteger capacity = 0;
+    pthread_mutex_lock(&_lock);
+    capacity = _frameBufferPoolCapacity;
+    pthread_mutex_unlock(&_lock);
+    return capacity;
+}
+
+- (YYImageFrame *)frameAtIndex:(NSUInteger)index targetPixelSize:(CGSize)targetPixelSize decodeForDisplay:(BOOL)decodeForDisplay {
+    YYImageFrame *result = nil;
+    pthread_mutex_lock(&_lock);
+    result = [self _frameAtIndex:index targetPixelSize:targetPixelSize decodeForDisplay:decodeForDisplay];
+    pthread_mutex_unlock(&_lock);
+    return result;
+}
+
 - (NSTimeInterval)frameDurationAtIndex:(NSUInteger)index {
     NSTimeInterval result = 0;
     dispatch_semaphore_wait(_framesLock, DISPATCH_TIME_FOREVER);
@@ -1595,6 +2778,14 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
     return result;
 }
 
+- (NSData *)preDecodedAnimationData {
+    NSData *result = nil;
+    pthread_mutex_lock(&_lock);
+    result = [self _preDecodedAnimationData];
+    pthread_mutex_unlock(&_lock);
+    return result;
+}
+
 #pragma private (wrap)
 
 - (BOOL)_updateData:(NSData *)data final:(BOOL)final {
@@ -1620,8 +2811,84 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
     return YES;
 }
 
+- (BOOL)_appendData:(NSData *)data final:(BOOL)final {
+    if (_finalized) return NO;
+    if (_data && !_appendBuffer) return NO; // already updated with `updateData:final:`
+    
+    size_t length = _appendLength + data.length;
+    if (!_appendBuffer || length > _appendBuffer->_capacity) {
+        size_t capacity = _appendBuffer ? _appendBuffer->_capacity * 2 : 64 * 1024;
+        if (capacity < length) capacity = length;
+        _YYImageDecoderBuffer *buffer = [_YYImageDecoderBuffer new];
+        buffer->_bytes = malloc(capacity);
+        if (!buffer->_bytes) return NO;
+        buffer->_capacity = capacity;
+        if (_appendLength) memcpy(buffer->_bytes, _appendBuffer->_bytes, _appendLength);
+        _appendBuffer = buffer;
+    }
+    if (data.length) memcpy(_appendBuffer->_bytes + _appendLength, data.bytes, data.length);
+    _appendLength = length;
+    
+    // An immutable view of the bytes written so far (no copy), it keeps the buffer alive.
+    // ImageIO gets it with CGImageSourceUpdateData() and continues its incremental decoding.
+    _YYImageDecoderBuffer *buffer = _appendBuffer;
+    NSData *accumulated = [[NSData alloc] initWithBytesNoCopy:buffer->_bytes length:length deallocator:^(void *bytes, NSUInteger len) {
+        [buffer class]; // release the buffer with the data
+    }];
+    return [self _updateData:accumulated final:final];
+}
+
+- (YYImageFrame *)_frameAtIndex:(NSUInteger)index targetPixelSize:(CGSize)targetPixelSize decodeForDisplay:(BOOL)decodeForDisplay {
+    if (index >= _frames.count || _width == 0 || _height == 0) return nil;
+    if (_type == YYImageTypeICO) return [self _frameAtIndex:index decodeForDisplay:decodeForDisplay]; // multi-size frames
+    
+    // the target size is in display orientation
+    switch (_orientation) {
+        case UIImageOrientationLeft:
+        case UIImageOrientationRight:
+        case UIImageOrientationLeftMirrored:
+        case UIImageOrientationRightMirrored: {
+            targetPixelSize = CGSizeMake(targetPixelSize.height, targetPixelSize.width);
+        } break;
+        default: break;
+    }
+    
+    // aspect fill the target size, never upscale
+    CGFloat factor = MAX(targetPixelSize.width / _width, targetPixelSize.height / _height);
+    if (factor <= 0 || factor >= 1) return [self _frameAtIndex:index decodeForDisplay:decodeForDisplay];
+    size_t width = MAX(1, (size_t)ceil(_width * factor));
+    size_t height = MAX(1, (size_t)ceil(_height * factor));
+    if (width >= _width || height >= _height) return [self _frameAtIndex:index decodeForDisplay:decodeForDisplay];
+    
+    CGImageRef imageRef = NULL;
+    BOOL decoded = NO;
+    if (!_needBlend) imageRef = [self _newDownsampledImageAtIndex:index width:width height:height decodeForDisplay:decodeForDisplay decoded:&decoded];
+    if (!imageRef) { // decode (and blend) in full size, then scale down
+        YYImageFrame *frame = [self _frameAtIndex:index decodeForDisplay:YES];
+        imageRef = YYCGImageCreateDownsampledCopy(frame.image.CGImage, width, height);
+        decoded = YES;
+    }
+    if (!imageRef) return nil;
+    
+    UIImage *image = [UIImage imageWithCGImage:imageRef scale:_scale orientation:_orientation];
+    CFRelease(imageRef);
+    if (!image) return nil;
+    image.isDecodedForDisplay = decoded;
+    
+    _YYImageDecoderFrame *frame = [(_YYImageDecoderFrame *)_frames[index] copy];
+    frame.image = image;
+    frame.width = width;
+    frame.height = height;
+    frame.offsetX = 0;
+    frame.offsetY = 0;
+    frame.dispose = YYImageDisposeNone;
+    frame.blend = YYImageBlendNone;
+    return frame;
+}
+
 - (YYImageFrame *)_frameAtIndex:(NSUInteger)index decodeForDisplay:(BOOL)decodeForDisplay {
     if (index >= _frames.count) return 0;
+    if (_preDecoded) return [self _preDecodedFrameAtIndex:index];
     _YYImageDecoderFrame *frame = [(_YYImageDecoderFrame *)_frames[index] copy];
     BOOL decoded = NO;
     BOOL extendToCanvas = NO;
@@ -1632,6 +2899,14 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
     if (!_needBlend) {
         CGImageRef imageRef = [self _newUnblendedImageAtIndex:index extendToCanvas:extendToCanvas decoded:&decoded];
         if (!imageRef) return nil;
+        if (decodeForDisplay && !decoded && extendToCanvas) {
+            CGImageRef imageRefDecoded = [self _newPooledDecodedCopy:imageRef];
+            if (imageRefDecoded) {
+                CFRelease(imageRef);
+                imageRef = imageRefDecoded;
+                decoded = YES;
+            }
+        }
         if (decodeForDisplay && !decoded) {
             CGImageRef imageRefDecoded = YYCGImageCreateDecodedCopy(imageRef, YES);
             if (imageRefDecoded) {
@@ -1665,7 +2940,7 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
                 CGContextDrawImage(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height), unblendedImage);
                 CFRelease(unblendedImage);
             }
-            imageRef = CGBitmapContextCreateImage(_blendCanvas);
+            imageRef = [self _newCanvasImage];
             if (frame.dispose == YYImageDisposeBackground) {
                 CGContextClearRect(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height));
             }
@@ -1715,6 +2990,101 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
     return CFBridgingRelease(properties);
 }
 
+- (NSData *)_preDecodedAnimationData {
+    if (!_finalized || _frameCount == 0 || _width == 0 || _height == 0) return nil;
+    if (_type == YYImageTypeICO) return nil; // multi-size frames
+    if (_width > 0x4000 || _height > 0x4000) return nil;
+    
+    uint32_t width = (uint32_t)_width, height = (uint32_t)_height, frameCount = (uint32_t)_frameCount;
+    size_t bytesPerRow = (size_t)width * 4;
+    size_t canvasSize = bytesPerRow * height;
+    size_t compressedCapacity = yy_lz4_compress_bound(canvasSize);
+    NSMutableData *result = [NSMutableData dataWithLength:YY_ANIM_HEADER_SIZE + (size_t)frameCount * YY_ANIM_FRAME_SIZE];
+    uint8_t *current = calloc(canvasSize, 1);
+    uint8_t *previous = calloc(canvasSize, 1);
+    uint8_t *packed = malloc(canvasSize);
+    uint8_t *compressed = malloc(compressedCapacity);
+    CGContextRef context = NULL;
+    if (current && previous && packed && compressed) {
+        context = CGBitmapContextCreate(current, width, height, 8, bytesPerRow, YYCGColorSpaceGetDeviceRGB(), kCGBitmapByteOrder32Host | kCGImageAlphaPremultipliedFirst);
+    }
+    if (!context) goto fail;
+    
+    for (uint32_t i = 0; i < frameCount; i++) {
+        @autoreleasepool {
+            YYImageFrame *frame = [self _frameAtIndex:i decodeForDisplay:YES];
+            CGImageRef imageRef = frame.image.CGImage;
+            if (!imageRef) goto fail;
+            CGContextClearRect(context, CGRectMake(0, 0, width, height));
+            CGContextDrawImage(context, CGRectMake(0, 0, width, height), imageRef);
+            
+            // dirty rect of the changed pixels (top-left based)
+            yy_anim_frame af = {0};
+            af.duration = (uint32_t)MIN(MAX(frame.duration, 0) * 1000000, UINT32_MAX);
+            if (i % YY_ANIM_KEYFRAME_INTERVAL == 0) {
+                af.flags = YY_ANIM_FLAG_KEYFRAME;
+                af.width = width;
+                af.height = height;
+            } else {
+                uint32_t top = height, bottom = 0, left = width, right = 0;
+                for (uint32_t y = 0; y < height; y++) {
+                    const uint32_t *cur = (const uint32_t *)(current + y * bytesPerRow);
+                    const uint32_t *pre = (const uint32_t *)(previous + y * bytesPerRow);
+                    if (memcmp(cur, pre, bytesPerRow) == 0) continue;
+                    uint32_t l = 0, r = width;
+                    while (cur[l] == pre[l]) l++;
+                    while (cur[r - 1] == pre[r - 1]) r--;
+                    if (top == height) top = y;
+                    bottom = y + 1;
+                    left = MIN(left, l);
+                    right = MAX(right, r);
+                }
+                if (top < bottom) {
+                    af.x = left;
+                    af.y = top;
+                    af.width = right - left;
+                    af.height = bottom - top;
+                }
+            }
+            
+            af.offset = (uint32_t)result.length;
+            if (af.width && af.height) {
+                yy_blend_copy(current + af.y * bytesPerRow + af.x * 4, bytesPerRow, packed, (size_t)af.width * 4, af.width, af.height);
+                size_t length = yy_lz4_compress(packed, (size_t)af.width * 4 * af.height, compressed, compressedCapacity);
+                if (length == 0 || result.length + length > UINT32_MAX) goto fail;
+                [result appendBytes:compressed length:length];
+                af.length = (uint32_t)length;
+            }
+            yy_anim_frame_write((uint8_t *)result.mutableBytes + YY_ANIM_HEADER_SIZE + i * YY_ANIM_FRAME_SIZE, &af);
+            memcpy(previous, current, canvasSize);
+        }
+    }
+    
+    uint8_t *header = result.mutableBytes;
+    yy_anim_write_uint32(header, YY_ANIM_MAGIC);
+    yy_anim_write_uint32(header + 4, YY_ANIM_VERSION);
+    yy_anim_write_uint32(header + 8, width);
+    yy_anim_write_uint32(header + 12, height);
+    yy_anim_write_uint32(header + 16, frameCount);
+    yy_anim_write_uint32(header + 20, (uint32_t)_loopCount);
+    yy_anim_write_uint32(header + 24, (uint32_t)_orientation);
+    
+    CFRelease(context);
+    free(current);
+    free(previous);
+    free(packed);
+    free(compressed);
+    return result;
+    
+fail:
+    if (context) CFRelease(context);
+    if (current) free(current);
+    if (previous) free(previous);
+    if (packed) free(packed);
+    if (compressed) free(compressed);
+    return nil;
+}
+
 #pragma private
 
 - (void)_updateSource {
@@ -1727,6 +3097,10 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
             [self _updateSourceAPNG];
         } break;
             
+        case YYImageTypePreDecoded: {
+            [self _updateSourcePreDecoded];
+        } break;
+            
         default: {
             [self _updateSourceImageIO];
         } break;
@@ -1746,13 +3120,19 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
     
     /*
      https://developers.google.com/speed/webp/docs/api
-     The documentation said we can use WebPIDecoder to decode webp progressively, 
-     but currently it can only returns an empty image (not same as progressive jpegs),
-     so we don't use progressive decoding.
+     Before finalized, we use WebPIDecoder to decode the (non-animated) webp
+     incrementally: only the newly arrived bytes are appended to the decoder, and
+     the rows decoded so far are displayed (webp is not progressive like jpeg).
      
      When using WebPDecode() to decode multi-frame webp, we will get the error
      "VP8_STATUS_UNSUPPORTED_FEATURE", so we first use WebPDemuxer to unpack it.
      */
+    if (!_finalized) {
+        [self _updateSourceWebPIncremental];
+        return;
+    }
+    if (_webpIDecoder) WebPIDelete(_webpIDecoder);
+    _webpIDecoder = NULL;
     
     WebPData webPData = {0};
     webPData.bytes = _data.bytes;
@@ -1839,6 +3219,41 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
 #endif
 }
 
+- (void)_updateSourceWebPIncremental {
+#if YYIMAGE_WEBP_ENABLED
+    if (!_webpIDecoder) {
+        WebPBitstreamFeatures features;
+        if (WebPGetFeatures(_data.bytes, _data.length, &features) != VP8_STATUS_OK) return; // need more data
+        if (features.has_animation) return; // wait for the final data
+        _webpIDecoder = WebPINewRGB(MODE_bgrA, NULL, 0, 0); // use internal memory
+        if (!_webpIDecoder) return;
+        _webpIDecodedLength = 0;
+    }
+    if (_data.length > _webpIDecodedLength) {
+        // if an error occurs, the decoder keeps the error status and returns no more rows
+        WebPIAppend(_webpIDecoder, (const uint8_t *)_data.bytes + _webpIDecodedLength, _data.length - _webpIDecodedLength);
+        _webpIDecodedLength = _data.length;
+    }
+    
+    int lastY = 0, width = 0, height = 0, stride = 0;
+    if (!WebPIDecGetRGB(_webpIDecoder, &lastY, &width, &height, &stride)) return;
+    if (lastY < 1 || width < 1 || height < 1) return;
+    
+    _YYImageDecoderFrame *frame = [_YYImageDecoderFrame new];
+    frame.index = 0;
+    frame.width = width;
+    frame.height = height;
+    frame.hasAlpha = YES;
+    frame.isFullSize = YES;
+    _width = width;
+    _height = height;
+    _frameCount = 1;
+    dispatch_semaphore_wait(_framesLock, DISPATCH_TIME_FOREVER);
+    _frames = @[frame];
+    dispatch_semaphore_signal(_framesLock);
+#endif
+}
+
 - (void)_updateSourceAPNG {
     /*
      APNG extends PNG format to support animation, it was supported by ImageIO
@@ -1851,6 +3266,8 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
     
     yy_png_info_release(_apngSource);
     _apngSource = nil;
+    yy_png_decoder_release(_apngDecoder);
+    _apngDecoder = NULL;
     
     [self _updateSourceImageIO]; // decode first frame
     if (_frameCount == 0) return; // png decode failed
@@ -1931,11 +3348,102 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
     _loopCount = apng->apng_loop_num;
     _needBlend = needBlend;
     _apngSource = apng;
+    _apngDecoder = yy_png_decoder_create(_data.bytes, apng); // fallback to ImageIO if NULL
+    dispatch_semaphore_wait(_framesLock, DISPATCH_TIME_FOREVER);
+    _frames = frames;
+    dispatch_semaphore_signal(_framesLock);
+}
+
+- (void)_updateSourcePreDecoded {
+    _width = 0;
+    _height = 0;
+    _loopCount = 0;
+    _frameCount = 0;
+    _preDecoded = NO;
+    dispatch_semaphore_wait(_framesLock, DISPATCH_TIME_FOREVER);
+    _frames = nil;
+    dispatch_semaphore_signal(_framesLock);
+    if (!_finalized) return; // the frame table may be incomplete
+    
+    yy_anim_info info;
+    if (!yy_anim_info_read(_data.bytes, _data.length, &info)) return;
+    
+    NSMutableArray *frames = [NSMutableArray new];
+    NSUInteger keyframeIndex = 0;
+    for (uint32_t i = 0; i < info.frame_count; i++) {
+        yy_anim_frame af;
+        yy_anim_frame_read(&info, i, &af);
+        if (af.flags & YY_ANIM_FLAG_KEYFRAME) keyframeIndex = i;
+        
+        // frames are always rendered to the full canvas
+        _YYImageDecoderFrame *frame = [_YYImageDecoderFrame new];
+        frame.index = i;
+        frame.duration = af.duration / 1000000.0;
+        frame.width = info.width;
+        frame.height = info.height;
+        frame.hasAlpha = YES;
+        frame.isFullSize = YES;
+        frame.blendFromIndex = keyframeIndex;
+        [frames addObject:frame];
+    }
+    
+    _width = info.width;
+    _height = info.height;
+    _loopCount = info.loop_count;
+    _frameCount = frames.count;
+    _orientation = (UIImageOrientation)info.orientation;
+    _needBlend = YES;
+    _blendFrameIndex = NSNotFound;
+    _preDecodedInfo = info;
+    _preDecoded = YES;
     dispatch_semaphore_wait(_framesLock, DISPATCH_TIME_FOREVER);
     _frames = frames;
     dispatch_semaphore_signal(_framesLock);
 }
 
+/// Render the pre-decoded frame to canvas, replay the frames from the keyframe if needed.
+- (BOOL)_renderPreDecodedFrameAtIndex:(NSUInteger)index {
+    if (![self _createBlendContextIfNeeded]) return NO;
+    uint8_t *canvas = CGBitmapContextGetData(_blendCanvas);
+    if (!canvas) return NO;
+    size_t canvasBytesPerRow = CGBitmapContextGetBytesPerRow(_blendCanvas);
+    
+    NSUInteger keyframeIndex = ((_YYImageDecoderFrame *)_frames[index]).blendFromIndex;
+    if (_blendFrameIndex == index) return YES;
+    NSUInteger start = keyframeIndex;
+    if (_blendFrameIndex != NSNotFound && _blendFrameIndex >= keyframeIndex && _blendFrameIndex < index) {
+        start = _blendFrameIndex + 1; // sequential playback
+    }
+    
+    _blendFrameIndex = NSNotFound;
+    const uint8_t *bytes = _data.bytes;
+    for (NSUInteger i = start; i <= index; i++) {
+        yy_anim_frame af;
+        yy_anim_frame_read(&_preDecodedInfo, (uint32_t)i, &af);
+        if (af.width == 0 || af.height == 0) continue; // same as previous frame
+        size_t bytesPerRow = (size_t)af.width * 4;
+        if (!YYImageBufferReserve(&_blendFrameBuffer, &_blendFrameBufferSize, bytesPerRow * af.height)) return NO;
+        if (!yy_lz4_decompress(bytes + af.offset, af.length, _blendFrameBuffer, bytesPerRow * af.height)) return NO;
+        yy_blend_copy(_blendFrameBuffer, bytesPerRow, canvas + af.y * canvasBytesPerRow + af.x * 4, canvasBytesPerRow, af.width, af.height);
+    }
+    _blendFrameIndex = index;
+    return YES;
+}
+
+- (YYImageFrame *)_preDecodedFrameAtIndex:(NSUInteger)index {
+    if (![self _renderPreDecodedFrameAtIndex:index]) return nil;
+    CGImageRef imageRef = [self _newCanvasImage];
+    if (!imageRef) return nil;
+    UIImage *image = [UIImage imageWithCGImage:imageRef scale:_scale orientation:_orientation];
+    CFRelease(imageRef);
+    if (!image) return nil;
+    image.isDecodedForDisplay = YES;
+    
+    _YYImageDecoderFrame *frame = [(_YYImageDecoderFrame *)_frames[index] copy];
+    frame.image = image;
+    return frame;
+}
+
 - (void)_updateSourceImageIO {
     _width = 0;
     _height = 0;
@@ -2073,6 +3581,14 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
     }
     
     if (_apngSource) {
+        if (_apngDecoder) {
+            CGImageRef imageRef = [self _newAPNGImageAtIndex:index extendToCanvas:extendToCanvas];
+            if (imageRef) {
+                if (decoded) *decoded = YES;
+                return imageRef;
+            }
+        }
+        
         uint32_t size = 0;
         uint8_t *bytes = yy_png_copy_frame_data_at_index(_data.bytes, _apngSource, (uint32_t)index, &size);
         if (!bytes) return NULL;
@@ -2112,6 +3628,29 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
     }
     
 #if YYIMAGE_WEBP_ENABLED
+    if (_webpIDecoder) {
+        int lastY = 0, width = 0, height = 0, stride = 0;
+        const uint8_t *rgba = WebPIDecGetRGB(_webpIDecoder, &lastY, &width, &height, &stride);
+        if (!rgba || lastY < 1 || width < 1 || height < 1) return NULL;
+        
+        size_t bytesPerRow = YYImageByteAlign(width * 4, 32);
+        size_t length = bytesPerRow * height;
+        uint8_t *pixels = calloc(1, length); // the rows not decoded yet are transparent
+        if (!pixels) return NULL;
+        yy_blend_copy(rgba, stride, pixels, bytesPerRow, width, lastY);
+        
+        CGDataProviderRef provider = CGDataProviderCreateWithData(pixels, pixels, length, YYCGDataProviderReleaseDataCallback);
+        if (!provider) {
+            free(pixels);
+            return NULL;
+        }
+        pixels = NULL; // hold by provider
+        CGImageRef image = CGImageCreate(width, height, 8, 32, bytesPerRow, YYCGColorSpaceGetDeviceRGB(), kCGBitmapByteOrder32Host | kCGImageAlphaPremultipliedFirst, provider, NULL, false, kCGRenderingIntentDefault);
+        CFRelease(provider);
+        if (decoded) *decoded = YES;
+        return image;
+    }
+    
     if (_webpSource) {
         WebPIterator iter;
         if (!WebPDemuxGetFrame(_webpSource, (int)(index + 1), &iter)) return NULL; // demux webp frame data
@@ -2195,6 +3734,303 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
     return NULL;
 }
 
+/**
+ Decode a full size frame at a smaller size with the codec's scaled decoding.
+ 
+ @param decodeForDisplay Whether decode the image to BGRA8888 premultiplied bitmap for display.
+ @param decoded Output whether the image is decoded for display.
+ @return NULL if the frame cannot be decoded in this way.
+ */
+- (CGImageRef)_newDownsampledImageAtIndex:(NSUInteger)index
+                                    width:(size_t)width
+                                   height:(size_t)height
+                         decodeForDisplay:(BOOL)decodeForDisplay
+                                  decoded:(BOOL *)decoded CF_RETURNS_RETAINED {
+    if (!_finalized && index > 0) return NULL;
+    if (_frames.count <= index) return NULL;
+    _YYImageDecoderFrame *frame = _frames[index];
+    if (!frame.isFullSize) return NULL;
+    
+    if (_source) {
+        // ImageIO decodes jpeg with DCT scaling when creating thumbnail
+        NSDictionary *options = @{(id)kCGImageSourceCreateThumbnailFromImageAlways : @(YES),
+                                  (id)kCGImageSourceThumbnailMaxPixelSize : @(MAX(width, height)),
+                                  (id)kCGImageSourceCreateThumbnailWithTransform : @(NO),
+                                  (id)kCGImageSourceShouldCacheImmediately : @(YES)};
+        CGImageRef imageRef = CGImageSourceCreateThumbnailAtIndex(_source, index, (CFDictionaryRef)options);
+        if (!imageRef || !decodeForDisplay) return imageRef;
+        CGImageRef imageRefDecoded = YYCGImageCreateDecodedCopy(imageRef, YES);
+        if (imageRefDecoded) {
+            CFRelease(imageRef);
+            imageRef = imageRefDecoded;
+            if (decoded) *decoded = YES;
+        }
+        return imageRef;
+    }
+    
+#if YYIMAGE_WEBP_ENABLED
+    if (_webpSource) {
+        WebPIterator iter;
+        if (!WebPDemuxGetFrame(_webpSource, (int)(index + 1), &iter)) return NULL;
+        
+        size_t bytesPerRow = YYImageByteAlign(width * 4, 32);
+        size_t length = bytesPerRow * height;
+        WebPDecoderConfig config;
+        if (!WebPInitDecoderConfig(&config)) {
+            WebPDemuxReleaseIterator(&iter);
+            return NULL;
+        }
+        void *pixels = calloc(1, length);
+        if (!pixels) {
+            WebPDemuxReleaseIterator(&iter);
+            return NULL;
+        }
+        // same pixel format as YYCGImageCreateWithWebPData()
+        CGBitmapInfo bitmapInfo;
+        if (decodeForDisplay) {
+            bitmapInfo = kCGBitmapByteOrder32Host;
+            bitmapInfo |= iter.has_alpha ? kCGImageAlphaPremultipliedFirst : kCGImageAlphaNoneSkipFirst;
+            config.output.colorspace = MODE_bgrA;
+        } else {
+            bitmapInfo = kCGBitmapByteOrderDefault;
+            bitmapInfo |= iter.has_alpha ? kCGImageAlphaLast : kCGImageAlphaNoneSkipLast;
+            config.output.colorspace = MODE_RGBA;
+        }
+        config.options.use_scaling = 1;
+        config.options.scaled_width = (int)width;
+        config.options.scaled_height = (int)height;
+        config.output.is_external_memory = 1;
+        config.output.u.RGBA.rgba = pixels;
+        config.output.u.RGBA.stride = (int)bytesPerRow;
+        config.output.u.RGBA.size = length;
+        VP8StatusCode result = WebPDecode(iter.fragment.bytes, iter.fragment.size, &config); // decode with scaling
+        WebPDemuxReleaseIterator(&iter);
+        if (result != VP8_STATUS_OK) {
+            free(pixels);
+            return NULL;
+        }
+        
+        CGDataProviderRef provider = CGDataProviderCreateWithData(pixels, pixels, length, YYCGDataProviderReleaseDataCallback);
+        if (!provider) {
+            free(pixels);
+            return NULL;
+        }
+        pixels = NULL; // hold by provider
+        CGImageRef image = CGImageCreate(width, height, 8, 32, bytesPerRow, YYCGColorSpaceGetDeviceRGB(), bitmapInfo, provider, NULL, false, kCGRenderingIntentDefault);
+        CFRelease(provider);
+        if (image && decoded) *decoded = decodeForDisplay;
+        return image;
+    }
+#endif
+    
+    return NULL;
+}
+
+/**
+ Decode an APNG frame with the native decoder (no remux and ImageIO).
+ The image is in BGRA8888 premultiplied format (decoded for display).
+ */
+- (CGImageRef)_newAPNGImageAtIndex:(NSUInteger)index extendToCanvas:(BOOL)extendToCanvas CF_RETURNS_RETAINED {
+    if (index >= _apngSource->apng_frame_num) return NULL;
+    yy_png_chunk_fcTL *fcTL = &(_apngSource->apng_frames + index)->frame_control;
+    if ((uint64_t)fcTL->x_offset + fcTL->width > _width || (uint64_t)fcTL->y_offset + fcTL->height > _height) return NULL;
+    
+    size_t width = extendToCanvas ? _width : fcTL->width;
+    size_t height = extendToCanvas ? _height : fcTL->height;
+    size_t bytesPerRow = YYImageByteAlign(width * 4, 32);
+    size_t length = bytesPerRow * height;
+    
+    yy_frame_pool *pool = extendToCanvas ? [self _availableFramePool] : NULL;
+    uint8_t *pixels = pool ? yy_frame_pool_acquire(pool) : NULL;
+    if (pixels) {
+        memset(pixels, 0, length);
+        uint8_t *dest = pixels + fcTL->y_offset * bytesPerRow + fcTL->x_offset * 4;
+        if (!yy_png_decoder_decode_frame(_apngDecoder, _data.bytes, _apngSource, (uint32_t)index, dest, bytesPerRow, false)) {
+            yy_frame_pool_recycle(pool, pixels);
+            return NULL;
+        }
+        return yy_frame_pool_create_image(pool, pixels, width, height, bytesPerRow, kCGBitmapByteOrder32Host | kCGImageAlphaPremultipliedFirst);
+    }
+    
+    pixels = calloc(1, length);
+    if (!pixels) return NULL;
+    uint8_t *dest = pixels;
+    if (extendToCanvas) dest += fcTL->y_offset * bytesPerRow + fcTL->x_offset * 4;
+    if (!yy_png_decoder_decode_frame(_apngDecoder, _data.bytes, _apngSource, (uint32_t)index, dest, bytesPerRow, false)) {
+        free(pixels);
+        return NULL;
+    }
+    
+    CGDataProviderRef provider = CGDataProviderCreateWithData(pixels, pixels, length, YYCGDataProviderReleaseDataCallback);
+    if (!provider) {
+        free(pixels);
+        return NULL;
+    }
+    pixels = NULL; // hold by provider
+    CGImageRef image = CGImageCreate(width, height, 8, 32, bytesPerRow, YYCGColorSpaceGetDeviceRGB(), kCGBitmapByteOrder32Host | kCGImageAlphaPremultipliedFirst, provider, NULL, false, kCGRenderingIntentDefault);
+    CFRelease(provider);
+    return image;
+}
+
+/**
+ Draw a frame into the canvas region in memory (the top-left pixel of the frame),
+ use the frame's blend op. The region may be partially written if the frame data is broken.
+ */
+- (BOOL)_drawFrame:(_YYImageDecoderFrame *)frame inRegion:(uint8_t *)region bytesPerRow:(size_t)bytesPerRow {
+    BOOL blendOver = frame.blend == YYImageBlendOver;
+    if (_apngDecoder) {
+        return yy_png_decoder_decode_frame(_apngDecoder, _data.bytes, _apngSource, (uint32_t)frame.index, region, bytesPerRow, blendOver);
+    }
+#if YYIMAGE_WEBP_ENABLED
+    if (_webpSource) {
+        WebPIterator iter;
+        if (!WebPDemuxGetFrame(_webpSource, (int)(frame.index + 1), &iter)) return NO;
+        if (!iter.has_alpha) blendOver = NO;
+        uint32_t width = (uint32_t)frame.width, height = (uint32_t)frame.height;
+        size_t frameBytesPerRow = (size_t)width * 4;
+        uint8_t *pixels = region; // decode to canvas directly if no need to blend
+        if (blendOver) {
+            if (!YYImageBufferReserve(&_blendFrameBuffer, &_blendFrameBufferSize, frameBytesPerRow * height)) {
+                WebPDemuxReleaseIterator(&iter);
+                return NO;
+            }
+            pixels = _blendFrameBuffer;
+        }
+        
+        WebPDecoderConfig config;
+        BOOL suc = WebPInitDecoderConfig(&config);
+        if (suc) {
+            config.output.colorspace = MODE_bgrA;
+            config.output.is_external_memory = 1;
+            config.output.u.RGBA.rgba = pixels;
+            config.output.u.RGBA.stride = (int)(blendOver ? frameBytesPerRow : bytesPerRow);
+            config.output.u.RGBA.size = config.output.u.RGBA.stride * (height - 1) + frameBytesPerRow;
+            VP8StatusCode result = WebPDecode(iter.fragment.bytes, iter.fragment.size, &config);
+            suc = result == VP8_STATUS_OK; // NOT_ENOUGH_DATA: truncated frame, rows are not all written
+        }
+        WebPDemuxReleaseIterator(&iter);
+        if (!suc) return NO;
+        if (blendOver) yy_blend_over(pixels, frameBytesPerRow, region, bytesPerRow, width, height);
+        return YES;
+    }
+#endif
+    return NO;
+}
+
+/**
+ Render a frame into the blend canvas's memory in place, and apply the dispose op.
+ The pixels are composited with the `yy_blend_xxx` kernels instead of CoreGraphics.
+ 
+ @param frame Frame to render.
+ @param image If NULL, just update the canvas as the frame is displayed and disposed
+ (same as `_blendImageWithFrame:`), otherwise output a new image of the frame
+ (same as `_newBlendedImageWithFrame:`).
+ @return NO if the frame cannot be rendered in place or the frame data is broken,
+ the canvas is not changed (the frame region is restored).
+ */
+- (BOOL)_blendFrameInCanvas:(_YYImageDecoderFrame *)frame image:(CGImageRef *)image {
+    uint8_t *canvas = CGBitmapContextGetData(_blendCanvas);
+    size_t canvasBytesPerRow = CGBitmapContextGetBytesPerRow(_blendCanvas);
+    if (!canvas || frame.width == 0 || frame.height == 0) return NO;
+    if (frame.width > _width || frame.height > _height) return NO;
+    if (frame.offsetX > _width - frame.width || frame.offsetY > _height - frame.height) return NO; // frame out of canvas
+    
+    // CoreGraphics's origin is bottom-left, but the memory's first row is the top.
+    size_t regionX = frame.offsetX;
+    size_t regionY = _height - frame.offsetY - frame.height;
+    uint32_t regionWidth = (uint32_t)frame.width, regionHeight = (uint32_t)frame.height;
+    uint8_t *region = canvas + regionY * canvasBytesPerRow + regionX * 4;
+    size_t regionBytesPerRow = (size_t)regionWidth * 4;
+    
+    if (!image) {
+        if (frame.dispose == YYImageDisposePrevious) {
+            // nothing
+        } else if (frame.dispose == YYImageDisposeBackground) {
+            yy_blend_clear(region, canvasBytesPerRow, regionWidth, regionHeight);
+        } else {
+            // keep the region, so the canvas is not changed if the frame data is broken
+            if (!YYImageBufferReserve(&_blendRestoreBuffer, &_blendRestoreBufferSize, regionBytesPerRow * regionHeight)) return NO;
+            yy_blend_copy(region, canvasBytesPerRow, _blendRestoreBuffer, regionBytesPerRow, regionWidth, regionHeight);
+            if (![self _drawFrame:frame inRegion:region bytesPerRow:canvasBytesPerRow]) {
+                yy_blend_copy(_blendRestoreBuffer, regionBytesPerRow, region, canvasBytesPerRow, regionWidth, regionHeight);
+                return NO;
+            }
+        }
+        return YES;
+    }
+    
+    // keep the region for dispose op 'PREVIOUS', and for restoring if the frame data is broken
+    if (!YYImageBufferReserve(&_blendRestoreBuffer, &_blendRestoreBufferSize, regionBytesPerRow * regionHeight)) return NO;
+    yy_blend_copy(region, canvasBytesPerRow, _blendRestoreBuffer, regionBytesPerRow, regionWidth, regionHeight);
+    if (![self _drawFrame:frame inRegion:region bytesPerRow:canvasBytesPerRow]) {
+        yy_blend_copy(_blendRestoreBuffer, regionBytesPerRow, region, canvasBytesPerRow, regionWidth, regionHeight);
+        return NO;
+    }
+    *image = [self _newCanvasImage];
+    
+    if (frame.dispose == YYImageDisposePrevious) {
+        yy_blend_copy(_blendRestoreBuffer, regionBytesPerRow, region, canvasBytesPerRow, regionWidth, regionHeight);
+    } else if (frame.dispose == YYImageDisposeBackground) {
+        yy_blend_clear(region, canvasBytesPerRow, regionWidth, regionHeight);
+    }
+    return YES;
+}
+
+/// Whether the frames can be composited in canvas's memory with `_blendFrameInCanvas:image:`.
+- (BOOL)_canBlendFrameInCanvas {
+#if YYIMAGE_WEBP_ENABLED
+    if (_webpSource) return YES;
+#endif
+    return _apngDecoder != NULL;
+}
+
+/// Returns the frame pool (create if needed), or NULL if pool is disabled.
+- (yy_frame_pool *)_availableFramePool {
+    if (_frameBufferPoolCapacity == 0 || _width == 0 || _height == 0) return NULL;
+    size_t bufferSize = YYImageByteAlign(_width * 4, 32) * _height;
+    if (_framePool && _framePool->buffer_size != bufferSize) { // canvas size changed
+        yy_frame_pool_release(_framePool);
+        _framePool = NULL;
+    }
+    if (!_framePool) {
+        _framePool = yy_frame_pool_create(bufferSize, (uint32_t)MIN(_frameBufferPoolCapacity, UINT32_MAX));
+    }
+    return _framePool;
+}
+
+/// Decode a canvas sized image to a pooled bitmap, returns NULL if the pool is not available.
+- (CGImageRef)_newPooledDecodedCopy:(CGImageRef)imageRef CF_RETURNS_RETAINED {
+    if (CGImageGetWidth(imageRef) != _width || CGImageGetHeight(imageRef) != _height) return NULL;
+    yy_frame_pool *pool = [self _availableFramePool];
+    if (!pool) return NULL;
+    uint8_t *buffer = yy_frame_pool_acquire(pool);
+    if (!buffer) return NULL;
+    
+    size_t bytesPerRow = YYImageByteAlign(_width * 4, 32);
+    CGBitmapInfo bitmapInfo = kCGBitmapByteOrder32Host | kCGImageAlphaPremultipliedFirst;
+    memset(buffer, 0, bytesPerRow * _height);
+    CGContextRef context = CGBitmapContextCreate(buffer, _width, _height, 8, bytesPerRow, YYCGColorSpaceGetDeviceRGB(), bitmapInfo);
+    if (!context) {
+        yy_frame_pool_recycle(pool, buffer);
+        return NULL;
+    }
+    CGContextDrawImage(context, CGRectMake(0, 0, _width, _height), imageRef); // decode
+    CFRelease(context);
+    return yy_frame_pool_create_image(pool, buffer, _width, _height, bytesPerRow, bitmapInfo);
+}
+
+/// Create an image with the current canvas's content (use the frame pool if available).
+- (CGImageRef)_newCanvasImage CF_RETURNS_RETAINED {
+    uint8_t *canvas = CGBitmapContextGetData(_blendCanvas);
+    yy_frame_pool *pool = canvas ? [self _availableFramePool] : NULL;
+    uint8_t *buffer = pool ? yy_frame_pool_acquire(pool) : NULL;
+    if (!buffer) return CGBitmapContextCreateImage(_blendCanvas);
+    
+    size_t bytesPerRow = YYImageByteAlign(_width * 4, 32);
+    yy_blend_copy(canvas, CGBitmapContextGetBytesPerRow(_blendCanvas), buffer, bytesPerRow, (uint32_t)_width, (uint32_t)_height);
+    return yy_frame_pool_create_image(pool, buffer, _width, _height, bytesPerRow, kCGBitmapByteOrder32Host | kCGImageAlphaPremultipliedFirst);
+}
+
 - (BOOL)_createBlendContextIfNeeded {
     if (!_blendCanvas) {
         _blendFrameIndex = NSNotFound;
@@ -2205,6 +4041,8 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
 }
 
 - (void)_blendImageWithFrame:(_YYImageDecoderFrame *)frame {
+    if ([self _canBlendFrameInCanvas] && [self _blendFrameInCanvas:frame image:NULL]) return;
+    
     if (frame.dispose == YYImageDisposePrevious) {
         // nothing
     } else if (frame.dispose == YYImageDisposeBackground) {
@@ -2229,6 +4067,8 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
 
 - (CGImageRef)_newBlendedImageWithFrame:(_YYImageDecoderFrame *)frame CF_RETURNS_RETAINED{
     CGImageRef imageRef = NULL;
+    if ([self _canBlendFrameInCanvas] && [self _blendFrameInCanvas:frame image:&imageRef]) return imageRef;
+    
     if (frame.dispose == YYImageDisposePrevious) {
         if (frame.blend == YYImageBlendOver) {
             CGImageRef previousImage = CGBitmapContextCreateImage(_blendCanvas);
@@ -2237,7 +4077,7 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
                 CGContextDrawImage(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height), unblendImage);
                 CFRelease(unblendImage);
             }
-            imageRef = CGBitmapContextCreateImage(_blendCanvas);
+            imageRef = [self _newCanvasImage];
             CGContextClearRect(_blendCanvas, CGRectMake(0, 0, _width, _height));
             if (previousImage) {
                 CGContextDrawImage(_blendCanvas, CGRectMake(0, 0, _width, _height), previousImage);
@@ -2251,7 +4091,7 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
                 CGContextDrawImage(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height), unblendImage);
                 CFRelease(unblendImage);
             }
-            imageRef = CGBitmapContextCreateImage(_blendCanvas);
+            imageRef = [self _newCanvasImage];
             CGContextClearRect(_blendCanvas, CGRectMake(0, 0, _width, _height));
             if (previousImage) {
                 CGContextDrawImage(_blendCanvas, CGRectMake(0, 0, _width, _height), previousImage);
@@ -2265,7 +4105,7 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
                 CGContextDrawImage(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height), unblendImage);
                 CFRelease(unblendImage);
             }
-            imageRef = CGBitmapContextCreateImage(_blendCanvas);
+            imageRef = [self _newCanvasImage];
             CGContextClearRect(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height));
         } else {
             CGImageRef unblendImage = [self _newUnblendedImageAtIndex:frame.index extendToCanvas:NO decoded:NULL];
@@ -2274,7 +4114,7 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
                 CGContextDrawImage(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height), unblendImage);
                 CFRelease(unblendImage);
             }
-            imageRef = CGBitmapContextCreateImage(_blendCanvas);
+            imageRef = [self _newCanvasImage];
             CGContextClearRect(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height));
         }
     } else { // no dispose
@@ -2284,7 +4124,7 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
                 CGContextDrawImage(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height), unblendImage);
                 CFRelease(unblendImage);
             }
-            imageRef = CGBitmapContextCreateImage(_blendCanvas);
+            imageRef = [self _newCanvasImage];
         } else {
             CGImageRef unblendImage = [self _newUnblendedImageAtIndex:frame.index extendToCanvas:NO decoded:NULL];
             if (unblendImage) {
@@ -2292,7 +4132,7 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
                 CGContextDrawImage(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height), unblendImage);
                 CFRelease(unblendImage);
             }
-            imageRef = CGBitmapContextCreateImage(_blendCanvas);
+            imageRef = [self _newCanvasImage];
         }
     }
     return imageRef;
@@ -2332,6 +4172,7 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
     _type = type;
     _images = [NSMutableArray new];
     _durations = [NSMutableArray new];
+    _maxConcurrentFrameCount = [NSProcessInfo processInfo].activeProcessorCount;
 
     switch (type) {
         case YYImageTypeJPEG:
@@ -2515,24 +4356,67 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
     return suc;
 }
 
+/**
+ Encode each frame with the block concurrently (at most `_maxConcurrentFrameCount`
+ frames at a time), the block is called on background threads (or the current thread).
+ Returns the block's results in frame order, or nil if any block returns nil.
+ */
+- (NSArray *)_encodeFramesWithBlock:(id (^)(NSUInteger index))block {
+    NSUInteger count = _images.count;
+    NSMutableArray *results = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++) [results addObject:[NSNull null]];
+    dispatch_semaphore_t lock = dispatch_semaphore_create(1);
+    
+    // workers take the next frame until all frames are encoded, so a slow frame doesn't block others
+    int32_t nextIndex = -1, failed = 0;
+    int32_t *nextIndexPtr = &nextIndex, *failedPtr = &failed;
+    size_t workerCount = MIN(MAX(_maxConcurrentFrameCount, 1), count);
+    dispatch_apply(workerCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t worker) {
+        while (*failedPtr == 0) {
+            NSUInteger index = (NSUInteger)OSAtomicIncrement32(nextIndexPtr);
+            if (index >= count) break;
+            @autoreleasepool {
+                id result = block(index);
+                if (!result) {
+                    OSAtomicIncrement32(failedPtr);
+                    break;
+                }
+                dispatch_semaphore_wait(lock, DISPATCH_TIME_FOREVER);
+                results[index] = result;
+                dispatch_semaphore_signal(lock);
+            }
+        }
+    });
+    return failed ? nil : results;
+}
+
 - (NSData *)_encodeAPNG {
     // encode APNG (ImageIO doesn't support APNG encoding, so we use a custom encoder)
-    NSMutableArray *pngDatas = [NSMutableArray new];
-    NSMutableArray *pngSizes = [NSMutableArray new];
-    NSUInteger canvasWidth = 0, canvasHeight = 0;
-    for (int i = 0; i < _images.count; i++) {
-        CGImageRef decoded = [self _newCGImageFromIndex:i decoded:YES];
+    // frames are decoded and encoded concurrently, then muxed in order
+    NSArray *frames = [self _encodeFramesWithBlock:^id(NSUInteger index) {
+        CGImageRef decoded = [self _newCGImageFromIndex:index decoded:YES];
         if (!decoded) return nil;
         CGSize size = CGSizeMake(CGImageGetWidth(decoded), CGImageGetHeight(decoded));
-        [pngSizes addObject:[NSValue valueWithCGSize:size]];
-        if (canvasWidth < size.width) canvasWidth = size.width;
-        if (canvasHeight < size.height) canvasHeight = size.height;
         CFDataRef frameData = YYCGImageCreateEncodedData(decoded, YYImageTypePNG, 1);
         CFRelease(decoded);
         if (!frameData) return nil;
-        [pngDatas addObject:(__bridge id)(frameData)];
-        CFRelease(frameData);
-        if (size.width < 1 || size.height < 1) return nil;
+        if (size.width < 1 || size.height < 1) {
+            CFRelease(frameData);
+            return nil;
+        }
+        return @[CFBridgingRelease(frameData), [NSValue valueWithCGSize:size]];
+    }];
+    if (!frames) return nil;
+    
+    NSMutableArray *pngDatas = [NSMutableArray new];
+    NSMutableArray *pngSizes = [NSMutableArray new];
+    NSUInteger canvasWidth = 0, canvasHeight = 0;
+    for (NSArray *frame in frames) {
+        CGSize size = [(NSValue *)frame[1] CGSizeValue];
+        [pngDatas addObject:frame[0]];
+        [pngSizes addObject:frame[1]];
+        if (canvasWidth < size.width) canvasWidth = size.width;
+        if (canvasHeight < size.height) canvasHeight = size.height;
     }
     CGSize firstFrameSize = [(NSValue *)[pngSizes firstObject] CGSizeValue];
     if (firstFrameSize.width < canvasWidth || firstFrameSize.height < canvasHeight) {
@@ -2668,17 +4552,17 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
 
 - (NSData *)_encodeWebP {
 #if YYIMAGE_WEBP_ENABLED
-    // encode webp
-    NSMutableArray *webpDatas = [NSMutableArray new];
-    for (NSUInteger i = 0; i < _images.count; i++) {
-        CGImageRef image = [self _newCGImageFromIndex:i decoded:NO];
+    // encode webp frames concurrently, then mux them in order
+    BOOL lossless = _lossless, useThreads = _useThreads;
+    CGFloat quality = _quality;
+    NSArray *webpDatas = [self _encodeFramesWithBlock:^id(NSUInteger index) {
+        CGImageRef image = [self _newCGImageFromIndex:index decoded:NO];
         if (!image) return nil;
-        CFDataRef frameData = YYCGImageCreateEncodedWebPData(image, _lossless, _quality, 4, YYImagePresetDefault);
+        CFDataRef frameData = YYCGImageCreateEncodedWebPDataWithThreads(image, lossless, quality, 4, YYImagePresetDefault, useThreads);
         CFRelease(image);
-        if (!frameData) return nil;
-        [webpDatas addObject:(__bridge id)frameData];
-        CFRelease(frameData);
-    }
+        return CFBridgingRelease(frameData);
+    }];
+    if (!webpDatas) return nil;
     if (webpDatas.count == 1) {
         return webpDatas.firstObject;
     } else {
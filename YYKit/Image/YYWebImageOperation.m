@@ -90,7 +90,7 @@ static void URLInBlackListAdd(NSURL *url) {
 @property (readwrite, getter=isStarted) BOOL started;
 @property (nonatomic, strong) NSRecursiveLock *lock;
 @property (nonatomic, strong) NSURLConnection *connection;
-@property (nonatomic, strong) NSMutableData *data;
+@property (nonatomic, strong) NSMutableData *data; ///< received data, or the bytes not appended to progressiveDecoder yet
 @property (nonatomic, assign) NSInteger expectedSize;
 @property (nonatomic, assign) UIBackgroundTaskIdentifier taskID;
 
@@ -99,6 +99,7 @@ static void URLInBlackListAdd(NSURL *url) {
 @property (nonatomic, assign) BOOL progressiveIgnored;
 @property (nonatomic, assign) BOOL progressiveDetected;
 @property (nonatomic, assign) NSUInteger progressiveScanedLength;
+@property (nonatomic, assign) NSUInteger progressiveAppendedLength; ///< data length already moved to progressiveDecoder
 @property (nonatomic, assign) NSUInteger progressiveDisplayCount;
 
 @property (nonatomic, copy) YYWebImageProgressBlock progress;
@@ -136,10 +137,10 @@ static void URLInBlackListAdd(NSURL *url) {
     return thread;
 }
 
-/// Global image queue, used for image reading and decoding.
-+ (dispatch_queue_t)_imageQueue {
+/// Run a block on the global image executor, used for image reading and decoding.
++ (void)_imageAsync:(dispatch_block_t)block {
 #ifdef YYDispatchQueuePool_h
-    return YYDispatchQueueGetForQOS(NSQualityOfServiceUtility);
+    YYDispatchAsync(NSQualityOfServiceUtility, block);
 #else
     #define MAX_QUEUE_COUNT 16
     static int queueCount;
@@ -163,7 +164,7 @@ static void URLInBlackListAdd(NSURL *url) {
     });
     int32_t cur = OSAtomicIncrement32(&counter);
     if (cur < 0) cur = -cur;
-    return queues[(cur) % queueCount];
+    dispatch_async(queues[(cur) % queueCount], block);
     #undef MAX_QUEUE_COUNT
 #endif
 }
@@ -240,6 +241,20 @@ static void URLInBlackListAdd(NSURL *url) {
     [self _endBackgroundTask];
 }
 
+// runs on network thread, moves the bytes kept by the progressive decoder back to `_data`
+- (void)_endProgressiveDecoding {
+    if (!_progressiveDecoder) return;
+    NSData *appended = _progressiveDecoder.data;
+    if (appended.length) {
+        NSMutableData *data = [NSMutableData dataWithCapacity:appended.length + _data.length];
+        [data appendData:appended];
+        if (_data) [data appendData:_data];
+        _data = data;
+    }
+    _progressiveDecoder = nil;
+    _progressiveAppendedLength = 0;
+}
+
 // runs on network thread
 - (void)_startOperation {
     if ([self isCancelled]) return;
@@ -260,7 +275,7 @@ static void URLInBlackListAdd(NSURL *url) {
             }
             if (!(_options & YYWebImageOptionIgnoreDiskCache)) {
                 __weak typeof(self) _self = self;
-                dispatch_async([self.class _imageQueue], ^{
+                [self.class _imageAsync:^{
                     __strong typeof(_self) self = _self;
                     if (!self || [self isCancelled]) return;
                     UIImage *image = [self.cache getImageForKey:self.cacheKey withType:YYImageCacheTypeDisk];
@@ -270,7 +285,7 @@ static void URLInBlackListAdd(NSURL *url) {
                     } else {
                         [self performSelector:@selector(_startRequest:) onThread:[self.class _networkThread] withObject:nil waitUntilDone:NO];
                     }
-                });
+                }];
                 return;
             }
         }
@@ -351,11 +366,11 @@ static void URLInBlackListAdd(NSURL *url) {
             if (_cache) {
                 if (image || (_options & YYWebImageOptionRefreshImageCache)) {
                     NSData *data = _data;
-                    dispatch_async([YYWebImageOperation _imageQueue], ^{
+                    [YYWebImageOperation _imageAsync:^{
                         YYImageCacheType cacheType = (_options & YYWebImageOptionIgnoreDiskCache) ? YYImageCacheTypeMemory : YYImageCacheTypeAll;
                         [_cache setImage:image imageData:data forKey:_cacheKey withType:cacheType];
 
-                    });
+                    }];
                 }
             }
             _data = nil;
@@ -436,6 +451,12 @@ static void URLInBlackListAdd(NSURL *url) {
                 if (_expectedSize < 0) _expectedSize = -1;
             }
             _data = [NSMutableData dataWithCapacity:_expectedSize > 0 ? _expectedSize : 0];
+            // the bytes of the previous response (if any) are discarded
+            _progressiveDecoder = nil;
+            _progressiveAppendedLength = 0;
+            _progressiveScanedLength = 0;
+            _progressiveDetected = NO;
+            _progressiveDisplayCount = 0;
             if (_progress) {
                 [_lock lock];
                 if (![self isCancelled]) _progress(0, _expectedSize);
@@ -453,10 +474,11 @@ static void URLInBlackListAdd(NSURL *url) {
         if (canceled) return;
         
         if (data) [_data appendData:data];
+        NSUInteger receivedLength = _progressiveAppendedLength + _data.length;
         if (_progress) {
             [_lock lock];
             if (![self isCancelled]) {
-                _progress(_data.length, _expectedSize);
+                _progress(receivedLength, _expectedSize);
             }
             [_lock unlock];
         }
@@ -475,21 +497,32 @@ static void URLInBlackListAdd(NSURL *url) {
         
         if (!_progressiveDecoder) {
             _progressiveDecoder = [[YYImageDecoder alloc] initWithScale:[UIScreen mainScreen].scale];
+            _progressiveAppendedLength = 0;
+        }
+        /*
+         The bytes arrived after last decoding are moved to the decoder, which keeps
+         the accumulated data and the decoding state, so the data is not duplicated.
+         */
+        [_progressiveDecoder appendData:_data final:NO];
+        if (_progressiveDecoder.data.length != receivedLength) { // append failed
+            [self _endProgressiveDecoding];
+            _progressiveIgnored = YES;
+            return;
         }
-        [_progressiveDecoder updateData:_data final:NO];
+        _progressiveAppendedLength = receivedLength;
+        _data = [NSMutableData new];
         if ([self isCancelled]) return;
         
         if (_progressiveDecoder.type == YYImageTypeUnknown ||
-            _progressiveDecoder.type == YYImageTypeWebP ||
-            _progressiveDecoder.type == YYImageTypeOther) {
-            _progressiveDecoder = nil;
+            _progressiveDecoder.type >= YYImageTypeOther) {
+            [self _endProgressiveDecoding];
             _progressiveIgnored = YES;
             return;
         }
         if (progressiveBlur) { // only support progressive JPEG and interlaced PNG
             if (_progressiveDecoder.type != YYImageTypeJPEG &&
                 _progressiveDecoder.type != YYImageTypePNG) {
-                _progressiveDecoder = nil;
+                [self _endProgressiveDecoding];
                 _progressiveIgnored = YES;
                 return;
             }
@@ -515,17 +548,18 @@ static void URLInBlackListAdd(NSURL *url) {
                     NSNumber *isProg = jpeg[(id)kCGImagePropertyJFIFIsProgressive];
                     if (!isProg.boolValue) {
                         _progressiveIgnored = YES;
-                        _progressiveDecoder = nil;
+                        [self _endProgressiveDecoding];
                         return;
                     }
                     _progressiveDetected = YES;
                 }
                 
-                NSInteger scanLength = (NSInteger)_data.length - (NSInteger)_progressiveScanedLength - 4;
+                NSData *appended = _progressiveDecoder.data;
+                NSInteger scanLength = (NSInteger)appended.length - (NSInteger)_progressiveScanedLength - 4;
                 if (scanLength <= 2) return;
                 NSRange scanRange = NSMakeRange(_progressiveScanedLength, scanLength);
-                NSRange markerRange = [_data rangeOfData:JPEGSOSMarker() options:kNilOptions range:scanRange];
-                _progressiveScanedLength = _data.length;
+                NSRange markerRange = [appended rangeOfData:JPEGSOSMarker() options:kNilOptions range:scanRange];
+                _progressiveScanedLength = appended.length;
                 if (markerRange.location == NSNotFound) return;
                 if ([self isCancelled]) return;
                 
@@ -536,7 +570,7 @@ static void URLInBlackListAdd(NSURL *url) {
                     NSNumber *isProg = png[(id)kCGImagePropertyPNGInterlaceType];
                     if (!isProg.boolValue) {
                         _progressiveIgnored = YES;
-                        _progressiveDecoder = nil;
+                        [self _endProgressiveDecoding];
                         return;
                     }
                     _progressiveDetected = YES;
@@ -553,7 +587,7 @@ static void URLInBlackListAdd(NSURL *url) {
             
             CGFloat radius = 32;
             if (_expectedSize > 0) {
-                radius *= 1.0 / (3 * _data.length / (CGFloat)_expectedSize + 0.6) - 0.25;
+                radius *= 1.0 / (3 * receivedLength / (CGFloat)_expectedSize + 0.6) - 0.25;
             } else {
                 radius /= (_progressiveDisplayCount);
             }
@@ -575,17 +609,29 @@ static void URLInBlackListAdd(NSURL *url) {
     @autoreleasepool {
         [_lock lock];
         _connection = nil;
+        [self _endProgressiveDecoding];
         if (![self isCancelled]) {
             __weak typeof(self) _self = self;
-            dispatch_async([self.class _imageQueue], ^{
+            [self.class _imageAsync:^{
                 __strong typeof(_self) self = _self;
                 if (!self) return;
                 
                 BOOL shouldDecode = (self.options & YYWebImageOptionIgnoreImageDecoding) == 0;
                 BOOL allowAnimation = (self.options & YYWebImageOptionIgnoreAnimatedImage) == 0;
+                CGSize targetPixelSize = self.cache.decodeTargetPixelSize;
+                BOOL downsample = targetPixelSize.width > 0 && targetPixelSize.height > 0;
                 UIImage *image;
                 BOOL hasAnimation = NO;
-                if (allowAnimation) {
+                if (downsample) {
+                    YYImageDecoder *decoder = [YYImageDecoder decoderWithData:self.data scale:[UIScreen mainScreen].scale];
+                    if (allowAnimation && decoder.frameCount > 1) {
+                        image = [[YYImage alloc] initWithDecoder:decoder]; // don't parse the data again
+                        if (shouldDecode) image = [image imageByDecoded];
+                        hasAnimation = YES;
+                    } else {
+                        image = [decoder frameAtIndex:0 targetPixelSize:targetPixelSize decodeForDisplay:shouldDecode].image;
+                    }
+                } else if (allowAnimation) {
                     image = [[YYImage alloc] initWithData:self.data scale:[UIScreen mainScreen].scale];
                     if (shouldDecode) image = [image imageByDecoded];
                     if ([((YYImage *)image) animatedImageFrameCount] > 1) {
@@ -606,16 +652,18 @@ static void URLInBlackListAdd(NSURL *url) {
                     case YYImageTypeJPEG:
                     case YYImageTypeGIF:
                     case YYImageTypePNG:
-                    case YYImageTypeWebP: { // save to disk cache
-                        if (!hasAnimation) {
+                    case YYImageTypeWebP:
+                    case YYImageTypePreDecoded: { // save to disk cache
+                        if (!hasAnimation && !downsample) { // keep original data if downsampled
                             if (imageType == YYImageTypeGIF ||
-                                imageType == YYImageTypeWebP) {
+                                imageType == YYImageTypeWebP ||
+                                imageType == YYImageTypePreDecoded) {
                                 self.data = nil; // clear the data, re-encode for disk cache
                             }
                         }
                     } break;
                     default: {
-                        self.data = nil; // clear the data, re-encode for disk cache
+                        if (!downsample) self.data = nil; // clear the data, re-encode for disk cache
                     } break;
                 }
                 if ([self isCancelled]) return;
@@ -630,7 +678,7 @@ static void URLInBlackListAdd(NSURL *url) {
                 }
                 
                 [self performSelector:@selector(_didReceiveImageFromWeb:) onThread:[self.class _networkThread] withObject:image waitUntilDone:NO];
-            });
+            }];
             if (![self.request.URL isFileURL] && (self.options & YYWebImageOptionShowNetworkActivity)) {
                 [[UIApplication sharedExtensionApplication] decrementNetworkActivityCount];
             }
@@ -648,6 +696,7 @@ static void URLInBlackListAdd(NSURL *url) {
             }
             _connection = nil;
             _data = nil;
+            _progressiveDecoder = nil;
             if (![_request.URL isFileURL] && (_options & YYWebImageOptionShowNetworkActivity)) {
                 [[UIApplication sharedExtensionApplication] decrementNetworkActivityCount];
             }
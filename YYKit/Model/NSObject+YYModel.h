@@ -136,6 +136,32 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (BOOL)modelSetWithDictionary:(NSDictionary *)dic;
 
+/**
+ Set the receiver's properties with a key-value dictionary, but skip the properties
+ whose incoming values are equal to the current values.
+ 
+ @param dic  A key-value dictionary mapped to the receiver's properties.
+ Any invalid key-value pair in dictionary will be ignored.
+ 
+ @discussion The key-value transform rules are same as `modelSetWithDictionary:`.
+ The setter is not called if the incoming value can be compared cheaply (string, number,
+ date, url, data, plain container...) and is equal to the current property value.
+ Nested model object is patched recursively in copy-on-write mode: it's copied (shallow,
+ with `modelCopy`) only before its first changed property, and the copy is set to the
+ property, so only the objects on the changed paths are copied, and a nested object
+ shared by other owners is never mutated. A nested object which implements
+ `modelCustomTransformFromDictionary:` is always copied, as the transform may change it.
+ If the property has custom class mapping, the nested object is created again as
+ `modelSetWithDictionary:` does. It's useful when you refresh a lot of models with the
+ data which is mostly unchanged.
+ 
+ The properties changed inside `modelCustomTransformFromDictionary:` are not reported
+ in the returned array, as they're not compared with the old values.
+ 
+ @return An array of property's name which is changed (may be empty), or nil if an error occurs.
+ */
+- (nullable NSArray<NSString *> *)modelApplyPatchWithDictionary:(NSDictionary *)dic;
+
 /**
  Generate a json object from the receiver's properties.
  model-->json
@@ -204,6 +230,22 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (NSUInteger)modelHash;
 
+/**
+ Get a hash code with the receiver's properties, the result is cached in the receiver.
+ 
+ @discussion The cached value is invalidated by `modelSetWithJSON:`, `modelSetWithDictionary:`,
+ `modelApplyPatchWithDictionary:` and `modelInitWithCoder:`. If you change the properties
+ in other way, call `modelInvalidateCachedHash` before use this method.
+ 
+ @return Hash code, same as `modelHash`.
+ */
+- (NSUInteger)modelCachedHash;
+
+/**
+ Remove the hash code cached by `modelCachedHash`.
+ */
+- (void)modelInvalidateCachedHash;
+
 /**
  Compares the receiver with another object for equality, based on properties.
  根据属性，将接收器与另一个对象进行比较，以确定是否相等。
@@ -214,6 +256,18 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (BOOL)modelIsEqual:(id)model;
 
+/**
+ Compares the receiver with another object based on properties, and returns the
+ properties which are different.
+ 
+ @param model  Another object, should be the same class as the receiver.
+ 
+ @return An array of property's name whose value is not equal (may be empty),
+ or nil if the object is not the same class as the receiver (or the receiver is a
+ Foundation object such as NSString, NSArray).
+ */
+- (nullable NSArray<NSString *> *)modelDiffWith:(id)model;
+
 /**
  Description method for debugging purposes based on properties.
  
@@ -13,6 +13,10 @@
 #import "YYClassInfo.h"
 #import <objc/message.h>
 
+#if __has_include("NSNumber+YYAdd.h")
+#import "NSNumber+YYAdd.h"
+#endif
+
 #define force_inline __inline__ __attribute__((always_inline))
 
 /// Foundation Class Type
@@ -75,7 +79,13 @@ static force_inline BOOL YYEncodingTypeIsCNumber(YYEncodingType type) {
     }
 }
 
-/// Parse a number value from 'id'.
+/**
+ Parse a number value from 'id'.
+ A plain decimal string is parsed by `YYNumberParseString()` if NSNumber+YYAdd is
+ available. Words (@"true", @"null"...), hex, exponent and out of range integers are
+ not accepted by it, they're parsed by the code below as before (atof/atoll), which
+ is also the whole parser when YYModel is used without NSNumber+YYAdd.
+ */
 static force_inline NSNumber *YYNSNumberCreateFromID(__unsafe_unretained id value) {
     static NSCharacterSet *dot;
     static NSDictionary *dic;
@@ -111,6 +121,11 @@ static force_inline NSNumber *YYNSNumberCreateFromID(__unsafe_unretained id valu
     if (!value || value == (id)kCFNull) return nil;
     if ([value isKindOfClass:[NSNumber class]]) return value;
     if ([value isKindOfClass:[NSString class]]) {
+#ifdef NSNumber_YYAdd_h
+        BOOL valid = NO;
+        NSNumber *parsed = YYNumberParseString(value, &valid);
+        if (valid) return parsed;
+#endif
         NSNumber *num = dic[value];
         if (num != nil) {
             if (num == (id)kCFNull) return nil;
@@ -471,6 +486,8 @@ static force_inline id YYValueForMultiKeys(__unsafe_unretained NSDictionary *dic
     BOOL _hasCustomTransformFromDictionary;
     BOOL _hasCustomTransformToDictionary;
     BOOL _hasCustomClassFromDictionary;
+    /// Some instance of this model has cached the hash (see -modelCachedHash).
+    BOOL _hasCachedHash;
 }
 @end
 
@@ -1097,13 +1114,266 @@ static void ModelSetValueForProperty(__unsafe_unretained id model,
     }
 }
 
+/**
+ Whether the property values of two models are equal.
+ 
+ @discussion Caller should hold strong reference to the parameters before this function returns.
+ The property which is not KVC compatible is ignored (same as `-modelIsEqual:`).
+ 
+ @param model1 Should not be nil.
+ @param model2 Should not be nil, and should be the same class as model1.
+ @param meta   Should not be nil, meta->_getter should not be nil.
+ @return YES if the two values are equal.
+ */
+static BOOL ModelPropertyIsEqual(__unsafe_unretained id model1,
+                                 __unsafe_unretained id model2,
+                                 __unsafe_unretained _YYModelPropertyMeta *meta) {
+    if (!meta->_isKVCCompatible) return YES;
+    switch (meta->_type & YYEncodingTypeMask) {
+        case YYEncodingTypeBool: {
+            bool v1 = ((bool (*)(id, SEL))(void *) objc_msgSend)((id)model1, meta->_getter);
+            bool v2 = ((bool (*)(id, SEL))(void *) objc_msgSend)((id)model2, meta->_getter);
+            return v1 == v2;
+        }
+        case YYEncodingTypeInt8:
+        case YYEncodingTypeUInt8: {
+            uint8_t v1 = ((uint8_t (*)(id, SEL))(void *) objc_msgSend)((id)model1, meta->_getter);
+            uint8_t v2 = ((uint8_t (*)(id, SEL))(void *) objc_msgSend)((id)model2, meta->_getter);
+            return v1 == v2;
+        }
+        case YYEncodingTypeInt16:
+        case YYEncodingTypeUInt16: {
+            uint16_t v1 = ((uint16_t (*)(id, SEL))(void *) objc_msgSend)((id)model1, meta->_getter);
+            uint16_t v2 = ((uint16_t (*)(id, SEL))(void *) objc_msgSend)((id)model2, meta->_getter);
+            return v1 == v2;
+        }
+        case YYEncodingTypeInt32:
+        case YYEncodingTypeUInt32: {
+            uint32_t v1 = ((uint32_t (*)(id, SEL))(void *) objc_msgSend)((id)model1, meta->_getter);
+            uint32_t v2 = ((uint32_t (*)(id, SEL))(void *) objc_msgSend)((id)model2, meta->_getter);
+            return v1 == v2;
+        }
+        case YYEncodingTypeInt64:
+        case YYEncodingTypeUInt64: {
+            uint64_t v1 = ((uint64_t (*)(id, SEL))(void *) objc_msgSend)((id)model1, meta->_getter);
+            uint64_t v2 = ((uint64_t (*)(id, SEL))(void *) objc_msgSend)((id)model2, meta->_getter);
+            return v1 == v2;
+        }
+        case YYEncodingTypeFloat: {
+            float v1 = ((float (*)(id, SEL))(void *) objc_msgSend)((id)model1, meta->_getter);
+            float v2 = ((float (*)(id, SEL))(void *) objc_msgSend)((id)model2, meta->_getter);
+            return v1 == v2;
+        }
+        case YYEncodingTypeDouble: {
+            double v1 = ((double (*)(id, SEL))(void *) objc_msgSend)((id)model1, meta->_getter);
+            double v2 = ((double (*)(id, SEL))(void *) objc_msgSend)((id)model2, meta->_getter);
+            return v1 == v2;
+        }
+        case YYEncodingTypeObject:
+        case YYEncodingTypeClass:
+        case YYEncodingTypeBlock: {
+            id v1 = ((id (*)(id, SEL))(void *) objc_msgSend)((id)model1, meta->_getter);
+            id v2 = ((id (*)(id, SEL))(void *) objc_msgSend)((id)model2, meta->_getter);
+            if (v1 == v2) return YES;
+            if (v1 == nil || v2 == nil) return NO;
+            return [v1 isEqual:v2];
+        }
+        case YYEncodingTypeStruct:
+        case YYEncodingTypeUnion: {
+            @try {
+                NSValue *v1 = [model1 valueForKey:NSStringFromSelector(meta->_getter)];
+                NSValue *v2 = [model2 valueForKey:NSStringFromSelector(meta->_getter)];
+                if (v1 == v2) return YES;
+                if (v1 == nil || v2 == nil) return NO;
+                return [v1 isEqual:v2];
+            } @catch (NSException *exception) {
+                return NO;
+            }
+        }
+        default: return YES;
+    }
+}
+
+/**
+ Whether the property value is equal to the value which will be set to it.
+ 
+ @discussion Caller should hold strong reference to the parameters before this function returns.
+ Only the value which can be compared without conversion (or with a cheap conversion)
+ is checked, otherwise this function returns NO.
+ 
+ @param model Should not be nil.
+ @param value Should not be nil, but can be NSNull.
+ @param meta  Should not be nil, meta->_getter should not be nil.
+ @return YES if the setter can be skipped.
+ */
+static BOOL ModelPropertyIsEqualToValue(__unsafe_unretained id model,
+                                        __unsafe_unretained id value,
+                                        __unsafe_unretained _YYModelPropertyMeta *meta) {
+    if (meta->_isCNumber) {
+        NSNumber *num = YYNSNumberCreateFromID(value);
+        if (num == nil) return NO;
+        NSNumber *current = ModelCreateNumberFromProperty(model, meta);
+        if (current == nil) return NO;
+        return [current isEqualToNumber:num];
+    }
+
+    switch (meta->_type & YYEncodingTypeMask) {
+        case YYEncodingTypeObject: {
+            id current = ((id (*)(id, SEL))(void *) objc_msgSend)((id)model, meta->_getter);
+            if (value == (id)kCFNull) return current == nil;
+            if (current == nil) return NO;
+            if (current == value) return YES;
+            switch (meta->_nsType) {
+                case YYEncodingTypeNSString:
+                case YYEncodingTypeNSMutableString: {
+                    if (![value isKindOfClass:[NSString class]]) return NO;
+                    return [(NSString *)current isEqualToString:value];
+                }
+                case YYEncodingTypeNSNumber: {
+                    if (![value isKindOfClass:[NSNumber class]]) return NO;
+                    return [(NSNumber *)current isEqualToNumber:value];
+                }
+                case YYEncodingTypeNSDecimalNumber: {
+                    if (![value isKindOfClass:[NSDecimalNumber class]]) return NO;
+                    return [current isEqual:value];
+                }
+                case YYEncodingTypeNSValue: {
+                    if (![value isKindOfClass:[NSValue class]]) return NO;
+                    return [current isEqual:value];
+                }
+                case YYEncodingTypeNSData:
+                case YYEncodingTypeNSMutableData: {
+                    if (![value isKindOfClass:[NSData class]]) return NO;
+                    return [(NSData *)current isEqualToData:value];
+                }
+                case YYEncodingTypeNSDate: {
+                    if (![value isKindOfClass:[NSDate class]]) return NO;
+                    return [(NSDate *)current isEqualToDate:value];
+                }
+                case YYEncodingTypeNSURL: {
+                    if (![value isKindOfClass:[NSURL class]]) return NO;
+                    return [current isEqual:value];
+                }
+                case YYEncodingTypeNSArray:
+                case YYEncodingTypeNSMutableArray: {
+                    if (meta->_genericCls) return NO;
+                    if (![value isKindOfClass:[NSArray class]]) return NO;
+                    return [(NSArray *)current isEqualToArray:value];
+                }
+                case YYEncodingTypeNSDictionary:
+                case YYEncodingTypeNSMutableDictionary: {
+                    if (meta->_genericCls) return NO;
+                    if (![value isKindOfClass:[NSDictionary class]]) return NO;
+                    return [(NSDictionary *)current isEqualToDictionary:value];
+                }
+                case YYEncodingTypeNSSet:
+                case YYEncodingTypeNSMutableSet: {
+                    if (meta->_genericCls) return NO;
+                    if (![value isKindOfClass:[NSSet class]]) return NO;
+                    return [(NSSet *)current isEqualToSet:value];
+                }
+                default: {
+                    Class cls = meta->_genericCls ?: meta->_cls;
+                    if (!cls || [value isKindOfClass:[NSDictionary class]]) return NO;
+                    if (![value isKindOfClass:cls]) return NO;
+                    return [current isEqual:value];
+                }
+            }
+        }
+        case YYEncodingTypeClass: {
+            Class current = ((Class (*)(id, SEL))(void *) objc_msgSend)((id)model, meta->_getter);
+            if (value == (id)kCFNull) return current == NULL;
+            if ([value isKindOfClass:[NSString class]]) return current == NSClassFromString(value);
+            return current == (Class)value;
+        }
+        case YYEncodingTypeSEL: {
+            SEL current = ((SEL (*)(id, SEL))(void *) objc_msgSend)((id)model, meta->_getter);
+            if (value == (id)kCFNull) return current == NULL;
+            if (![value isKindOfClass:[NSString class]]) return NO;
+            return current && sel_isEqual(current, NSSelectorFromString(value));
+        }
+        default: return NO;
+    }
+}
+
+@interface NSObject (YYModelPatch)
+- (NSArray *)_yy_modelApplyPatchWithDictionary:(NSDictionary *)dic copied:(id *)copied;
+@end
 
 typedef struct {
     void *modelMeta;  ///< _YYModelMeta
-    void *model;      ///< id (self)
+    void *model;      ///< id (self, or the retained copy of self if modelCopied)
     void *dictionary; ///< NSDictionary (json)
+    void *changedNames; ///< NSMutableArray<NSString>, changed property names (patch only, can be NULL)
+    BOOL copyOnWrite; ///< copy self before the first change (patch only)
+    BOOL modelCopied; ///< `model` is the copy of self
 } ModelSetContext;
 
+/**
+ Returns the model to be changed. If context.copyOnWrite is YES, the model is copied
+ with `modelCopy` before the first change, so the original model is never changed.
+ 
+ @return The model, or nil if the copy failed.
+ */
+static id ModelSetContextGetWritableModel(ModelSetContext *context) {
+    if (context->copyOnWrite && !context->modelCopied) {
+        id copied = [(__bridge id)(context->model) modelCopy];
+        if (!copied) return nil;
+        context->model = (void *)CFBridgingRetain(copied);
+        context->modelCopied = YES;
+    }
+    return (__bridge id)(context->model);
+}
+
+/**
+ Set value to model with a property meta, if the value is not equal to current value.
+ 
+ @discussion Caller should hold strong reference to the parameters before this function returns.
+ A nested model object is patched in copy-on-write mode: it's copied (shallow, with `modelCopy`)
+ only before its first changed property, and the copy is set to the property; so only
+ the objects on the changed paths are copied, and the object shared by others is not changed.
+ If the property has custom class mapping (`+modelCustomClassForDictionary:`) or the
+ nested object is not an instance of the property's class, a new object is created instead.
+ 
+ @param context Should not be nil, context->model is the model to be patched.
+ @param value   Should not be nil, but can be NSNull.
+ @param meta    Should not be nil, and meta->_setter should not be nil.
+ @return YES if the property is changed.
+ */
+static BOOL ModelPatchValueForProperty(ModelSetContext *context,
+                                       __unsafe_unretained id value,
+                                       __unsafe_unretained _YYModelPropertyMeta *meta) {
+    __unsafe_unretained id model = (__bridge id)(context->model);
+    if (meta->_getter && ModelPropertyIsEqualToValue(model, value, meta)) return NO;
+    
+    if (meta->_getter &&
+        (meta->_type & YYEncodingTypeMask) == YYEncodingTypeObject &&
+        meta->_nsType == YYEncodingTypeNSUnknown &&
+        [value isKindOfClass:[NSDictionary class]]) {
+        Class cls = meta->_genericCls ?: meta->_cls;
+        if (cls && ![value isKindOfClass:cls] && !meta->_hasCustomClassFromDictionary) {
+            NSObject *one = ((id (*)(id, SEL))(void *) objc_msgSend)((id)model, meta->_getter);
+            if (one && object_getClass(one) == cls) {
+                id patched = nil;
+                NSArray *changed = [one _yy_modelApplyPatchWithDictionary:value copied:&patched];
+                if (changed) {
+                    if (!patched || object_getClass(patched) != cls) return NO;
+                    model = ModelSetContextGetWritableModel(context);
+                    if (!model) return NO;
+                    ((void (*)(id, SEL, id))(void *) objc_msgSend)((id)model, meta->_setter, (id)patched);
+                    return YES;
+                }
+            }
+        }
+    }
+    
+    model = ModelSetContextGetWritableModel(context);
+    if (!model) return NO;
+    ModelSetValueForProperty(model, value, meta);
+    return YES;
+}
+
+
 /**
  Apply function for dictionary, to set the key-value pair to model.
  
@@ -1115,10 +1385,15 @@ static void ModelSetWithDictionaryFunction(const void *_key, const void *_value,
     ModelSetContext *context = _context;
     __unsafe_unretained _YYModelMeta *meta = (__bridge _YYModelMeta *)(context->modelMeta);
     __unsafe_unretained _YYModelPropertyMeta *propertyMeta = [meta->_mapper objectForKey:(__bridge id)(_key)];
-    __unsafe_unretained id model = (__bridge id)(context->model);
     while (propertyMeta) {
         if (propertyMeta->_setter) {
-            ModelSetValueForProperty(model, (__bridge __unsafe_unretained id)_value, propertyMeta);
+            if (context->changedNames) {
+                if (ModelPatchValueForProperty(context, (__bridge __unsafe_unretained id)_value, propertyMeta)) {
+                    [(__bridge NSMutableArray *)context->changedNames addObject:propertyMeta->_name];
+                }
+            } else {
+                ModelSetValueForProperty((__bridge id)(context->model), (__bridge __unsafe_unretained id)_value, propertyMeta);
+            }
         }
         propertyMeta = propertyMeta->_next;
     };
@@ -1146,8 +1421,13 @@ static void ModelSetWithPropertyMetaArrayFunction(const void *_propertyMeta, voi
     }
     
     if (value) {
-        __unsafe_unretained id model = (__bridge id)(context->model);
-        ModelSetValueForProperty(model, value, propertyMeta);
+        if (context->changedNames) {
+            if (ModelPatchValueForProperty(context, value, propertyMeta)) {
+                [(__bridge NSMutableArray *)context->changedNames addObject:propertyMeta->_name];
+            }
+        } else {
+            ModelSetValueForProperty((__bridge id)(context->model), value, propertyMeta);
+        }
     }
 }
 
@@ -1475,6 +1755,28 @@ static NSString *ModelDescription(NSObject *model) {
 }
 
 - (BOOL)modelSetWithDictionary:(NSDictionary *)dic {
+    return [self _yy_modelSetWithDictionary:dic changedNames:nil copied:NULL];
+}
+
+- (NSArray *)modelApplyPatchWithDictionary:(NSDictionary *)dic {
+    return [self _yy_modelApplyPatchWithDictionary:dic copied:NULL];
+}
+
+- (NSArray *)_yy_modelApplyPatchWithDictionary:(NSDictionary *)dic copied:(id *)copied {
+    NSMutableArray *changedNames = [NSMutableArray new];
+    BOOL suc = [self _yy_modelSetWithDictionary:dic changedNames:changedNames copied:copied];
+    return suc ? changedNames : nil;
+}
+
+/**
+ Set the receiver's properties with a dictionary.
+ 
+ @param changedNames Output the changed property names, and skip the equal values (patch).
+ @param copied       If not NULL, the receiver is not changed: it's copied before the
+    first change, and the changed copy is returned (nil if nothing changed).
+ */
+- (BOOL)_yy_modelSetWithDictionary:(NSDictionary *)dic changedNames:(NSMutableArray *)changedNames copied:(id *)copied {
+    if (copied) *copied = nil;
     if (!dic || dic == (id)kCFNull) return NO;
     if (![dic isKindOfClass:[NSDictionary class]]) return NO;
     
@@ -1490,6 +1792,12 @@ static NSString *ModelDescription(NSObject *model) {
     context.modelMeta = (__bridge void *)(modelMeta);
     context.model = (__bridge void *)(self);
     context.dictionary = (__bridge void *)(dic);
+    context.changedNames = (__bridge void *)(changedNames);
+    context.copyOnWrite = copied != NULL;
+    if (copied && modelMeta->_hasCustomTransformFromDictionary) {
+        // the custom transform may change any property, so copy before it
+        if (!ModelSetContextGetWritableModel(&context)) return NO;
+    }
     
     if (modelMeta->_keyMappedCount >= CFDictionaryGetCount((CFDictionaryRef)dic)) {
         CFDictionaryApplyFunction((CFDictionaryRef)dic, ModelSetWithDictionaryFunction, &context);
@@ -1512,10 +1820,21 @@ static NSString *ModelDescription(NSObject *model) {
                              &context);
     }
     
+    id model = context.modelCopied ? CFBridgingRelease(context.model) : self;
+    if (copied && context.modelCopied) *copied = model;
+    if (copied && !context.modelCopied) return YES; // nothing changed
+    
+    BOOL suc = YES;
     if (modelMeta->_hasCustomTransformFromDictionary) {
-        return [((id<YYModel>)self) modelCustomTransformFromDictionary:dic];
+        suc = [((id<YYModel>)model) modelCustomTransformFromDictionary:dic];
     }
-    return YES;
+    
+    // the custom transform may change any property, so invalidate the hash after it
+    if (modelMeta->_hasCachedHash &&
+        (!changedNames || changedNames.count || modelMeta->_hasCustomTransformFromDictionary)) {
+        [model modelInvalidateCachedHash];
+    }
+    return suc;
 }
 
 - (id)modelToJSONObject {
@@ -1724,6 +2043,7 @@ static NSString *ModelDescription(NSObject *model) {
             }
         }
     }
+    if (modelMeta->_hasCachedHash) [self modelInvalidateCachedHash];
     return self;
 }
 
@@ -1743,6 +2063,26 @@ static NSString *ModelDescription(NSObject *model) {
     return value;
 }
 
+static const int model_cached_hash_key;
+
+- (NSUInteger)modelCachedHash {
+    if (self == (id)kCFNull) return [self hash];
+    _YYModelMeta *modelMeta = [_YYModelMeta metaWithClass:self.class];
+    if (modelMeta->_nsType) return [self hash];
+    
+    NSNumber *hash = objc_getAssociatedObject(self, &model_cached_hash_key);
+    if (hash) return hash.unsignedIntegerValue;
+    modelMeta->_hasCachedHash = YES;
+    NSUInteger value = [self modelHash];
+    objc_setAssociatedObject(self, &model_cached_hash_key, @(value), OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+    return value;
+}
+
+- (void)modelInvalidateCachedHash {
+    if (self == (id)kCFNull) return;
+    objc_setAssociatedObject(self, &model_cached_hash_key, nil, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+}
+
 - (BOOL)modelIsEqual:(id)model {
     if (self == model) return YES;
     if (![model isMemberOfClass:self.class]) return NO;
@@ -1751,16 +2091,24 @@ static NSString *ModelDescription(NSObject *model) {
     if ([self hash] != [model hash]) return NO;
     
     for (_YYModelPropertyMeta *propertyMeta in modelMeta->_allPropertyMetas) {
-        if (!propertyMeta->_isKVCCompatible) continue;
-        id this = [self valueForKey:NSStringFromSelector(propertyMeta->_getter)];
-        id that = [model valueForKey:NSStringFromSelector(propertyMeta->_getter)];
-        if (this == that) continue;
-        if (this == nil || that == nil) return NO;
-        if (![this isEqual:that]) return NO;
+        if (!ModelPropertyIsEqual(self, model, propertyMeta)) return NO;
     }
     return YES;
 }
 
+- (NSArray *)modelDiffWith:(id)model {
+    if (![model isMemberOfClass:self.class]) return nil;
+    if (self == model) return @[];
+    _YYModelMeta *modelMeta = [_YYModelMeta metaWithClass:self.class];
+    if (modelMeta->_nsType) return nil;
+    
+    NSMutableArray *names = [NSMutableArray new];
+    for (_YYModelPropertyMeta *propertyMeta in modelMeta->_allPropertyMetas) {
+        if (!ModelPropertyIsEqual(self, model, propertyMeta)) [names addObject:propertyMeta->_name];
+    }
+    return names;
+}
+
 - (NSString *)modelDescription {
     return ModelDescription(self);
 }
@@ -189,6 +189,40 @@ extern const CGSize YYTextContainerMaxSize;
                                           text:(NSAttributedString *)text
                                          range:(NSRange)range;
 
+/**
+ Generate a layout with the given container and text, reusing a previous layout
+ of the text before editing.
+ 
+ @discussion Only the paragraphs intersecting the edited range (and one paragraph
+ before and after them) are typeset by CoreText again. The lines before them are
+ reused, and the CTLines after them are reused in new YYTextLine objects with shifted
+ positions. Only the CTFramesetter/CTFrame work is saved: the text is still copied,
+ and the line array, row edges, bounding rect and attachments are still rebuilt for
+ the whole text, so the cost is still linear in the text length (but much lower).
+ 
+ It falls back to a full layout (same as `layoutWithContainer:text:`) when the
+ container is different from the previous layout's container in size, insets or
+ path line width, or has a path, exclusion paths, vertical form, a maximum number
+ of rows or a line position modifier, or when the previous layout did not contain
+ the whole text.
+ 
+ A layout created incrementally has no `frameSetter` and `frame`.
+ 
+ @param container      The text container (if nil, returns nil).
+ @param text           The full text after editing (if nil, returns nil). The
+    characters and attributes outside the edited range should be same as the
+    previous layout's text.
+ @param previousLayout The layout before editing. If nil, it's a full layout.
+ @param editedRange    The edited range in the new text.
+ @param delta          The change in length of the text (new length - old length).
+ @return A new layout, or nil when an error occurs.
+ */
++ (nullable YYTextLayout *)layoutWithContainer:(YYTextContainer *)container
+                                          text:(NSAttributedString *)text
+                                previousLayout:(nullable YYTextLayout *)previousLayout
+                                   editedRange:(NSRange)editedRange
+                                changeInLength:(NSInteger)delta;
+
 /**
  Generate layouts with the given containers and text.
  
@@ -214,6 +248,26 @@ extern const CGSize YYTextContainerMaxSize;
                                                       text:(NSAttributedString *)text
                                                      range:(NSRange)range;
 
+/**
+ Generate layouts for pairs of text and container concurrently.
+ 
+ @discussion The layouts are generated on global queue by at most as many
+ workers as the active processor count. This method blocks until all the
+ layouts are generated, so it's recommended to call it on a background queue.
+ 
+ @param containers An array of YYTextContainer object (if nil, returns nil).
+ @param texts      An array of NSAttributedString object, the count should be
+    same as containers (otherwise returns nil).
+ @param cancel     Cancel checker, it's called before each layout (from any thread).
+    Pass a block such as `^{ return sentinel.value != value; }` to cancel the work
+    with a `YYSentinel`. It can be nil.
+ @return An array of YYTextLayout object in the same order as texts, or nil when
+    cancelled or an error occurs.
+ */
++ (nullable NSArray<YYTextLayout *> *)layoutsWithContainers:(NSArray<YYTextContainer *> *)containers
+                                                      texts:(NSArray<NSAttributedString *> *)texts
+                                                     cancel:(nullable BOOL (^)(void))cancel;
+
 - (instancetype)init UNAVAILABLE_ATTRIBUTE;
 + (instancetype)new UNAVAILABLE_ATTRIBUTE;
 
@@ -229,10 +283,10 @@ extern const CGSize YYTextContainerMaxSize;
 @property (nonatomic, strong, readonly) NSAttributedString *text;
 ///< The text range in full text
 @property (nonatomic, readonly) NSRange range;
-///< CTFrameSetter
-@property (nonatomic, readonly) CTFramesetterRef frameSetter;
-///< CTFrame
-@property (nonatomic, readonly) CTFrameRef frame;
+///< CTFrameSetter, NULL if the layout was updated incrementally
+@property (nullable, nonatomic, readonly) CTFramesetterRef frameSetter;
+///< CTFrame, NULL if the layout was updated incrementally
+@property (nullable, nonatomic, readonly) CTFrameRef frame;
 ///< Array of `YYTextLine`, no truncated
 @property (nonatomic, strong, readonly) NSArray<YYTextLine *> *lines;
 ///< YYTextLine with truncated token, or nil
@@ -571,4 +625,71 @@ extern const CGSize YYTextContainerMaxSize;
 
 @end
 
+
+
+/**
+ A thread-safe memory cache of text layouts.
+ 
+ @discussion The layouts are keyed by the content of the text (characters and
+ attributes) and the parameters of the container, so a layout is reused for an
+ equal text and container even if they are different objects.
+ 
+ The texts with equal content also share one CTFramesetter, so the layouts of a
+ text in containers of different sizes only create the framesetter once. So the
+ `frameSetter` of these layouts may be shared with other layouts.
+ 
+ A layout with attachments is not cached, as its views and layers can't be shared.
+ A cached layout may be drawn by several views at the same time, so its drawing
+ is serialized.
+ 
+ The containers are compared by their parameters, but the `path`, `exclusionPaths`,
+ `truncationToken` and `linePositionModifier` are compared with `isEqual:`. UIBezierPath
+ compares by pointer and the container copies the path when it's set, and the
+ modifier is copied with the container. So a container with a custom `path` only
+ matches the copies of itself (never the container of another view), and a container
+ with a custom `linePositionModifier` without `isEqual:` never hits the cache
+ (`YYTextLinePositionSimpleModifier` implements it).
+ 
+ The cache is bounded by `YYMemoryCache`, and it releases all objects when
+ receiving memory warning. YYLabel and YYTextView use the shared cache only when
+ their `usesLayoutCache` is YES.
+ */
+@interface YYTextLayoutCache : NSObject
+
+/// The shared cache.
++ (instancetype)sharedCache;
+
+/// The maximum total length of the texts of cached layouts. Default is 1M.
+@property NSUInteger costLimit;
+
+/// The maximum number of cached layouts. Default is 1000.
+@property NSUInteger countLimit;
+
+/// The maximum number of cached framesetters. Default is 64.
+@property NSUInteger frameSetterCountLimit;
+
+/// The number of layout requests which returned a cached layout.
+@property (readonly) NSUInteger hitCount;
+
+/// The number of layout requests which created a new layout.
+@property (readonly) NSUInteger missCount;
+
+/// hitCount / (hitCount + missCount), or 0 if there's no request.
+@property (readonly) double hitRate;
+
+/**
+ Returns a cached layout for the text and container, or generates and caches
+ a new layout (see `+[YYTextLayout layoutWithContainer:text:]`).
+ 
+ @param container The text container (if nil, returns nil).
+ @param text      The text (if nil, returns nil).
+ @return A layout, or nil when an error occurs.
+ */
+- (nullable YYTextLayout *)layoutWithContainer:(YYTextContainer *)container text:(NSAttributedString *)text;
+
+/// Remove all cached layouts and framesetters, and reset the hit counts.
+- (void)removeAllObjects;
+
+@end
+
 NS_ASSUME_NONNULL_END
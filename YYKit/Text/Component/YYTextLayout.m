@@ -15,6 +15,8 @@
 #import "YYTextUtilities.h"
 #import "YYTextAttribute.h"
 #import "YYTextArchiver.h"
+#import "YYMemoryCache.h"
+#import <libkern/OSAtomic.h>
 
 #import "NSAttributedString+YYText.h"
 #import "UIFont+YYAdd.h"
@@ -58,6 +60,129 @@ static CGColorRef YYTextGetCGColor(CGColorRef color) {
     return color;
 }
 
+/**
+ CoreText bugs that depend on the system version.
+ 
+ @param joinedEmoji  Bug when draw joined emoji since iOS 8.3.
+ See -[NSMutableAttributedString setClearColorToJoinedEmoji] for more information.
+ 
+ @param layoutSize   It may use larger constraint size when create CTFrame with
+ CTFramesetterCreateFrame in iOS 10.
+ */
+static void YYTextGetCoreTextBugs(BOOL *joinedEmoji, BOOL *layoutSize) {
+    static BOOL needFixJoinedEmojiBug = NO;
+    static BOOL needFixLayoutSizeBug = NO;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        CGFloat systemVersionFloat = [UIDevice currentDevice].systemVersion.floatValue;
+        if (8.3 <= systemVersionFloat && systemVersionFloat < 9) {
+            needFixJoinedEmojiBug = YES;
+        }
+        if (systemVersionFloat >= 10) {
+            needFixLayoutSizeBug = YES;
+        }
+    });
+    if (joinedEmoji) *joinedEmoji = needFixJoinedEmojiBug;
+    if (layoutSize) *layoutSize = needFixLayoutSizeBug;
+}
+
+/**
+ Calculate the row edges and the first line index of each row.
+ The lines should be sorted by row, and the returned buffers should be freed by caller.
+ */
+static BOOL YYTextCreateRowEdges(NSArray *lines, NSUInteger rowCount, BOOL isVerticalForm, YYRowEdge **rowsEdge, NSUInteger **rowsIndex) {
+    YYRowEdge *lineRowsEdge = calloc(rowCount, sizeof(YYRowEdge));
+    NSUInteger *lineRowsIndex = calloc(rowCount, sizeof(NSUInteger));
+    if (!lineRowsEdge || !lineRowsIndex) {
+        if (lineRowsEdge) free(lineRowsEdge);
+        if (lineRowsIndex) free(lineRowsIndex);
+        return NO;
+    }
+    NSInteger lastRowIdx = -1;
+    CGFloat lastHead = 0;
+    CGFloat lastFoot = 0;
+    for (NSUInteger i = 0, max = lines.count; i < max; i++) {
+        YYTextLine *line = lines[i];
+        CGRect rect = line.bounds;
+        if ((NSInteger)line.row != lastRowIdx) {
+            if (lastRowIdx >= 0) {
+                lineRowsEdge[lastRowIdx] = (YYRowEdge) {.head = lastHead, .foot = lastFoot };
+            }
+            lastRowIdx = line.row;
+            lineRowsIndex[lastRowIdx] = i;
+            if (isVerticalForm) {
+                lastHead = rect.origin.x + rect.size.width;
+                lastFoot = lastHead - rect.size.width;
+            } else {
+                lastHead = rect.origin.y;
+                lastFoot = lastHead + rect.size.height;
+            }
+        } else {
+            if (isVerticalForm) {
+                lastHead = MAX(lastHead, rect.origin.x + rect.size.width);
+                lastFoot = MIN(lastFoot, rect.origin.x);
+            } else {
+                lastHead = MIN(lastHead, rect.origin.y);
+                lastFoot = MAX(lastFoot, rect.origin.y + rect.size.height);
+            }
+        }
+    }
+    lineRowsEdge[lastRowIdx] = (YYRowEdge) {.head = lastHead, .foot = lastFoot };
+    
+    for (NSUInteger i = 1; i < rowCount; i++) {
+        YYRowEdge v0 = lineRowsEdge[i - 1];
+        YYRowEdge v1 = lineRowsEdge[i];
+        lineRowsEdge[i - 1].foot = lineRowsEdge[i].head = (v0.foot + v1.head) * 0.5;
+    }
+    *rowsEdge = lineRowsEdge;
+    *rowsIndex = lineRowsIndex;
+    return YES;
+}
+
+/// Calculate the bounding size from text bounding rect.
+static CGSize YYTextGetBoundingSize(YYTextContainer *container, CGRect textBoundingRect) {
+    CGRect rect = textBoundingRect;
+    if (container.path) {
+        if (container.pathLineWidth > 0) {
+            CGFloat inset = container.pathLineWidth / 2;
+            rect = CGRectInset(rect, -inset, -inset);
+        }
+    } else {
+        rect = UIEdgeInsetsInsetRect(rect, UIEdgeInsetsInvert(container.insets));
+    }
+    rect = CGRectStandardize(rect);
+    CGSize size = rect.size;
+    if (container.verticalForm) {
+        size.width += container.size.width - (rect.origin.x + rect.size.width);
+    } else {
+        size.width += rect.origin.x;
+    }
+    size.height += rect.origin.y;
+    if (size.width < 0) size.width = 0;
+    if (size.height < 0) size.height = 0;
+    size.width = ceil(size.width);
+    size.height = ceil(size.height);
+    return size;
+}
+
+/// Whether the container is a simple rect which can be laid out paragraph by paragraph.
+static BOOL YYTextContainerIsSimpleRect(YYTextContainer *container) {
+    return container.path == nil && container.exclusionPaths.count == 0 && !container.verticalForm &&
+    container.maximumNumberOfRows == 0 && container.linePositionModifier == nil;
+}
+
+/// Returns the number of lines (sorted by range) which end before the text index.
+static NSUInteger YYTextLineCountBeforeIndex(NSArray *lines, NSUInteger index) {
+    NSUInteger lo = 0, hi = lines.count;
+    while (lo < hi) {
+        NSUInteger mid = (lo + hi) / 2;
+        YYTextLine *line = lines[mid];
+        if (line.range.location + line.range.length <= index) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
 @implementation YYTextLinePositionSimpleModifier
 - (void)modifyLines:(NSArray *)lines fromText:(NSAttributedString *)text inContainer:(YYTextContainer *)container {
     if (container.verticalForm) {
@@ -82,6 +207,16 @@ static CGColorRef YYTextGetCGColor(CGColorRef color) {
     one.fixedLineHeight = _fixedLineHeight;
     return one;
 }
+
+- (BOOL)isEqual:(id)object {
+    if (self == object) return YES;
+    if (![object isMemberOfClass:self.class]) return NO;
+    return _fixedLineHeight == ((YYTextLinePositionSimpleModifier *)object).fixedLineHeight;
+}
+
+- (NSUInteger)hash {
+    return (NSUInteger)(NSInteger)lround(_fixedLineHeight * 64);
+}
 @end
 
 
@@ -312,6 +447,32 @@ dispatch_semaphore_signal(_lock);
 
 
 
+/// A CTFramesetter shared by the layouts of equal texts, see `YYTextLayoutCache`.
+@interface _YYTextFrameSetter : NSObject {
+    @package
+    CTFramesetterRef _frameSetter;
+    dispatch_semaphore_t _lock; ///< layout objects of CoreText should be used in one thread at a time
+}
+@end
+
+@implementation _YYTextFrameSetter
+
+- (instancetype)initWithText:(NSAttributedString *)text {
+    self = [super init];
+    _frameSetter = CTFramesetterCreateWithAttributedString((CFTypeRef)text);
+    if (!_frameSetter) return nil;
+    _lock = dispatch_semaphore_create(1);
+    return self;
+}
+
+- (void)dealloc {
+    if (_frameSetter) CFRelease(_frameSetter);
+}
+
+@end
+
+
+
 @interface YYTextLayout ()
 
 @property (nonatomic, readwrite) YYTextContainer *container;
@@ -344,6 +505,13 @@ dispatch_semaphore_signal(_lock);
 
 @property (nonatomic, assign) NSUInteger *lineRowsIndex;
 @property (nonatomic, assign) YYRowEdge *lineRowsEdge; ///< top-left origin
+@property (nonatomic, strong) dispatch_semaphore_t drawLock; ///< a layout shared by YYTextLayoutCache is drawn in one thread at a time
+
+/// Generate a layout with a shared framesetter created from the same text (or nil).
++ (YYTextLayout *)_layoutWithContainer:(YYTextContainer *)container
+                                  text:(NSAttributedString *)text
+                                 range:(NSRange)range
+                           frameSetter:(_YYTextFrameSetter *)sharedFrameSetter;
 
 @end
 
@@ -368,6 +536,10 @@ dispatch_semaphore_signal(_lock);
 }
 
 + (YYTextLayout *)layoutWithContainer:(YYTextContainer *)container text:(NSAttributedString *)text range:(NSRange)range {
+    return [self _layoutWithContainer:container text:text range:range frameSetter:nil];
+}
+
++ (YYTextLayout *)_layoutWithContainer:(YYTextContainer *)container text:(NSAttributedString *)text range:(NSRange)range frameSetter:(_YYTextFrameSetter *)sharedFrameSetter {
     YYTextLayout *layout = NULL;
     CGPathRef cgPath = nil;
     CGRect cgPathBox = {0};
@@ -401,22 +573,8 @@ dispatch_semaphore_signal(_lock);
     container->_readonly = YES;
     maximumNumberOfRows = container.maximumNumberOfRows;
     
-    // CoreText bug when draw joined emoji since iOS 8.3.
-    // See -[NSMutableAttributedString setClearColorToJoinedEmoji] for more information.
-    static BOOL needFixJoinedEmojiBug = NO;
-    // It may use larger constraint size when create CTFrame with
-    // CTFramesetterCreateFrame in iOS 10.
-    static BOOL needFixLayoutSizeBug = NO;
-    static dispatch_once_t onceToken;
-    dispatch_once(&onceToken, ^{
-        CGFloat systemVersionFloat = [UIDevice currentDevice].systemVersion.floatValue;
-        if (8.3 <= systemVersionFloat && systemVersionFloat < 9) {
-            needFixJoinedEmojiBug = YES;
-        }
-        if (systemVersionFloat >= 10) {
-            needFixLayoutSizeBug = YES;
-        }
-    });
+    BOOL needFixJoinedEmojiBug = NO, needFixLayoutSizeBug = NO;
+    YYTextGetCoreTextBugs(&needFixJoinedEmojiBug, &needFixLayoutSizeBug);
     if (needFixJoinedEmojiBug) {
         [((NSMutableAttributedString *)text) setClearColorToJoinedEmoji];
     }
@@ -491,9 +649,16 @@ dispatch_semaphore_signal(_lock);
     }
     
     // create CoreText objects
-    ctSetter = CTFramesetterCreateWithAttributedString((CFTypeRef)text);
-    if (!ctSetter) goto fail;
-    ctFrame = CTFramesetterCreateFrame(ctSetter, YYCFRangeFromNSRange(range), cgPath, (CFTypeRef)frameAttrs);
+    if (sharedFrameSetter && !needFixJoinedEmojiBug) {
+        ctSetter = (CTFramesetterRef)CFRetain(sharedFrameSetter->_frameSetter);
+        dispatch_semaphore_wait(sharedFrameSetter->_lock, DISPATCH_TIME_FOREVER);
+        ctFrame = CTFramesetterCreateFrame(ctSetter, YYCFRangeFromNSRange(range), cgPath, (CFTypeRef)frameAttrs);
+        dispatch_semaphore_signal(sharedFrameSetter->_lock);
+    } else {
+        ctSetter = CTFramesetterCreateWithAttributedString((CFTypeRef)text);
+        if (!ctSetter) goto fail;
+        ctFrame = CTFramesetterCreateFrame(ctSetter, YYCFRangeFromNSRange(range), cgPath, (CFTypeRef)frameAttrs);
+    }
     if (!ctFrame) goto fail;
     lines = [NSMutableArray new];
     ctLines = CTFrameGetLines(ctFrame);
@@ -609,72 +774,10 @@ dispatch_semaphore_signal(_lock);
             }
         }
         
-        lineRowsEdge = calloc(rowCount, sizeof(YYRowEdge));
-        if (lineRowsEdge == NULL) goto fail;
-        lineRowsIndex = calloc(rowCount, sizeof(NSUInteger));
-        if (lineRowsIndex == NULL) goto fail;
-        NSInteger lastRowIdx = -1;
-        CGFloat lastHead = 0;
-        CGFloat lastFoot = 0;
-        for (NSUInteger i = 0, max = lines.count; i < max; i++) {
-            YYTextLine *line = lines[i];
-            CGRect rect = line.bounds;
-            if ((NSInteger)line.row != lastRowIdx) {
-                if (lastRowIdx >= 0) {
-                    lineRowsEdge[lastRowIdx] = (YYRowEdge) {.head = lastHead, .foot = lastFoot };
-                }
-                lastRowIdx = line.row;
-                lineRowsIndex[lastRowIdx] = i;
-                if (isVerticalForm) {
-                    lastHead = rect.origin.x + rect.size.width;
-                    lastFoot = lastHead - rect.size.width;
-                } else {
-                    lastHead = rect.origin.y;
-                    lastFoot = lastHead + rect.size.height;
-                }
-            } else {
-                if (isVerticalForm) {
-                    lastHead = MAX(lastHead, rect.origin.x + rect.size.width);
-                    lastFoot = MIN(lastFoot, rect.origin.x);
-                } else {
-                    lastHead = MIN(lastHead, rect.origin.y);
-                    lastFoot = MAX(lastFoot, rect.origin.y + rect.size.height);
-                }
-            }
-        }
-        lineRowsEdge[lastRowIdx] = (YYRowEdge) {.head = lastHead, .foot = lastFoot };
-        
-        for (NSUInteger i = 1; i < rowCount; i++) {
-            YYRowEdge v0 = lineRowsEdge[i - 1];
-            YYRowEdge v1 = lineRowsEdge[i];
-            lineRowsEdge[i - 1].foot = lineRowsEdge[i].head = (v0.foot + v1.head) * 0.5;
-        }
+        if (!YYTextCreateRowEdges(lines, rowCount, isVerticalForm, &lineRowsEdge, &lineRowsIndex)) goto fail;
     }
     
-    { // calculate bounding size
-        CGRect rect = textBoundingRect;
-        if (container.path) {
-            if (container.pathLineWidth > 0) {
-                CGFloat inset = container.pathLineWidth / 2;
-                rect = CGRectInset(rect, -inset, -inset);
-            }
-        } else {
-            rect = UIEdgeInsetsInsetRect(rect, UIEdgeInsetsInvert(container.insets));
-        }
-        rect = CGRectStandardize(rect);
-        CGSize size = rect.size;
-        if (container.verticalForm) {
-            size.width += container.size.width - (rect.origin.x + rect.size.width);
-        } else {
-            size.width += rect.origin.x;
-        }
-        size.height += rect.origin.y;
-        if (size.width < 0) size.width = 0;
-        if (size.height < 0) size.height = 0;
-        size.width = ceil(size.width);
-        size.height = ceil(size.height);
-        textBoundingSize = size;
-    }
+    textBoundingSize = YYTextGetBoundingSize(container, textBoundingRect);
     
     visibleRange = YYNSRangeFromCFRange(CTFrameGetVisibleStringRange(ctFrame));
     if (needTruncation) {
@@ -890,6 +993,248 @@ fail:
     return nil;
 }
 
++ (YYTextLayout *)layoutWithContainer:(YYTextContainer *)container text:(NSAttributedString *)text previousLayout:(YYTextLayout *)previousLayout editedRange:(NSRange)editedRange changeInLength:(NSInteger)delta {
+    if (!container || !text) return nil;
+    YYTextContainer *oldContainer = previousLayout.container;
+    NSUInteger length = text.length;
+    NSUInteger oldLength = previousLayout.text.length;
+    BOOL needFixJoinedEmojiBug = NO, needFixLayoutSizeBug = NO;
+    YYTextGetCoreTextBugs(&needFixJoinedEmojiBug, &needFixLayoutSizeBug);
+    
+    BOOL canUpdate = previousLayout && !needFixJoinedEmojiBug && previousLayout.lines.count > 0;
+    if (canUpdate) {
+        canUpdate = YYTextContainerIsSimpleRect(container) && YYTextContainerIsSimpleRect(oldContainer) &&
+        CGSizeEqualToSize(container.size, oldContainer.size) &&
+        UIEdgeInsetsEqualToEdgeInsets(container.insets, oldContainer.insets) &&
+        container.pathLineWidth == oldContainer.pathLineWidth &&
+        container.isPathFillEvenOdd == oldContainer.isPathFillEvenOdd;
+    }
+    if (canUpdate) {
+        canUpdate = previousLayout.truncatedLine == nil &&
+        NSEqualRanges(previousLayout.range, NSMakeRange(0, oldLength)) &&
+        NSEqualRanges(previousLayout.visibleRange, NSMakeRange(0, oldLength)) &&
+        (NSInteger)oldLength + delta == (NSInteger)length &&
+        editedRange.location + editedRange.length <= length &&
+        (NSInteger)editedRange.length >= delta;
+    }
+    if (!canUpdate) return [self layoutWithContainer:container text:text];
+    
+    YYTextLayout *layout = nil;
+    CGPathRef cgPath = nil;
+    CGRect cgPathBox = {0};
+    CGFloat constraintMaxY = 0;
+    NSMutableDictionary *frameAttrs = nil;
+    CTFramesetterRef ctSetter = NULL;
+    CTFrameRef ctFrame = NULL;
+    CFArrayRef ctLines = nil;
+    CGPoint *lineOrigins = NULL;
+    NSUInteger lineCount = 0;
+    NSArray *oldLines = previousLayout.lines;
+    NSMutableArray *subLines = nil;
+    NSMutableArray *lines = nil;
+    NSMutableArray *attachments = nil;
+    NSMutableArray *attachmentRanges = nil;
+    NSMutableArray *attachmentRects = nil;
+    NSMutableSet *attachmentContentsSet = nil;
+    YYRowEdge *lineRowsEdge = NULL;
+    NSUInteger *lineRowsIndex = NULL;
+    
+    text = text.mutableCopy;
+    container = container.copy;
+    container->_readonly = YES;
+    
+    // The edited paragraphs, with one paragraph before them (used to align the
+    // new lines to the old ones) and one paragraph after them (used to calculate
+    // the offset of the following lines).
+    NSString *string = text.string;
+    NSRange range = [string paragraphRangeForRange:editedRange];
+    if (range.location > 0) {
+        range = NSUnionRange(range, [string paragraphRangeForRange:NSMakeRange(range.location - 1, 0)]);
+    }
+    BOOL hasNextParagraph = NO;
+    if (range.location + range.length < length) {
+        range = NSUnionRange(range, [string paragraphRangeForRange:NSMakeRange(range.location + range.length, 0)]);
+        hasNextParagraph = YES;
+    }
+    NSUInteger prefixCount = YYTextLineCountBeforeIndex(oldLines, range.location);
+    NSUInteger suffixIndex = YYTextLineCountBeforeIndex(oldLines, range.location + range.length - delta);
+    if (prefixCount >= suffixIndex) goto fail;
+    
+    // same as the rect path in full layout
+    {
+        CGRect rect = (CGRect) {CGPointZero, container.size };
+        if (rect.size.width <= 0 || rect.size.height <= 0) goto fail;
+        constraintMaxY = CGRectGetMaxY(CGRectStandardize(UIEdgeInsetsInsetRect(rect, container.insets)));
+        if (needFixLayoutSizeBug) rect.size.height = YYTextContainerMaxSize.height;
+        rect = UIEdgeInsetsInsetRect(rect, container.insets);
+        rect = CGRectStandardize(rect);
+        cgPathBox = rect;
+        rect = CGRectApplyAffineTransform(rect, CGAffineTransformMakeScale(1, -1));
+        cgPath = CGPathCreateWithRect(rect, NULL);
+        if (!cgPath) goto fail;
+    }
+    frameAttrs = [NSMutableDictionary dictionary];
+    if (container.isPathFillEvenOdd == NO) {
+        frameAttrs[(id)kCTFramePathFillRuleAttributeName] = @(kCTFramePathFillWindingNumber);
+    }
+    if (container.pathLineWidth > 0) {
+        frameAttrs[(id)kCTFramePathWidthAttributeName] = @(container.pathLineWidth);
+    }
+    
+    // layout the paragraphs, the string index of CTLine is relative to range.location
+    ctSetter = CTFramesetterCreateWithAttributedString((CFTypeRef)[text attributedSubstringFromRange:range]);
+    if (!ctSetter) goto fail;
+    ctFrame = CTFramesetterCreateFrame(ctSetter, CFRangeMake(0, 0), cgPath, (CFTypeRef)frameAttrs);
+    if (!ctFrame) goto fail;
+    if (CTFrameGetVisibleStringRange(ctFrame).length != (CFIndex)range.length) goto fail;
+    ctLines = CTFrameGetLines(ctFrame);
+    lineCount = CFArrayGetCount(ctLines);
+    if (lineCount == 0) goto fail;
+    lineOrigins = malloc(lineCount * sizeof(CGPoint));
+    if (lineOrigins == NULL) goto fail;
+    CTFrameGetLineOrigins(ctFrame, CFRangeMake(0, lineCount), lineOrigins);
+    subLines = [NSMutableArray new];
+    for (NSUInteger i = 0; i < lineCount; i++) {
+        CTLineRef ctLine = CFArrayGetValueAtIndex(ctLines, i);
+        CFArrayRef ctRuns = CTLineGetGlyphRuns(ctLine);
+        if (!ctRuns || CFArrayGetCount(ctRuns) == 0) continue;
+        CGPoint position;
+        position.x = cgPathBox.origin.x + lineOrigins[i].x;
+        position.y = cgPathBox.size.height + cgPathBox.origin.y - lineOrigins[i].y;
+        YYTextLine *line = [YYTextLine lineWithCTLine:ctLine position:position vertical:NO];
+        line.textOffset = range.location;
+        [subLines addObject:line];
+    }
+    if (subLines.count == 0) goto fail;
+    
+    // The first paragraph is not edited, so its first line should be at the same position as before.
+    CGFloat offset = 0;
+    if (range.location > 0) {
+        YYTextLine *oldLine = oldLines[prefixCount];
+        YYTextLine *newLine = subLines.firstObject;
+        if (!NSEqualRanges(oldLine.range, newLine.range)) goto fail;
+        offset = oldLine.position.y - newLine.position.y;
+    }
+    for (YYTextLine *line in subLines) {
+        line.position = CGPointMake(line.position.x, line.position.y + offset);
+    }
+    
+    // The last paragraph is not edited either, the lines after it move as its last line.
+    CGFloat suffixOffset = 0;
+    if (hasNextParagraph) {
+        YYTextLine *oldLine = oldLines[suffixIndex - 1];
+        YYTextLine *newLine = subLines.lastObject;
+        if (oldLine.range.location + delta != newLine.range.location || oldLine.range.length != newLine.range.length) goto fail;
+        suffixOffset = newLine.position.y - oldLine.position.y;
+    }
+    
+    lines = [NSMutableArray arrayWithCapacity:prefixCount + subLines.count + oldLines.count - suffixIndex];
+    [lines addObjectsFromArray:[oldLines subarrayWithRange:NSMakeRange(0, prefixCount)]];
+    [lines addObjectsFromArray:subLines];
+    for (NSUInteger i = suffixIndex, max = oldLines.count; i < max; i++) {
+        YYTextLine *oldLine = oldLines[i];
+        CGPoint position = oldLine.position;
+        position.y += suffixOffset;
+        YYTextLine *line = [YYTextLine lineWithCTLine:oldLine.CTLine position:position vertical:NO];
+        line.textOffset = oldLine.textOffset + delta;
+        [lines addObject:line];
+    }
+    for (NSUInteger i = prefixCount, max = lines.count; i < max; i++) {
+        YYTextLine *line = lines[i];
+        line.index = i;
+        line.row = i;
+    }
+    
+    { // fall back to full layout if the text is not fully visible
+        YYTextLine *lastLine = lines.lastObject;
+        if (lastLine.range.location + lastLine.range.length != length) goto fail;
+        if (lastLine.bottom > constraintMaxY) goto fail;
+    }
+    
+    CGRect textBoundingRect = CGRectZero;
+    for (NSUInteger i = 0, max = lines.count; i < max; i++) {
+        YYTextLine *line = lines[i];
+        if (i == 0) textBoundingRect = line.bounds;
+        else textBoundingRect = CGRectUnion(textBoundingRect, line.bounds);
+    }
+    if (!YYTextCreateRowEdges(lines, lines.count, NO, &lineRowsEdge, &lineRowsIndex)) goto fail;
+    
+    layout = [[YYTextLayout alloc] _init];
+    layout.text = text;
+    layout.container = container;
+    layout.range = NSMakeRange(0, length);
+    
+    // The flags of the unchanged text are kept from previous layout, they are
+    // only used to skip drawing, so a stale YES is harmless.
+    layout.needDrawText = YES;
+    layout.containsHighlight = previousLayout.containsHighlight;
+    layout.needDrawBlockBorder = previousLayout.needDrawBlockBorder;
+    layout.needDrawBackgroundBorder = previousLayout.needDrawBackgroundBorder;
+    layout.needDrawShadow = previousLayout.needDrawShadow;
+    layout.needDrawUnderline = previousLayout.needDrawUnderline;
+    layout.needDrawAttachment = previousLayout.needDrawAttachment;
+    layout.needDrawInnerShadow = previousLayout.needDrawInnerShadow;
+    layout.needDrawStrikethrough = previousLayout.needDrawStrikethrough;
+    layout.needDrawBorder = previousLayout.needDrawBorder;
+    [text enumerateAttributesInRange:range options:NSAttributedStringEnumerationLongestEffectiveRangeNotRequired usingBlock:^(NSDictionary *attrs, NSRange attrsRange, BOOL *stop) {
+        if (attrs[YYTextHighlightAttributeName]) layout.containsHighlight = YES;
+        if (attrs[YYTextBlockBorderAttributeName]) layout.needDrawBlockBorder = YES;
+        if (attrs[YYTextBackgroundBorderAttributeName]) layout.needDrawBackgroundBorder = YES;
+        if (attrs[YYTextShadowAttributeName] || attrs[NSShadowAttributeName]) layout.needDrawShadow = YES;
+        if (attrs[YYTextUnderlineAttributeName]) layout.needDrawUnderline = YES;
+        if (attrs[YYTextAttachmentAttributeName]) layout.needDrawAttachment = YES;
+        if (attrs[YYTextInnerShadowAttributeName]) layout.needDrawInnerShadow = YES;
+        if (attrs[YYTextStrikethroughAttributeName]) layout.needDrawStrikethrough = YES;
+        if (attrs[YYTextBorderAttributeName]) layout.needDrawBorder = YES;
+    }];
+    
+    attachments = [NSMutableArray new];
+    attachmentRanges = [NSMutableArray new];
+    attachmentRects = [NSMutableArray new];
+    attachmentContentsSet = [NSMutableSet new];
+    for (YYTextLine *line in lines) {
+        if (line.attachments.count > 0) {
+            [attachments addObjectsFromArray:line.attachments];
+            [attachmentRanges addObjectsFromArray:line.attachmentRanges];
+            [attachmentRects addObjectsFromArray:line.attachmentRects];
+            for (YYTextAttachment *attachment in line.attachments) {
+                if (attachment.content) {
+                    [attachmentContentsSet addObject:attachment.content];
+                }
+            }
+        }
+    }
+    if (attachments.count == 0) {
+        attachments = attachmentRanges = attachmentRects = nil;
+    }
+    
+    layout.lines = lines;
+    layout.attachments = attachments;
+    layout.attachmentRanges = attachmentRanges;
+    layout.attachmentRects = attachmentRects;
+    layout.attachmentContentsSet = attachmentContentsSet;
+    layout.rowCount = lines.count;
+    layout.visibleRange = NSMakeRange(0, length);
+    layout.textBoundingRect = textBoundingRect;
+    layout.textBoundingSize = YYTextGetBoundingSize(container, textBoundingRect);
+    layout.lineRowsEdge = lineRowsEdge;
+    layout.lineRowsIndex = lineRowsIndex;
+    CFRelease(cgPath);
+    CFRelease(ctSetter);
+    CFRelease(ctFrame);
+    free(lineOrigins);
+    return layout;
+    
+fail:
+    if (cgPath) CFRelease(cgPath);
+    if (ctSetter) CFRelease(ctSetter);
+    if (ctFrame) CFRelease(ctFrame);
+    if (lineOrigins) free(lineOrigins);
+    if (lineRowsEdge) free(lineRowsEdge);
+    if (lineRowsIndex) free(lineRowsIndex);
+    return [self layoutWithContainer:container text:text];
+}
+
 + (NSArray *)layoutWithContainers:(NSArray *)containers text:(NSAttributedString *)text {
     return [self layoutWithContainers:containers text:text range:NSMakeRange(0, text.length)];
 }
@@ -914,6 +1259,52 @@ fail:
     return layouts;
 }
 
++ (NSArray *)layoutsWithContainers:(NSArray *)containers texts:(NSArray *)texts cancel:(BOOL (^)(void))cancel {
+    if (!containers || !texts || containers.count != texts.count) return nil;
+    containers = containers.copy;
+    texts = texts.copy;
+    NSUInteger count = texts.count;
+    if (count == 0) return @[];
+    if (count > INT32_MAX) return nil;
+    
+    CFTypeRef *results = calloc(count, sizeof(CFTypeRef));
+    if (!results) return nil;
+    int32_t nextIndex = 0, failed = 0;
+    int32_t *nextIndexPtr = &nextIndex, *failedPtr = &failed; // dispatch_apply is synchronous
+    NSUInteger workerCount = MIN(count, [NSProcessInfo processInfo].activeProcessorCount);
+    dispatch_apply(workerCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t worker) {
+        while (*failedPtr == 0) {
+            if (cancel && cancel()) {
+                OSAtomicIncrement32(failedPtr);
+                break;
+            }
+            int32_t index = OSAtomicIncrement32(nextIndexPtr) - 1;
+            if (index >= (int32_t)count) break;
+            @autoreleasepool {
+                YYTextLayout *layout = [self layoutWithContainer:containers[index] text:texts[index]];
+                if (!layout) {
+                    OSAtomicIncrement32(failedPtr);
+                    break;
+                }
+                results[index] = CFBridgingRetain(layout);
+            }
+        }
+    });
+    
+    NSMutableArray *layouts = nil;
+    if (failed == 0) {
+        layouts = [NSMutableArray arrayWithCapacity:count];
+        for (NSUInteger i = 0; i < count; i++) {
+            [layouts addObject:(__bridge id)results[i]];
+        }
+    }
+    for (NSUInteger i = 0; i < count; i++) {
+        if (results[i]) CFRelease(results[i]);
+    }
+    free(results);
+    return layouts;
+}
+
 - (void)setFrameSetter:(CTFramesetterRef)frameSetter {
     if (_frameSetter != frameSetter) {
         if (frameSetter) CFRetain(frameSetter);
@@ -1039,6 +1430,7 @@ fail:
     for (NSUInteger i = 0, max = CFArrayGetCount(runs); i < max; i++) {
         CTRunRef run = CFArrayGetValueAtIndex(runs, i);
         CFRange range = CTRunGetStringRange(run);
+        range.location += line.textOffset;
         if (position.affinity == YYTextAffinityBackward) {
             if (range.location < position.offset && position.offset <= range.location + range.length) {
                 return run;
@@ -1108,6 +1500,7 @@ fail:
         NSUInteger glyphCount = CTRunGetGlyphCount(run);
         if (glyphCount == 0) continue;
         CFRange range = CTRunGetStringRange(run);
+        range.location += line.textOffset;
         if (range.length <= 1) continue;
         if (position <= range.location || position >= range.location + range.length) continue;
         CFDictionaryRef attrs = CTRunGetAttributes(run);
@@ -1118,8 +1511,8 @@ fail:
         CFIndex indices[glyphCount];
         CTRunGetStringIndices(run, CFRangeMake(0, glyphCount), indices);
         for (NSUInteger g = 0; g < glyphCount; g++) {
-            CFIndex prev = indices[g];
-            CFIndex next = g + 1 < glyphCount ? indices[g + 1] : range.location + range.length;
+            CFIndex prev = indices[g] + line.textOffset;
+            CFIndex next = g + 1 < glyphCount ? indices[g + 1] + line.textOffset : range.location + range.length;
             if (position == prev) break; // Emoji edge
             if (prev < position && position < next) { // inside an emoji (such as National Flag Emoji)
                 CGPoint pos = CGPointZero;
@@ -1277,10 +1670,10 @@ fail:
 - (CGFloat)offsetForTextPosition:(NSUInteger)position lineIndex:(NSUInteger)lineIndex {
     if (lineIndex >= _lines.count) return CGFLOAT_MAX;
     YYTextLine *line = _lines[lineIndex];
-    CFRange range = CTLineGetStringRange(line.CTLine);
+    NSRange range = line.range;
     if (position < range.location || position > range.location + range.length) return CGFLOAT_MAX;
     
-    CGFloat offset = CTLineGetOffsetForStringIndex(line.CTLine, position, NULL);
+    CGFloat offset = CTLineGetOffsetForStringIndex(line.CTLine, position - line.textOffset, NULL);
     return _container.verticalForm ? (offset + line.position.y) : (offset + line.position.x);
 }
 
@@ -1332,7 +1725,7 @@ fail:
                     NSUInteger next = indices[g + 1];
                     do {
                         if (next == range.location + range.length) break;
-                        unichar c = [_text.string characterAtIndex:next];
+                        unichar c = [_text.string characterAtIndex:next + line.textOffset];
                         if ((c == 0xFE0E || c == 0xFE0F)) { // unicode variant form for emoji style
                             next++;
                         } else break;
@@ -1345,7 +1738,7 @@ fail:
             break;
         }
     }
-    return idx;
+    return idx + line.textOffset;
 }
 
 - (YYTextPosition *)closestPositionToPoint:(CGPoint)point {
@@ -2735,6 +3128,7 @@ static void YYTextDrawBorder(YYTextLayout *layout, CGContextRef context, CGSize
             
             CFRange runRange = CTRunGetStringRange(run);
             if (runRange.location == kCFNotFound || runRange.length == 0) continue;
+            runRange.location += line.textOffset;
             if (runRange.location + runRange.length > layout.text.length) continue;
             
             NSMutableArray *runRects = [NSMutableArray new];
@@ -2865,6 +3259,7 @@ static void YYTextDrawDecoration(YYTextLayout *layout, CGContextRef context, CGS
             
             CFRange runRange = CTRunGetStringRange(run);
             if (runRange.location == kCFNotFound || runRange.length == 0) continue;
+            runRange.location += line.textOffset;
             if (runRange.location + runRange.length > layout.text.length) continue;
             NSString *runStr = [layout.text attributedSubstringFromRange:NSMakeRange(runRange.location, runRange.length)].string;
             if (YYTextIsLinebreakString(runStr)) continue; // may need more checks...
@@ -3335,6 +3730,19 @@ static void YYTextDrawDebug(YYTextLayout *layout, CGContextRef context, CGSize s
                 layer:(CALayer *)layer
                 debug:(YYTextDebugOption *)debug
                 cancel:(BOOL (^)(void))cancel{
+    dispatch_semaphore_t lock = self.drawLock;
+    if (lock) dispatch_semaphore_wait(lock, DISPATCH_TIME_FOREVER);
+    [self _drawInContext:context size:size point:point view:view layer:layer debug:debug cancel:cancel];
+    if (lock) dispatch_semaphore_signal(lock);
+}
+
+- (void)_drawInContext:(CGContextRef)context
+                  size:(CGSize)size
+                 point:(CGPoint)point
+                  view:(UIView *)view
+                 layer:(CALayer *)layer
+                 debug:(YYTextDebugOption *)debug
+                cancel:(BOOL (^)(void))cancel {
     @autoreleasepool {
         if (self.needDrawBlockBorder && context) {
             if (cancel && cancel()) return;
@@ -3404,3 +3812,220 @@ static void YYTextDrawDebug(YYTextLayout *layout, CGContextRef context, CGSize s
 }
 
 @end
+
+
+
+#pragma mark - Layout Cache
+
+static inline NSUInteger YYTextHashMix(NSUInteger hash, NSUInteger value) {
+    return hash * 31 + value;
+}
+
+static inline NSUInteger YYTextHashFloat(CGFloat value) {
+    return (NSUInteger)(NSInteger)lround(value * 64);
+}
+
+static inline BOOL YYTextObjectIsEqual(id obj1, id obj2) {
+    return obj1 == obj2 || [obj1 isEqual:obj2];
+}
+
+/// A hash of the characters and attributes, equal texts have the same hash.
+static NSUInteger YYTextAttributedStringHash(NSAttributedString *text) {
+    CFStringRef string = (__bridge CFStringRef)text.string;
+    NSUInteger length = CFStringGetLength(string);
+    __block uint64_t hash = 14695981039346656037ULL; // FNV-1a
+    unichar buffer[256];
+    for (NSUInteger i = 0; i < length; i += 256) {
+        NSUInteger count = MIN(256, length - i);
+        CFStringGetCharacters(string, CFRangeMake(i, count), buffer);
+        for (NSUInteger c = 0; c < count; c++) {
+            hash = (hash ^ buffer[c]) * 1099511628211ULL;
+        }
+    }
+    // longest effective ranges, so equal texts get the same runs
+    [text enumerateAttributesInRange:NSMakeRange(0, length) options:kNilOptions usingBlock:^(NSDictionary *attrs, NSRange range, BOOL *stop) {
+        __block NSUInteger attrsHash = 0;
+        [attrs enumerateKeysAndObjectsUsingBlock:^(id key, id obj, BOOL *stop) {
+            attrsHash += [key hash] ^ [obj hash]; // independent of the order of keys
+        }];
+        hash = (hash ^ range.location) * 1099511628211ULL;
+        hash = (hash ^ range.length) * 1099511628211ULL;
+        hash = (hash ^ attrsHash) * 1099511628211ULL;
+    }];
+    return (NSUInteger)hash;
+}
+
+static NSUInteger YYTextContainerHash(YYTextContainer *container) {
+    CGSize size = container.size;
+    UIEdgeInsets insets = container.insets;
+    NSUInteger hash = YYTextHashFloat(size.width);
+    hash = YYTextHashMix(hash, YYTextHashFloat(size.height));
+    hash = YYTextHashMix(hash, YYTextHashFloat(insets.top));
+    hash = YYTextHashMix(hash, YYTextHashFloat(insets.left));
+    hash = YYTextHashMix(hash, YYTextHashFloat(insets.bottom));
+    hash = YYTextHashMix(hash, YYTextHashFloat(insets.right));
+    hash = YYTextHashMix(hash, container.maximumNumberOfRows);
+    hash = YYTextHashMix(hash, container.truncationType);
+    hash = YYTextHashMix(hash, container.isVerticalForm);
+    return hash;
+}
+
+static BOOL YYTextContainerIsEqual(YYTextContainer *container1, YYTextContainer *container2) {
+    if (container1 == container2) return YES;
+    if (!CGSizeEqualToSize(container1.size, container2.size)) return NO;
+    if (!UIEdgeInsetsEqualToEdgeInsets(container1.insets, container2.insets)) return NO;
+    if (container1.isVerticalForm != container2.isVerticalForm) return NO;
+    if (container1.isPathFillEvenOdd != container2.isPathFillEvenOdd) return NO;
+    if (container1.pathLineWidth != container2.pathLineWidth) return NO;
+    if (container1.maximumNumberOfRows != container2.maximumNumberOfRows) return NO;
+    if (container1.truncationType != container2.truncationType) return NO;
+    if (!YYTextObjectIsEqual(container1.path, container2.path)) return NO;
+    if (!YYTextObjectIsEqual(container1.exclusionPaths, container2.exclusionPaths)) return NO;
+    if (!YYTextObjectIsEqual(container1.truncationToken, container2.truncationToken)) return NO;
+    if (!YYTextObjectIsEqual(container1.linePositionModifier, container2.linePositionModifier)) return NO;
+    return YES;
+}
+
+/// Key of YYTextLayoutCache, compares the content of text and container.
+/// The container is nil for a framesetter.
+@interface _YYTextLayoutCacheKey : NSObject {
+    @package
+    NSAttributedString *_text;
+    YYTextContainer *_container;
+    NSUInteger _textHash;
+    NSUInteger _hash;
+}
+@end
+
+@implementation _YYTextLayoutCacheKey
+
++ (instancetype)keyWithText:(NSAttributedString *)text textHash:(NSUInteger)textHash container:(YYTextContainer *)container {
+    _YYTextLayoutCacheKey *key = [self new];
+    key->_text = text;
+    key->_textHash = textHash;
+    key->_container = container;
+    key->_hash = container ? YYTextHashMix(textHash, YYTextContainerHash(container)) : textHash;
+    return key;
+}
+
+- (NSUInteger)hash {
+    return _hash;
+}
+
+- (BOOL)isEqual:(id)object {
+    if (self == object) return YES;
+    if (![object isKindOfClass:[_YYTextLayoutCacheKey class]]) return NO;
+    _YYTextLayoutCacheKey *key = object;
+    if (_hash != key->_hash || _textHash != key->_textHash) return NO;
+    if ((_container == nil) != (key->_container == nil)) return NO;
+    if (_container && !YYTextContainerIsEqual(_container, key->_container)) return NO;
+    return _text == key->_text || [_text isEqualToAttributedString:key->_text];
+}
+
+@end
+
+
+@implementation YYTextLayoutCache {
+    YYMemoryCache *_layoutCache;
+    YYMemoryCache *_frameSetterCache;
+    int64_t _hitCount;
+    int64_t _missCount;
+}
+
++ (instancetype)sharedCache {
+    static YYTextLayoutCache *cache;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        cache = [self new];
+    });
+    return cache;
+}
+
+- (instancetype)init {
+    self = [super init];
+    _layoutCache = [YYMemoryCache new];
+    _layoutCache.name = @"YYTextLayoutCache";
+    _layoutCache.costLimit = 1024 * 1024;
+    _layoutCache.countLimit = 1000;
+    _frameSetterCache = [YYMemoryCache new];
+    _frameSetterCache.name = @"YYTextLayoutCache.frameSetter";
+    _frameSetterCache.countLimit = 64;
+    return self;
+}
+
+- (NSUInteger)costLimit {
+    return _layoutCache.costLimit;
+}
+
+- (void)setCostLimit:(NSUInteger)costLimit {
+    _layoutCache.costLimit = costLimit;
+}
+
+- (NSUInteger)countLimit {
+    return _layoutCache.countLimit;
+}
+
+- (void)setCountLimit:(NSUInteger)countLimit {
+    _layoutCache.countLimit = countLimit;
+}
+
+- (NSUInteger)frameSetterCountLimit {
+    return _frameSetterCache.countLimit;
+}
+
+- (void)setFrameSetterCountLimit:(NSUInteger)frameSetterCountLimit {
+    _frameSetterCache.countLimit = frameSetterCountLimit;
+}
+
+- (NSUInteger)hitCount {
+    return (NSUInteger)_hitCount;
+}
+
+- (NSUInteger)missCount {
+    return (NSUInteger)_missCount;
+}
+
+- (double)hitRate {
+    double hit = _hitCount, miss = _missCount;
+    return hit + miss > 0 ? hit / (hit + miss) : 0;
+}
+
+- (YYTextLayout *)layoutWithContainer:(YYTextContainer *)container text:(NSAttributedString *)text {
+    if (!container || !text) return nil;
+    NSUInteger textHash = YYTextAttributedStringHash(text);
+    _YYTextLayoutCacheKey *key = [_YYTextLayoutCacheKey keyWithText:text textHash:textHash container:container];
+    YYTextLayout *layout = [_layoutCache objectForKey:key];
+    if (layout) {
+        OSAtomicIncrement64(&_hitCount);
+        return layout;
+    }
+    OSAtomicIncrement64(&_missCount);
+    
+    // the keys in cache should not be changed, so copy the text
+    text = text.copy;
+    _YYTextLayoutCacheKey *frameSetterKey = [_YYTextLayoutCacheKey keyWithText:text textHash:textHash container:nil];
+    _YYTextFrameSetter *frameSetter = [_frameSetterCache objectForKey:frameSetterKey];
+    if (!frameSetter) {
+        frameSetter = [[_YYTextFrameSetter alloc] initWithText:text];
+        if (frameSetter) [_frameSetterCache setObject:frameSetter forKey:frameSetterKey];
+    }
+    layout = [YYTextLayout _layoutWithContainer:container text:text range:NSMakeRange(0, text.length) frameSetter:frameSetter];
+    if (!layout) return nil;
+    
+    // attachment views and layers can't be shared by several labels
+    if (layout.attachments.count > 0) return layout;
+    // the CTFrame and CTLines of a shared layout may be drawn in several threads
+    layout.drawLock = dispatch_semaphore_create(1);
+    key = [_YYTextLayoutCacheKey keyWithText:text textHash:textHash container:layout.container];
+    [_layoutCache setObject:layout forKey:key withCost:text.length];
+    return layout;
+}
+
+- (void)removeAllObjects {
+    [_layoutCache removeAllObjects];
+    [_frameSetterCache removeAllObjects];
+    _hitCount = 0;
+    _missCount = 0;
+}
+
+@end
@@ -38,7 +38,7 @@
         if (_CTLine) {
             _lineWidth = CTLineGetTypographicBounds(_CTLine, &_ascent, &_descent, &_leading);
             CFRange range = CTLineGetStringRange(_CTLine);
-            _range = NSMakeRange(range.location, range.length);
+            _range = NSMakeRange(range.location + _textOffset, range.length);
             if (CTLineGetGlyphCount(_CTLine) > 0) {
                 CFArrayRef runs = CTLineGetGlyphRuns(_CTLine);
                 CTRunRef run = CFArrayGetValueAtIndex(runs, 0);
@@ -57,6 +57,13 @@
     }
 }
 
+- (void)setTextOffset:(NSInteger)textOffset {
+    if (_textOffset == textOffset) return;
+    _range.location += textOffset - _textOffset;
+    _textOffset = textOffset;
+    [self reloadBounds];
+}
+
 - (void)setPosition:(CGPoint)position {
     _position = position;
     [self reloadBounds];
@@ -107,6 +114,7 @@
             }
             
             NSRange runRange = YYNSRangeFromCFRange(CTRunGetStringRange(run));
+            runRange.location += _textOffset;
             [attachments addObject:attachment];
             [attachmentRanges addObject:[NSValue valueWithRange:runRange]];
             [attachmentRects addObject:[NSValue valueWithCGRect:runTypoBounds]];
@@ -36,6 +36,25 @@ NS_ASSUME_NONNULL_BEGIN
  @return If the 'text' is modified in this method, returns `YES`, otherwise returns `NO`.
  */
 - (BOOL)parseText:(nullable NSMutableAttributedString *)text selectedRange:(nullable NSRangePointer)selectedRange;
+
+@optional
+/**
+ Same as `parseText:selectedRange:`, and YYTextView tells which part of the text
+ is changed since it was parsed last time, so the parser may only parse it again.
+ 
+ @param text           The attributed string (same object as the last call).
+ @param selectedRange  Current selected range in `text`.
+ @param editedRange    The range in `text` which is changed (in characters or attributes)
+    since last parsing. The characters and attributes out of this range are the
+    same as the output of last parsing.
+ @param delta          The change in length since last parsing.
+ 
+ @return If the 'text' is modified in this method, returns `YES`, otherwise returns `NO`.
+ */
+- (BOOL)parseText:(nullable NSMutableAttributedString *)text
+    selectedRange:(nullable NSRangePointer)selectedRange
+      editedRange:(NSRange)editedRange
+   changeInLength:(NSInteger)delta;
 @end
 
 
@@ -46,8 +65,11 @@ NS_ASSUME_NONNULL_BEGIN
  It'a very simple markdown parser, you can use this parser to highlight some 
  small piece of markdown text.
  
- This markdown parser use regular expression to parse text, slow and weak.
- If you want to write a better parser, try these projests:
+ The text is tokenized line by line in a single pass. When YYTextView tells the
+ edited range (see `parseText:selectedRange:editedRange:changeInLength:`), only the
+ blocks around it are parsed again; `parseText:selectedRange:` parses the whole text.
+ It only highlights the markdown syntax and is still weak; if you want to write
+ a better parser, try these projests:
  https://github.com/NimbusKit/markdown
  https://github.com/dreamwieber/AttributedMarkdown
  https://github.com/indragiek/CocoaMarkdown
@@ -85,6 +107,9 @@ NS_ASSUME_NONNULL_BEGIN
  The custom emoticon mapper.
  The key is a specified plain string, such as @":smile:".
  The value is a UIImage which will replace the specified plain string in text.
+ 
+ The text is scanned from left to right, and the longest key wins if several
+ keys start at the same location.
  */
 @property (nullable, copy) NSDictionary<NSString *, __kindof UIImage *> *emoticonMapper;
 @end
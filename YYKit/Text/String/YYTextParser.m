@@ -20,6 +20,442 @@
 
 #pragma mark - Markdown Parser
 
+#define YYTextMarkdownDirtyMargin 1024 ///< characters around the edited range copied to find the dirty blocks
+
+/// Attribute applied by a markdown token.
+typedef NS_ENUM(uint8_t, YYTextMarkdownStyle) {
+    YYTextMarkdownStyleControl = 0,     ///< control text color
+    YYTextMarkdownStyleHeader,          ///< header text color
+    YYTextMarkdownStyleHeaderFont,      ///< header font of `level` (0~5)
+    YYTextMarkdownStyleItalic,          ///< italic font
+    YYTextMarkdownStyleBold,            ///< bold font
+    YYTextMarkdownStyleBoldItalic,      ///< bold italic font
+    YYTextMarkdownStyleUnderline,       ///< underline
+    YYTextMarkdownStyleStrikethrough,   ///< strikethrough
+    YYTextMarkdownStyleInline,          ///< inline text color
+    YYTextMarkdownStyleMonospace,       ///< monospace font
+    YYTextMarkdownStyleInlineBorder,    ///< inline code border
+    YYTextMarkdownStyleLink,            ///< link text color
+    YYTextMarkdownStyleCode,            ///< code text color
+    YYTextMarkdownStyleCodeBorder,      ///< code block border
+};
+
+/// Tokens are applied pass by pass, later passes override the earlier ones.
+typedef NS_ENUM(uint8_t, YYTextMarkdownPass) {
+    YYTextMarkdownPassHeader = 0,       ///< #header
+    YYTextMarkdownPassH1,               ///< header\n====
+    YYTextMarkdownPassH2,               ///< header\n----
+    YYTextMarkdownPassBreakline,        ///< ******
+    YYTextMarkdownPassEmphasis,         ///< *text*  _text_
+    YYTextMarkdownPassStrong,           ///< **text**
+    YYTextMarkdownPassStrongEmphasis,   ///< ***text*** ___text___
+    YYTextMarkdownPassUnderline,        ///< __text__
+    YYTextMarkdownPassStrikethrough,    ///< ~~text~~
+    YYTextMarkdownPassInlineCode,       ///< `text`
+    YYTextMarkdownPassLink,             ///< [name](link)
+    YYTextMarkdownPassLinkRefer,        ///< [ref]:
+    YYTextMarkdownPassList,             ///< 1.text 2.text 3.text
+    YYTextMarkdownPassBlockQuote,       ///< > quote
+    YYTextMarkdownPassCodeBlock,        ///< \tcode \tcode
+    YYTextMarkdownPassCount,
+};
+
+typedef struct {
+    uint8_t pass;
+    uint8_t style;
+    uint8_t level;
+    NSUInteger location;
+    NSUInteger length;
+} YYTextMarkdownToken;
+
+typedef struct {
+    const unichar *chars; ///< text with escaped characters replaced by '@'
+    NSUInteger length;
+    YYTextMarkdownToken *tokens;
+    NSUInteger tokenCount;
+    NSUInteger tokenCapacity;
+    BOOL failed;          ///< no memory
+} YYTextMarkdownContext;
+
+static inline BOOL YYTextMarkdownIsSpace(unichar c) {
+    return c == ' ' || c == '\t';
+}
+
+static inline BOOL YYTextMarkdownIsWhite(unichar c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static void YYTextMarkdownAddToken(YYTextMarkdownContext *ctx, YYTextMarkdownPass pass, YYTextMarkdownStyle style, NSUInteger location, NSUInteger length) {
+    if (ctx->tokenCount == ctx->tokenCapacity) {
+        NSUInteger capacity = ctx->tokenCapacity ? ctx->tokenCapacity * 2 : 64;
+        YYTextMarkdownToken *tokens = realloc(ctx->tokens, capacity * sizeof(YYTextMarkdownToken));
+        if (!tokens) {
+            ctx->failed = YES;
+            return;
+        }
+        ctx->tokens = tokens;
+        ctx->tokenCapacity = capacity;
+    }
+    YYTextMarkdownToken *token = ctx->tokens + ctx->tokenCount++;
+    token->pass = pass;
+    token->style = style;
+    token->level = 0;
+    token->location = location;
+    token->length = length;
+}
+
+/// Replaces escaped characters (such as "\*") with "@@" in place, so they are not parsed as markdown.
+static void YYTextMarkdownReplaceEscapes(unichar *chars, NSUInteger length) {
+    for (NSUInteger i = 0; i + 1 < length; i++) {
+        if (chars[i] != '\\') continue;
+        switch (chars[i + 1]) {
+            case '\\': case '`': case '*': case '_': case '(': case ')':
+            case '[': case ']': case '#': case '+': case '-': case '!': {
+                chars[i] = chars[i + 1] = '@';
+                i++;
+            } break;
+            default: break;
+        }
+    }
+}
+
+/// Whether the line [start, end) contains only `c` (at least one).
+static BOOL YYTextMarkdownLineIsAll(const unichar *chars, NSUInteger start, NSUInteger end, unichar c) {
+    if (start == end) return NO;
+    for (NSUInteger i = start; i < end; i++) {
+        if (chars[i] != c) return NO;
+    }
+    return YES;
+}
+
+/**
+ Scans delimited spans in a line, such as "*text*" or "~~text~~": the opening run
+ is not preceded by the delimiter and is followed by a non-blank character, the
+ closing run is preceded by a non-blank character and is not followed by the
+ delimiter, and the closest closing run wins.
+ `delimiters` has one or two characters, each run is `count` of the same character.
+ */
+static void YYTextMarkdownScanDelimited(YYTextMarkdownContext *ctx, NSUInteger start, NSUInteger end,
+                                        const char *delimiters, NSUInteger count,
+                                        YYTextMarkdownPass pass, YYTextMarkdownStyle style) {
+    const unichar *s = ctx->chars;
+    BOOL closed[2] = {NO, NO}; ///< no more closing run for the delimiter in this line
+    for (NSUInteger i = start; i + count < end;) {
+        unichar c = s[i];
+        int kind = c == (unichar)delimiters[0] ? 0 : (delimiters[1] && c == (unichar)delimiters[1]) ? 1 : -1;
+        if (kind < 0 || closed[kind] || (i > start && s[i - 1] == c)) {
+            i++;
+            continue;
+        }
+        NSUInteger n = 1;
+        while (n < count && s[i + n] == c) n++;
+        unichar next = s[i + count];
+        if (n < count || next == c || YYTextMarkdownIsSpace(next)) {
+            i++;
+            continue;
+        }
+        
+        NSUInteger close = NSNotFound;
+        for (NSUInteger j = i + count + 1; j + count <= end; j++) {
+            unichar prev = s[j - 1];
+            if (prev == c || YYTextMarkdownIsSpace(prev)) continue;
+            NSUInteger m = 0;
+            while (m < count && s[j + m] == c) m++;
+            if (m < count) continue;
+            if (j + count < end && s[j + count] == c) continue;
+            close = j;
+            break;
+        }
+        if (close == NSNotFound) {
+            // a later opening run can't find a closing run either
+            closed[kind] = YES;
+            i++;
+            continue;
+        }
+        YYTextMarkdownAddToken(ctx, pass, YYTextMarkdownStyleControl, i, count);
+        YYTextMarkdownAddToken(ctx, pass, YYTextMarkdownStyleControl, close, count);
+        YYTextMarkdownAddToken(ctx, pass, style, i + count, close - i - count);
+        i = close + count;
+    }
+}
+
+/// Scans inline code in a line: "`code`", "``code``" or "```code```".
+static void YYTextMarkdownScanInlineCode(YYTextMarkdownContext *ctx, NSUInteger start, NSUInteger end) {
+    const unichar *s = ctx->chars;
+    for (NSUInteger i = start; i < end;) {
+        if (s[i] != '`') {
+            i++;
+            continue;
+        }
+        NSUInteger run = 0;
+        while (i + run < end && s[i + run] == '`') run++;
+        NSUInteger contentStart = i + run, contentEnd = contentStart;
+        while (contentEnd < end && s[contentEnd] != '`') contentEnd++;
+        NSUInteger closeRun = 0;
+        while (contentEnd + closeRun < end && s[contentEnd + closeRun] == '`') closeRun++;
+        if (run > 3 || contentEnd == contentStart || closeRun != run) {
+            i = contentEnd; // the closing run may open the next one
+            continue;
+        }
+        NSUInteger length = contentEnd + run - i;
+        YYTextMarkdownAddToken(ctx, YYTextMarkdownPassInlineCode, YYTextMarkdownStyleControl, i, run);
+        YYTextMarkdownAddToken(ctx, YYTextMarkdownPassInlineCode, YYTextMarkdownStyleControl, contentEnd, run);
+        YYTextMarkdownAddToken(ctx, YYTextMarkdownPassInlineCode, YYTextMarkdownStyleInline, contentStart, contentEnd - contentStart);
+        YYTextMarkdownAddToken(ctx, YYTextMarkdownPassInlineCode, YYTextMarkdownStyleMonospace, i, length);
+        YYTextMarkdownAddToken(ctx, YYTextMarkdownPassInlineCode, YYTextMarkdownStyleInlineBorder, i, length);
+        i += length;
+    }
+}
+
+/// Returns the end of a bracketed part "[text]" or "(text)" at `i`, or NSNotFound.
+static NSUInteger YYTextMarkdownBracketEnd(const unichar *s, NSUInteger i, NSUInteger end, unichar open, unichar close) {
+    if (i >= end || s[i] != open) return NSNotFound;
+    NSUInteger j = i + 1;
+    while (j < end && s[j] != open && s[j] != close) j++;
+    if (j == end || s[j] != close || j == i + 1) return NSNotFound;
+    return j + 1;
+}
+
+/// Scans links in a line: "[name](link)", "[name][ref]", "![name](link)".
+static void YYTextMarkdownScanLink(YYTextMarkdownContext *ctx, NSUInteger start, NSUInteger end) {
+    const unichar *s = ctx->chars;
+    for (NSUInteger i = start; i < end; i++) {
+        NSUInteger open = i;
+        if (s[i] == '!' && i + 1 < end && s[i + 1] == '[') open = i + 1;
+        else if (s[i] != '[') continue;
+        NSUInteger nameEnd = YYTextMarkdownBracketEnd(s, open, end, '[', ']');
+        if (nameEnd == NSNotFound) continue;
+        NSUInteger linkEnd = YYTextMarkdownBracketEnd(s, nameEnd, end, '(', ')');
+        if (linkEnd == NSNotFound) linkEnd = YYTextMarkdownBracketEnd(s, nameEnd, end, '[', ']');
+        if (linkEnd == NSNotFound) continue;
+        YYTextMarkdownAddToken(ctx, YYTextMarkdownPassLink, YYTextMarkdownStyleLink, i, linkEnd - i);
+        i = linkEnd - 1;
+    }
+}
+
+/// Scans the line-level markers: header, breakline, link reference, list and block quote.
+static void YYTextMarkdownScanLineMarkers(YYTextMarkdownContext *ctx, NSUInteger start, NSUInteger end) {
+    const unichar *s = ctx->chars;
+    if (start == end) return;
+    
+    // #header
+    if (s[start] == '#') {
+        NSUInteger sharp = 0;
+        while (start + sharp < end && s[start + sharp] == '#') sharp++;
+        if (sharp > 6) sharp = 6;
+        if (end - start > sharp) {
+            YYTextMarkdownAddToken(ctx, YYTextMarkdownPassHeader, YYTextMarkdownStyleControl, start, sharp);
+            YYTextMarkdownAddToken(ctx, YYTextMarkdownPassHeader, YYTextMarkdownStyleHeader, start + sharp, end - start - sharp);
+            YYTextMarkdownAddToken(ctx, YYTextMarkdownPassHeader, YYTextMarkdownStyleHeaderFont, start, end - start);
+            if (!ctx->failed) ctx->tokens[ctx->tokenCount - 1].level = sharp - 1;
+        }
+    }
+    
+    NSUInteger indent = start;
+    while (indent < end && YYTextMarkdownIsSpace(s[indent])) indent++;
+    if (indent == end) return;
+    unichar first = s[indent];
+    
+    // ***, - - -
+    if (first == '*' || first == '-') {
+        NSUInteger count = 0, i = indent;
+        for (; i < end; i++) {
+            if (s[i] == first) count++;
+            else if (!YYTextMarkdownIsSpace(s[i])) break;
+        }
+        if (i == end && count >= 3) {
+            YYTextMarkdownAddToken(ctx, YYTextMarkdownPassBreakline, YYTextMarkdownStyleControl, start, end - start);
+        }
+    }
+    
+    // [x]:
+    if (first == '[' && indent + 3 < end && s[indent + 1] != '[' && s[indent + 1] != ']' &&
+        s[indent + 2] == ']' && s[indent + 3] == ':') {
+        YYTextMarkdownAddToken(ctx, YYTextMarkdownPassLinkRefer, YYTextMarkdownStyleControl, start, indent + 4 - start);
+    }
+    
+    // * item, 1. item
+    NSUInteger marker = NSNotFound;
+    if (first == '*' || first == '+' || first == '-') {
+        marker = indent + 1;
+    } else if (first >= '0' && first <= '9') {
+        NSUInteger i = indent;
+        while (i < end && s[i] >= '0' && s[i] <= '9') i++;
+        if (i < end && s[i] == '.') marker = i + 1;
+    }
+    if (marker != NSNotFound && marker < end && YYTextMarkdownIsSpace(s[marker])) {
+        NSUInteger i = marker;
+        while (i < end && YYTextMarkdownIsSpace(s[i])) i++;
+        YYTextMarkdownAddToken(ctx, YYTextMarkdownPassList, YYTextMarkdownStyleControl, start, i - start);
+    }
+    
+    // > quote
+    if (first == '>') {
+        NSUInteger i = indent + 1;
+        while (i < end && (YYTextMarkdownIsSpace(s[i]) || s[i] == '>')) i++;
+        YYTextMarkdownAddToken(ctx, YYTextMarkdownPassBlockQuote, YYTextMarkdownStyleControl, start, i - start);
+    }
+}
+
+static void YYTextMarkdownAddCodeBlock(YYTextMarkdownContext *ctx, NSUInteger start, NSUInteger end) {
+    YYTextMarkdownAddToken(ctx, YYTextMarkdownPassCodeBlock, YYTextMarkdownStyleCode, start, end - start);
+    YYTextMarkdownAddToken(ctx, YYTextMarkdownPassCodeBlock, YYTextMarkdownStyleMonospace, start, end - start);
+    YYTextMarkdownAddToken(ctx, YYTextMarkdownPassCodeBlock, YYTextMarkdownStyleCodeBorder, start, end - start);
+}
+
+/**
+ Tokenizes the text line by line in a single pass. The text should start at the
+ beginning of a line that is not inside a code block.
+ Tokens are sorted by pass when it returns.
+ */
+static void YYTextMarkdownTokenize(YYTextMarkdownContext *ctx) {
+    const unichar *s = ctx->chars;
+    NSUInteger length = ctx->length;
+    
+    // code block: indented lines after a blank line, until a line which is not indented or blank
+    BOOL inCodeRun = NO;
+    NSUInteger codeStart = NSNotFound, codeEnd = 0;
+    
+    for (NSUInteger start = 0; start < length && !ctx->failed;) {
+        NSUInteger end = start;
+        while (end < length && s[end] != '\n') end++;
+        BOOL hasNewline = end < length;
+        NSUInteger next = hasNewline ? end + 1 : end;
+        NSUInteger nextEnd = next;
+        while (nextEnd < length && s[nextEnd] != '\n') nextEnd++;
+        
+        YYTextMarkdownScanLineMarkers(ctx, start, end);
+        
+        // header\n===, header\n---
+        if (hasNewline && start < end) {
+            if (s[start] != '=' && YYTextMarkdownLineIsAll(s, next, nextEnd, '=')) {
+                YYTextMarkdownAddToken(ctx, YYTextMarkdownPassH1, YYTextMarkdownStyleHeader, start, end - start);
+                YYTextMarkdownAddToken(ctx, YYTextMarkdownPassH1, YYTextMarkdownStyleHeaderFont, start, end + 1 - start);
+                YYTextMarkdownAddToken(ctx, YYTextMarkdownPassH1, YYTextMarkdownStyleControl, next, nextEnd - next);
+            }
+            if (s[start] != '-' && YYTextMarkdownLineIsAll(s, next, nextEnd, '-')) {
+                YYTextMarkdownAddToken(ctx, YYTextMarkdownPassH2, YYTextMarkdownStyleHeader, start, end - start);
+                YYTextMarkdownAddToken(ctx, YYTextMarkdownPassH2, YYTextMarkdownStyleHeaderFont, start, end + 1 - start);
+                if (!ctx->failed) ctx->tokens[ctx->tokenCount - 1].level = 1;
+                YYTextMarkdownAddToken(ctx, YYTextMarkdownPassH2, YYTextMarkdownStyleControl, next, nextEnd - next);
+            }
+        }
+        
+        YYTextMarkdownScanDelimited(ctx, start, end, "*_", 1, YYTextMarkdownPassEmphasis, YYTextMarkdownStyleItalic);
+        YYTextMarkdownScanDelimited(ctx, start, end, "*", 2, YYTextMarkdownPassStrong, YYTextMarkdownStyleBold);
+        YYTextMarkdownScanDelimited(ctx, start, end, "*_", 3, YYTextMarkdownPassStrongEmphasis, YYTextMarkdownStyleBoldItalic);
+        YYTextMarkdownScanDelimited(ctx, start, end, "_", 2, YYTextMarkdownPassUnderline, YYTextMarkdownStyleUnderline);
+        YYTextMarkdownScanDelimited(ctx, start, end, "~", 2, YYTextMarkdownPassStrikethrough, YYTextMarkdownStyleStrikethrough);
+        YYTextMarkdownScanInlineCode(ctx, start, end);
+        YYTextMarkdownScanLink(ctx, start, end);
+        
+        BOOL blank = YES;
+        NSUInteger contentEnd = start;
+        for (NSUInteger i = start; i < end; i++) {
+            if (!YYTextMarkdownIsWhite(s[i])) {
+                blank = NO;
+                contentEnd = i + 1;
+            }
+        }
+        BOOL indented = (end - start >= 4 && s[start] == ' ' && s[start + 1] == ' ' && s[start + 2] == ' ' && s[start + 3] == ' ') ||
+                        (start < end && s[start] == '\t');
+        if (blank && (hasNewline || (inCodeRun && indented))) {
+            inCodeRun = YES;
+        } else if (!blank && indented && inCodeRun) {
+            if (codeStart == NSNotFound) codeStart = start;
+            codeEnd = contentEnd;
+        } else {
+            if (codeStart != NSNotFound) YYTextMarkdownAddCodeBlock(ctx, codeStart, codeEnd);
+            codeStart = NSNotFound;
+            inCodeRun = NO;
+        }
+        start = next;
+    }
+    if (codeStart != NSNotFound) YYTextMarkdownAddCodeBlock(ctx, codeStart, codeEnd);
+    if (ctx->failed || ctx->tokenCount == 0) return;
+    
+    // stable counting sort by pass
+    YYTextMarkdownToken *sorted = malloc(ctx->tokenCount * sizeof(YYTextMarkdownToken));
+    if (!sorted) {
+        ctx->failed = YES;
+        return;
+    }
+    NSUInteger offsets[YYTextMarkdownPassCount + 1] = {0};
+    for (NSUInteger i = 0; i < ctx->tokenCount; i++) offsets[ctx->tokens[i].pass + 1]++;
+    for (NSUInteger i = 1; i <= YYTextMarkdownPassCount; i++) offsets[i] += offsets[i - 1];
+    for (NSUInteger i = 0; i < ctx->tokenCount; i++) sorted[offsets[ctx->tokens[i].pass]++] = ctx->tokens[i];
+    free(ctx->tokens);
+    ctx->tokens = sorted;
+    ctx->tokenCapacity = ctx->tokenCount;
+}
+
+/// Whether a block can't be affected by the lines around it: not blank, not indented, and not "===" or "---".
+static BOOL YYTextMarkdownLineIsAnchor(const unichar *s, NSUInteger start, NSUInteger end) {
+    if (start == end) return NO;
+    if (s[start] == '\t') return NO;
+    if (end - start >= 4 && s[start] == ' ' && s[start + 1] == ' ' && s[start + 2] == ' ' && s[start + 3] == ' ') return NO;
+    if (YYTextMarkdownLineIsAll(s, start, end, '=') || YYTextMarkdownLineIsAll(s, start, end, '-')) return NO;
+    for (NSUInteger i = start; i < end; i++) {
+        if (!YYTextMarkdownIsWhite(s[i])) return YES;
+    }
+    return NO;
+}
+
+/**
+ Expands an edited range to the blocks that should be parsed again: from an anchor
+ line before the line above the edit, to the line before the next anchor line.
+ */
+static NSRange YYTextMarkdownDirtyRange(const unichar *s, NSUInteger length, NSRange edited) {
+    NSUInteger start = edited.location;
+    while (start > 0 && s[start - 1] != '\n') start--;
+    if (start > 0) { // the line above
+        start--;
+        while (start > 0 && s[start - 1] != '\n') start--;
+    }
+    while (start > 0) {
+        NSUInteger end = start;
+        while (end < length && s[end] != '\n') end++;
+        if (YYTextMarkdownLineIsAnchor(s, start, end)) break;
+        start--;
+        while (start > 0 && s[start - 1] != '\n') start--;
+    }
+    
+    NSUInteger end = edited.location + edited.length;
+    while (end < length && s[end] != '\n') end++;
+    while (end < length) {
+        NSUInteger next = end + 1, nextEnd = next;
+        while (nextEnd < length && s[nextEnd] != '\n') nextEnd++;
+        if (YYTextMarkdownLineIsAnchor(s, next, nextEnd)) break;
+        end = nextEnd;
+    }
+    if (end < length) end++; // include the line break
+    return NSMakeRange(start, end - start);
+}
+
+/**
+ Same as `YYTextMarkdownDirtyRange`, but only the characters around the edited range
+ are copied: the window is enlarged until the dirty range doesn't reach its edges.
+ */
+static NSRange YYTextMarkdownDirtyRangeInString(CFStringRef string, NSUInteger length, NSRange edited) {
+    NSUInteger margin = YYTextMarkdownDirtyMargin;
+    while (YES) {
+        NSUInteger start = edited.location > margin ? edited.location - margin : 0;
+        NSUInteger end = length - NSMaxRange(edited) > margin ? NSMaxRange(edited) + margin : length;
+        unichar *s = malloc((end - start) * sizeof(unichar));
+        if (!s) return NSMakeRange(0, length);
+        CFStringGetCharacters(string, CFRangeMake(start, end - start), s);
+        NSRange range = YYTextMarkdownDirtyRange(s, end - start, NSMakeRange(edited.location - start, edited.length));
+        free(s);
+        // a line cut by the window is only trusted when the range stops before it
+        if ((range.location > 0 || start == 0) && (NSMaxRange(range) < end - start || end == length)) {
+            range.location += start;
+            return range;
+        }
+        margin *= 4;
+    }
+}
+
+
 @implementation YYTextSimpleMarkdownParser {
     UIFont *_font;
     NSMutableArray *_headerFonts; ///< h1~h6
@@ -29,57 +465,29 @@
     UIFont *_monospaceFont;
     YYTextBorder *_border;
     
-    NSRegularExpression *_regexEscape;          ///< escape
-    NSRegularExpression *_regexHeader;          ///< #header
-    NSRegularExpression *_regexH1;              ///< header\n====
-    NSRegularExpression *_regexH2;              ///< header\n----
-    NSRegularExpression *_regexBreakline;       ///< ******
-    NSRegularExpression *_regexEmphasis;        ///< *text*  _text_
-    NSRegularExpression *_regexStrong;          ///< **text**
-    NSRegularExpression *_regexStrongEmphasis;  ///< ***text*** ___text___
-    NSRegularExpression *_regexUnderline;       ///< __text__
-    NSRegularExpression *_regexStrikethrough;   ///< ~~text~~
-    NSRegularExpression *_regexInlineCode;      ///< `text`
-    NSRegularExpression *_regexLink;            ///< [name](link)
-    NSRegularExpression *_regexLinkRefer;       ///< [ref]:
-    NSRegularExpression *_regexList;            ///< 1.text 2.text 3.text
-    NSRegularExpression *_regexBlockQuote;      ///< > quote
-    NSRegularExpression *_regexCodeBlock;       ///< \tcode \tcode
-    NSRegularExpression *_regexNotEmptyLine;
-}
-
-- (void)initRegex {
-#define regexp(reg, option) [NSRegularExpression regularExpressionWithPattern : @reg options : option error : NULL]
-    _regexEscape = regexp("(\\\\\\\\|\\\\\\`|\\\\\\*|\\\\\\_|\\\\\\(|\\\\\\)|\\\\\\[|\\\\\\]|\\\\#|\\\\\\+|\\\\\\-|\\\\\\!)", 0);
-    _regexHeader = regexp("^((\\#{1,6}[^#].*)|(\\#{6}.+))$", NSRegularExpressionAnchorsMatchLines);
-    _regexH1 = regexp("^[^=\\n][^\\n]*\\n=+$", NSRegularExpressionAnchorsMatchLines);
-    _regexH2 = regexp("^[^-\\n][^\\n]*\\n-+$", NSRegularExpressionAnchorsMatchLines);
-    _regexBreakline = regexp("^[ \\t]*([*-])[ \\t]*((\\1)[ \\t]*){2,}[ \\t]*$", NSRegularExpressionAnchorsMatchLines);
-    _regexEmphasis = regexp("((?<!\\*)\\*(?=[^ \\t*])(.+?)(?<=[^ \\t*])\\*(?!\\*)|(?<!_)_(?=[^ \\t_])(.+?)(?<=[^ \\t_])_(?!_))", 0);
-    _regexStrong = regexp("(?<!\\*)\\*{2}(?=[^ \\t*])(.+?)(?<=[^ \\t*])\\*{2}(?!\\*)", 0);
-    _regexStrongEmphasis =  regexp("((?<!\\*)\\*{3}(?=[^ \\t*])(.+?)(?<=[^ \\t*])\\*{3}(?!\\*)|(?<!_)_{3}(?=[^ \\t_])(.+?)(?<=[^ \\t_])_{3}(?!_))", 0);
-    _regexUnderline = regexp("(?<!_)__(?=[^ \\t_])(.+?)(?<=[^ \\t_])\\__(?!_)", 0);
-    _regexStrikethrough = regexp("(?<!~)~~(?=[^ \\t~])(.+?)(?<=[^ \\t~])\\~~(?!~)", 0);
-    _regexInlineCode = regexp("(?<!`)(`{1,3})([^`\n]+?)\\1(?!`)", 0);
-    _regexLink = regexp("!?\\[([^\\[\\]]+)\\](\\(([^\\(\\)]+)\\)|\\[([^\\[\\]]+)\\])", 0);
-    _regexLinkRefer = regexp("^[ \\t]*\\[[^\\[\\]]\\]:", NSRegularExpressionAnchorsMatchLines);
-    _regexList = regexp("^[ \\t]*([*+-]|\\d+[.])[ \\t]+", NSRegularExpressionAnchorsMatchLines);
-    _regexBlockQuote = regexp("^[ \\t]*>[ \\t>]*", NSRegularExpressionAnchorsMatchLines);
-    _regexCodeBlock = regexp("(^\\s*$\\n)((( {4}|\\t).*(\\n|\\z))|(^\\s*$\\n))+", NSRegularExpressionAnchorsMatchLines);
-    _regexNotEmptyLine = regexp("^[ \\t]*[^ \\t]+[ \\t]*$", NSRegularExpressionAnchorsMatchLines);
-#undef regexp
+    dispatch_semaphore_t _lock;
+    __weak NSMutableAttributedString *_lastText; ///< the text parsed last time
+    NSUInteger _lastLength;                      ///< length of the text after last parsing
 }
 
 - (instancetype)init {
     self = [super init];
+    _lock = dispatch_semaphore_create(1);
     _fontSize = 14;
     _headerFontSize = 20;
     [self _updateFonts];
     [self setColorWithBrightTheme];
-    [self initRegex];
     return self;
 }
 
+/// The styles are changed, so the next parsing should not be incremental.
+- (void)_invalidateLastText {
+    dispatch_semaphore_wait(_lock, DISPATCH_TIME_FOREVER);
+    _lastText = nil;
+    _lastLength = 0;
+    dispatch_semaphore_signal(_lock);
+}
+
 - (void)setFontSize:(CGFloat)fontSize {
     if (fontSize < 1) fontSize = 12;
     _fontSize = fontSize;
@@ -104,6 +512,7 @@
     _boldItalicFont = [_font fontWithBoldItalic];
     _monospaceFont = [UIFont fontWithName:@"Menlo" size:_fontSize]; // Since iOS 7
     if (!_monospaceFont) _monospaceFont = [UIFont fontWithName:@"Courier" size:_fontSize]; // Since iOS 3
+    [self _invalidateLastText];
 }
 
 - (void)setColorWithBrightTheme {
@@ -121,6 +530,7 @@
     _border.insets = UIEdgeInsetsMake(-1, 0, -1, 0);
     _border.cornerRadius = 2;
     _border.strokeWidth = CGFloatFromPixel(1);
+    [self _invalidateLastText];
 }
 
 - (void)setColorWithDarkTheme {
@@ -138,175 +548,369 @@
     _border.insets = UIEdgeInsetsMake(-1, 0, -1, 0);
     _border.cornerRadius = 2;
     _border.strokeWidth = CGFloatFromPixel(1);
+    [self _invalidateLastText];
 }
 
-- (NSUInteger)lenghOfBeginWhiteInString:(NSString *)str withRange:(NSRange)range{
-    for (NSUInteger i = 0; i < range.length; i++) {
-        unichar c = [str characterAtIndex:i + range.location];
-        if (c != ' ' && c != '\t' && c != '\n') return i;
-    }
-    return str.length;
+- (void)setTextColor:(UIColor *)textColor {
+    _textColor = textColor;
+    [self _invalidateLastText];
 }
 
-- (NSUInteger)lenghOfEndWhiteInString:(NSString *)str withRange:(NSRange)range{
-    for (NSInteger i = range.length - 1; i >= 0; i--) {
-        unichar c = [str characterAtIndex:i + range.location];
-        if (c != ' ' && c != '\t' && c != '\n') return range.length - i;
-    }
-    return str.length;
+- (void)setControlTextColor:(UIColor *)controlTextColor {
+    _controlTextColor = controlTextColor;
+    [self _invalidateLastText];
+}
+
+- (void)setHeaderTextColor:(UIColor *)headerTextColor {
+    _headerTextColor = headerTextColor;
+    [self _invalidateLastText];
+}
+
+- (void)setInlineTextColor:(UIColor *)inlineTextColor {
+    _inlineTextColor = inlineTextColor;
+    [self _invalidateLastText];
+}
+
+- (void)setCodeTextColor:(UIColor *)codeTextColor {
+    _codeTextColor = codeTextColor;
+    [self _invalidateLastText];
+}
+
+- (void)setLinkTextColor:(UIColor *)linkTextColor {
+    _linkTextColor = linkTextColor;
+    [self _invalidateLastText];
 }
 
-- (NSUInteger)lenghOfBeginChar:(unichar)c inString:(NSString *)str withRange:(NSRange)range{
-    for (NSUInteger i = 0; i < range.length; i++) {
-        if ([str characterAtIndex:i + range.location] != c) return i;
+- (void)_applyTokens:(const YYTextMarkdownToken *)tokens count:(NSUInteger)count offset:(NSUInteger)offset toText:(NSMutableAttributedString *)text {
+    for (NSUInteger i = 0; i < count; i++) {
+        YYTextMarkdownToken token = tokens[i];
+        NSRange r = NSMakeRange(token.location + offset, token.length);
+        switch (token.style) {
+            case YYTextMarkdownStyleControl: [text setColor:_controlTextColor range:r]; break;
+            case YYTextMarkdownStyleHeader: [text setColor:_headerTextColor range:r]; break;
+            case YYTextMarkdownStyleHeaderFont: [text setFont:_headerFonts[token.level] range:r]; break;
+            case YYTextMarkdownStyleItalic: [text setFont:_italicFont range:r]; break;
+            case YYTextMarkdownStyleBold: [text setFont:_boldFont range:r]; break;
+            case YYTextMarkdownStyleBoldItalic: [text setFont:_boldItalicFont range:r]; break;
+            case YYTextMarkdownStyleUnderline: {
+                [text setTextUnderline:[YYTextDecoration decorationWithStyle:YYTextLineStyleSingle width:@1 color:nil] range:r];
+            } break;
+            case YYTextMarkdownStyleStrikethrough: {
+                [text setTextStrikethrough:[YYTextDecoration decorationWithStyle:YYTextLineStyleSingle width:@1 color:nil] range:r];
+            } break;
+            case YYTextMarkdownStyleInline: [text setColor:_inlineTextColor range:r]; break;
+            case YYTextMarkdownStyleMonospace: [text setFont:_monospaceFont range:r]; break;
+            case YYTextMarkdownStyleInlineBorder: [text setTextBorder:_border.copy range:r]; break;
+            case YYTextMarkdownStyleLink: [text setColor:_linkTextColor range:r]; break;
+            case YYTextMarkdownStyleCode: [text setColor:_codeTextColor range:r]; break;
+            case YYTextMarkdownStyleCodeBorder: [text setTextBlockBorder:_border.copy range:r]; break;
+        }
     }
-    return str.length;
 }
 
 - (BOOL)parseText:(NSMutableAttributedString *)text selectedRange:(NSRangePointer)range {
-    if (text.length == 0) return NO;
-    [text removeAttributesInRange:NSMakeRange(0, text.length)];
-    text.font = _font;
-    text.color = _textColor;
-    
-    NSMutableString *str = text.string.mutableCopy;
-    [_regexEscape replaceMatchesInString:str options:kNilOptions range:NSMakeRange(0, str.length) withTemplate:@"@@"];
-    
-    [_regexHeader enumerateMatchesInString:str options:0 range:NSMakeRange(0, str.length) usingBlock:^(NSTextCheckingResult *result, NSMatchingFlags flags, BOOL *stop) {
-        NSRange r = result.range;
-        NSUInteger whiteLen = [self lenghOfBeginWhiteInString:str withRange:r];
-        NSUInteger sharpLen = [self lenghOfBeginChar:'#' inString:str withRange:NSMakeRange(r.location + whiteLen, r.length - whiteLen)];
-        if (sharpLen > 6) sharpLen = 6;
-        [text setColor:_controlTextColor range:NSMakeRange(r.location, whiteLen + sharpLen)];
-        [text setColor:_headerTextColor range:NSMakeRange(r.location + whiteLen + sharpLen, r.length - whiteLen - sharpLen)];
-        [text setFont:_headerFonts[sharpLen - 1] range:result.range];
-    }];
-    
-    [_regexH1 enumerateMatchesInString:str options:0 range:NSMakeRange(0, str.length) usingBlock:^(NSTextCheckingResult *result, NSMatchingFlags flags, BOOL *stop) {
-        NSRange r = result.range;
-        NSRange linebreak = [str rangeOfString:@"\n" options:0 range:result.range locale:nil];
-        if (linebreak.location != NSNotFound) {
-            [text setColor:_headerTextColor range:NSMakeRange(r.location, linebreak.location - r.location)];
-            [text setFont:_headerFonts[0] range:NSMakeRange(r.location, linebreak.location - r.location + 1)];
-            [text setColor:_controlTextColor range:NSMakeRange(linebreak.location + linebreak.length, r.location + r.length - linebreak.location - linebreak.length)];
-        }
-    }];
-    
-    [_regexH2 enumerateMatchesInString:str options:0 range:NSMakeRange(0, str.length) usingBlock:^(NSTextCheckingResult *result, NSMatchingFlags flags, BOOL *stop) {
-        NSRange r = result.range;
-        NSRange linebreak = [str rangeOfString:@"\n" options:0 range:result.range locale:nil];
-        if (linebreak.location != NSNotFound) {
-            [text setColor:_headerTextColor range:NSMakeRange(r.location, linebreak.location - r.location)];
-            [text setFont:_headerFonts[1] range:NSMakeRange(r.location, linebreak.location - r.location + 1)];
-            [text setColor:_controlTextColor range:NSMakeRange(linebreak.location + linebreak.length, r.location + r.length - linebreak.location - linebreak.length)];
-        }
-    }];
-    
-    [_regexBreakline enumerateMatchesInString:str options:0 range:NSMakeRange(0, str.length) usingBlock:^(NSTextCheckingResult *result, NSMatchingFlags flags, BOOL *stop) {
-        [text setColor:_controlTextColor range:result.range];
-    }];
-    
-    [_regexEmphasis enumerateMatchesInString:str options:0 range:NSMakeRange(0, str.length) usingBlock:^(NSTextCheckingResult *result, NSMatchingFlags flags, BOOL *stop) {
-        NSRange r = result.range;
-        [text setColor:_controlTextColor range:NSMakeRange(r.location, 1)];
-        [text setColor:_controlTextColor range:NSMakeRange(r.location + r.length - 1, 1)];
-        [text setFont:_italicFont range:NSMakeRange(r.location + 1, r.length - 2)];
-    }];
-    
-    [_regexStrong enumerateMatchesInString:str options:0 range:NSMakeRange(0, str.length) usingBlock:^(NSTextCheckingResult *result, NSMatchingFlags flags, BOOL *stop) {
-        NSRange r = result.range;
-        [text setColor:_controlTextColor range:NSMakeRange(r.location, 2)];
-        [text setColor:_controlTextColor range:NSMakeRange(r.location + r.length - 2, 2)];
-        [text setFont:_boldFont range:NSMakeRange(r.location + 2, r.length - 4)];
-    }];
-    
-    [_regexStrongEmphasis enumerateMatchesInString:str options:0 range:NSMakeRange(0, str.length) usingBlock:^(NSTextCheckingResult *result, NSMatchingFlags flags, BOOL *stop) {
-        NSRange r = result.range;
-        [text setColor:_controlTextColor range:NSMakeRange(r.location, 3)];
-        [text setColor:_controlTextColor range:NSMakeRange(r.location + r.length - 3, 3)];
-        [text setFont:_boldItalicFont range:NSMakeRange(r.location + 3, r.length - 6)];
-    }];
-    
-    [_regexUnderline enumerateMatchesInString:str options:0 range:NSMakeRange(0, str.length) usingBlock:^(NSTextCheckingResult *result, NSMatchingFlags flags, BOOL *stop) {
-        NSRange r = result.range;
-        [text setColor:_controlTextColor range:NSMakeRange(r.location, 2)];
-        [text setColor:_controlTextColor range:NSMakeRange(r.location + r.length - 2, 2)];
-        [text setTextUnderline:[YYTextDecoration decorationWithStyle:YYTextLineStyleSingle width:@1 color:nil] range:NSMakeRange(r.location + 2, r.length - 4)];
-    }];
+    return [self _parseText:text editedRange:NSMakeRange(NSNotFound, 0) changeInLength:0];
+}
+
+- (BOOL)parseText:(NSMutableAttributedString *)text selectedRange:(NSRangePointer)range editedRange:(NSRange)editedRange changeInLength:(NSInteger)delta {
+    return [self _parseText:text editedRange:editedRange changeInLength:delta];
+}
+
+- (BOOL)_parseText:(NSMutableAttributedString *)text editedRange:(NSRange)editedRange changeInLength:(NSInteger)delta {
+    NSUInteger length = text.length;
+    if (length == 0) {
+        [self _invalidateLastText];
+        return NO;
+    }
+    CFStringRef string = (__bridge CFStringRef)text.string;
     
-    [_regexStrikethrough enumerateMatchesInString:str options:0 range:NSMakeRange(0, str.length) usingBlock:^(NSTextCheckingResult *result, NSMatchingFlags flags, BOOL *stop) {
-        NSRange r = result.range;
-        [text setColor:_controlTextColor range:NSMakeRange(r.location, 2)];
-        [text setColor:_controlTextColor range:NSMakeRange(r.location + r.length - 2, 2)];
-        [text setTextStrikethrough:[YYTextDecoration decorationWithStyle:YYTextLineStyleSingle width:@1 color:nil] range:NSMakeRange(r.location + 2, r.length - 4)];
-    }];
+    dispatch_semaphore_wait(_lock, DISPATCH_TIME_FOREVER);
     
-    [_regexInlineCode enumerateMatchesInString:str options:0 range:NSMakeRange(0, str.length) usingBlock:^(NSTextCheckingResult *result, NSMatchingFlags flags, BOOL *stop) {
-        NSRange r = result.range;
-        NSUInteger len = [self lenghOfBeginChar:'`' inString:str withRange:r];
-        [text setColor:_controlTextColor range:NSMakeRange(r.location, len)];
-        [text setColor:_controlTextColor range:NSMakeRange(r.location + r.length - len, len)];
-        [text setColor:_inlineTextColor range:NSMakeRange(r.location + len, r.length - 2 * len)];
-        [text setFont:_monospaceFont range:r];
-        [text setTextBorder:_border.copy range:r];
-    }];
+    // If the caller tells the edited range of the text parsed last time, only the
+    // blocks around it are parsed again, the others keep their attributes.
+    NSRange parseRange = NSMakeRange(0, length);
+    if (editedRange.location != NSNotFound && _lastText == text &&
+        (NSInteger)_lastLength + delta == (NSInteger)length && NSMaxRange(editedRange) <= length) {
+        parseRange = YYTextMarkdownDirtyRangeInString(string, length, editedRange);
+    }
     
-    [_regexLink enumerateMatchesInString:str options:0 range:NSMakeRange(0, str.length) usingBlock:^(NSTextCheckingResult *result, NSMatchingFlags flags, BOOL *stop) {
-        NSRange r = result.range;
-        [text setColor:_linkTextColor range:r];
-    }];
+    unichar *work = malloc(MAX(parseRange.length, 1) * sizeof(unichar));
+    YYTextMarkdownContext ctx = {0};
+    if (work) {
+        CFStringGetCharacters(string, CFRangeMake(parseRange.location, parseRange.length), work);
+        YYTextMarkdownReplaceEscapes(work, parseRange.length);
+        ctx.chars = work;
+        ctx.length = parseRange.length;
+        YYTextMarkdownTokenize(&ctx);
+    }
+    BOOL succeed = work && !ctx.failed;
+    if (succeed) {
+        [text removeAttributesInRange:parseRange];
+        [text setFont:_font range:parseRange];
+        [text setColor:_textColor range:parseRange];
+        [self _applyTokens:ctx.tokens count:ctx.tokenCount offset:parseRange.location toText:text];
+    }
+    if (ctx.tokens) free(ctx.tokens);
+    if (work) free(work);
     
-    [_regexLinkRefer enumerateMatchesInString:str options:0 range:NSMakeRange(0, str.length) usingBlock:^(NSTextCheckingResult *result, NSMatchingFlags flags, BOOL *stop) {
-        NSRange r = result.range;
-        [text setColor:_controlTextColor range:r];
-    }];
+    _lastLength = succeed ? length : 0;
+    _lastText = succeed ? text : nil;
     
-    [_regexList enumerateMatchesInString:str options:0 range:NSMakeRange(0, str.length) usingBlock:^(NSTextCheckingResult *result, NSMatchingFlags flags, BOOL *stop) {
-        NSRange r = result.range;
-        [text setColor:_controlTextColor range:r];
-    }];
+    dispatch_semaphore_signal(_lock);
+    return succeed;
+}
+
+@end
+
+
+
+#pragma mark - Emoticon Parser
+
+#define LOCK(...) dispatch_semaphore_wait(_lock, DISPATCH_TIME_FOREVER); \
+__VA_ARGS__; \
+dispatch_semaphore_signal(_lock);
+
+/// An emoticon key found in text.
+typedef struct {
+    NSUInteger location;
+    uint32_t key; ///< index of the key
+} YYTextEmoticonMatch;
+
+/**
+ Aho-Corasick automaton over UTF-16 for the emoticon keys.
+ Node 0 is the root; the trie edges are stored in an open addressing hash table.
+ */
+typedef struct {
+    uint32_t nodeCount;
+    uint32_t *fail;       ///< failure link of node
+    uint32_t *output;     ///< nearest node in the failure chain that ends a key, 0 if none
+    int32_t *nodeKey;     ///< index of the key ending at node, -1 if none
+    uint32_t keyCount;
+    uint32_t *keyLength;  ///< length of key
+    uint64_t *edgeKeys;   ///< (node << 16 | char) + 1, 0 for an empty slot
+    uint32_t *edgeNodes;  ///< target node of edge
+    uint32_t edgeMask;
+} YYTextEmoticonTrie;
+
+static inline uint32_t YYTextEmoticonTrieEdgeSlot(const YYTextEmoticonTrie *trie, uint64_t key) {
+    uint64_t hash = key * 0x9E3779B97F4A7C15ULL;
+    uint32_t slot = (uint32_t)(hash >> 32) & trie->edgeMask;
+    while (trie->edgeKeys[slot] && trie->edgeKeys[slot] != key) slot = (slot + 1) & trie->edgeMask;
+    return slot;
+}
+
+/// Returns the child node of `node` by `c`, or 0 if not found.
+static inline uint32_t YYTextEmoticonTrieChild(const YYTextEmoticonTrie *trie, uint32_t node, unichar c) {
+    uint64_t key = (((uint64_t)node << 16) | c) + 1;
+    uint32_t slot = YYTextEmoticonTrieEdgeSlot(trie, key);
+    return trie->edgeKeys[slot] ? trie->edgeNodes[slot] : 0;
+}
+
+static void YYTextEmoticonTrieFree(YYTextEmoticonTrie *trie) {
+    if (!trie) return;
+    free(trie->fail);
+    free(trie->output);
+    free(trie->nodeKey);
+    free(trie->keyLength);
+    free(trie->edgeKeys);
+    free(trie->edgeNodes);
+    free(trie);
+}
+
+/**
+ Creates an automaton for keys. `keys` are UTF-16 buffers with `lengths`;
+ an empty key is ignored. Returns NULL if there's no memory.
+ */
+static YYTextEmoticonTrie *YYTextEmoticonTrieCreate(const unichar *const *keys, const uint32_t *lengths, uint32_t count) {
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < count; i++) total += lengths[i];
+    if (total >= UINT32_MAX / 2) return NULL;
+    uint32_t capacity = (uint32_t)total + 1;
+    uint32_t edgeCapacity = 16;
+    while (edgeCapacity < capacity * 2) edgeCapacity <<= 1;
     
-    [_regexBlockQuote enumerateMatchesInString:str options:0 range:NSMakeRange(0, str.length) usingBlock:^(NSTextCheckingResult *result, NSMatchingFlags flags, BOOL *stop) {
-        NSRange r = result.range;
-        [text setColor:_controlTextColor range:r];
-    }];
+    YYTextEmoticonTrie *trie = calloc(1, sizeof(YYTextEmoticonTrie));
+    uint32_t *parent = malloc(capacity * sizeof(uint32_t));
+    unichar *edgeChar = malloc(capacity * sizeof(unichar));
+    uint32_t *depth = calloc(capacity, sizeof(uint32_t));
+    uint32_t *order = malloc(capacity * sizeof(uint32_t));
+    if (trie) {
+        trie->fail = calloc(capacity, sizeof(uint32_t));
+        trie->output = calloc(capacity, sizeof(uint32_t));
+        trie->nodeKey = malloc(capacity * sizeof(int32_t));
+        trie->keyLength = malloc((count ? count : 1) * sizeof(uint32_t));
+        trie->edgeKeys = calloc(edgeCapacity, sizeof(uint64_t));
+        trie->edgeNodes = malloc(edgeCapacity * sizeof(uint32_t));
+    }
+    if (!trie || !parent || !edgeChar || !depth || !order || !trie->fail || !trie->output ||
+        !trie->nodeKey || !trie->keyLength || !trie->edgeKeys || !trie->edgeNodes) {
+        YYTextEmoticonTrieFree(trie);
+        free(parent);
+        free(edgeChar);
+        free(depth);
+        free(order);
+        return NULL;
+    }
+    trie->edgeMask = edgeCapacity - 1;
+    trie->keyCount = count;
+    trie->nodeCount = 1;
+    trie->nodeKey[0] = -1;
     
-    [_regexCodeBlock enumerateMatchesInString:str options:0 range:NSMakeRange(0, str.length) usingBlock:^(NSTextCheckingResult *result, NSMatchingFlags flags, BOOL *stop) {
-        NSRange r = result.range;
-        NSRange firstLineRange = [_regexNotEmptyLine rangeOfFirstMatchInString:str options:kNilOptions range:r];
-        NSUInteger lenStart = (firstLineRange.location != NSNotFound) ? firstLineRange.location - r.location : 0;
-        NSUInteger lenEnd = [self lenghOfEndWhiteInString:str withRange:r];
-        if (lenStart + lenEnd < r.length) {
-            NSRange codeR = NSMakeRange(r.location + lenStart, r.length - lenStart - lenEnd);
-            [text setColor:_codeTextColor range:codeR];
-            [text setFont:_monospaceFont range:codeR];
-            YYTextBorder *border = [YYTextBorder new];
-            border.lineStyle = YYTextLineStyleSingle;
-            border.fillColor = [UIColor colorWithWhite:0.184 alpha:0.090];
-            border.strokeColor = [UIColor colorWithWhite:0.200 alpha:0.300];
-            border.insets = UIEdgeInsetsMake(-1, 0, -1, 0);
-            border.cornerRadius = 3;
-            border.strokeWidth = CGFloatFromPixel(2);
-            [text setTextBlockBorder:_border.copy range:codeR];
+    // trie
+    uint32_t maxDepth = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        trie->keyLength[i] = lengths[i];
+        if (lengths[i] == 0) continue;
+        uint32_t node = 0;
+        for (uint32_t ci = 0; ci < lengths[i]; ci++) {
+            unichar c = keys[i][ci];
+            uint64_t key = (((uint64_t)node << 16) | c) + 1;
+            uint32_t slot = YYTextEmoticonTrieEdgeSlot(trie, key);
+            if (!trie->edgeKeys[slot]) {
+                uint32_t child = trie->nodeCount++;
+                trie->edgeKeys[slot] = key;
+                trie->edgeNodes[slot] = child;
+                trie->nodeKey[child] = -1;
+                parent[child] = node;
+                edgeChar[child] = c;
+                depth[child] = depth[node] + 1;
+                if (depth[child] > maxDepth) maxDepth = depth[child];
+            }
+            node = trie->edgeNodes[slot];
         }
-    }];
+        trie->nodeKey[node] = i;
+    }
     
-    return YES;
+    // breadth first order (counting sort by depth), so a failure link is always set before it's used
+    uint32_t *offsets = calloc(maxDepth + 2, sizeof(uint32_t));
+    if (!offsets) {
+        YYTextEmoticonTrieFree(trie);
+        trie = NULL;
+    } else {
+        for (uint32_t node = 0; node < trie->nodeCount; node++) offsets[depth[node] + 1]++;
+        for (uint32_t d = 1; d <= maxDepth + 1; d++) offsets[d] += offsets[d - 1];
+        for (uint32_t node = 0; node < trie->nodeCount; node++) order[offsets[depth[node]]++] = node;
+        free(offsets);
+        
+        for (uint32_t i = 1; i < trie->nodeCount; i++) {
+            uint32_t node = order[i];
+            uint32_t fail = 0;
+            if (depth[node] > 1) {
+                unichar c = edgeChar[node];
+                uint32_t state = trie->fail[parent[node]];
+                while (state && !YYTextEmoticonTrieChild(trie, state, c)) state = trie->fail[state];
+                fail = YYTextEmoticonTrieChild(trie, state, c);
+            }
+            trie->fail[node] = fail;
+            trie->output[node] = trie->nodeKey[fail] >= 0 ? fail : trie->output[fail];
+        }
+    }
+    free(parent);
+    free(edgeChar);
+    free(depth);
+    free(order);
+    return trie;
 }
 
+/**
+ Finds keys in text from left to right, at each location the longest key wins,
+ and matches never overlap. Returns a malloc'd array of matches (or NULL if none
+ found) and sets `count`.
+ */
+static YYTextEmoticonMatch *YYTextEmoticonTrieMatch(const YYTextEmoticonTrie *trie, const unichar *chars, NSUInteger length, NSUInteger *count) {
+    *count = 0;
+    int32_t *longest = NULL; ///< index of the longest key starting at location, -1 if none
+    uint32_t state = 0;
+    for (NSUInteger i = 0; i < length; i++) {
+        unichar c = chars[i];
+        uint32_t next;
+        while (!(next = YYTextEmoticonTrieChild(trie, state, c)) && state) state = trie->fail[state];
+        state = next;
+        uint32_t node = trie->nodeKey[state] >= 0 ? state : trie->output[state];
+        for (; node; node = trie->output[node]) {
+            if (!longest) {
+                longest = malloc(length * sizeof(int32_t));
+                if (!longest) return NULL;
+                memset(longest, 0xFF, length * sizeof(int32_t));
+            }
+            int32_t key = trie->nodeKey[node];
+            NSUInteger location = i + 1 - trie->keyLength[key];
+            int32_t old = longest[location];
+            if (old < 0 || trie->keyLength[old] < trie->keyLength[key]) longest[location] = key;
+        }
+    }
+    if (!longest) return NULL;
+    
+    YYTextEmoticonMatch *matches = malloc(length * sizeof(YYTextEmoticonMatch));
+    if (matches) {
+        NSUInteger matchCount = 0;
+        for (NSUInteger i = 0; i < length;) {
+            int32_t key = longest[i];
+            if (key < 0) {
+                i++;
+                continue;
+            }
+            matches[matchCount].location = i;
+            matches[matchCount].key = key;
+            matchCount++;
+            i += trie->keyLength[key];
+        }
+        *count = matchCount;
+    }
+    free(longest);
+    return matches;
+}
 
+/// Compiled emoticon mapper, immutable after creation.
+@interface _YYTextEmoticonMatcher : NSObject {
+@package
+    YYTextEmoticonTrie *_trie;
+    NSArray<NSString *> *_keys;
+}
+- (instancetype)initWithKeys:(NSArray<NSString *> *)keys;
 @end
 
+@implementation _YYTextEmoticonMatcher
 
+- (instancetype)initWithKeys:(NSArray<NSString *> *)keys {
+    self = [super init];
+    NSUInteger count = keys.count;
+    if (count == 0) return nil;
+    
+    NSUInteger total = 0;
+    for (NSString *key in keys) total += key.length;
+    unichar *chars = malloc(MAX(total, 1) * sizeof(unichar));
+    const unichar **keyChars = malloc(count * sizeof(unichar *));
+    uint32_t *keyLengths = malloc(count * sizeof(uint32_t));
+    if (chars && keyChars && keyLengths) {
+        unichar *cur = chars;
+        for (NSUInteger i = 0; i < count; i++) {
+            NSString *key = keys[i];
+            NSUInteger length = key.length;
+            [key getCharacters:cur range:NSMakeRange(0, length)];
+            keyChars[i] = cur;
+            keyLengths[i] = (uint32_t)length;
+            cur += length;
+        }
+        _trie = YYTextEmoticonTrieCreate(keyChars, keyLengths, (uint32_t)count);
+    }
+    free(chars);
+    free(keyChars);
+    free(keyLengths);
+    if (!_trie) return nil;
+    _keys = keys.copy;
+    return self;
+}
 
-#pragma mark - Emoticon Parser
+- (void)dealloc {
+    YYTextEmoticonTrieFree(_trie);
+}
+
+@end
 
-#define LOCK(...) dispatch_semaphore_wait(_lock, DISPATCH_TIME_FOREVER); \
-__VA_ARGS__; \
-dispatch_semaphore_signal(_lock);
 
 @implementation YYTextSimpleEmoticonParser {
-    NSRegularExpression *_regex;
+    _YYTextEmoticonMatcher *_matcher;
     NSDictionary *_mapper;
     dispatch_semaphore_t _lock;
 }
@@ -322,33 +926,11 @@ dispatch_semaphore_signal(_lock);
 }
 
 - (void)setEmoticonMapper:(NSDictionary *)emoticonMapper {
+    NSDictionary *mapper = emoticonMapper.copy;
+    _YYTextEmoticonMatcher *matcher = mapper.count ? [[_YYTextEmoticonMatcher alloc] initWithKeys:mapper.allKeys] : nil;
     LOCK(
-         _mapper = emoticonMapper.copy;
-         if (_mapper.count == 0) {
-             _regex = nil;
-         } else {
-             NSMutableString *pattern = @"(".mutableCopy;
-             NSArray *allKeys = _mapper.allKeys;
-             NSCharacterSet *charset = [NSCharacterSet characterSetWithCharactersInString:@"$^?+*.,#|{}[]()\\"];
-             for (NSUInteger i = 0, max = allKeys.count; i < max; i++) {
-                 NSMutableString *one = [allKeys[i] mutableCopy];
-                 
-                 // escape regex characters
-                 for (NSUInteger ci = 0, cmax = one.length; ci < cmax; ci++) {
-                     unichar c = [one characterAtIndex:ci];
-                     if ([charset characterIsMember:c]) {
-                         [one insertString:@"\\" atIndex:ci];
-                         ci++;
-                         cmax++;
-                     }
-                 }
-                 
-                 [pattern appendString:one];
-                 if (i != max - 1) [pattern appendString:@"|"];
-             }
-             [pattern appendString:@")"];
-             _regex = [[NSRegularExpression alloc] initWithPattern:pattern options:kNilOptions error:nil];
-         }
+         _mapper = mapper;
+         _matcher = matcher;
     );
 }
 
@@ -383,35 +965,67 @@ dispatch_semaphore_signal(_lock);
     if (text.length == 0) return NO;
     
     NSDictionary *mapper;
-    NSRegularExpression *regex;
-    LOCK(mapper = _mapper; regex = _regex;);
-    if (mapper.count == 0 || regex == nil) return NO;
+    _YYTextEmoticonMatcher *matcher;
+    LOCK(mapper = _mapper; matcher = _matcher;);
+    if (mapper.count == 0 || matcher == nil) return NO;
     
-    NSArray *matches = [regex matchesInString:text.string options:kNilOptions range:NSMakeRange(0, text.length)];
-    if (matches.count == 0) return NO;
+    NSString *string = text.string;
+    NSUInteger length = string.length;
+    const unichar *chars = CFStringGetCharactersPtr((CFStringRef)string);
+    unichar *buffer = NULL;
+    if (!chars) {
+        buffer = malloc(length * sizeof(unichar));
+        if (!buffer) return NO;
+        [string getCharacters:buffer range:NSMakeRange(0, length)];
+        chars = buffer;
+    }
+    NSUInteger matchCount = 0;
+    YYTextEmoticonMatch *matches = YYTextEmoticonTrieMatch(matcher->_trie, chars, length, &matchCount);
+    if (buffer) free(buffer);
+    if (matchCount == 0) {
+        if (matches) free(matches);
+        return NO;
+    }
     
+    // rebuild the text once, instead of replacing each match in place
+    NSArray *discontinuousKeys = [NSMutableAttributedString allDiscontinuousAttributeKeys];
+    NSMutableAttributedString *result = [NSMutableAttributedString new];
     NSRange selectedRange = range ? *range : NSMakeRange(0, 0);
-    NSUInteger cutLength = 0;
-    for (NSUInteger i = 0, max = matches.count; i < max; i++) {
-        NSTextCheckingResult *one = matches[i];
-        NSRange oneRange = one.range;
-        if (oneRange.length == 0) continue;
-        oneRange.location -= cutLength;
-        NSString *subStr = [text.string substringWithRange:oneRange];
-        UIImage *emoticon = mapper[subStr];
+    NSUInteger cutLength = 0, copiedLength = 0;
+    BOOL changed = NO;
+    for (NSUInteger i = 0; i < matchCount; i++) {
+        NSString *key = matcher->_keys[matches[i].key];
+        NSRange oneRange = NSMakeRange(matches[i].location, key.length);
+        UIImage *emoticon = mapper[key];
         if (!emoticon) continue;
         
+        NSMutableDictionary *attributes = [text attributesAtIndex:oneRange.location effectiveRange:NULL].mutableCopy;
         CGFloat fontSize = 12; // CoreText default value
-        CTFontRef font = (__bridge CTFontRef)([text attribute:NSFontAttributeName atIndex:oneRange.location]);
+        CTFontRef font = (__bridge CTFontRef)attributes[NSFontAttributeName];
         if (font) fontSize = CTFontGetSize(font);
         NSMutableAttributedString *atr = [NSAttributedString attachmentStringWithEmojiImage:emoticon fontSize:fontSize];
-        [atr setTextBackedString:[YYTextBackedString stringWithString:subStr] range:NSMakeRange(0, atr.length)];
-        [text replaceCharactersInRange:oneRange withString:atr.string];
-        [text removeDiscontinuousAttributesInRange:NSMakeRange(oneRange.location, atr.length)];
-        [text addAttributes:atr.attributes range:NSMakeRange(oneRange.location, atr.length)];
+        if (!atr) continue;
+        [atr setTextBackedString:[YYTextBackedString stringWithString:key] range:NSMakeRange(0, atr.length)];
+        [attributes removeObjectsForKeys:discontinuousKeys];
+        [attributes addEntriesFromDictionary:atr.attributes];
+        
+        if (oneRange.location > copiedLength) {
+            [result appendAttributedString:[text attributedSubstringFromRange:NSMakeRange(copiedLength, oneRange.location - copiedLength)]];
+        }
+        [result appendAttributedString:[[NSAttributedString alloc] initWithString:atr.string attributes:attributes]];
+        copiedLength = NSMaxRange(oneRange);
+        changed = YES;
+        
+        oneRange.location -= cutLength;
         selectedRange = [self _replaceTextInRange:oneRange withLength:atr.length selectedRange:selectedRange];
-        cutLength += oneRange.length - 1;
+        cutLength += oneRange.length - atr.length;
+    }
+    free(matches);
+    if (!changed) return NO;
+    if (copiedLength < length) {
+        [result appendAttributedString:[text attributedSubstringFromRange:NSMakeRange(copiedLength, length - copiedLength)]];
     }
+    [text setAttributedString:result];
     if (range) *range = selectedRange;
     
     return YES;
@@ -342,6 +342,17 @@ NS_ASSUME_NONNULL_BEGIN
  */
 @property (nonatomic) BOOL ignoreCommonProperties;
 
+/**
+ Whether the layouts are taken from `[YYTextLayoutCache sharedCache]`, so labels
+ with the same text and container share one layout.
+ 
+ The default value is `NO`.
+ 
+ @discussion It's useful for many labels with repeated content (such as cells in
+ a table view). See `YYTextLayoutCache` for the texts and containers not cached.
+ */
+@property (nonatomic) BOOL usesLayoutCache;
+
 /*
  Tips:
  
@@ -443,6 +454,7 @@ IB_DESIGNABLE
 @property (nonatomic) BOOL fadeOnAsynchronouslyDisplay;
 @property (nonatomic) BOOL fadeOnHighlight;
 @property (nonatomic) BOOL ignoreCommonProperties;
+@property (nonatomic) BOOL usesLayoutCache;
 @end
 #endif // !TARGET_INTERFACE_BUILDER
 
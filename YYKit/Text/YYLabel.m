@@ -84,8 +84,8 @@ static dispatch_queue_t YYLabelGetReleaseQueue() {
 }
 
 - (void)_updateLayout {
-    _innerLayout = [YYTextLayout layoutWithContainer:_innerContainer text:_innerText];
-    _shrinkInnerLayout = [YYLabel _shrinkLayoutWithLayout:_innerLayout];
+    _innerLayout = [YYLabel _layoutWithContainer:_innerContainer text:_innerText usesCache:_usesLayoutCache];
+    _shrinkInnerLayout = [YYLabel _shrinkLayoutWithLayout:_innerLayout usesCache:_usesLayoutCache];
 }
 
 - (void)_setLayoutNeedUpdate {
@@ -121,7 +121,12 @@ static dispatch_queue_t YYLabelGetReleaseQueue() {
     return _shrinkHighlightLayout ? _shrinkHighlightLayout : _highlightLayout;
 }
 
-+ (YYTextLayout *)_shrinkLayoutWithLayout:(YYTextLayout *)layout {
++ (YYTextLayout *)_layoutWithContainer:(YYTextContainer *)container text:(NSAttributedString *)text usesCache:(BOOL)usesCache {
+    if (usesCache) return [[YYTextLayoutCache sharedCache] layoutWithContainer:container text:text];
+    return [YYTextLayout layoutWithContainer:container text:text];
+}
+
++ (YYTextLayout *)_shrinkLayoutWithLayout:(YYTextLayout *)layout usesCache:(BOOL)usesCache {
     if (layout.text.length && layout.lines.count == 0) {
         YYTextContainer *container = layout.container.copy;
         container.maximumNumberOfRows = 1;
@@ -132,7 +137,7 @@ static dispatch_queue_t YYLabelGetReleaseQueue() {
             containerSize.width = YYTextContainerMaxSize.width;
         }
         container.size = containerSize;
-        return [YYTextLayout layoutWithContainer:container text:layout.text];
+        return [self _layoutWithContainer:container text:layout.text usesCache:usesCache];
     } else {
         return nil;
     }
@@ -215,7 +220,7 @@ static dispatch_queue_t YYLabelGetReleaseQueue() {
             [hiText setAttribute:key value:value range:_highlightRange];
         }];
         _highlightLayout = [YYTextLayout layoutWithContainer:_innerContainer text:hiText];
-        _shrinkHighlightLayout = [YYLabel _shrinkLayoutWithLayout:_highlightLayout];
+        _shrinkHighlightLayout = [YYLabel _shrinkLayoutWithLayout:_highlightLayout usesCache:NO];
         if (!_highlightLayout) _highlight = nil;
     }
     
@@ -500,7 +505,7 @@ static dispatch_queue_t YYLabelGetReleaseQueue() {
     YYTextContainer *container = [_innerContainer copy];
     container.size = size;
     
-    YYTextLayout *layout = [YYTextLayout layoutWithContainer:container text:_innerText];
+    YYTextLayout *layout = [YYLabel _layoutWithContainer:container text:_innerText usesCache:_usesLayoutCache];
     return layout.textBoundingSize;
 }
 
@@ -1030,7 +1035,7 @@ static dispatch_queue_t YYLabelGetReleaseQueue() {
         YYTextContainer *container = [_innerContainer copy];
         container.size = YYTextContainerMaxSize;
         
-        YYTextLayout *layout = [YYTextLayout layoutWithContainer:container text:_innerText];
+        YYTextLayout *layout = [YYLabel _layoutWithContainer:container text:_innerText usesCache:_usesLayoutCache];
         return layout.textBoundingSize;
     }
     
@@ -1048,7 +1053,7 @@ static dispatch_queue_t YYLabelGetReleaseQueue() {
     YYTextContainer *container = [_innerContainer copy];
     container.size = containerSize;
     
-    YYTextLayout *layout = [YYTextLayout layoutWithContainer:container text:_innerText];
+    YYTextLayout *layout = [YYLabel _layoutWithContainer:container text:_innerText usesCache:_usesLayoutCache];
     return layout.textBoundingSize;
 }
 
@@ -1076,6 +1081,7 @@ static dispatch_queue_t YYLabelGetReleaseQueue() {
     NSMutableArray *attachmentLayers = _attachmentLayers;
     BOOL layoutNeedUpdate = _state.layoutNeedUpdate;
     BOOL fadeForAsync = _displaysAsynchronously && _fadeOnAsynchronouslyDisplay;
+    BOOL usesLayoutCache = _usesLayoutCache;
     __block YYTextLayout *layout = (_state.showingHighlight && _highlightLayout) ? self._highlightLayout : self._innerLayout;
     __block YYTextLayout *shrinkLayout = nil;
     __block BOOL layoutUpdated = NO;
@@ -1116,8 +1122,8 @@ static dispatch_queue_t YYLabelGetReleaseQueue() {
         
         YYTextLayout *drawLayout = layout;
         if (layoutNeedUpdate) {
-            layout = [YYTextLayout layoutWithContainer:container text:text];
-            shrinkLayout = [YYLabel _shrinkLayoutWithLayout:layout];
+            layout = [YYLabel _layoutWithContainer:container text:text usesCache:usesLayoutCache];
+            shrinkLayout = [YYLabel _shrinkLayoutWithLayout:layout usesCache:usesLayoutCache];
             if (isCancelled()) return;
             layoutUpdated = YES;
             drawLayout = shrinkLayout ? shrinkLayout : layout;
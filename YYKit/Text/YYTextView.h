@@ -249,6 +249,13 @@ NS_ASSUME_NONNULL_BEGIN
  */
 @property (nullable, nonatomic, copy) YYTextDebugOption *debugOption;
 
+/**
+ Whether the layouts of the placeholder and `sizeThatFits:` are taken from
+ `[YYTextLayoutCache sharedCache]`. The layout of the editing text is never cached.
+ The default value is NO.
+ */
+@property (nonatomic) BOOL usesLayoutCache;
+
 
 #pragma mark - Working with the Selection and Menu
 ///=============================================================================
@@ -337,9 +344,11 @@ NS_ASSUME_NONNULL_BEGIN
 @property (nonatomic) BOOL allowsUndoAndRedo;
 
 /**
- The maximum undo/redo level. The default value is 20.
+ The maximum undo/redo level. The default value is 100.
  最大摇动撤销值
  
+ @discussion Each level only keeps the changed part of the text, so a deep
+ history costs little memory even for a large document.
  */
 @property (nonatomic) NSUInteger maximumUndoLevel;
 
@@ -432,6 +441,7 @@ IB_DESIGNABLE
 @property (nullable, nonatomic, copy) NSArray *exclusionPaths;
 @property (nullable, nonatomic, copy) id<YYTextLinePositionModifier> linePositionModifier;
 @property (nullable, nonatomic, copy) YYTextDebugOption *debugOption;
+@property (nonatomic) BOOL usesLayoutCache;
 - (void)scrollRangeToVisible:(NSRange)range;
 @property (nonatomic) NSRange selectedRange;
 @property (nullable, nonatomic, readwrite, strong) __kindof UIView *inputView;
@@ -29,7 +29,7 @@
 #import "YYImage.h"
 
 
-#define kDefaultUndoLevelMax 20 // Default maximum undo level
+#define kDefaultUndoLevelMax 100 // Default maximum undo level
 
 #define kAutoScrollMinimumDuration 0.1 // Time in seconds to tick auto-scroll.
 #define kLongPressMinimumDuration 0.5 // Time in seconds the fingers must be held down for long press gesture.
@@ -44,6 +44,8 @@
 #define kDefaultInset UIEdgeInsetsMake(6, 4, 6, 4)
 #define kDefaultVerticalInset UIEdgeInsetsMake(4, 6, 4, 6)
 
+#define kDiffBufferSize 256 // Characters compared at a time when diff the text.
+
 
 NSString *const YYTextViewTextDidBeginEditingNotification = @"YYTextViewTextDidBeginEditing";
 NSString *const YYTextViewTextDidChangeNotification = @"YYTextViewTextDidChange";
@@ -63,6 +65,71 @@ typedef NS_ENUM(NSUInteger, YYTextMoveDirection) {
 };
 
 
+/**
+ Compare two texts, returns the range in new text which is different from old text
+ (in characters or attributes). The text before and after the range are same.
+ */
+static NSRange YYTextGetEditedRange(NSAttributedString *oldText, NSAttributedString *newText) {
+    CFStringRef oldString = (__bridge CFStringRef)oldText.string;
+    CFStringRef newString = (__bridge CFStringRef)newText.string;
+    NSUInteger oldLength = oldText.length, newLength = newText.length;
+    NSUInteger commonLength = MIN(oldLength, newLength);
+    unichar oldBuffer[kDiffBufferSize], newBuffer[kDiffBufferSize];
+    
+    // common prefix and suffix of characters
+    NSUInteger prefix = 0;
+    while (prefix < commonLength) {
+        NSUInteger count = MIN(kDiffBufferSize, commonLength - prefix);
+        CFStringGetCharacters(oldString, CFRangeMake(prefix, count), oldBuffer);
+        CFStringGetCharacters(newString, CFRangeMake(prefix, count), newBuffer);
+        if (memcmp(oldBuffer, newBuffer, count * sizeof(unichar)) == 0) {
+            prefix += count;
+            continue;
+        }
+        NSUInteger i = 0;
+        while (oldBuffer[i] == newBuffer[i]) i++;
+        prefix += i;
+        break;
+    }
+    NSUInteger suffix = 0;
+    while (suffix < commonLength - prefix) {
+        NSUInteger count = MIN(kDiffBufferSize, commonLength - prefix - suffix);
+        CFStringGetCharacters(oldString, CFRangeMake(oldLength - suffix - count, count), oldBuffer);
+        CFStringGetCharacters(newString, CFRangeMake(newLength - suffix - count, count), newBuffer);
+        if (memcmp(oldBuffer, newBuffer, count * sizeof(unichar)) == 0) {
+            suffix += count;
+            continue;
+        }
+        NSUInteger i = 0;
+        while (oldBuffer[count - 1 - i] == newBuffer[count - 1 - i]) i++;
+        suffix += i;
+        break;
+    }
+    
+    // shrink them to the same attributes
+    NSUInteger index = 0;
+    while (index < prefix) {
+        NSRange oldRange, newRange;
+        NSDictionary *oldAttrs = [oldText attributesAtIndex:index effectiveRange:&oldRange];
+        NSDictionary *newAttrs = [newText attributesAtIndex:index effectiveRange:&newRange];
+        if (oldAttrs != newAttrs && ![oldAttrs isEqualToDictionary:newAttrs]) break;
+        index = MIN(oldRange.location + oldRange.length, newRange.location + newRange.length);
+    }
+    prefix = MIN(prefix, index);
+    index = 0; // distance from end
+    while (index < suffix) {
+        NSRange oldRange, newRange;
+        NSDictionary *oldAttrs = [oldText attributesAtIndex:oldLength - 1 - index effectiveRange:&oldRange];
+        NSDictionary *newAttrs = [newText attributesAtIndex:newLength - 1 - index effectiveRange:&newRange];
+        if (oldAttrs != newAttrs && ![oldAttrs isEqualToDictionary:newAttrs]) break;
+        index = MIN(oldLength - oldRange.location, newLength - newRange.location);
+    }
+    suffix = MIN(suffix, index);
+    
+    return NSMakeRange(prefix, newLength - prefix - suffix);
+}
+
+
 /// An object that captures the state of the text view. Used for undo and redo.
 @interface _YYTextViewUndoObject : NSObject
 @property (nonatomic, strong) NSAttributedString *text;
@@ -78,6 +145,87 @@ typedef NS_ENUM(NSUInteger, YYTextMoveDirection) {
 @end
 
 
+/// The difference between two states of the text view.
+/// Replace `range` in the newer text with `text` to get the older text.
+@interface _YYTextViewUndoDelta : NSObject
+@property (nonatomic, assign) NSRange range; ///< changed range in the newer text
+@property (nonatomic, strong) NSAttributedString *text; ///< replaced text from the older text
+@property (nonatomic, assign) NSRange selectedRange; ///< selected range of the older state
+@end
+@implementation _YYTextViewUndoDelta
+@end
+
+
+/**
+ A stack of `_YYTextViewUndoObject`. Only the last object keeps the whole text,
+ the others are kept as deltas, and rebuilt when the objects above them are removed.
+ */
+@interface _YYTextViewUndoStack : NSObject
+@property (nonatomic, readonly) NSUInteger count;
+@property (nonatomic, readonly) _YYTextViewUndoObject *lastObject;
+- (void)addObject:(_YYTextViewUndoObject *)object;
+- (void)removeLastObject;
+- (void)removeFirstObject;
+- (void)removeAllObjects;
+@end
+@implementation _YYTextViewUndoStack {
+    NSMutableArray *_deltas; ///< _YYTextViewUndoDelta, the last one is the delta from lastObject
+}
+
+- (instancetype)init {
+    self = [super init];
+    _deltas = [NSMutableArray new];
+    return self;
+}
+
+- (NSUInteger)count {
+    return _lastObject ? _deltas.count + 1 : 0;
+}
+
+- (void)addObject:(_YYTextViewUndoObject *)object {
+    if (!object) return;
+    if (_lastObject) {
+        NSAttributedString *oldText = _lastObject.text;
+        NSRange range = YYTextGetEditedRange(oldText, object.text);
+        NSInteger delta = (NSInteger)object.text.length - (NSInteger)oldText.length;
+        _YYTextViewUndoDelta *one = [_YYTextViewUndoDelta new];
+        one.range = range;
+        one.text = [oldText attributedSubstringFromRange:NSMakeRange(range.location, range.length - delta)];
+        one.selectedRange = _lastObject.selectedRange;
+        [_deltas addObject:one];
+    }
+    _lastObject = object;
+}
+
+- (void)removeLastObject {
+    if (!_lastObject) return;
+    _YYTextViewUndoDelta *one = _deltas.lastObject;
+    if (!one) {
+        _lastObject = nil;
+        return;
+    }
+    [_deltas removeLastObject];
+    NSMutableAttributedString *text = _lastObject.text.mutableCopy;
+    [text replaceCharactersInRange:one.range withAttributedString:one.text];
+    _lastObject = [_YYTextViewUndoObject objectWithText:text range:one.selectedRange];
+}
+
+- (void)removeFirstObject {
+    if (_deltas.count) {
+        [_deltas removeObjectAtIndex:0];
+    } else {
+        _lastObject = nil;
+    }
+}
+
+- (void)removeAllObjects {
+    [_deltas removeAllObjects];
+    _lastObject = nil;
+}
+
+@end
+
+
 @interface YYTextView () <UIScrollViewDelegate, UIAlertViewDelegate, YYTextDebugTarget, YYTextKeyboardObserver> {
     
     YYTextRange *_selectedTextRange; /// nonnull
@@ -122,10 +270,13 @@ typedef NS_ENUM(NSUInteger, YYTextMoveDirection) {
     NSTimeInterval _touchBeganTime;
     NSTimeInterval _trackingTime;
     
-    NSMutableArray *_undoStack;
-    NSMutableArray *_redoStack;
+    _YYTextViewUndoStack *_undoStack;
+    _YYTextViewUndoStack *_redoStack;
     NSRange _lastTypeRange;
     
+    NSRange _parseEditedRange; ///< range in _innerText edited since last parsing, location is NSNotFound if not edited
+    NSInteger _parseChangeInLength; ///< change in length of _innerText since last parsing
+    
     struct {
         unsigned int trackingGrabber : 2;       ///< YYTextGrabberDirection, current tracking grabber
         unsigned int trackingCaret : 1;         ///< track the caret
@@ -152,6 +303,8 @@ typedef NS_ENUM(NSUInteger, YYTextMoveDirection) {
         
         unsigned int insideUndoBlock : 1;
         unsigned int firstResponderBeforeUndoAlert : 1;
+        
+        unsigned int parseNeedWholeText : 1;    ///< _innerText is changed out of _parseEditedRange since last parsing
     } _state;
 }
 
@@ -208,6 +361,8 @@ typedef NS_ENUM(NSUInteger, YYTextMoveDirection) {
 }
 
 /// Update layout immediately.
+/// Only the edited paragraphs are typeset again; the text copy, data detection,
+/// diff and line rebuilding are still done for the whole text.
 - (void)_updateLayout {
     NSMutableAttributedString *text = _innerText.mutableCopy;
     _placeHolderView.hidden = text.length > 0;
@@ -228,8 +383,11 @@ typedef NS_ENUM(NSUInteger, YYTextMoveDirection) {
             [text setAttribute:key value:value range:NSMakeRange(_innerText.length, 1)];
         }];
     }
+    NSRange editedRange = NSMakeRange(0, text.length);
+    NSInteger delta = (NSInteger)text.length - (NSInteger)_innerLayout.text.length;
+    if (_innerLayout) editedRange = YYTextGetEditedRange(_innerLayout.text, text);
     [self willChangeValueForKey:@"textLayout"];
-    _innerLayout = [YYTextLayout layoutWithContainer:_innerContainer text:text];
+    _innerLayout = [YYTextLayout layoutWithContainer:_innerContainer text:text previousLayout:_innerLayout editedRange:editedRange changeInLength:delta];
     [self didChangeValueForKey:@"textLayout"];
     CGSize size = [_innerLayout textBoundingSize];
     CGSize visibleSize = [self _getVisibleSize];
@@ -368,7 +526,12 @@ typedef NS_ENUM(NSUInteger, YYTextMoveDirection) {
         container.size = self.bounds.size;
         container.truncationType = YYTextTruncationTypeEnd;
         container.truncationToken = nil;
-        YYTextLayout *layout = [YYTextLayout layoutWithContainer:container text:_placeholderAttributedText];
+        YYTextLayout *layout = nil;
+        if (_usesLayoutCache) {
+            layout = [[YYTextLayoutCache sharedCache] layoutWithContainer:container text:_placeholderAttributedText];
+        } else {
+            layout = [YYTextLayout layoutWithContainer:container text:_placeholderAttributedText];
+        }
         CGSize size = [layout textBoundingSize];
         BOOL needDraw = size.width > 1 && size.height > 1;
         if (needDraw) {
@@ -1452,6 +1615,7 @@ typedef NS_ENUM(NSUInteger, YYTextMoveDirection) {
     }
     if (notify) [_inputDelegate textWillChange:self];
     NSRange newRange = NSMakeRange(range.asRange.location, text.length);
+    [self _addParseEditedRange:range.asRange replacementLength:text.length];
     [_innerText replaceCharactersInRange:range.asRange withString:text];
     [_innerText removeDiscontinuousAttributesInRange:newRange];
     if (notify) [_inputDelegate textDidChange:self];
@@ -1494,15 +1658,45 @@ typedef NS_ENUM(NSUInteger, YYTextMoveDirection) {
     [self _setAttributedText:_innerText];
 }
 
+/// Record the range of _innerText which will be replaced, for the next parsing.
+- (void)_addParseEditedRange:(NSRange)range replacementLength:(NSUInteger)length {
+    NSInteger delta = (NSInteger)length - (NSInteger)range.length;
+    if (_parseEditedRange.location == NSNotFound) {
+        _parseEditedRange = NSMakeRange(range.location, length);
+    } else {
+        // map the end of previous edited range to the text after this edit
+        NSUInteger end = NSMaxRange(_parseEditedRange);
+        if (end >= NSMaxRange(range)) end += delta;
+        else if (end > range.location) end = range.location + length;
+        end = MAX(end, range.location + length);
+        NSUInteger start = MIN(_parseEditedRange.location, range.location);
+        _parseEditedRange = NSMakeRange(start, end - start);
+    }
+    _parseChangeInLength += delta;
+}
+
 /// Parse text with `textParser` and update the _selectedTextRange.
 /// @return Whether changed (text or selection)
 - (BOOL)_parseText {
-    if (self.textParser) {
+    NSRange editedRange = _parseEditedRange;
+    NSInteger delta = _parseChangeInLength;
+    BOOL parseWholeText = _state.parseNeedWholeText || editedRange.location == NSNotFound;
+    _parseEditedRange = NSMakeRange(NSNotFound, 0);
+    _parseChangeInLength = 0;
+    _state.parseNeedWholeText = NO;
+    
+    id<YYTextParser> textParser = self.textParser;
+    if (textParser) {
         YYTextRange *oldTextRange = _selectedTextRange;
         NSRange newRange = _selectedTextRange.asRange;
         
         [_inputDelegate textWillChange:self];
-        BOOL textChanged = [self.textParser parseText:_innerText selectedRange:&newRange];
+        BOOL textChanged;
+        if (!parseWholeText && [textParser respondsToSelector:@selector(parseText:selectedRange:editedRange:changeInLength:)]) {
+            textChanged = [textParser parseText:_innerText selectedRange:&newRange editedRange:editedRange changeInLength:delta];
+        } else {
+            textChanged = [textParser parseText:_innerText selectedRange:&newRange];
+        }
         [_inputDelegate textDidChange:self];
         
         YYTextRange *newTextRange = [YYTextRange rangeWithRange:newRange];
@@ -1597,7 +1791,7 @@ typedef NS_ENUM(NSUInteger, YYTextMoveDirection) {
     _lastTypeRange = _selectedTextRange.asRange;
     [_undoStack addObject:object];
     while (_undoStack.count > _maximumUndoLevel) {
-        [_undoStack removeObjectAtIndex:0];
+        [_undoStack removeFirstObject];
     }
 }
 
@@ -1610,7 +1804,7 @@ typedef NS_ENUM(NSUInteger, YYTextMoveDirection) {
     _YYTextViewUndoObject *object = [_YYTextViewUndoObject objectWithText:_innerText.copy range:_selectedTextRange.asRange];
     [_redoStack addObject:object];
     while (_redoStack.count > _maximumUndoLevel) {
-        [_redoStack removeObjectAtIndex:0];
+        [_redoStack removeFirstObject];
     }
 }
 
@@ -1623,7 +1817,7 @@ typedef NS_ENUM(NSUInteger, YYTextMoveDirection) {
 
 - (BOOL)_canRedo {
     if (_redoStack.count == 0) return NO;
-    _YYTextViewUndoObject *object = _undoStack.lastObject;
+    _YYTextViewUndoObject *object = _redoStack.lastObject;
     if ([object.text isEqualToAttributedString:_innerText]) return NO;
     return YES;
 }
@@ -1958,6 +2152,7 @@ typedef NS_ENUM(NSUInteger, YYTextMoveDirection) {
     _textAlignment = NSTextAlignmentNatural;
     
     _innerText = [NSMutableAttributedString new];
+    _parseEditedRange = NSMakeRange(NSNotFound, 0);
     _innerContainer = [YYTextContainer new];
     _innerContainer.insets = kDefaultInset;
     _textContainerInset = kDefaultInset;
@@ -1994,8 +2189,8 @@ typedef NS_ENUM(NSUInteger, YYTextMoveDirection) {
     [self addSubview:_containerView];
     [self addSubview:_selectionView];
     
-    _undoStack = [NSMutableArray new];
-    _redoStack = [NSMutableArray new];
+    _undoStack = [_YYTextViewUndoStack new];
+    _redoStack = [_YYTextViewUndoStack new];
     _allowsUndoAndRedo = YES;
     _maximumUndoLevel = kDefaultUndoLevelMax;
     
@@ -2062,6 +2257,7 @@ typedef NS_ENUM(NSUInteger, YYTextMoveDirection) {
     _state.typingAttributesOnce = NO;
     _typingAttributesHolder.font = font;
     _innerText.font = font;
+    _state.parseNeedWholeText = YES;
     [self _resetUndoAndRedoStack];
     [self _commitUpdate];
 }
@@ -2073,6 +2269,7 @@ typedef NS_ENUM(NSUInteger, YYTextMoveDirection) {
     _state.typingAttributesOnce = NO;
     _typingAttributesHolder.color = textColor;
     _innerText.color = textColor;
+    _state.parseNeedWholeText = YES;
     [self _resetUndoAndRedoStack];
     [self _commitUpdate];
 }
@@ -2083,6 +2280,7 @@ typedef NS_ENUM(NSUInteger, YYTextMoveDirection) {
     
     _typingAttributesHolder.alignment = textAlignment;
     _innerText.alignment = textAlignment;
+    _state.parseNeedWholeText = YES;
     [self _resetUndoAndRedoStack];
     [self _commitUpdate];
 }
@@ -2154,6 +2352,7 @@ typedef NS_ENUM(NSUInteger, YYTextMoveDirection) {
     [_inputDelegate selectionWillChange:self];
     [_inputDelegate textWillChange:self];
      _innerText = text;
+    _state.parseNeedWholeText = YES;
     [self _parseText];
     _selectedTextRange = [YYTextRange rangeWithRange:NSMakeRange(0, _innerText.length)];
     [_inputDelegate textDidChange:self];
@@ -2480,7 +2679,12 @@ typedef NS_ENUM(NSUInteger, YYTextMoveDirection) {
     YYTextContainer *container = [_innerContainer copy];
     container.size = size;
     
-    YYTextLayout *layout = [YYTextLayout layoutWithContainer:container text:_innerText];
+    YYTextLayout *layout = nil;
+    if (_usesLayoutCache) {
+        layout = [[YYTextLayoutCache sharedCache] layoutWithContainer:container text:_innerText];
+    } else {
+        layout = [YYTextLayout layoutWithContainer:container text:_innerText];
+    }
     return layout.textBoundingSize;
 }
 
@@ -3314,10 +3518,12 @@ typedef NS_ENUM(NSUInteger, YYTextMoveDirection) {
     if (!markedText) markedText = @"";
     if (_markedTextRange == nil) {
         _markedTextRange = [YYTextRange rangeWithRange:NSMakeRange(_selectedTextRange.end.offset, markedText.length)];
+        [self _addParseEditedRange:NSMakeRange(_selectedTextRange.end.offset, 0) replacementLength:markedText.length];
         [_innerText replaceCharactersInRange:NSMakeRange(_selectedTextRange.end.offset, 0) withString:markedText];
         _selectedTextRange = [YYTextRange rangeWithRange:NSMakeRange(_selectedTextRange.start.offset + selectedRange.location, selectedRange.length)];
     } else {
         _markedTextRange = [self _correctedTextRange:_markedTextRange];
+        [self _addParseEditedRange:_markedTextRange.asRange replacementLength:markedText.length];
         [_innerText replaceCharactersInRange:_markedTextRange.asRange withString:markedText];
         _markedTextRange = [YYTextRange rangeWithRange:NSMakeRange(_markedTextRange.start.offset, markedText.length)];
         _selectedTextRange = [YYTextRange rangeWithRange:NSMakeRange(_markedTextRange.start.offset + selectedRange.location, selectedRange.length)];
@@ -3428,6 +3634,7 @@ typedef NS_ENUM(NSUInteger, YYTextMoveDirection) {
 - (void)setBaseWritingDirection:(UITextWritingDirection)writingDirection forRange:(YYTextRange *)range {
     if (!range) return;
     range = [self _correctedTextRange:range];
+    [self _addParseEditedRange:range.asRange replacementLength:range.asRange.length];
     [_innerText setBaseWritingDirection:(NSWritingDirection)writingDirection range:range.asRange];
     [self _commitUpdate];
 }
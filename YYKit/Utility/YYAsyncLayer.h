@@ -13,6 +13,24 @@
 #import <QuartzCore/QuartzCore.h>
 
 @class YYAsyncLayerDisplayTask;
+
+/// Statistics of YYAsyncLayer's bitmap buffer pool.
+typedef struct {
+    uint64_t allocationCount; ///< Buffers allocated (not found in pool).
+    uint64_t reuseCount;      ///< Buffers reused from pool.
+    uint64_t reusedBytes;     ///< Bytes not allocated because of reuse.
+    size_t pooledBytes;       ///< Bytes of the free buffers in pool.
+} YYAsyncLayerBitmapPoolStatistics;
+
+/// Statistics of YYAsyncLayer's render scheduler.
+typedef struct {
+    uint64_t renderCount;         ///< Renders began.
+    uint64_t coalescedCount;      ///< Display requests merged into a pending render.
+    uint64_t droppedCount;        ///< Pending renders dropped before begin (stale).
+    uint64_t wastedCount;         ///< Renders cancelled after begin (the result is discarded).
+    NSTimeInterval totalWaitTime; ///< Total queue wait time of the began renders, in seconds.
+    NSTimeInterval maxWaitTime;   ///< Max queue wait time of the began renders, in seconds.
+} YYAsyncLayerRenderStatistics;
 #warning zll ??? 具体的应用?
 NS_ASSUME_NONNULL_BEGIN
 
@@ -26,6 +44,26 @@ NS_ASSUME_NONNULL_BEGIN
 @interface YYAsyncLayer : CALayer
 /// Whether the render code is executed in background. Default is YES.
 @property BOOL displaysAsynchronously;
+
+/**
+ Returns the statistics of the bitmap buffer pool shared by all YYAsyncLayer.
+ 
+ @discussion The layer renders contents into a reusable bitmap buffer, and the
+ contents image uses the buffer without copy. When the contents is replaced, the 
+ buffer is returned to the pool for the next rendering of a similar sized layer.
+ The free buffers are released on memory warning or entering background.
+ */
++ (YYAsyncLayerBitmapPoolStatistics)bitmapPoolStatistics;
+
+/**
+ Returns the statistics of the render scheduler shared by all YYAsyncLayer.
+ 
+ @discussion The asynchronous renders are not executed in request order: a layer
+ which is visible, or about to be scrolled into the screen, is rendered before the 
+ offscreen ones. Repeated display requests of a layer before its render begins are 
+ merged into one render, and the render is dropped if it is cancelled before begin.
+ */
++ (YYAsyncLayerRenderStatistics)renderStatistics;
 @end
 
 
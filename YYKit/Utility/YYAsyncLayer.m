@@ -11,6 +11,8 @@
 
 #import "YYAsyncLayer.h"
 #import "YYSentinel.h"
+#import <pthread.h>
+#import <objc/runtime.h>
 
 #if __has_include("YYDispatchQueuePool.h")
 #import "YYDispatchQueuePool.h"
@@ -18,10 +20,10 @@
 #import <libkern/OSAtomic.h>
 #endif
 
-/// Global display queue, used for content rendering.
-static dispatch_queue_t YYAsyncLayerGetDisplayQueue() {
+/// Run a block on the global display executor, used for content rendering.
+static void YYAsyncLayerDisplayAsync(dispatch_block_t block) {
 #ifdef YYDispatchQueuePool_h
-    return YYDispatchQueueGetForQOS(NSQualityOfServiceUserInitiated);
+    YYDispatchAsync(NSQualityOfServiceUserInitiated, block);
 #else
 #define MAX_QUEUE_COUNT 16
     static int queueCount;
@@ -45,7 +47,7 @@ static dispatch_queue_t YYAsyncLayerGetDisplayQueue() {
     });
     int32_t cur = OSAtomicIncrement32(&counter);
     if (cur < 0) cur = -cur;
-    return queues[(cur) % queueCount];
+    dispatch_async(queues[(cur) % queueCount], block);
 #undef MAX_QUEUE_COUNT
 #endif
 }
@@ -59,12 +61,430 @@ static dispatch_queue_t YYAsyncLayerGetReleaseQueue() {
 }
 
 
+#define BITMAP_POOL_MAX_COUNT 16                 ///< max free buffers kept in pool
+#define BITMAP_POOL_MAX_BYTES (16 * 1024 * 1024) ///< max bytes of free buffers kept in pool
+
+/*
+ Bitmap buffer pool shared by all layers.
+ 
+ The layer contents image is created with the buffer directly (no copy), and the
+ buffer is returned to the pool when the image is released (the layer's contents
+ is replaced). Buffers are bucketed by size class, so similar sized layers (such as
+ the labels in table view cells) reuse the buffers of each other.
+ */
+typedef struct {
+    void *data;
+    size_t capacity;
+} YYAsyncLayerBuffer;
+
+static pthread_mutex_t _bitmapPoolLock = PTHREAD_MUTEX_INITIALIZER;
+static YYAsyncLayerBuffer _bitmapPool[BITMAP_POOL_MAX_COUNT];
+static NSUInteger _bitmapPoolCount;
+static YYAsyncLayerBitmapPoolStatistics _bitmapPoolStatistics;
+
+/// Size class of a buffer length: 4KB aligned, and at most 12.5% larger than the length (if larger than 32KB).
+static size_t YYAsyncLayerBufferSizeClass(size_t length) {
+    size_t unit = 4096;
+    while ((unit << 4) <= length) unit <<= 1;
+    return (length + unit - 1) / unit * unit;
+}
+
+static void YYAsyncLayerBufferPoolPurge() {
+    pthread_mutex_lock(&_bitmapPoolLock);
+    for (NSUInteger i = 0; i < _bitmapPoolCount; i++) {
+        free(_bitmapPool[i].data);
+    }
+    _bitmapPoolCount = 0;
+    _bitmapPoolStatistics.pooledBytes = 0;
+    pthread_mutex_unlock(&_bitmapPoolLock);
+}
+
+static void *YYAsyncLayerBufferAcquire(size_t capacity) {
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        NSNotificationCenter *center = [NSNotificationCenter defaultCenter];
+        void (^purge)(NSNotification *) = ^(NSNotification *note) {
+            YYAsyncLayerBufferPoolPurge();
+        };
+        [center addObserverForName:UIApplicationDidReceiveMemoryWarningNotification object:nil queue:nil usingBlock:purge];
+        [center addObserverForName:UIApplicationDidEnterBackgroundNotification object:nil queue:nil usingBlock:purge];
+    });
+    
+    void *data = NULL;
+    pthread_mutex_lock(&_bitmapPoolLock);
+    for (NSUInteger i = 0; i < _bitmapPoolCount; i++) {
+        if (_bitmapPool[i].capacity == capacity) {
+            data = _bitmapPool[i].data;
+            _bitmapPool[i] = _bitmapPool[--_bitmapPoolCount];
+            _bitmapPoolStatistics.pooledBytes -= capacity;
+            _bitmapPoolStatistics.reuseCount++;
+            _bitmapPoolStatistics.reusedBytes += capacity;
+            break;
+        }
+    }
+    if (!data) _bitmapPoolStatistics.allocationCount++;
+    pthread_mutex_unlock(&_bitmapPoolLock);
+    if (!data) data = malloc(capacity);
+    return data;
+}
+
+static void YYAsyncLayerBufferRecycle(void *data, size_t capacity) {
+    if (!data) return;
+    void *evicted = NULL;
+    pthread_mutex_lock(&_bitmapPoolLock);
+    if (capacity <= BITMAP_POOL_MAX_BYTES) {
+        // pool is full, evict a buffer for the recent one (only if the recent one fits then)
+        BOOL full = _bitmapPoolCount == BITMAP_POOL_MAX_COUNT ||
+                    _bitmapPoolStatistics.pooledBytes + capacity > BITMAP_POOL_MAX_BYTES;
+        size_t remainBytes = _bitmapPoolStatistics.pooledBytes;
+        if (full && _bitmapPoolCount > 0) remainBytes -= _bitmapPool[0].capacity;
+        if (remainBytes + capacity <= BITMAP_POOL_MAX_BYTES) {
+            if (full) {
+                evicted = _bitmapPool[0].data;
+                _bitmapPoolStatistics.pooledBytes -= _bitmapPool[0].capacity;
+                _bitmapPool[0] = _bitmapPool[--_bitmapPoolCount];
+            }
+            _bitmapPool[_bitmapPoolCount++] = (YYAsyncLayerBuffer){data, capacity};
+            _bitmapPoolStatistics.pooledBytes += capacity;
+            data = NULL;
+        }
+    }
+    pthread_mutex_unlock(&_bitmapPoolLock);
+    if (evicted) free(evicted);
+    if (data) free(data);
+}
+
+static void YYAsyncLayerReleaseImageData(void *info, const void *data, size_t size) {
+    YYAsyncLayerBufferRecycle((void *)data, (size_t)info);
+}
+
+/// A bitmap context drawing into a pooled buffer.
+typedef struct {
+    CGContextRef context;
+    void *data;
+    size_t capacity;
+} YYAsyncLayerBitmap;
+
+/**
+ Creates a bitmap context with pooled buffer, and makes it the current UIKit context
+ (same as UIGraphicsBeginImageContextWithOptions). The context is NULL if failed.
+ */
+static void YYAsyncLayerBitmapBegin(YYAsyncLayerBitmap *bitmap, CGSize size, BOOL opaque, CGFloat scale) {
+    memset(bitmap, 0, sizeof(YYAsyncLayerBitmap));
+    size_t width = ceil(size.width * scale);
+    size_t height = ceil(size.height * scale);
+    if (width == 0 || height == 0) return;
+    size_t bytesPerRow = (width * 4 + 63) / 64 * 64;
+    if (bytesPerRow / 4 < width || SIZE_MAX / bytesPerRow < height) return;
+    size_t capacity = YYAsyncLayerBufferSizeClass(bytesPerRow * height);
+    void *data = YYAsyncLayerBufferAcquire(capacity);
+    if (!data) return;
+    
+    static CGColorSpaceRef space;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        space = CGColorSpaceCreateDeviceRGB();
+    });
+    CGBitmapInfo info = kCGBitmapByteOrder32Host | (opaque ? kCGImageAlphaNoneSkipFirst : kCGImageAlphaPremultipliedFirst);
+    CGContextRef context = CGBitmapContextCreate(data, width, height, 8, bytesPerRow, space, info);
+    if (!context) {
+        YYAsyncLayerBufferRecycle(data, capacity);
+        return;
+    }
+    if (!opaque) CGContextClearRect(context, CGRectMake(0, 0, width, height)); // the buffer may be reused
+    CGContextTranslateCTM(context, 0, height);
+    CGContextScaleCTM(context, scale, -scale); // UIKit's coordinate (top-left based, in points)
+    UIGraphicsPushContext(context);
+    bitmap->context = context;
+    bitmap->data = data;
+    bitmap->capacity = capacity;
+}
+
+/// Ends the bitmap context and returns an image which holds the buffer without copy.
+static CGImageRef YYAsyncLayerBitmapCreateImage(YYAsyncLayerBitmap *bitmap) CF_RETURNS_RETAINED {
+    if (!bitmap->context) return NULL;
+    UIGraphicsPopContext();
+    CGContextRef context = bitmap->context;
+    size_t width = CGBitmapContextGetWidth(context);
+    size_t height = CGBitmapContextGetHeight(context);
+    size_t bytesPerRow = CGBitmapContextGetBytesPerRow(context);
+    CGBitmapInfo info = CGBitmapContextGetBitmapInfo(context);
+    CGColorSpaceRef space = CGBitmapContextGetColorSpace(context);
+    CGImageRef image = NULL;
+    CGDataProviderRef provider = CGDataProviderCreateWithData((void *)bitmap->capacity, bitmap->data, bytesPerRow * height, YYAsyncLayerReleaseImageData);
+    if (provider) {
+        image = CGImageCreate(width, height, 8, 32, bytesPerRow, space, info, provider, NULL, false, kCGRenderingIntentDefault);
+        CFRelease(provider); // the buffer is recycled when the image is released
+    } else {
+        YYAsyncLayerBufferRecycle(bitmap->data, bitmap->capacity);
+    }
+    CFRelease(context);
+    memset(bitmap, 0, sizeof(YYAsyncLayerBitmap));
+    return image;
+}
+
+/// Ends the bitmap context and recycles the buffer (drawing cancelled).
+static void YYAsyncLayerBitmapCancel(YYAsyncLayerBitmap *bitmap) {
+    if (!bitmap->context) return;
+    UIGraphicsPopContext();
+    CFRelease(bitmap->context);
+    YYAsyncLayerBufferRecycle(bitmap->data, bitmap->capacity);
+    memset(bitmap, 0, sizeof(YYAsyncLayerBitmap));
+}
+
+/// Ends the bitmap context and returns the image.
+static UIImage *YYAsyncLayerBitmapGetImage(YYAsyncLayerBitmap *bitmap, CGFloat scale) {
+    CGImageRef imageRef = YYAsyncLayerBitmapCreateImage(bitmap);
+    if (!imageRef) return nil;
+    UIImage *image = [UIImage imageWithCGImage:imageRef scale:scale orientation:UIImageOrientationUp];
+    CFRelease(imageRef);
+    return image;
+}
+
+
+#define RENDER_OFFSCREEN_DELAY 1.0   ///< render delay (seconds) of the layer not in window
+#define RENDER_DISTANCE_SPEED 2000.0 ///< points per second, the render delay of a layer grows with its distance from screen
+#define RENDER_SCROLL_LOOKAHEAD 0.25 ///< seconds, the area to be scrolled into screen in this time is treated as visible
+
+/*
+ Render scheduler shared by all layers.
+ 
+ Pending render jobs are kept in a min-heap keyed by deadline (request time plus a
+ delay computed from the layer's distance to the visible area of the window, which 
+ is extended in the scrolling direction). Each block sent to the display executor
+ pops the most urgent job, so the order is decided when a render begins, not when 
+ it is requested. A layer has at most one pending job: a display request before 
+ the render begins replaces the pending job. Stale jobs (cancelled by the sentinel) 
+ are dropped without rendering.
+ */
+@interface _YYAsyncLayerRenderJob : NSObject {
+@package
+    CFTimeInterval _requestTime; ///< Time of the first request.
+    CFTimeInterval _deadline;    ///< Heap key.
+    NSUInteger _index;           ///< Index in heap, NSNotFound if not pending.
+    BOOL (^_isCancelled)(void);
+    dispatch_block_t _work;
+}
+@end
+
+@implementation _YYAsyncLayerRenderJob
+@end
+
+/// Content offset sample of a scroll view, used to estimate the scroll velocity.
+@interface _YYAsyncLayerScrollSample : NSObject {
+@package
+    CGPoint _offset;
+    CFTimeInterval _time;
+    CGPoint _velocity; ///< points per second
+}
+@end
+
+@implementation _YYAsyncLayerScrollSample
+@end
+
+static pthread_mutex_t _renderLock = PTHREAD_MUTEX_INITIALIZER;
+static NSMutableArray *_renderHeap;
+static YYAsyncLayerRenderStatistics _renderStatistics;
+
+static inline CFTimeInterval YYAsyncLayerRenderHeapKey(NSUInteger index) {
+    return ((_YYAsyncLayerRenderJob *)_renderHeap[index])->_deadline;
+}
+
+static void YYAsyncLayerRenderHeapSwap(NSUInteger i, NSUInteger j) {
+    _YYAsyncLayerRenderJob *a = _renderHeap[i], *b = _renderHeap[j];
+    [_renderHeap exchangeObjectAtIndex:i withObjectAtIndex:j];
+    a->_index = j;
+    b->_index = i;
+}
+
+static void YYAsyncLayerRenderHeapSiftUp(NSUInteger index) {
+    while (index > 0) {
+        NSUInteger parent = (index - 1) / 2;
+        if (YYAsyncLayerRenderHeapKey(parent) <= YYAsyncLayerRenderHeapKey(index)) break;
+        YYAsyncLayerRenderHeapSwap(index, parent);
+        index = parent;
+    }
+}
+
+static void YYAsyncLayerRenderHeapSiftDown(NSUInteger index) {
+    NSUInteger count = _renderHeap.count;
+    while (YES) {
+        NSUInteger left = index * 2 + 1, right = left + 1, min = index;
+        if (left < count && YYAsyncLayerRenderHeapKey(left) < YYAsyncLayerRenderHeapKey(min)) min = left;
+        if (right < count && YYAsyncLayerRenderHeapKey(right) < YYAsyncLayerRenderHeapKey(min)) min = right;
+        if (min == index) break;
+        YYAsyncLayerRenderHeapSwap(index, min);
+        index = min;
+    }
+}
+
+static _YYAsyncLayerRenderJob *YYAsyncLayerRenderHeapPop() {
+    NSUInteger count = _renderHeap.count;
+    if (count == 0) return nil;
+    _YYAsyncLayerRenderJob *job = _renderHeap[0];
+    YYAsyncLayerRenderHeapSwap(0, count - 1);
+    [_renderHeap removeLastObject];
+    if (count > 1) YYAsyncLayerRenderHeapSiftDown(0);
+    job->_index = NSNotFound;
+    return job;
+}
+
+/// Pops the most urgent job and renders it (called on the display executor).
+static void YYAsyncLayerRenderNext() {
+    dispatch_block_t work = nil;
+    BOOL (^isCancelled)(void) = nil;
+    CFTimeInterval requestTime = 0;
+    pthread_mutex_lock(&_renderLock);
+    _YYAsyncLayerRenderJob *job = YYAsyncLayerRenderHeapPop();
+    if (job) {
+        work = job->_work;
+        isCancelled = job->_isCancelled;
+        requestTime = job->_requestTime;
+        job->_work = nil;
+        job->_isCancelled = nil;
+    }
+    pthread_mutex_unlock(&_renderLock);
+    if (!work) return;
+    
+    BOOL cancelled = isCancelled();
+    CFTimeInterval wait = CACurrentMediaTime() - requestTime;
+    pthread_mutex_lock(&_renderLock);
+    if (cancelled) {
+        _renderStatistics.droppedCount++;
+    } else {
+        _renderStatistics.renderCount++;
+        _renderStatistics.totalWaitTime += wait;
+        if (wait > _renderStatistics.maxWaitTime) _renderStatistics.maxWaitTime = wait;
+    }
+    pthread_mutex_unlock(&_renderLock);
+    if (!cancelled) work();
+}
+
+/// Adds a render job, or replaces the work of the layer's pending job. Returns the pending job.
+static _YYAsyncLayerRenderJob *YYAsyncLayerRenderSchedule(_YYAsyncLayerRenderJob *job, CFTimeInterval delay,
+                                                          BOOL (^isCancelled)(void), dispatch_block_t work) {
+    CFTimeInterval now = CACurrentMediaTime();
+    BOOL coalesced = NO;
+    dispatch_block_t oldWork = nil; // released outside the lock
+    BOOL (^oldIsCancelled)(void) = nil;
+    pthread_mutex_lock(&_renderLock);
+    if (!_renderHeap) _renderHeap = [NSMutableArray new];
+    if (job && job->_index != NSNotFound) {
+        coalesced = YES;
+        oldWork = job->_work;
+        oldIsCancelled = job->_isCancelled;
+        _renderStatistics.coalescedCount++;
+    } else {
+        job = [_YYAsyncLayerRenderJob new];
+        job->_requestTime = now;
+        job->_index = _renderHeap.count;
+        [_renderHeap addObject:job];
+    }
+    job->_deadline = job->_requestTime + delay; // keeps the first request time, so a pending job will not starve
+    job->_work = work;
+    job->_isCancelled = isCancelled;
+    YYAsyncLayerRenderHeapSiftUp(job->_index);
+    YYAsyncLayerRenderHeapSiftDown(job->_index);
+    pthread_mutex_unlock(&_renderLock);
+    
+    if (!coalesced) {
+        YYAsyncLayerDisplayAsync(^{
+            YYAsyncLayerRenderNext();
+        });
+    }
+    return job;
+}
+
+/// Counts a render which is cancelled after it begins.
+static void YYAsyncLayerRenderWasted() {
+    pthread_mutex_lock(&_renderLock);
+    _renderStatistics.wastedCount++;
+    pthread_mutex_unlock(&_renderLock);
+}
+
+/// Returns the velocity (points per second) of the scrolling scroll view which contains the view.
+static CGPoint YYAsyncLayerScrollVelocity(UIView *view) {
+    static char sampleKey;
+    UIScrollView *scrollView = nil;
+    for (UIView *superview = view.superview; superview; superview = superview.superview) {
+        if (![superview isKindOfClass:[UIScrollView class]]) continue;
+        UIScrollView *candidate = (UIScrollView *)superview;
+        if (candidate.dragging || candidate.decelerating) {
+            scrollView = candidate;
+            break;
+        }
+    }
+    if (!scrollView) return CGPointZero;
+    
+    CFTimeInterval now = CACurrentMediaTime();
+    CGPoint offset = scrollView.contentOffset;
+    _YYAsyncLayerScrollSample *sample = objc_getAssociatedObject(scrollView, &sampleKey);
+    if (!sample) {
+        sample = [_YYAsyncLayerScrollSample new];
+        objc_setAssociatedObject(scrollView, &sampleKey, sample, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+        CGPoint velocity = [scrollView.panGestureRecognizer velocityInView:scrollView];
+        sample->_velocity = CGPointMake(-velocity.x, -velocity.y);
+    } else {
+        CFTimeInterval interval = now - sample->_time;
+        if (interval < 0.008) return sample->_velocity; // sampled in this frame
+        if (interval < 0.1) {
+            sample->_velocity = CGPointMake((offset.x - sample->_offset.x) / interval,
+                                            (offset.y - sample->_offset.y) / interval);
+        } else {
+            CGPoint velocity = [scrollView.panGestureRecognizer velocityInView:scrollView];
+            sample->_velocity = scrollView.tracking ? CGPointMake(-velocity.x, -velocity.y) : CGPointZero;
+        }
+    }
+    sample->_offset = offset;
+    sample->_time = now;
+    return sample->_velocity;
+}
+
+static CGFloat YYAsyncLayerRectDistance(CGRect a, CGRect b) {
+    CGFloat dx = MAX(CGRectGetMinX(a) - CGRectGetMaxX(b), CGRectGetMinX(b) - CGRectGetMaxX(a));
+    CGFloat dy = MAX(CGRectGetMinY(a) - CGRectGetMaxY(b), CGRectGetMinY(b) - CGRectGetMaxY(a));
+    return MAX(0, MAX(dx, dy));
+}
+
+/// Returns the render delay of a layer by its distance from the visible area (main thread).
+static CFTimeInterval YYAsyncLayerRenderDelay(CALayer *layer) {
+    UIView *view = [layer.delegate isKindOfClass:[UIView class]] ? (UIView *)layer.delegate : nil;
+    UIWindow *window = view.window;
+    if (!window || view.hidden) return RENDER_OFFSCREEN_DELAY;
+    CGRect rect = [layer convertRect:layer.bounds toLayer:window.layer];
+    CGRect visible = window.bounds;
+    CGPoint velocity = YYAsyncLayerScrollVelocity(view);
+    if (velocity.x != 0 || velocity.y != 0) {
+        // layers move in the opposite direction of the content offset, extend the visible area forward
+        CGRect ahead = CGRectOffset(visible, velocity.x * RENDER_SCROLL_LOOKAHEAD, velocity.y * RENDER_SCROLL_LOOKAHEAD);
+        visible = CGRectUnion(visible, ahead);
+    }
+    CGFloat distance = YYAsyncLayerRectDistance(rect, visible);
+    return MIN(distance / RENDER_DISTANCE_SPEED, RENDER_OFFSCREEN_DELAY);
+}
+
+
 @implementation YYAsyncLayerDisplayTask
 @end
 
 
 @implementation YYAsyncLayer {
     YYSentinel *_sentinel;
+    _YYAsyncLayerRenderJob *_renderJob; ///< The last render job, may be pending.
+}
+
++ (YYAsyncLayerBitmapPoolStatistics)bitmapPoolStatistics {
+    pthread_mutex_lock(&_bitmapPoolLock);
+    YYAsyncLayerBitmapPoolStatistics statistics = _bitmapPoolStatistics;
+    pthread_mutex_unlock(&_bitmapPoolLock);
+    return statistics;
+}
+
++ (YYAsyncLayerRenderStatistics)renderStatistics {
+    pthread_mutex_lock(&_renderLock);
+    YYAsyncLayerRenderStatistics statistics = _renderStatistics;
+    pthread_mutex_unlock(&_renderLock);
+    return statistics;
 }
 
 #pragma mark - Override
@@ -126,7 +546,7 @@ static dispatch_queue_t YYAsyncLayerGetReleaseQueue() {
         CGSize size = self.bounds.size;
         BOOL opaque = self.opaque;
         CGFloat scale = self.contentsScale;
-        CGColorRef backgroundColor = (opaque && self.backgroundColor) ? CGColorRetain(self.backgroundColor) : NULL;
+        UIColor *backgroundColor = (opaque && self.backgroundColor) ? [UIColor colorWithCGColor:self.backgroundColor] : nil;
         if (size.width < 1 || size.height < 1) {
             CGImageRef image = (__bridge_retained CGImageRef)(self.contents);
             self.contents = nil;
@@ -136,43 +556,39 @@ static dispatch_queue_t YYAsyncLayerGetReleaseQueue() {
                 });
             }
             if (task.didDisplay) task.didDisplay(self, YES);
-            CGColorRelease(backgroundColor);
             return;
         }
         
-        dispatch_async(YYAsyncLayerGetDisplayQueue(), ^{
-            if (isCancelled()) {
-                CGColorRelease(backgroundColor);
-                return;
-            }
-            UIGraphicsBeginImageContextWithOptions(size, opaque, scale);
-            CGContextRef context = UIGraphicsGetCurrentContext();
+        _renderJob = YYAsyncLayerRenderSchedule(_renderJob, YYAsyncLayerRenderDelay(self), isCancelled, ^{
+            YYAsyncLayerBitmap bitmap;
+            YYAsyncLayerBitmapBegin(&bitmap, size, opaque, scale);
+            CGContextRef context = bitmap.context;
             if (opaque && context) {
                 CGContextSaveGState(context); {
-                    if (!backgroundColor || CGColorGetAlpha(backgroundColor) < 1) {
+                    if (!backgroundColor || CGColorGetAlpha(backgroundColor.CGColor) < 1) {
                         CGContextSetFillColorWithColor(context, [UIColor whiteColor].CGColor);
                         CGContextAddRect(context, CGRectMake(0, 0, size.width * scale, size.height * scale));
                         CGContextFillPath(context);
                     }
                     if (backgroundColor) {
-                        CGContextSetFillColorWithColor(context, backgroundColor);
+                        CGContextSetFillColorWithColor(context, backgroundColor.CGColor);
                         CGContextAddRect(context, CGRectMake(0, 0, size.width * scale, size.height * scale));
                         CGContextFillPath(context);
                     }
                 } CGContextRestoreGState(context);
-                CGColorRelease(backgroundColor);
             }
             task.display(context, size, isCancelled);
             if (isCancelled()) {
-                UIGraphicsEndImageContext();
+                YYAsyncLayerBitmapCancel(&bitmap);
+                YYAsyncLayerRenderWasted();
                 dispatch_async(dispatch_get_main_queue(), ^{
                     if (task.didDisplay) task.didDisplay(self, NO);
                 });
                 return;
             }
-            UIImage *image = UIGraphicsGetImageFromCurrentImageContext();
-            UIGraphicsEndImageContext();
+            UIImage *image = YYAsyncLayerBitmapGetImage(&bitmap, scale);
             if (isCancelled()) {
+                YYAsyncLayerRenderWasted();
                 dispatch_async(dispatch_get_main_queue(), ^{
                     if (task.didDisplay) task.didDisplay(self, NO);
                 });
@@ -180,6 +596,7 @@ static dispatch_queue_t YYAsyncLayerGetReleaseQueue() {
             }
             dispatch_async(dispatch_get_main_queue(), ^{
                 if (isCancelled()) {
+                    YYAsyncLayerRenderWasted();
                     if (task.didDisplay) task.didDisplay(self, NO);
                 } else {
                     self.contents = (__bridge id)(image.CGImage);
@@ -190,8 +607,9 @@ static dispatch_queue_t YYAsyncLayerGetReleaseQueue() {
     } else {
         [_sentinel increase];
         if (task.willDisplay) task.willDisplay(self);
-        UIGraphicsBeginImageContextWithOptions(self.bounds.size, self.opaque, self.contentsScale);
-        CGContextRef context = UIGraphicsGetCurrentContext();
+        YYAsyncLayerBitmap bitmap;
+        YYAsyncLayerBitmapBegin(&bitmap, self.bounds.size, self.opaque, self.contentsScale);
+        CGContextRef context = bitmap.context;
         if (self.opaque && context) {
             CGSize size = self.bounds.size;
             size.width *= self.contentsScale;
@@ -210,8 +628,7 @@ static dispatch_queue_t YYAsyncLayerGetReleaseQueue() {
             } CGContextRestoreGState(context);
         }
         task.display(context, self.bounds.size, ^{return NO;});
-        UIImage *image = UIGraphicsGetImageFromCurrentImageContext();
-        UIGraphicsEndImageContext();
+        UIImage *image = YYAsyncLayerBitmapGetImage(&bitmap, self.contentsScale);
         self.contents = (__bridge id)(image.CGImage);
         if (task.didDisplay) task.didDisplay(self, YES);
     }
@@ -20,6 +20,14 @@ NS_ASSUME_NONNULL_BEGIN
  A dispatch queue pool holds multiple serial queues.
  Use this class to control queue's thread count (instead of concurrent queue).
  
+ @discussion The queues are handed out in round-robin and are not balanced by load,
+ so a block may wait behind a long running block on its queue while other queues
+ are idle. The pool is not backed by YYDispatchExecutor (a dispatch queue cannot
+ be), use YYDispatchExecutor or YYDispatchAsync() for the work which needs load
+ balancing. In YYKit, only YYAsyncLayer's display and YYWebImageOperation's image
+ decoding use the executor; YYImageCache, YYMemoryCache and YYLabel still use the
+ queues from this pool.
+ 
  分派队列池包含多个串行队列。
  使用此类控制队列的线程数（而不是并发队列）。
  */
@@ -40,16 +48,94 @@ NS_ASSUME_NONNULL_BEGIN
 /// Pool's name.
 @property (nullable, nonatomic, readonly) NSString *name;
 
-/// Get a serial queue from pool.
+/// Get a serial queue from pool (round-robin).
 - (dispatch_queue_t)queue;
 
 + (instancetype)defaultPoolForQOS:(NSQualityOfService)qos;
 
 @end
 
-/// Get a serial queue from global queue pool with a specified qos.
+/// Get a serial queue from global queue pool with a specified qos (round-robin,
+/// not load balanced, see YYDispatchAsync() for the work-stealing executor).
 extern dispatch_queue_t YYDispatchQueueGetForQOS(NSQualityOfService qos);
 
+
+
+/// Statistics of a YYDispatchExecutor.
+typedef struct {
+    NSUInteger threadCount;        ///< Living thread count.
+    NSUInteger pendingCount;       ///< Blocks waiting to run (queue depth).
+    NSUInteger maxPendingCount;    ///< Max queue depth since the executor was created.
+    uint64_t executedCount;        ///< Blocks started.
+    NSTimeInterval averageLatency; ///< Average time from submitting to running a block.
+    NSTimeInterval maxLatency;     ///< Max time from submitting to running a block.
+} YYDispatchExecutorStatistics;
+
+/**
+ A work-stealing executor runs blocks concurrently with a bounded number of threads.
+ 
+ @discussion Unlike picking a serial queue from YYDispatchQueuePool in round-robin,
+ a block never waits behind a long running block while another thread is idle:
+ each thread has its own block list, and an idle thread steals blocks from others.
+ The threads are created when needed, and exit after being idle for a while.
+ 
+ Blocks submitted to an executor run concurrently in no guaranteed order, use
+ YYDispatchStrand to run blocks serially.
+ */
+@interface YYDispatchExecutor : NSObject
+- (instancetype)init UNAVAILABLE_ATTRIBUTE;
++ (instancetype)new UNAVAILABLE_ATTRIBUTE;
+
+/**
+ Creates and returns an executor.
+ @param name        The name of the executor (used as the thread name).
+ @param threadCount Maxmium thread count, should in range (1, 32).
+ @param qos         Thread quality of service (QOS).
+ @return A new executor, or nil if an error occurs.
+ */
+- (nullable instancetype)initWithName:(nullable NSString *)name threadCount:(NSUInteger)threadCount qos:(NSQualityOfService)qos;
+
+/// Executor's name.
+@property (nullable, nonatomic, readonly) NSString *name;
+
+/// Maxmium thread count.
+@property (nonatomic, readonly) NSUInteger threadCount;
+
+/// Submit a block to run asynchronously. The submitted blocks still run after
+/// the executor is released.
+- (void)async:(dispatch_block_t)block;
+
+/// Current statistics, the values may be changing while reading.
+- (YYDispatchExecutorStatistics)statistics;
+
+/// The shared executor for a qos, the thread count is the active processor count.
++ (instancetype)defaultExecutorForQOS:(NSQualityOfService)qos;
+
+@end
+
+
+/**
+ A strand runs blocks serially (in FIFO order) on an executor, like a serial
+ queue targeting the executor.
+ */
+@interface YYDispatchStrand : NSObject
+- (instancetype)init UNAVAILABLE_ATTRIBUTE;
++ (instancetype)new UNAVAILABLE_ATTRIBUTE;
+
+/// Creates a strand with an executor.
+- (nullable instancetype)initWithExecutor:(YYDispatchExecutor *)executor;
+
+/// The executor which runs the blocks.
+@property (nonatomic, readonly) YYDispatchExecutor *executor;
+
+/// Submit a block to run asynchronously after the blocks submitted before.
+- (void)async:(dispatch_block_t)block;
+
+@end
+
+/// Submit a block to the shared executor with a specified qos.
+extern void YYDispatchAsync(NSQualityOfService qos, dispatch_block_t block);
+
 NS_ASSUME_NONNULL_END
 
 #endif
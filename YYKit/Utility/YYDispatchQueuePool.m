@@ -12,6 +12,9 @@
 #import "YYDispatchQueuePool.h"
 #import <UIKit/UIKit.h>
 #import <libkern/OSAtomic.h>
+#import <mach/mach_time.h>
+#import <pthread.h>
+#import <sys/time.h>
 
 #define MAX_QUEUE_COUNT 32
 
@@ -37,6 +40,10 @@ static inline qos_class_t NSQualityOfServiceToQOSClass(NSQualityOfService qos) {
     }
 }
 
+static inline bool YYDispatchQOSAvailable(void) {
+    return [UIDevice currentDevice].systemVersion.floatValue >= 8.0;
+}
+
 typedef struct {
     const char *name;
     void **queues;
@@ -236,3 +243,418 @@ static YYDispatchContext *YYDispatchContextGetForQOS(NSQualityOfService qos) {
 dispatch_queue_t YYDispatchQueueGetForQOS(NSQualityOfService qos) {
     return YYDispatchContextGetQueue(YYDispatchContextGetForQOS(qos));
 }
+
+
+////////////////////////////////////////////////////////////////////////////////
+#pragma mark - Executor
+
+#define MAX_THREAD_COUNT 32
+#define EXECUTOR_IDLE_TIMEOUT 10 ///< seconds, an idle thread exits after this time
+
+typedef struct _YYDispatchTask {
+    struct _YYDispatchTask *next;
+    dispatch_function_t work;
+    void *context;
+    uint64_t submitTime; ///< mach_absolute_time
+} YYDispatchTask;
+
+/// Task list of a thread, other threads may steal tasks from it.
+typedef struct {
+    pthread_mutex_t lock;
+    YYDispatchTask *head;
+    YYDispatchTask *tail;
+} YYDispatchDeque;
+
+typedef struct {
+    char *name;
+    qos_class_t qos;
+    bool useQos;
+    long priority;           ///< dispatch queue priority for the fallback
+    uint32_t threadLimit;
+    YYDispatchDeque *deques; ///< one deque per thread slot
+    volatile int32_t refCount; ///< the executor object and each thread hold a reference
+    
+    pthread_mutex_t lock;    ///< protects the thread states below
+    pthread_cond_t cond;     ///< idle threads wait on it
+    uint32_t threadCount;
+    uint32_t idleCount;
+    bool slotUsed[MAX_THREAD_COUNT];
+    bool stopped;
+    
+    volatile int32_t counter;         ///< round-robin counter for tasks submitted from other threads
+    volatile int32_t pendingCount;    ///< tasks submitted but not started
+    volatile int32_t maxPendingCount;
+    volatile int64_t executedCount;
+    volatile int64_t totalWaitTime;   ///< in mach time units
+    volatile int64_t maxWaitTime;     ///< in mach time units
+} YYDispatchExecutorContext;
+
+typedef struct {
+    YYDispatchExecutorContext *context;
+    uint32_t slot;
+} YYDispatchWorker;
+
+static pthread_key_t YYDispatchWorkerKey;
+
+static void YYDispatchWorkerKeyCreate(void) {
+    pthread_key_create(&YYDispatchWorkerKey, NULL);
+}
+
+static void YYDispatchDequePush(YYDispatchDeque *deque, YYDispatchTask *task) {
+    pthread_mutex_lock(&deque->lock);
+    if (deque->tail) deque->tail->next = task;
+    else deque->head = task;
+    deque->tail = task;
+    pthread_mutex_unlock(&deque->lock);
+}
+
+static YYDispatchTask *YYDispatchDequePop(YYDispatchDeque *deque) {
+    if (!deque->head) return NULL; // fast path, checked again with lock
+    pthread_mutex_lock(&deque->lock);
+    YYDispatchTask *task = deque->head;
+    if (task) {
+        deque->head = task->next;
+        if (!deque->head) deque->tail = NULL;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return task;
+}
+
+static void YYDispatchExecutorContextRelease(YYDispatchExecutorContext *context) {
+    if (OSAtomicDecrement32Barrier(&context->refCount) > 0) return;
+    for (uint32_t i = 0; i < context->threadLimit; i++) {
+        pthread_mutex_destroy(&context->deques[i].lock);
+    }
+    free(context->deques);
+    pthread_mutex_destroy(&context->lock);
+    pthread_cond_destroy(&context->cond);
+    if (context->name) free(context->name);
+    free(context);
+}
+
+static YYDispatchExecutorContext *YYDispatchExecutorContextCreate(const char *name, uint32_t threadLimit, NSQualityOfService qos) {
+    static pthread_once_t onceToken = PTHREAD_ONCE_INIT;
+    pthread_once(&onceToken, YYDispatchWorkerKeyCreate);
+    
+    YYDispatchExecutorContext *context = calloc(1, sizeof(YYDispatchExecutorContext));
+    if (!context) return NULL;
+    context->deques = calloc(threadLimit, sizeof(YYDispatchDeque));
+    if (!context->deques) {
+        free(context);
+        return NULL;
+    }
+    for (uint32_t i = 0; i < threadLimit; i++) {
+        pthread_mutex_init(&context->deques[i].lock, NULL);
+    }
+    pthread_mutex_init(&context->lock, NULL);
+    pthread_cond_init(&context->cond, NULL);
+    context->threadLimit = threadLimit;
+    context->qos = NSQualityOfServiceToQOSClass(qos);
+    context->useQos = YYDispatchQOSAvailable();
+    context->priority = NSQualityOfServiceToDispatchPriority(qos);
+    context->refCount = 1;
+    if (name) context->name = strdup(name);
+    return context;
+}
+
+/// Take the next task, from the thread's own deque first, then steal from others.
+static YYDispatchTask *YYDispatchExecutorContextTakeTask(YYDispatchExecutorContext *context, uint32_t slot) {
+    for (uint32_t i = 0; i < context->threadLimit; i++) {
+        YYDispatchTask *task = YYDispatchDequePop(context->deques + (slot + i) % context->threadLimit);
+        if (task) {
+            OSAtomicDecrement32Barrier(&context->pendingCount);
+            return task;
+        }
+    }
+    return NULL;
+}
+
+static void YYDispatchExecutorContextRunTask(YYDispatchExecutorContext *context, YYDispatchTask *task) {
+    int64_t wait = (int64_t)(mach_absolute_time() - task->submitTime);
+    OSAtomicIncrement64(&context->executedCount);
+    OSAtomicAdd64(wait, &context->totalWaitTime);
+    int64_t maxWait = context->maxWaitTime;
+    while (wait > maxWait && !OSAtomicCompareAndSwap64(maxWait, wait, &context->maxWaitTime)) {
+        maxWait = context->maxWaitTime;
+    }
+    task->work(task->context);
+    free(task);
+}
+
+static void *YYDispatchWorkerMain(void *arg) {
+    YYDispatchWorker *worker = arg;
+    YYDispatchExecutorContext *context = worker->context;
+    pthread_setspecific(YYDispatchWorkerKey, worker);
+    if (context->name) pthread_setname_np(context->name);
+    
+    while (true) {
+        YYDispatchTask *task = YYDispatchExecutorContextTakeTask(context, worker->slot);
+        if (task) {
+            YYDispatchExecutorContextRunTask(context, task);
+            continue;
+        }
+        
+        bool exit = false;
+        pthread_mutex_lock(&context->lock);
+        while (context->pendingCount == 0) {
+            if (context->stopped) {
+                exit = true;
+                break;
+            }
+            struct timeval now;
+            gettimeofday(&now, NULL);
+            struct timespec timeout = {now.tv_sec + EXECUTOR_IDLE_TIMEOUT, now.tv_usec * 1000};
+            context->idleCount++;
+            int result = pthread_cond_timedwait(&context->cond, &context->lock, &timeout);
+            context->idleCount--;
+            if (result == ETIMEDOUT && context->pendingCount == 0) {
+                exit = true;
+                break;
+            }
+        }
+        if (exit) {
+            context->threadCount--;
+            context->slotUsed[worker->slot] = false;
+        }
+        pthread_mutex_unlock(&context->lock);
+        if (exit) break;
+    }
+    
+    pthread_setspecific(YYDispatchWorkerKey, NULL);
+    free(worker);
+    YYDispatchExecutorContextRelease(context);
+    return NULL;
+}
+
+/// Run the tasks on a GCD thread, used when a thread could not be created.
+static void YYDispatchExecutorContextDrain(void *arg) {
+    YYDispatchExecutorContext *context = arg;
+    YYDispatchTask *task;
+    while ((task = YYDispatchExecutorContextTakeTask(context, 0))) {
+        YYDispatchExecutorContextRunTask(context, task);
+    }
+    YYDispatchExecutorContextRelease(context);
+}
+
+/// Create a thread, should be called with context->lock locked.
+static bool YYDispatchExecutorContextSpawnThread(YYDispatchExecutorContext *context, uint32_t preferredSlot) {
+    uint32_t slot = preferredSlot;
+    for (uint32_t i = 1; i < context->threadLimit && context->slotUsed[slot]; i++) {
+        slot = (preferredSlot + i) % context->threadLimit;
+    }
+    if (context->slotUsed[slot]) return false;
+    
+    YYDispatchWorker *worker = malloc(sizeof(YYDispatchWorker));
+    if (!worker) return false;
+    worker->context = context;
+    worker->slot = slot;
+    
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (context->useQos) pthread_attr_set_qos_class_np(&attr, context->qos, 0);
+    OSAtomicIncrement32Barrier(&context->refCount);
+    pthread_t thread;
+    int result = pthread_create(&thread, &attr, YYDispatchWorkerMain, worker);
+    pthread_attr_destroy(&attr);
+    if (result != 0) {
+        free(worker);
+        OSAtomicDecrement32Barrier(&context->refCount); // the executor still holds a reference
+        return false;
+    }
+    context->slotUsed[slot] = true;
+    context->threadCount++;
+    return true;
+}
+
+static void YYDispatchExecutorContextSubmit(YYDispatchExecutorContext *context, void *taskContext, dispatch_function_t work) {
+    YYDispatchTask *task = malloc(sizeof(YYDispatchTask));
+    if (!task) {
+        work(taskContext); // out of memory, run it synchronously rather than lose it
+        return;
+    }
+    task->next = NULL;
+    task->work = work;
+    task->context = taskContext;
+    task->submitTime = mach_absolute_time();
+    
+    // a worker pushes tasks to its own deque, others push in round-robin,
+    // and an idle thread steals tasks from any deque.
+    YYDispatchWorker *current = pthread_getspecific(YYDispatchWorkerKey);
+    uint32_t slot;
+    if (current && current->context == context) {
+        slot = current->slot;
+    } else {
+        slot = (uint32_t)OSAtomicIncrement32(&context->counter) % context->threadLimit;
+    }
+    YYDispatchDequePush(context->deques + slot, task);
+    int32_t pending = OSAtomicIncrement32Barrier(&context->pendingCount);
+    int32_t maxPending = context->maxPendingCount;
+    while (pending > maxPending && !OSAtomicCompareAndSwap32(maxPending, pending, &context->maxPendingCount)) {
+        maxPending = context->maxPendingCount;
+    }
+    
+    pthread_mutex_lock(&context->lock);
+    if (context->idleCount > 0) {
+        pthread_cond_signal(&context->cond);
+    } else if (context->threadCount < context->threadLimit) {
+        if (!YYDispatchExecutorContextSpawnThread(context, slot) && context->threadCount == 0) {
+            OSAtomicIncrement32Barrier(&context->refCount);
+            dispatch_async_f(dispatch_get_global_queue(context->priority, 0), context, YYDispatchExecutorContextDrain);
+        }
+    }
+    pthread_mutex_unlock(&context->lock);
+}
+
+/// Stop the threads after all the submitted tasks are finished, and release the context.
+static void YYDispatchExecutorContextStop(YYDispatchExecutorContext *context) {
+    pthread_mutex_lock(&context->lock);
+    context->stopped = true;
+    pthread_cond_broadcast(&context->cond);
+    pthread_mutex_unlock(&context->lock);
+    YYDispatchExecutorContextRelease(context);
+}
+
+
+static void YYDispatchBlockInvoke(void *context) {
+    @autoreleasepool {
+        dispatch_block_t block = (__bridge_transfer dispatch_block_t)context;
+        block();
+    }
+}
+
+
+@implementation YYDispatchExecutor {
+    YYDispatchExecutorContext *_context;
+}
+
+- (void)dealloc {
+    if (_context) {
+        YYDispatchExecutorContextStop(_context);
+        _context = NULL;
+    }
+}
+
+- (instancetype)initWithName:(NSString *)name threadCount:(NSUInteger)threadCount qos:(NSQualityOfService)qos {
+    if (threadCount == 0 || threadCount > MAX_THREAD_COUNT) return nil;
+    self = [super init];
+    _context = YYDispatchExecutorContextCreate(name.UTF8String, (uint32_t)threadCount, qos);
+    if (!_context) return nil;
+    _name = name;
+    _threadCount = threadCount;
+    return self;
+}
+
+- (void)async:(dispatch_block_t)block {
+    if (!block) return;
+    YYDispatchExecutorContextSubmit(_context, (__bridge_retained void *)[block copy], YYDispatchBlockInvoke);
+}
+
+- (YYDispatchExecutorStatistics)statistics {
+    static double timeUnit; // seconds per mach time unit
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        mach_timebase_info_data_t timebase;
+        mach_timebase_info(&timebase);
+        timeUnit = (double)timebase.numer / timebase.denom / NSEC_PER_SEC;
+    });
+    
+    YYDispatchExecutorStatistics statistics = {0};
+    pthread_mutex_lock(&_context->lock);
+    statistics.threadCount = _context->threadCount;
+    pthread_mutex_unlock(&_context->lock);
+    int32_t pendingCount = _context->pendingCount;
+    statistics.pendingCount = pendingCount > 0 ? pendingCount : 0;
+    statistics.maxPendingCount = _context->maxPendingCount;
+    statistics.executedCount = _context->executedCount;
+    if (statistics.executedCount > 0) {
+        statistics.averageLatency = _context->totalWaitTime * timeUnit / statistics.executedCount;
+    }
+    statistics.maxLatency = _context->maxWaitTime * timeUnit;
+    return statistics;
+}
+
++ (instancetype)defaultExecutorForQOS:(NSQualityOfService)qos {
+    static YYDispatchExecutor *executors[5];
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        // threads are created when needed, so the unused executors cost nothing
+        int count = (int)[NSProcessInfo processInfo].activeProcessorCount;
+        count = count < 1 ? 1 : count > MAX_THREAD_COUNT ? MAX_THREAD_COUNT : count;
+        executors[0] = [[self alloc] initWithName:@"com.ibireme.yykit.executor.user-interactive" threadCount:count qos:NSQualityOfServiceUserInteractive];
+        executors[1] = [[self alloc] initWithName:@"com.ibireme.yykit.executor.user-initiated" threadCount:count qos:NSQualityOfServiceUserInitiated];
+        executors[2] = [[self alloc] initWithName:@"com.ibireme.yykit.executor.utility" threadCount:count qos:NSQualityOfServiceUtility];
+        executors[3] = [[self alloc] initWithName:@"com.ibireme.yykit.executor.background" threadCount:count qos:NSQualityOfServiceBackground];
+        executors[4] = [[self alloc] initWithName:@"com.ibireme.yykit.executor.default" threadCount:count qos:NSQualityOfServiceDefault];
+    });
+    switch (qos) {
+        case NSQualityOfServiceUserInteractive: return executors[0];
+        case NSQualityOfServiceUserInitiated: return executors[1];
+        case NSQualityOfServiceUtility: return executors[2];
+        case NSQualityOfServiceBackground: return executors[3];
+        case NSQualityOfServiceDefault:
+        default: return executors[4];
+    }
+}
+
+@end
+
+
+@implementation YYDispatchStrand {
+    pthread_mutex_t _lock;
+    NSMutableArray *_blocks; ///< Array<dispatch_block_t>, waiting blocks
+    BOOL _scheduled;         ///< whether a block is submitted to the executor
+}
+
+- (void)dealloc {
+    pthread_mutex_destroy(&_lock);
+}
+
+- (instancetype)initWithExecutor:(YYDispatchExecutor *)executor {
+    if (!executor) return nil;
+    self = [super init];
+    _executor = executor;
+    _blocks = [NSMutableArray new];
+    pthread_mutex_init(&_lock, NULL);
+    return self;
+}
+
+- (void)async:(dispatch_block_t)block {
+    if (!block) return;
+    BOOL schedule = NO;
+    pthread_mutex_lock(&_lock);
+    [_blocks addObject:[block copy]];
+    if (!_scheduled) {
+        _scheduled = YES;
+        schedule = YES;
+    }
+    pthread_mutex_unlock(&_lock);
+    if (schedule) [self _schedule];
+}
+
+// Submit one block at a time, so a busy strand doesn't occupy a thread.
+- (void)_schedule {
+    [_executor async:^{
+        [self _runNext];
+    }];
+}
+
+- (void)_runNext {
+    pthread_mutex_lock(&_lock);
+    dispatch_block_t block = _blocks.firstObject;
+    if (block) [_blocks removeObjectAtIndex:0];
+    pthread_mutex_unlock(&_lock);
+    if (block) block();
+    
+    pthread_mutex_lock(&_lock);
+    BOOL more = _blocks.count > 0;
+    if (!more) _scheduled = NO;
+    pthread_mutex_unlock(&_lock);
+    if (more) [self _schedule];
+}
+
+@end
+
+void YYDispatchAsync(NSQualityOfService qos, dispatch_block_t block) {
+    [[YYDispatchExecutor defaultExecutorForQOS:qos] async:block];
+}
@@ -25,12 +25,23 @@ typedef NS_OPTIONS (NSUInteger, YYFileHashType) {
     YYFileHashTypeSHA512  = 1 << 7, ///< SHA512 hash
     YYFileHashTypeCRC32   = 1 << 8, ///< crc32 checksum
     YYFileHashTypeAdler32 = 1 << 9, ///< adler32 checksum
+    YYFileHashTypeSHA256Tree = 1 << 10, ///< SHA256 tree hash (RFC 6962 Merkle tree hash with 1MB leaves)
 };
 
 /**
  Utility for computing hashes of file with high performance and low memory usage. 实用的文件哈希计算工具，具有高性能和低内存使用率。
  See `YYFileHashType` for all supported hash (checksum) type.
  
+ The file is memory mapped (MAP_PRIVATE) and hashed window by window, the next
+ window is read ahead while the current one is being hashed. Each hash type is
+ calculated on its own thread. For a large file, use `YYFileHashTypeSHA256Tree`
+ instead of SHA256: its 1MB leaves are hashed concurrently.
+ 
+ The file should not be modified while it's being hashed. The file size is checked
+ before each window, and the rest of the file is hashed with read() if the size is
+ changed, but a file truncated in the middle of a window may still crash the process
+ with SIGBUS (a limitation of memory mapped files).
+ 
  Sample Code:
  
      YYFileHash *hash = [YYFileHash hashForFile:@"/tmp/Xcode6.dmg" types:YYFileHashTypeMD5 | YYFileHashTypeSHA1];
@@ -88,6 +99,7 @@ typedef NS_OPTIONS (NSUInteger, YYFileHashType) {
 @property (nullable, nonatomic, strong, readonly) NSString *sha512String; ///< sha512 hash string in lowercase
 @property (nullable, nonatomic, strong, readonly) NSString *crc32String; ///< crc32 checksum string in lowercase
 @property (nullable, nonatomic, strong, readonly) NSString *adler32String; ///< adler32 checksum string in lowercase
+@property (nullable, nonatomic, strong, readonly) NSString *sha256TreeString; ///< sha256 tree hash string in lowercase
 
 @property (nullable, nonatomic, strong, readonly) NSData *md2Data; ///< md2 hash
 @property (nullable, nonatomic, strong, readonly) NSData *md4Data; ///< md4 hash
@@ -97,6 +109,7 @@ typedef NS_OPTIONS (NSUInteger, YYFileHashType) {
 @property (nullable, nonatomic, strong, readonly) NSData *sha256Data; ///< sha256 hash
 @property (nullable, nonatomic, strong, readonly) NSData *sha384Data; ///< sha384 hash
 @property (nullable, nonatomic, strong, readonly) NSData *sha512Data; ///< sha512 hash
+@property (nullable, nonatomic, strong, readonly) NSData *sha256TreeData; ///< sha256 tree hash
 @property (nonatomic, readonly) uint32_t crc32; ///< crc32 checksum
 @property (nonatomic, readonly) uint32_t adler32; ///< adler32 checksum
 
@@ -12,17 +12,52 @@
 #import "YYFileHash.h"
 #include <CommonCrypto/CommonCrypto.h>
 #include <zlib.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #if TARGET_OS_IPHONE || TARGET_IPHONE_SIMULATOR
 #define BUF_SIZE (1024 * 512) //512 KB per read
 #define BLOCK_LOOP_FACTOR 16 // 8MB (0.5MB*16) per block callback
 #define BUF_SIZE_NO_PROGRESS (1024 * 1024) // 1MB
+#define MAP_WINDOW_SIZE (1024 * 1024 * 8) // 8MB per hash round (mapped file)
 #else
 #define BUF_SIZE (1024 * 1024 * 16) //16MB per read
-#define BLOCK_LOOP_FACTOR 16 // 64MB (16MB*16) per block callback
+#define BLOCK_LOOP_FACTOR 16 // 256MB (16MB*16) per block callback
 #define BUF_SIZE_NO_PROGRESS (1024 * 1024 * 16) // 16MB
+#define MAP_WINDOW_SIZE (1024 * 1024 * 32) // 32MB per hash round (mapped file)
 #endif
 
+#define TREE_LEAF_SIZE (1024 * 1024) // 1MB per leaf of SHA256 tree hash
+
+/// Context of SHA256 tree hash.
+typedef struct {
+    CC_SHA256_CTX leaf;     ///< context of current leaf
+    size_t leaf_size;       ///< data length of current leaf
+    unsigned char *nodes;   ///< hashes of finished leaves
+    size_t count;           ///< count of finished leaves
+    size_t capacity;        ///< capacity of nodes (in hash count)
+    BOOL failed;            ///< memory allocation failed
+} sha256_tree_ctx;
+
+
+/// Feeds the data to all hash contexts, each hash is calculated on its own thread.
+static void YYFileHashUpdate(void **ctx, int(**ctx_update)(void *, const void *, CC_LONG), int count, const void *data, size_t size) {
+    int active[count];
+    int active_count = 0;
+    for (int i = 0; i < count; i++) {
+        if (ctx[i]) active[active_count++] = i;
+    }
+    if (active_count == 1) {
+        ctx_update[active[0]](ctx[active[0]], data, (CC_LONG)size);
+    } else if (active_count > 1) {
+        int *indexes = active;
+        dispatch_apply(active_count, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+            int index = indexes[i];
+            ctx_update[index](ctx[index], data, (CC_LONG)size);
+        });
+    }
+}
 
 
 @implementation YYFileHash
@@ -35,16 +70,18 @@
     YYFileHash *hash = nil;
     
     BOOL stop = NO, done = NO;
-    int64_t file_size = 0, readed = 0, loop = 0;
+    int64_t file_size = 0, readed = 0, next_callback = 0;
     const char *path = 0;
-    FILE *fd = 0;
+    int fd = -1;
     char *buf = NULL;
+    unsigned char *map = MAP_FAILED;
     
-    int hash_type_total = 10;
+    int hash_type_total = 11;
     void *ctx[hash_type_total];
     int(*ctx_init[hash_type_total])(void *);
     int(*ctx_update[hash_type_total])(void *, const void *, CC_LONG);
     int(*ctx_final[hash_type_total])(unsigned char *, void *);
+    void(*ctx_cleanup[hash_type_total])(void *);
     long digist_length[hash_type_total];
     unsigned char *digest[hash_type_total];
     
@@ -53,6 +90,7 @@
         ctx_init[i] = NULL;
         ctx_update[i] = NULL;
         ctx_final[i] = NULL;
+        ctx_cleanup[i] = NULL;
         digist_length[i] = 0;
         digest[i] = 0;
     }
@@ -104,6 +142,11 @@ digist_length[ctx_index] = Length;
     if (types & YYFileHashTypeAdler32) {
         init_hash(uLong, adler32_init, adler32_update, adler32_final, sizeof(uint32_t));
     }
+    ctx_index++;
+    if (types & YYFileHashTypeSHA256Tree) {
+        init_hash(sha256_tree_ctx, sha256_tree_init, sha256_tree_update, sha256_tree_final, CC_SHA256_DIGEST_LENGTH);
+        ctx_cleanup[ctx_index] = (void (*)(void *))sha256_tree_cleanup;
+    }
     
 #undef init_hash
     
@@ -117,58 +160,70 @@ digist_length[ctx_index] = Length;
     }
     if (hash_type_this == 0) goto cleanup;
     
-    buf = malloc(block ? BUF_SIZE : BUF_SIZE_NO_PROGRESS);
-    if (!buf) goto cleanup;
-    
     if (filePath.length == 0) goto cleanup;
     path = [filePath cStringUsingEncoding:NSUTF8StringEncoding];
-    fd = fopen(path, "rb");
-    if (!fd) goto cleanup;
+    fd = open(path, O_RDONLY);
+    if (fd < 0) goto cleanup;
     
-    if (fseeko(fd, 0, SEEK_END) != 0) goto cleanup;
-    file_size = ftell(fd);
-    if (fseeko(fd, 0, SEEK_SET) != 0) goto cleanup;
+    struct stat st;
+    if (fstat(fd, &st) != 0) goto cleanup;
+    file_size = st.st_size;
     if (file_size < 0) goto cleanup;
     
     // init hash context
     for (int i = 0; i < hash_type_total; i++) {
         if (ctx[i]) ctx_init[i](ctx[i]);
     }
-        
-    // read stream and calculate checksum in a single loop
-    // 'dispatch_io' has better performance, I will rewrite it later...
-    if (block) {
-        while (!done && !stop) {
-            size_t size = fread(buf, 1, BUF_SIZE, fd);
-            if (size < BUF_SIZE) {
-                if (feof(fd)) done = YES;    // finish
-                else { stop = YES; break; }  // error
-            }
-            for (int i = 0; i < hash_type_total; i++) {
-                if (ctx[i]) ctx_update[i](ctx[i], buf, (CC_LONG)size);
-            }
-            readed += size;
-            if (!done) {
-                loop++;
-                if ((loop % BLOCK_LOOP_FACTOR) == 0) {
-                    block(file_size, readed, &stop);
-                }
+    
+    // Map the file and hash it window by window. The next window is prefetched
+    // by kernel while the current window is being hashed, so the I/O is overlapped
+    // with the calculation. If the file cannot be mapped, read it with a buffer.
+    if (S_ISREG(st.st_mode) && file_size > 0 && (uint64_t)file_size <= SIZE_MAX) {
+        map = mmap(NULL, (size_t)file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) madvise(map, (size_t)file_size, MADV_SEQUENTIAL);
+    }
+    if (map == MAP_FAILED) {
+        buf = malloc(block ? BUF_SIZE : BUF_SIZE_NO_PROGRESS);
+        if (!buf) goto cleanup;
+    }
+    
+    next_callback = (int64_t)BUF_SIZE * BLOCK_LOOP_FACTOR;
+    while (!done && !stop) {
+        if (map != MAP_FAILED) {
+            // Accessing the mapped pages beyond the end of a truncated file raises SIGBUS,
+            // so check the file size before each window, and read the rest if it's changed.
+            struct stat cur_st;
+            if (fstat(fd, &cur_st) != 0 || cur_st.st_size != file_size) {
+                munmap(map, (size_t)file_size);
+                map = MAP_FAILED;
+                if (lseek(fd, (off_t)readed, SEEK_SET) != (off_t)readed) { stop = YES; break; }
+                buf = malloc(block ? BUF_SIZE : BUF_SIZE_NO_PROGRESS);
+                if (!buf) { stop = YES; break; }
+                continue;
             }
-        }
-    } else {
-        while (!done && !stop) {
-            size_t size = fread(buf, 1, BUF_SIZE_NO_PROGRESS, fd);
-            if (size < BUF_SIZE_NO_PROGRESS) {
-                if (feof(fd)) done = YES;    // finish
-                else { stop = YES; break; }  // error
+            size_t size = (size_t)MIN((int64_t)MAP_WINDOW_SIZE, file_size - readed);
+            int64_t next = readed + size;
+            if (next < file_size) {
+                madvise(map + next, (size_t)MIN((int64_t)MAP_WINDOW_SIZE, file_size - next), MADV_WILLNEED);
             }
-            for (int i = 0; i < hash_type_total; i++) {
-                if (ctx[i]) ctx_update[i](ctx[i], buf, (CC_LONG)size);
+            YYFileHashUpdate(ctx, ctx_update, hash_type_total, map + readed, size);
+            readed = next;
+            if (readed == file_size) done = YES; // finish
+        } else {
+            ssize_t size = read(fd, buf, block ? BUF_SIZE : BUF_SIZE_NO_PROGRESS);
+            if (size < 0) {
+                if (errno == EINTR) continue;
+                stop = YES; break; // error
             }
+            if (size == 0) { done = YES; break; } // finish
+            YYFileHashUpdate(ctx, ctx_update, hash_type_total, buf, size);
             readed += size;
         }
+        if (block && !done && readed >= next_callback) {
+            next_callback = readed + (int64_t)BUF_SIZE * BLOCK_LOOP_FACTOR;
+            block(file_size, readed, &stop);
+        }
     }
-
     
     // collect result
     if (done && !stop) {
@@ -176,7 +231,10 @@ digist_length[ctx_index] = Length;
         hash->_types = types;
         for (int i = 0; i < hash_type_total; i++) {
             if (ctx[i]) {
-                ctx_final[i](digest[i], ctx[i]);
+                if (ctx_final[i](digest[i], ctx[i]) < 0) {
+                    hash = nil;
+                    goto cleanup;
+                }
                 NSUInteger type = 1 << i;
                 NSData *data = [NSData dataWithBytes:digest[i] length:digist_length[i]];
                 NSMutableString *str = [NSMutableString string];
@@ -227,6 +285,10 @@ digist_length[ctx_index] = Length;
                         hash->_adler32 = hash32;
                         hash->_adler32String = [NSString stringWithFormat:@"%08x", hash32];
                     } break;
+                    case YYFileHashTypeSHA256Tree: {
+                        hash->_sha256TreeData = data;
+                        hash->_sha256TreeString = str;
+                    } break;
                     default:
                         break;
                 }
@@ -236,8 +298,10 @@ digist_length[ctx_index] = Length;
     
 cleanup: // do cleanup when canceled of finished
     if (buf) free(buf);
-    if (fd) fclose(fd);
+    if (map != MAP_FAILED) munmap(map, (size_t)file_size);
+    if (fd >= 0) close(fd);
     for (int i = 0; i < hash_type_total; i++) {
+        if (ctx[i] && ctx_cleanup[i]) ctx_cleanup[i](ctx[i]);
         if (ctx[i]) free(ctx[i]);
         if (digest[i]) free(digest[i]);
     }
@@ -279,4 +343,125 @@ static int adler32_final(unsigned char *buf, uLong *c) {
     return 0;
 }
 
+#pragma mark - sha256 tree callback
+
+/*
+ Merkle tree hash defined in RFC 6962 (Certificate Transparency) with SHA256,
+ the data is split into 1MB leaves:
+     leaf hash = SHA256(0x00 || leaf data)
+     node hash = SHA256(0x01 || left || right)
+ The leaves are hashed concurrently, so it's much faster than SHA256 for big file.
+ */
+
+static void sha256_tree_leaf_begin(CC_SHA256_CTX *c) {
+    unsigned char prefix = 0x00;
+    CC_SHA256_Init(c);
+    CC_SHA256_Update(c, &prefix, 1);
+}
+
+static BOOL sha256_tree_reserve(sha256_tree_ctx *c, size_t count) {
+    if (c->count + count <= c->capacity) return YES;
+    size_t capacity = MAX(c->capacity * 2, c->count + count);
+    capacity = MAX(capacity, 64);
+    unsigned char *nodes = realloc(c->nodes, capacity * CC_SHA256_DIGEST_LENGTH);
+    if (!nodes) {
+        c->failed = YES;
+        return NO;
+    }
+    c->nodes = nodes;
+    c->capacity = capacity;
+    return YES;
+}
+
+static void sha256_tree_leaf_end(sha256_tree_ctx *c) {
+    if (sha256_tree_reserve(c, 1)) {
+        CC_SHA256_Final(c->nodes + c->count * CC_SHA256_DIGEST_LENGTH, &c->leaf);
+        c->count++;
+    }
+    sha256_tree_leaf_begin(&c->leaf);
+    c->leaf_size = 0;
+}
+
+static int sha256_tree_init(sha256_tree_ctx *c) {
+    memset(c, 0, sizeof(sha256_tree_ctx));
+    sha256_tree_leaf_begin(&c->leaf);
+    return 0;
+}
+
+static int sha256_tree_update(sha256_tree_ctx *c, const void *data, CC_LONG len) {
+    if (c->failed) return -1;
+    const unsigned char *bytes = data;
+    
+    // fill the current leaf
+    if (c->leaf_size > 0) {
+        size_t fill = MIN((size_t)len, TREE_LEAF_SIZE - c->leaf_size);
+        CC_SHA256_Update(&c->leaf, bytes, (CC_LONG)fill);
+        c->leaf_size += fill;
+        bytes += fill;
+        len -= fill;
+        if (c->leaf_size == TREE_LEAF_SIZE) sha256_tree_leaf_end(c);
+    }
+    
+    // hash the whole leaves concurrently
+    size_t leaves = len / TREE_LEAF_SIZE;
+    if (leaves > 0 && sha256_tree_reserve(c, leaves)) {
+        unsigned char *nodes = c->nodes + c->count * CC_SHA256_DIGEST_LENGTH;
+        dispatch_apply(leaves, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+            CC_SHA256_CTX leaf;
+            sha256_tree_leaf_begin(&leaf);
+            CC_SHA256_Update(&leaf, bytes + i * TREE_LEAF_SIZE, TREE_LEAF_SIZE);
+            CC_SHA256_Final(nodes + i * CC_SHA256_DIGEST_LENGTH, &leaf);
+        });
+        c->count += leaves;
+        bytes += leaves * TREE_LEAF_SIZE;
+        len -= leaves * TREE_LEAF_SIZE;
+    }
+    
+    // keep the tail in the current leaf
+    if (len > 0) {
+        CC_SHA256_Update(&c->leaf, bytes, len);
+        c->leaf_size += len;
+    }
+    return c->failed ? -1 : 0;
+}
+
+static int sha256_tree_final(unsigned char *buf, sha256_tree_ctx *c) {
+    if (c->leaf_size > 0) sha256_tree_leaf_end(c);
+    if (c->failed) return -1;
+    if (c->count == 0) { // empty data
+        CC_SHA256(NULL, 0, buf);
+        return 0;
+    }
+    
+    // Merge the nodes level by level. The left subtree of RFC 6962 is always
+    // a perfect binary tree, so the last odd node is promoted to the next level.
+    size_t count = c->count;
+    unsigned char prefix = 0x01;
+    unsigned char md[CC_SHA256_DIGEST_LENGTH];
+    while (count > 1) {
+        size_t merged = 0;
+        for (size_t i = 0; i + 1 < count; i += 2) {
+            CC_SHA256_CTX node;
+            CC_SHA256_Init(&node);
+            CC_SHA256_Update(&node, &prefix, 1);
+            CC_SHA256_Update(&node, c->nodes + i * CC_SHA256_DIGEST_LENGTH, CC_SHA256_DIGEST_LENGTH * 2);
+            CC_SHA256_Final(md, &node);
+            memcpy(c->nodes + merged * CC_SHA256_DIGEST_LENGTH, md, CC_SHA256_DIGEST_LENGTH);
+            merged++;
+        }
+        if (count & 1) {
+            memmove(c->nodes + merged * CC_SHA256_DIGEST_LENGTH, c->nodes + (count - 1) * CC_SHA256_DIGEST_LENGTH, CC_SHA256_DIGEST_LENGTH);
+            merged++;
+        }
+        count = merged;
+    }
+    memcpy(buf, c->nodes, CC_SHA256_DIGEST_LENGTH);
+    return 0;
+}
+
+static void sha256_tree_cleanup(sha256_tree_ctx *c) {
+    if (c->nodes) free(c->nodes);
+    c->nodes = NULL;
+}
+
 @end